@@ -22,12 +22,110 @@ Options:
   --r2=... 			R2 rating where # is the ohm rating of R2 (eg: 10K = 10000)
   --num-temps=... 	the number of temperature points to calculate (default: 20)
   --max-adc=... 	the max ADC reading to use.  if you use R1, it limits the top value for the thermistor circuit, and thus the possible range of ADC values
+
+Uniform tables for shared/TemperatureTable.cc:
+  --uniform			emit a table with one entry every 2^step-bits ADC counts, so the
+				firmware can index it directly instead of searching it
+  --name=...			C name of the table (table_<name>) and prefix of its macros
+  --table=...			resample one of the breakpoint tables below instead of using
+				the thermistor model: %s
+  --step-bits=...		log2 of the ADC counts between entries (default: 4)
+  --frac-bits=...		fraction bits of the fixed point temperatures (default: 4)
+  --oversample=...		ADC readings are this many times the 10 bit ADC value (default: 1)
+  --error-below=...		only report the interpolation error below this temperature
 """
 
+from __future__ import print_function
 from math import *
 import sys
 import getopt
 
+# Breakpoint tables, (adc, temperature), that the firmware used to search.
+# Kept here as the source for the uniformly spaced tables.
+BREAKPOINTS = {
+	# MightyBoard rev E heated build platform
+	"hbp-e" : [
+		(1, 841), (54, 255), (107, 209), (160, 184), (213, 166), (266, 153),
+		(319, 142), (372, 132), (425, 124), (478, 116), (531, 108), (584, 101),
+		(637, 93), (690, 86), (743, 78), (796, 70), (849, 61), (902, 50),
+		(955, 34), (1008, 3), (1023, 0) ],
+	# MightyBoard rev G heated build platform
+	"hbp-g" : [
+		(1, 916), (54, 265), (107, 216), (160, 189), (213, 171), (266, 157),
+		(319, 135), (372, 127), (425, 119), (478, 112), (531, 104), (584, 98),
+		(637, 91), (690, 84), (743, 77), (796, 68), (849, 58), (902, 48),
+		(955, 34), (1008, 2), (1023, 0) ],
+	# Epcos 100K, adc readings are for one 10 bit sample
+	"epcos-100k" : [
+		(23, 300), (25, 295), (27, 290), (28, 285), (31, 280), (33, 275),
+		(35, 270), (38, 265), (41, 260), (44, 255), (48, 250), (52, 245),
+		(56, 240), (61, 235), (66, 230), (71, 225), (78, 220), (84, 215),
+		(92, 210), (100, 205), (109, 200), (120, 195), (131, 190), (143, 185),
+		(156, 180), (171, 175), (187, 170), (205, 165), (224, 160), (245, 155),
+		(268, 150), (293, 145), (320, 140), (348, 135), (379, 130), (411, 125),
+		(445, 120), (480, 115), (516, 110), (553, 105), (591, 100), (628, 95),
+		(665, 90), (702, 85), (737, 80), (770, 75), (801, 70), (830, 65),
+		(857, 60), (881, 55), (903, 50), (922, 45), (939, 40), (954, 35),
+		(966, 30), (977, 25), (985, 20), (993, 15), (999, 10), (1004, 5),
+		(1008, 0) ],
+	# K type thermocouple, ADS1118 counts (32767 counts / 256 mV) to Celsius
+	"thermocouple-k" : [
+		(-304, -64), (-232, -48), (-157, -32), (-79, -16), (0, 0), (82, 16),
+		(164, 32), (248, 48), (333, 64), (418, 80), (503, 96), (588, 112),
+		(672, 128), (755, 144), (837, 160), (919, 176), (1001, 192), (1083, 208),
+		(1165, 224), (1248, 240), (1331, 256), (1415, 272), (1499, 288), (1584, 304),
+		(1754, 336) ],
+}
+
+def interpolate(points, adc):
+	"Linear interpolation of a breakpoint table, extrapolating past its ends"
+	i = 1
+	while i < len(points) - 1 and adc > points[i][0]:
+		i = i + 1
+	a0, t0 = points[i - 1]
+	a1, t1 = points[i]
+	return t0 + float(adc - a0) * (t1 - t0) / (a1 - a0)
+
+def uniform(name, temp, first_adc, last_adc, step_bits, frac_bits, error_below, command):
+	"""Print a table of fixed point temperatures at first_adc + k << step_bits
+	and the macros TemperatureTable.cc needs to index it"""
+	step = 1 << step_bits
+	# one entry past the cell holding last_adc, so the firmware can always
+	# read the pair of entries around a reading
+	count = ((last_adc - first_adc) >> step_bits) + 2
+	def extended(adc):
+		# the last entry may lie past last_adc; continue the final slope
+		if adc <= last_adc:
+			return temp(adc)
+		return temp(last_adc) + (temp(last_adc) - temp(last_adc - 1)) * (adc - last_adc)
+	values = [int(floor(extended(first_adc + k * step) * (1 << frac_bits) + 0.5)) for k in range(count)]
+
+	# Error of the firmware's integer interpolation against the source
+	worst, worst_adc = 0.0, first_adc
+	for adc in range(first_adc, last_adc + 1):
+		k = (adc - first_adc) >> step_bits
+		frac = (adc - first_adc) & (step - 1)
+		v = values[k] + (((values[k + 1] - values[k]) * frac) >> step_bits) if frac else values[k]
+		if error_below is not None and temp(adc) >= error_below:
+			continue
+		err = abs(float(v) / (1 << frac_bits) - temp(adc))
+		if err > worst:
+			worst, worst_adc = err, adc
+
+	macro = name.upper()
+	print("// Made with ./createTemperatureLookup.py %s" % (command))
+	print("// %d entries, %d ADC counts apart; worst error %.2f C at ADC %d%s" % (count, step, worst, worst_adc,
+		"" if error_below is None else " (below %s C)" % (error_below)))
+	print("const static int16_t table_%s[] PROGMEM = {" % (name))
+	for i in range(0, count, 8):
+		row = ", ".join("%5d" % v for v in values[i:i + 8])
+		print("     %s%s" % (row, "," if i + 8 < count else ""))
+	print("};")
+	print("")
+	print("#define %s_FIRST_ADC %d" % (macro, first_adc))
+	print("#define %s_LAST_ADC %d" % (macro, last_adc))
+	print("#define %s_STEP_BITS %d" % (macro, step_bits))
+
 class Thermistor:
 	"Class to do the thermistor maths"
 	def __init__(self, r0, t0, beta, r1, r2):
@@ -66,9 +164,17 @@ def main(argv):
 	r2 = 1600;
 	num_temps = int(20);
 	max_adc = int(1023);
-	
+	uniform_table = False
+	name = "ext_thermistor"
+	table = None
+	step_bits = 4
+	frac_bits = 4
+	oversample = 1
+	error_below = None
+
 	try:
-		opts, args = getopt.getopt(argv, "h", ["help", "r0=", "t0=", "beta=", "r1=", "r2=", "max-adc="])
+		opts, args = getopt.getopt(argv, "h", ["help", "r0=", "t0=", "beta=", "r1=", "r2=", "max-adc=",
+			"uniform", "name=", "table=", "step-bits=", "frac-bits=", "oversample=", "error-below="])
 	except getopt.GetoptError:
 		usage()
 		sys.exit(2)
@@ -82,45 +188,73 @@ def main(argv):
 		elif opt == "--t0":
 			t0 = int(arg)
 		elif opt == "--beta":
-		 	beta = int(arg)
+			beta = int(arg)
 		elif opt == "--r1":
 			r1 = int(arg)
 		elif opt == "--r2":
 			r2 = int(arg)
 		elif opt == "--max-adc":
 			max_adc = int(arg)
-			
-	increment = int(max_adc/(num_temps-1));
-	
+		elif opt == "--uniform":
+			uniform_table = True
+		elif opt == "--name":
+			name = arg
+		elif opt == "--table":
+			if arg not in BREAKPOINTS:
+				usage()
+				sys.exit(2)
+			table = arg
+		elif opt == "--step-bits":
+			step_bits = int(arg)
+		elif opt == "--frac-bits":
+			frac_bits = int(arg)
+		elif opt == "--oversample":
+			oversample = int(arg)
+		elif opt == "--error-below":
+			error_below = int(arg)
+
 	t = Thermistor(r0, t0, beta, r1, r2)
 
+	if uniform_table:
+		command = " ".join(argv)
+		if table:
+			points = [(adc * oversample, temp) for adc, temp in BREAKPOINTS[table]]
+			uniform(name, lambda adc: interpolate(points, adc),
+				points[0][0], points[-1][0], step_bits, frac_bits, error_below, command)
+		else:
+			uniform(name, lambda adc: t.temp(float(adc) / oversample),
+				oversample, max_adc * oversample, step_bits, frac_bits, error_below, command)
+		return
+
+	increment = int(max_adc/(num_temps-1));
+
 	adcs = range(1, max_adc, increment);
 #	adcs = [1, 20, 25, 30, 35, 40, 45, 50, 60, 70, 80, 90, 100, 110, 130, 150, 190, 220,  250, 300]
 	first = 1
 
-	print "// Thermistor lookup table for RepRap Temperature Sensor Boards (http://make.rrrf.org/ts)"
-	print "// Made with createTemperatureLookup.py (http://svn.reprap.org/trunk/reprap/firmware/Arduino/utilities/createTemperatureLookup.py)"
-	print "// ./createTemperatureLookup.py --r0=%s --t0=%s --r1=%s --r2=%s --beta=%s --max-adc=%s" % (r0, t0, r1, r2, beta, max_adc)
-	print "// r0: %s" % (r0)
-	print "// t0: %s" % (t0)
-	print "// r1: %s" % (r1)
-	print "// r2: %s" % (r2)
-	print "// beta: %s" % (beta)
-	print "// max adc: %s" % (max_adc)
-	print "#define NUMTEMPS %s" % (len(adcs))
-	print "short temptable[NUMTEMPS][2] = {"
+	print("// Thermistor lookup table for RepRap Temperature Sensor Boards (http://make.rrrf.org/ts)")
+	print("// Made with createTemperatureLookup.py (http://svn.reprap.org/trunk/reprap/firmware/Arduino/utilities/createTemperatureLookup.py)")
+	print("// ./createTemperatureLookup.py --r0=%s --t0=%s --r1=%s --r2=%s --beta=%s --max-adc=%s" % (r0, t0, r1, r2, beta, max_adc))
+	print("// r0: %s" % (r0))
+	print("// t0: %s" % (t0))
+	print("// r1: %s" % (r1))
+	print("// r2: %s" % (r2))
+	print("// beta: %s" % (beta))
+	print("// max adc: %s" % (max_adc))
+	print("#define NUMTEMPS %s" % (len(adcs)))
+	print("short temptable[NUMTEMPS][2] = {")
 
 	counter = 0
 	for adc in adcs:
 		counter = counter +1
 		if counter == len(adcs):
-			print "   {%s, %s}" % (adc, int(t.temp(adc)))
+			print("   {%s, %s}" % (adc, int(t.temp(adc))))
 		else:
-			print "   {%s, %s}," % (adc, int(t.temp(adc)))
-	print "};"
+			print("   {%s, %s}," % (adc, int(t.temp(adc))))
+	print("};")
 	
 def usage():
-    print __doc__
+    print(__doc__ % (", ".join(sorted(BREAKPOINTS.keys()))))
 
 if __name__ == "__main__":
 	main(sys.argv[1:])
\ No newline at end of file
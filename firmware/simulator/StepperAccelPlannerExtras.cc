@@ -54,8 +54,30 @@ volatile float zadvance, zadvance2;
 // A block cannot be planned more time than there are blocks in the pipe line
 static int planner_counts[BLOCK_BUFFER_SIZE+1];
 
-// Track total time required to print
-static float total_time = 0.0;
+// Track total time required to print and the number of blocks printed.
+// The time is kept in ticks of the 2 MHz step timer so that it doesn't
+// drift as a float sum of a long build's blocks would.
+static uint64_t total_ticks = 0;
+static uint32_t total_blocks = 0;
+
+// Per layer statistics.  As s3gindex does, a layer is begun by the first
+// extruding move at a new Z height, and the retracts, Z hops and travel
+// moves before an extruding move go with the layer that it's in.
+typedef struct {
+     float    z;              // Z height (mm)
+     uint32_t blocks;         // Number of blocks
+     uint32_t below_nominal;  // Accelerated blocks which never reached their nominal rate
+     float    time;           // Print time (s)
+     float    distance;       // XYZ distance moved (mm)
+     float    peak_speed;     // Fastest XYZ speed reached by any block (mm/s)
+} layer_stats_t;
+
+static bool layer_stats_enabled = false;
+static bool layer_stats_failed = false;
+static layer_stats_t *layers = NULL;
+static size_t nlayers = 0, maxlayers = 0;
+static size_t last_layer = 0;
+static layer_stats_t layer_pending;   // Blocks waiting on an extruding move
 
 // Storage for the plan_record() counters
 static int record_add    = 0;
@@ -236,10 +258,27 @@ void init_extras(bool accel)
 #endif
 }
 
+// Set the maximum accelerations, in mm/s^2, as steppers::reset() would
+// from the EEPROM
+
+void set_max_accelerations(const int16_t *vals)
+{
+     for (int j = 0; j < STEPPER_COUNT; j++)
+     {
+	  float steps_per_mm = stepperAxisStepsPerMM(j);
+	  max_acceleration_units_per_sq_second[j] = (uint32_t)vals[j];
+	  // Limit the max accelerations so that the calculation of block->acceleration & JKN Advance K2
+	  // can be performed without overflow issues
+	  if (max_acceleration_units_per_sq_second[j] > (uint32_t)((float)0xFFFFF / steps_per_mm))
+	       max_acceleration_units_per_sq_second[j] = (uint32_t)((float)0xFFFFF / steps_per_mm);
+	  axis_steps_per_sqr_second[j] = (uint32_t)((float)max_acceleration_units_per_sq_second[j] * steps_per_mm);
+	  axis_accel_step_cutoff[j] = (uint32_t)0xffffffff / axis_steps_per_sqr_second[j];
+     }
+}
+
 float stepperAxisStepsToMM_(int32_t steps, uint8_t axis)
 {
-     return ((float)steps * 1000000.0f /
-	     (float)replicator_axis_steps_per_mm::axis_steps_per_mm[axis]);
+     return ((float)steps / stepperAxisStepsPerMM(axis));
 }
 
 int64_t getFilamentLength(uint8_t extruder)
@@ -270,6 +309,164 @@ float filamentUsed(void)
      return (filamentUsed);
 }
 
+void plan_layer_stats(bool enable)
+{
+     layer_stats_enabled = enable;
+}
+
+static layer_stats_t *layer_stats_find(float z)
+{
+     // Most blocks are in the same layer as the previous block
+     if (nlayers && fabsf(layers[last_layer].z - z) < 0.001f)
+	  return(&layers[last_layer]);
+
+     // Z hops and the like revisit earlier layers
+     for (size_t i = nlayers; i-- > 0; )
+     {
+	  if (fabsf(layers[i].z - z) < 0.001f)
+	  {
+	       last_layer = i;
+	       return(&layers[i]);
+	  }
+     }
+
+     if (nlayers >= maxlayers)
+     {
+	  size_t n = maxlayers ? 2 * maxlayers : 1024;
+	  layer_stats_t *tmp = (layer_stats_t *)realloc(layers, n * sizeof(layer_stats_t));
+	  if (!tmp)
+	       return(NULL);
+	  layers    = tmp;
+	  maxlayers = n;
+     }
+
+     memset(&layers[nlayers], 0, sizeof(layer_stats_t));
+     layers[nlayers].z = z;
+     last_layer = nlayers++;
+
+     return(&layers[last_layer]);
+}
+
+static void layer_stats_merge(layer_stats_t *layer, const layer_stats_t *from)
+{
+     layer->blocks        += from->blocks;
+     layer->below_nominal += from->below_nominal;
+     layer->time          += from->time;
+     layer->distance      += from->distance;
+     if (from->peak_speed > layer->peak_speed)
+	  layer->peak_speed = from->peak_speed;
+}
+
+static void layer_stats_add(const block_t *block, float t, uint32_t peak_rate)
+{
+     layer_stats_t *layer;
+     int32_t z_steps;
+     float dx, dy, dz, distance;
+
+     dx = stepperAxisStepsToMM_(block->steps[X_AXIS], X_AXIS);
+     dy = stepperAxisStepsToMM_(block->steps[Y_AXIS], Y_AXIS);
+     dz = stepperAxisStepsToMM_(block->steps[Z_AXIS], Z_AXIS);
+     distance = sqrt(dx*dx + dy*dy + dz*dz);
+
+     layer = &layer_pending;
+     layer->blocks   += 1;
+     layer->time     += t;
+     layer->distance += distance;
+     if (block->use_accel && peak_rate < block->nominal_rate)
+	  layer->below_nominal += 1;
+     if (block->step_event_count != 0)
+     {
+	  float speed = distance * (float)peak_rate / (float)block->step_event_count;
+	  if (speed > layer->peak_speed)
+	       layer->peak_speed = speed;
+     }
+
+     // Only an extruding move, one which moves an extruder and X or Y,
+     // settles the layer of the blocks pending
+     z_steps = block->starting_position[Z_AXIS] +
+	  (((block->direction_bits & (1 << Z_AXIS)) != 0) ?
+	   -(int32_t)block->steps[Z_AXIS] : (int32_t)block->steps[Z_AXIS]);
+     layer_pending.z = stepperAxisStepsToMM_(z_steps, Z_AXIS);
+     if (!(block->steps[A_AXIS] || block->steps[B_AXIS]) ||
+	 !(block->steps[X_AXIS] || block->steps[Y_AXIS]))
+	  return;
+
+     if (!(layer = layer_stats_find(layer_pending.z)))
+     {
+	  fprintf(stderr, "Insufficient virtual memory for the per layer statistics\n");
+	  layer_stats_enabled = false;
+	  layer_stats_failed  = true;
+	  return;
+     }
+     layer_stats_merge(layer, &layer_pending);
+     memset(&layer_pending, 0, sizeof(layer_stats_t));
+}
+
+static int layer_stats_compare(const void *a, const void *b)
+{
+     float za = ((const layer_stats_t *)a)->z;
+     float zb = ((const layer_stats_t *)b)->z;
+
+     return((za < zb) ? -1 : (za > zb) ? 1 : 0);
+}
+
+// Write the per layer statistics as CSV or JSON, in order of Z height.
+// Returns -1 if they could not all be kept.
+
+int plan_dump_layer_stats(FILE *f, int format)
+{
+     if (layer_stats_failed)
+	  return(-1);
+
+     if (f == NULL)
+	  f = stdout;
+
+     // Moves after the last extruding move, such as parking the
+     // extruder, go with the last layer
+     if (layer_pending.blocks)
+     {
+	  layer_stats_t *layer = nlayers ? &layers[last_layer] :
+	       layer_stats_find(layer_pending.z);
+	  if (!layer)
+	  {
+	       fprintf(stderr, "Insufficient virtual memory for the per layer statistics\n");
+	       return(-1);
+	  }
+	  layer_stats_merge(layer, &layer_pending);
+	  memset(&layer_pending, 0, sizeof(layer_stats_t));
+     }
+
+     // Objects printed one after the other revisit the same heights
+     qsort(layers, nlayers, sizeof(layer_stats_t), layer_stats_compare);
+
+     if (format == LAYER_STATS_JSON)
+	  fprintf(f, "{\n  \"layers\": [");
+     else
+	  fprintf(f, "layer,z_mm,blocks,below_nominal,time_s,distance_mm,"
+		  "avg_speed_mm_s,peak_speed_mm_s\n");
+
+     for (size_t i = 0; i < nlayers; i++)
+     {
+	  const layer_stats_t *l = &layers[i];
+	  float avg = (l->time > 0.0f) ? l->distance / l->time : 0.0f;
+
+	  if (format == LAYER_STATS_JSON)
+	       fprintf(f, "%s\n    {\"layer\": %lu, \"z_mm\": %.3f, \"blocks\": %u, "
+		       "\"below_nominal\": %u, \"time_s\": %.3f, \"distance_mm\": %.3f, "
+		       "\"avg_speed_mm_s\": %.3f, \"peak_speed_mm_s\": %.3f}",
+		       i ? "," : "", (unsigned long)i, l->z, l->blocks, l->below_nominal,
+		       l->time, l->distance, avg, l->peak_speed);
+	  else
+	       fprintf(f, "%lu,%.3f,%u,%u,%.3f,%.3f,%.3f,%.3f\n",
+		       (unsigned long)i, l->z, l->blocks, l->below_nominal,
+		       l->time, l->distance, avg, l->peak_speed);
+     }
+
+     if (format == LAYER_STATS_JSON)
+	  fprintf(f, "\n  ]\n}\n");
+     return(0);
+}
+
 #define CHECK_SPEED_CHANGES
 #ifdef CHECK_SPEED_CHANGES
 static int total_violation_count = 0;
@@ -282,15 +479,19 @@ void plan_dump_current_block(int discard, int report)
 {
      int32_t acceleration_time, coast_time, deceleration_time;
      uint16_t acc_step_rate, dec_step_rate, intermed;
-     char action[STEPPER_COUNT+1];
      block_t *block;
-     int count_direction[STEPPER_COUNT], step_loops;
-     uint32_t initial_rate, step_events_completed;
+     int step_loops;
+     uint32_t step_events_completed;
+     uint16_t timer;
+#ifndef SAILTIME
+     uint32_t initial_rate;
+     char action[STEPPER_COUNT+1];
+     int count_direction[STEPPER_COUNT];
      static int i = 0;
      uint8_t out_bits;
      static float z_height = 10.0;  // figure z-offset is around 10
-     uint16_t timer;
-#ifdef CHECK_SPEED_CHANGES
+#endif
+#if defined(CHECK_SPEED_CHANGES) && !defined(SAILTIME)
      static float maxd;
      static float prev_speed[STEPPER_COUNT] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
      static const char axes_names[] = "XYZAB";
@@ -300,6 +501,7 @@ void plan_dump_current_block(int discard, int report)
      if (!block)
 	  return;
 
+#ifndef SAILTIME
      if (report && block->message[0] != '\0')
 	  printf("%s", block->message);
 
@@ -314,11 +516,16 @@ void plan_dump_current_block(int discard, int report)
      action[4] = (block->steps[B_AXIS] != 0) ?
 	  (((uint32_t)(0x7fffffff & block->steps[B_AXIS]) == block->step_event_count) ? 'B' : 'b') : ' ';
      action[5] = '\0';
+#endif
 
-     if (block->acceleration_rate == 0)
+     // acceleration_rate is left over from whichever block last used this
+     // buffer slot when the block is not accelerated
+     if (!block->use_accel || block->acceleration_rate == 0)
      {
 	     // No acceleration
+#ifndef SAILTIME
 	     initial_rate  = block->nominal_rate;
+#endif
 	     acc_step_rate = block->nominal_rate;
 	     dec_step_rate = block->nominal_rate;
 	     acceleration_time = calc_timer(acc_step_rate, &step_loops) * block->step_event_count;
@@ -328,7 +535,9 @@ void plan_dump_current_block(int discard, int report)
      }
      else
      {
+#ifndef SAILTIME
 	     initial_rate      = block->initial_rate;
+#endif
 	     acc_step_rate     = block->initial_rate;
 	     acceleration_time = calc_timer(acc_step_rate, &step_loops);
 
@@ -392,6 +601,8 @@ void plan_dump_current_block(int discard, int report)
 	     }
      }
 
+     // sailtime only reports the total time; skip the per block bookkeeping
+#ifndef SAILTIME
      out_bits = block->direction_bits;
      count_direction[X_AXIS] = ((out_bits & (1<<X_AXIS)) != 0) ? -1 : 1;
      count_direction[Y_AXIS] = ((out_bits & (1<<Y_AXIS)) != 0) ? -1 : 1;
@@ -475,27 +686,54 @@ void plan_dump_current_block(int discard, int report)
      }
 
      planner_counts[max(0, min(block->planned, BLOCK_BUFFER_SIZE))] += 1;
-     total_time += (float)(acceleration_time + coast_time + deceleration_time) / 2000000.0;
+#endif
+     total_ticks += (uint64_t)(acceleration_time + coast_time + deceleration_time);
+     total_blocks++;
+
+     if (layer_stats_enabled)
+	  layer_stats_add(block, (float)(acceleration_time + coast_time + deceleration_time) / 2000000.0,
+			  acc_step_rate);
 
      if (discard)
 	  plan_discard_current_block();
 }
 
+double plan_total_time(void)
+{
+     return((double)total_ticks / 2000000.0);
+}
+
+uint64_t plan_total_ticks(void)
+{
+     return(total_ticks);
+}
+
+void plan_set_total_ticks(uint64_t ticks)
+{
+     total_ticks = ticks;
+}
+
+uint32_t plan_total_blocks(void)
+{
+     return(total_blocks);
+}
+
 void plan_dump_run_data(int time_only)
 {
      int cnt, ihours, imins, isecs, idsecs;
      unsigned i;
-     float ttime = total_time;
+     double total_time = plan_total_time();
+     double ttime = total_time;
      uint32_t ztot1, zavg_min1, zavg_max1;
      uint32_t ztot2, zavg_min2, zavg_max2;
      float zavg1, zavg2;
 
      ihours = (int)(ttime / (60.0 * 60.0));
-     ttime -= (float)(ihours * 60 * 60);
+     ttime -= (double)(ihours * 60 * 60);
      imins = (int)(ttime / 60.0);
-     ttime -= (float)(imins * 60);
+     ttime -= (double)(imins * 60);
      isecs = (int)ttime;
-     ttime -= (float)isecs;
+     ttime -= (double)isecs;
      idsecs = (int)(0.5 + ttime * 100.0);
      printf("Total print time is %02d:%02d:%02d.%02d (%f seconds)\n",
 	    ihours, imins, isecs, idsecs, total_time);
@@ -530,7 +768,7 @@ void plan_dump_run_data(int time_only)
      zavg_min2 = z2[2];
      zavg_max2 = z2[2];
      cnt = 0;
-     for (i = 2; i < (iz - 2); i++)
+     for (i = 2; (i + 2) < iz; i++)
      {
 	  cnt++;
 	  if (z1[i] < zavg_min1) zavg_min1 = z1[i];
@@ -550,6 +788,7 @@ void plan_dump_run_data(int time_only)
 
 void plan_block_notice(const char *fmt, ...)
 {
+#ifndef SAILTIME
      va_list ap;
      block_t *block;
      uint8_t index;
@@ -564,6 +803,7 @@ void plan_block_notice(const char *fmt, ...)
      vsnprintf(block->message + len, sizeof(block->message) - len, fmt, ap);
 
      va_end(ap);
+#endif
 }
 
 FPTYPE ftofpS(float x, int lineno, const char *src)
@@ -645,18 +885,84 @@ FPTYPE fpscale2S(FPTYPE x, int lineno, const char *src)
      return x << 1;
 }
 
+// The EEPROM reads the defaults, as a blank EEPROM does, unless an image
+// of a machine's EEPROM has been loaded with eeprom_load()
+
+#define EEPROM_IMAGE_SIZE 4096
+
+static uint8_t eeprom_image[EEPROM_IMAGE_SIZE];
+static size_t eeprom_image_size = 0;
+
+// Read a little endian value of size bytes as the firmware does: erased
+// bytes, all 0xff, read as the default
+static uint64_t eeprom_read(uint16_t location, uint8_t size, uint64_t default_value)
+{
+     uint64_t val = 0;
+     bool erased = true;
+
+     if ((size_t)location + size > eeprom_image_size)
+	  return(default_value);
+     for (uint8_t i = size; i-- > 0; )
+     {
+	  val = (val << 8) | eeprom_image[location + i];
+	  if (eeprom_image[location + i] != 0xff)
+	       erased = false;
+     }
+     return(erased ? default_value : val);
+}
+
 namespace eeprom {
 
-uint8_t getEeprom8(const uint16_t location, const uint8_t default_value) { return default_value; }
-uint16_t getEeprom16(const uint16_t location, const uint16_t default_value) { return default_value; }
-uint32_t getEeprom32(const uint16_t location, const uint32_t default_value) { return default_value; }
-float getEepromFixed16(const uint16_t location, const float default_value) { return default_value; }
+uint8_t getEeprom8(const uint16_t location, const uint8_t default_value) { return (uint8_t)eeprom_read(location, 1, default_value); }
+uint16_t getEeprom16(const uint16_t location, const uint16_t default_value) { return (uint16_t)eeprom_read(location, 2, default_value); }
+uint32_t getEeprom32(const uint16_t location, const uint32_t default_value) { return (uint32_t)eeprom_read(location, 4, default_value); }
+float getEepromFixed16(const uint16_t location, const float default_value)
+{
+     uint16_t val = (uint16_t)eeprom_read(location, 2, 0xffff);
+     if (val == 0xffff)
+	  return(default_value);
+     return((float)(val & 0xff) + (float)(val >> 8) / 256.0);
+}
 void setEepromFixed16(const uint16_t location, const float new_value) { }
-int64_t getEepromInt64(const uint16_t location, const int64_t default_value) { return default_value; }
+int64_t getEepromInt64(const uint16_t location, const int64_t default_value) { return (int64_t)eeprom_read(location, 8, (uint64_t)default_value); }
 void setEepromInt64(const uint16_t location, const int64_t value) { }
 void storeToolheadToleranceDefaults() { }
 void setDefaultsAcceleration() { }
 
+#define EEPROM_SETTING_DEFAULT(type, name, offset, dflt) (type)(dflt),
+Settings settings = { EEPROM_SETTINGS(EEPROM_SETTING_DEFAULT) };
+
+}
+
+// Load an image of a machine's EEPROM, such as avrdude reads with
+// "-U eeprom:r:file:r".  Call before steppers::init().  Returns false if
+// the file can't be read.
+
+bool eeprom_load(const char *file)
+{
+     FILE *f = fopen(file, "rb");
+
+     if (!f)
+     {
+	  fprintf(stderr, "Unable to open the EEPROM image \"%s\"; %s (%d)\n",
+		  file, strerror(errno), errno);
+	  return(false);
+     }
+     eeprom_image_size = fread(eeprom_image, 1, sizeof(eeprom_image), f);
+     if (ferror(f) || eeprom_image_size == 0)
+     {
+	  fprintf(stderr, "Unable to read the EEPROM image \"%s\"\n", file);
+	  eeprom_image_size = 0;
+	  fclose(f);
+	  return(false);
+     }
+     fclose(f);
+
+#define EEPROM_SETTING_LOAD(type, name, offset, dflt) \
+     eeprom::settings.name = (type)eeprom_read(offset, sizeof(type), (type)(dflt));
+     EEPROM_SETTINGS(EEPROM_SETTING_LOAD)
+
+     return(true);
 }
 
 #ifdef linux
@@ -5,6 +5,7 @@
 
 #define _STEPPERACCELPLANNEREXTRAS_HH_
 
+#include <stdio.h>
 #include "Point.hh"
 #include "SimulatorRecord.hh"
 #include "StepperAccelPlanner.hh"
@@ -20,6 +21,8 @@ extern bool   simulator_show_alt_feed_rate;
 extern FPTYPE simulator_max_feed_rate;
 
 extern void init_extras(bool acceleration);
+extern void set_max_accelerations(const int16_t *vals);
+extern bool eeprom_load(const char *file);
 extern void st_set_position(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &a, const int32_t &b);
 extern void st_set_e_position(const int32_t &a, const int32_t &b);
 extern int32_t st_get_position(uint8_t axis);
@@ -27,6 +30,17 @@ extern void st_deprime_enable(bool enable);
 extern void plan_dump(int chart);
 extern void plan_dump_current_block(int discard, int report);
 extern void plan_dump_run_data(int time_only);
+extern double plan_total_time(void);
+extern uint64_t plan_total_ticks(void);
+extern void plan_set_total_ticks(uint64_t ticks);
+extern uint32_t plan_total_blocks(void);
+
+// Per layer time, distance and speed statistics
+#define LAYER_STATS_CSV  0
+#define LAYER_STATS_JSON 1
+extern void plan_layer_stats(bool enable);
+extern int plan_dump_layer_stats(FILE *f, int format);
+
 void plan_block_notice(const char *fmt, ...);
 
 extern float stepperAxisStepsToMM_(int32_t steps, uint8_t axis);
@@ -0,0 +1,438 @@
+// Thermal model of an extruder hot end, for tuning and checking the
+// heater feed forward (HEATER_FEED_FORWARD in the board's Configuration.hh)
+// and the heater PID autotune (HEATER_AUTOTUNE)
+//
+//     heatsim [-achsv] [-g gain] [flow-file]
+//
+// The model heats the hot end to its target and then prints a flow
+// profile, running the firmware's PID and the Heater's control logic
+// every half second.  Feed forward is taken from the average flow over
+// the next HEATER_FEED_FORWARD_HORIZON milliseconds, as the firmware
+// takes it from the queued moves.  The flow file holds lines of
+// "seconds steps-per-second"; without one a profile of alternating
+// perimeter, infill and travel segments is printed.
+//
+// The worst temperature sag and overshoot during the print are
+// reported without and with feed forward.  With -c, heatsim exits
+// non-zero unless feed forward at the configured gain reduces the
+// worst sag.  With -s, the gain is swept to help pick a new one.
+//
+// With -a, the hot end is instead tuned by the firmware's relay feedback
+// autotune, and heating up from cold is compared between the default
+// and the tuned gains.  With -c as well, heatsim exits non-zero unless
+// the tuned gains bring the hot end to its target and settle it no
+// slower than the defaults.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "Configuration.hh"
+#include "PID.hh"
+#include "Autotune.hh"
+
+#if defined(__arm__)
+#define GETOPTS_END (char)-1
+#else
+#define GETOPTS_END -1
+#endif
+
+#ifndef HEATER_FEED_FORWARD
+#define HEATER_FEED_FORWARD 0
+#define HEATER_FEED_FORWARD_HORIZON 2000
+#endif
+
+// These must match Heater.hh and Heater.cc
+#define DEFAULT_P 7.0
+#define DEFAULT_I 0.325
+#define DEFAULT_D 36.0
+#define PID_BYPASS_DELTA 15
+#define UPDATE_INTERVAL 0.5
+
+// Hot end model: a heater cartridge coupled to the heater block, which
+// loses heat to the air and to the filament melted in it.  Roughly a
+// Replicator 2 with a 40 W cartridge printing 1.75 mm PLA.
+#define AMBIENT         22.0
+#define HEATER_WATTS    40.0
+#define CARTRIDGE_JK    3.0     // cartridge heat capacity, J/K
+#define COUPLING_WK     0.8     // cartridge to block conductance, W/K
+#define BLOCK_JK        8.0     // block heat capacity, J/K
+#define LOSS_WK         0.09    // block to air, W/K
+#define MELT_J_STEP     0.0115  // J per extruder step to heat filament by 208 K
+#define SENSOR_LAG      1.0     // thermocouple time constant, s
+#define SENSOR_QUANTUM  0.25    // thermocouple resolution, C
+#define DT              0.01    // model time step, s
+
+#define TARGET          230
+#define HYSTERESIS      2       // Heater.cc's TARGET_HYSTERESIS
+#define SETTLED         1.0     // settled when within this of the target
+#define MAX_SEGMENTS    1000
+
+typedef struct {
+     float seconds;
+     float rate;     // extruder steps per second
+} segment_t;
+
+static segment_t profile[MAX_SEGMENTS];
+static int nsegments = 0;
+static int verbose = 0;
+
+static void usage(FILE *f, const char *prog)
+{
+     if (f == NULL)
+	  f = stderr;
+
+     fprintf(f,
+"Usage: %s [-achsv] [-g gain] [flow-file]\n"
+"   flow-file -- File of \"seconds steps-per-second\" lines to print.  If not\n"
+"                supplied then a built in profile is printed\n"
+"      ?, -h  -- This help message\n"
+"         -a  -- Autotune the PID gains and compare heating up with them\n"
+"         -c  -- Check that feed forward reduces the worst temperature sag,\n"
+"                or with -a that the tuned gains heat up no slower\n"
+"    -g gain  -- Feed forward gain, heater PWM per 1000 steps/s (default %d)\n"
+"         -s  -- Sweep the feed forward gain\n"
+"         -v  -- Print the temperature every second\n",
+	     prog ? prog : "heatsim", HEATER_FEED_FORWARD);
+}
+
+typedef struct {
+     float p, i, d;
+} gains_t;
+
+static const gains_t default_gains = { DEFAULT_P, DEFAULT_I, DEFAULT_D };
+
+typedef struct {
+     float cartridge, block, sensor;
+} model_t;
+
+static void model_init(model_t *m)
+{
+     m->cartridge = m->block = m->sensor = AMBIENT;
+}
+
+// Advance the model by DT with the heater at PWM mv and flow steps/s
+static void model_step(model_t *m, int mv, float flow)
+{
+     float to_block = COUPLING_WK * (m->cartridge - m->block);
+     float melt = flow * MELT_J_STEP * (m->block - AMBIENT) / 208.0;
+     m->cartridge += DT * (HEATER_WATTS * mv / 255.0 - to_block) / CARTRIDGE_JK;
+     m->block += DT * (to_block - LOSS_WK * (m->block - AMBIENT) - melt) / BLOCK_JK;
+     m->sensor += DT * (m->block - m->sensor) / SENSOR_LAG;
+}
+
+// What the thermocouple reads
+static float model_read(const model_t *m)
+{
+     return SENSOR_QUANTUM * floorf(m->sensor / SENSOR_QUANTUM);
+}
+
+// Flow in steps/s at time t into the print
+static float flow_at(float t)
+{
+     for (int i = 0; i < nsegments; i++) {
+	  if (t < profile[i].seconds)
+	       return profile[i].rate;
+	  t -= profile[i].seconds;
+     }
+     return 0.0;
+}
+
+static float print_length(void)
+{
+     float t = 0.0;
+     for (int i = 0; i < nsegments; i++)
+	  t += profile[i].seconds;
+     return t;
+}
+
+// The firmware averages the queued moves' extrusion over the horizon
+static uint16_t lookahead_rate(float t)
+{
+     float horizon = HEATER_FEED_FORWARD_HORIZON / 1000.0;
+     float steps = 0.0;
+     for (float s = 0.0; s < horizon; s += DT)
+	  steps += flow_at(t + s) * DT;
+     return (uint16_t)(steps / horizon);
+}
+
+typedef struct {
+     float sag;         // worst drop below target while printing
+     float overshoot;   // worst rise above target while printing
+     float rms;         // RMS error while printing
+} result_t;
+
+static result_t run(int gain)
+{
+     PID pid;
+     pid.setPGain(DEFAULT_P);
+     pid.setIGain(DEFAULT_I);
+     pid.setDGain(DEFAULT_D);
+     pid.setTarget(TARGET);
+
+     model_t m;
+     model_init(&m);
+     bool bypassing = false;
+     int mv = 0;
+     float next_update = 0.0;
+     float print_start = -1.0, print_end = 0.0;
+     result_t r = { 0.0, 0.0, 0.0 };
+     double sum_sq = 0.0;
+     long samples = 0;
+
+     for (float t = 0.0; print_start < 0.0 || t < print_end; t += DT) {
+	  float printing = (print_start >= 0.0) ? t - print_start : -1.0;
+
+	  if (t >= next_update) {
+	       next_update += UPDATE_INTERVAL;
+	       float pv = model_read(&m);
+
+	       // Heater::manage_temperature()
+	       int delta = TARGET - (int)(0.5 + pv);
+	       if (bypassing && delta < PID_BYPASS_DELTA) {
+		    bypassing = false;
+		    pid.reset_state();
+	       }
+	       else if (!bypassing && delta > PID_BYPASS_DELTA + 10)
+		    bypassing = true;
+	       if (bypassing)
+		    mv = 255;
+	       else {
+		    mv = pid.calculate(pv);
+		    if (printing >= 0.0) {
+			 uint32_t ff = (uint32_t)lookahead_rate(printing) * gain / 1000;
+			 mv += (ff > 255) ? 255 : ff;
+		    }
+		    if (mv < 0) mv = 0;
+		    else if (mv > 255) mv = 255;
+	       }
+
+	       // Start printing a minute after first reaching the target
+	       if (print_start < 0.0 && t > 60.0 && fabs(pv - TARGET) < 1.0) {
+		    print_start = t + 60.0;
+		    print_end = print_start + print_length() + 30.0;
+	       }
+	       if (verbose && fmodf(t, 1.0) < UPDATE_INTERVAL / 2)
+		    printf("%8.1f %7.2f %3d %6.0f\n", t, pv, mv,
+			   printing >= 0.0 ? flow_at(printing) : 0.0);
+	  }
+
+	  model_step(&m, mv, (printing >= 0.0) ? flow_at(printing) : 0.0);
+
+	  if (printing >= 0.0) {
+	       float err = m.block - TARGET;
+	       if (-err > r.sag) r.sag = -err;
+	       if (err > r.overshoot) r.overshoot = err;
+	       sum_sq += err * err;
+	       samples++;
+	  }
+     }
+     r.rms = samples ? sqrt(sum_sq / samples) : 0.0;
+     return r;
+}
+
+// Tune the hot end at TARGET as Heater does when autotuning
+static bool autotune(gains_t *g)
+{
+     Autotune tuner;
+     model_t m;
+     int mv = 0;
+     float next_update = 0.0;
+
+     model_init(&m);
+     tuner.start(TARGET, 0, Autotune::TYREUS_LUYBEN, 0);
+     for (float t = 0.0; tuner.isRunning() && t < 7200.0; t += DT) {
+	  if (t >= next_update) {
+	       next_update += UPDATE_INTERVAL;
+	       // hundreds of microseconds, as Motherboard::getCurrentCentaMicros()
+	       mv = tuner.update(model_read(&m), (uint32_t)(t * 10000.0 + 0.5));
+	       if (verbose && fmodf(t, 1.0) < UPDATE_INTERVAL / 2)
+		    printf("%8.1f %7.2f %3d  cycle %d\n", t, model_read(&m), mv,
+			   tuner.getCycle());
+	  }
+	  model_step(&m, mv, 0.0);
+     }
+     if (tuner.getState() != Autotune::DONE)
+	  return false;
+     g->p = tuner.p;
+     g->i = tuner.i;
+     g->d = tuner.d;
+     return true;
+}
+
+typedef struct {
+     float reached;     // seconds until has_reached_target_temperature()
+     float settled;     // seconds until within SETTLED for good
+     float overshoot;   // worst rise above target
+} heatup_t;
+
+// Heat from cold to TARGET with the given gains, as stored in EEPROM
+static heatup_t heatup(const gains_t *g)
+{
+     PID pid;
+     pid.setPGain((int)(g->p * 256.0) / 256.0);
+     pid.setIGain((int)(g->i * 256.0) / 256.0);
+     pid.setDGain((int)(g->d * 256.0) / 256.0);
+     pid.setTarget(TARGET);
+
+     model_t m;
+     model_init(&m);
+     bool bypassing = false;
+     int mv = 0;
+     float next_update = 0.0;
+     heatup_t h = { -1.0, 0.0, 0.0 };
+
+     for (float t = 0.0; t < 900.0; t += DT) {
+	  if (t >= next_update) {
+	       next_update += UPDATE_INTERVAL;
+	       float pv = model_read(&m);
+
+	       // Heater::manage_temperature()
+	       int delta = TARGET - (int)(0.5 + pv);
+	       if (bypassing && delta < PID_BYPASS_DELTA) {
+		    bypassing = false;
+		    pid.reset_state();
+	       }
+	       else if (!bypassing && delta > PID_BYPASS_DELTA + 10)
+		    bypassing = true;
+	       if (bypassing)
+		    mv = 255;
+	       else {
+		    mv = pid.calculate(pv);
+		    if (mv < 0) mv = 0;
+		    else if (mv > 255) mv = 255;
+	       }
+
+	       if (h.reached < 0.0 && abs(delta) <= HYSTERESIS)
+		    h.reached = t;
+	       if (fabs(pv - TARGET) > SETTLED)
+		    h.settled = t;
+	  }
+	  model_step(&m, mv, 0.0);
+	  if (m.block - TARGET > h.overshoot)
+	       h.overshoot = m.block - TARGET;
+     }
+     return h;
+}
+
+static int load(const char *fname)
+{
+     FILE *fp = fopen(fname, "r");
+     if (!fp) {
+	  perror(fname);
+	  return -1;
+     }
+
+     char line[256];
+     while (nsegments < MAX_SEGMENTS && fgets(line, sizeof(line), fp)) {
+	  if (line[0] == '#')
+	       continue;
+	  if (sscanf(line, "%f %f", &profile[nsegments].seconds,
+		     &profile[nsegments].rate) == 2)
+	       nsegments++;
+     }
+     fclose(fp);
+     return nsegments;
+}
+
+int main(int argc, const char *argv[])
+{
+     int gain = HEATER_FEED_FORWARD;
+     int check = 0, sweep = 0, tune = 0;
+     char c;
+
+     while ((c = getopt(argc, (char **)argv, ":acg:hsv?")) != GETOPTS_END) {
+	  switch(c) {
+	  case 'a' :
+	       tune = 1;
+	       break;
+	  case 'c' :
+	       check = 1;
+	       break;
+	  case 'g' :
+	       gain = atoi(optarg);
+	       break;
+	  case 's' :
+	       sweep = 1;
+	       break;
+	  case 'v' :
+	       verbose = 1;
+	       break;
+	  case 'h' :
+	  case '?' :
+	       usage(stdout, argv[0]);
+	       return(0);
+	  default :
+	       usage(stderr, argv[0]);
+	       return(1);
+	  }
+     }
+     argc -= optind;
+     argv += optind;
+
+     if (argc > 0) {
+	  if (load(argv[0]) <= 0)
+	       return(1);
+     }
+     else {
+	  // perimeters, infill and a layer change; 400 steps/s is
+	  // about 10 mm^3/s of 1.75 mm filament
+	  for (int layer = 0; layer < 4; layer++) {
+	       profile[nsegments].seconds = 20.0;
+	       profile[nsegments++].rate = 100.0;
+	       profile[nsegments].seconds = 20.0;
+	       profile[nsegments++].rate = 400.0 + 100.0 * layer;
+	       profile[nsegments].seconds = 5.0;
+	       profile[nsegments++].rate = 0.0;
+	  }
+     }
+
+     if (tune) {
+	  gains_t tuned;
+	  if (!autotune(&tuned)) {
+	       printf("FAILED: autotune did not finish\n");
+	       return(1);
+	  }
+	  heatup_t before = heatup(&default_gains);
+	  heatup_t after = heatup(&tuned);
+	  printf("default P %6.3f I %6.4f D %6.3f: reached %5.1f s  settled %5.1f s  overshoot %5.2f C\n",
+		 default_gains.p, default_gains.i, default_gains.d,
+		 before.reached, before.settled, before.overshoot);
+	  printf("tuned   P %6.3f I %6.4f D %6.3f: reached %5.1f s  settled %5.1f s  overshoot %5.2f C\n",
+		 tuned.p, tuned.i, tuned.d,
+		 after.reached, after.settled, after.overshoot);
+	  if (check && !(after.reached >= 0.0 && after.reached <= before.reached &&
+			 after.settled <= before.settled)) {
+	       printf("FAILED: the tuned gains heat up slower than the defaults\n");
+	       return(1);
+	  }
+	  return(0);
+     }
+
+     if (sweep) {
+	  for (int g = 0; g <= 300; g += 20) {
+	       result_t r = run(g);
+	       printf("gain %3d: sag %5.2f C  overshoot %5.2f C  rms %5.2f C\n",
+		      g, r.sag, r.overshoot, r.rms);
+	  }
+	  return(0);
+     }
+
+     int v = verbose;
+     verbose = 0;
+     result_t off = run(0);
+     verbose = v;
+     result_t on = run(gain);
+
+     printf("feed forward off:      sag %5.2f C  overshoot %5.2f C  rms %5.2f C\n",
+	    off.sag, off.overshoot, off.rms);
+     printf("feed forward gain %3d: sag %5.2f C  overshoot %5.2f C  rms %5.2f C\n",
+	    gain, on.sag, on.overshoot, on.rms);
+
+     if (check && !(gain > 0 && on.sag < off.sag && on.rms < off.rms)) {
+	  printf("FAILED: feed forward does not reduce the temperature sag\n");
+	  return(1);
+     }
+     return(0);
+}
@@ -0,0 +1,291 @@
+// Check the firmware's fixed point PID controller against the float
+// implementation it replaced
+//
+//     pidcheck [-v] [trace-file ...]
+//
+// Each trace file holds one sample per line, "setpoint temperature",
+// as logged from a heater at its 0.5 second PID interval.  Lines
+// starting with '#' are ignored.  When no trace files are given, a set
+// of traces is generated by running the float controller against a
+// simple heater model.
+//
+// Every trace is replayed through the Heater's PID bypass logic with
+// several gain sets.  The outputs of the two controllers must agree to
+// within OUTPUT_SCALE, the size of one step of the controller's output.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "PID.hh"
+
+#if defined(__arm__)
+#define GETOPTS_END (char)-1
+#else
+#define GETOPTS_END -1
+#endif
+
+// These must match PID.cc and Heater.cc
+#define ERR_ACC_MAX     256
+#define OUTPUT_SCALE    2
+#define PID_BYPASS_DELTA 15
+
+#define MAX_SAMPLES 20000
+
+typedef struct {
+     int   sp;
+     float pv;
+} sample_t;
+
+// The float PID controller as it was before the move to fixed point
+class FloatPID {
+public:
+     float p_gain, i_gain, d_gain;
+     float delta_history[DELTA_SAMPLES];
+     float delta_summation;
+     uint8_t delta_idx;
+     float prev_error;
+     float error_acc;
+     int sp;
+
+     FloatPID(float p, float i, float d) : p_gain(p), i_gain(i), d_gain(d), sp(0) { reset_state(); }
+
+     void reset_state() {
+	  error_acc = prev_error = delta_summation = 0;
+	  for (delta_idx = 0; delta_idx < DELTA_SAMPLES; delta_idx++)
+	       delta_history[delta_idx] = 0;
+	  delta_idx = 0;
+     }
+
+     void setTarget(int target) {
+	  if (abs(sp - target) > 10)
+	       reset_state();
+	  sp = target;
+     }
+
+     int calculate(float pv) {
+	  float e = sp - pv;
+	  error_acc += e;
+	  if (error_acc > ERR_ACC_MAX)
+	       error_acc = ERR_ACC_MAX;
+	  else if (error_acc < -ERR_ACC_MAX)
+	       error_acc = -ERR_ACC_MAX;
+	  float p_term = e * p_gain;
+	  float i_term = error_acc * i_gain;
+	  float delta = e - prev_error;
+	  delta_summation -= delta_history[delta_idx];
+	  delta_history[delta_idx] = delta;
+	  delta_summation += delta;
+	  delta_idx = (delta_idx + 1) % DELTA_SAMPLES;
+	  float d_term = delta_summation * d_gain;
+	  prev_error = e;
+	  return ((int)(p_term + i_term + d_term)) * OUTPUT_SCALE;
+     }
+};
+
+// Gains are stored in EEPROM as 8.8 fixed point
+typedef struct {
+     float p, i, d;
+} gains_t;
+
+static const gains_t gains[] = {
+     { 7.0,      0.325,    36.0 },  // Heater.hh defaults
+     { 10.5,     0.5,      50.0 },
+     { 3.0,      0.1015625, 12.0 },
+     { 1.0,      0.01171875, 3.5 }
+};
+
+static int verbose = 0;
+
+static void usage(FILE *f, const char *prog)
+{
+     if (f == NULL)
+	  f = stderr;
+
+     fprintf(f,
+"Usage: %s [-hv] [trace-file ...]\n"
+"   trace-file -- File of \"setpoint temperature\" lines, one per PID sample.\n"
+"                 If none are supplied then generated traces are used\n"
+"       ?, -h  -- This help message\n"
+"          -v  -- Print every sample where the two controllers differ\n",
+	     prog ? prog : "pidcheck");
+}
+
+// Replay one trace with one gain set; returns the number of samples
+// whose outputs differ by more than OUTPUT_SCALE
+static int replay(const char *name, const sample_t *trace, int n, const gains_t *g)
+{
+     PID fixed;
+     FloatPID ref(g->p, g->i, g->d);
+     bool bypassing = false;
+     int bad = 0, differ = 0, maxdiff = 0, calcs = 0;
+
+     fixed.setPGain(g->p);
+     fixed.setIGain(g->i);
+     fixed.setDGain(g->d);
+     fixed.setTarget(0);
+
+     for (int k = 0; k < n; k++) {
+	  if (trace[k].sp != fixed.getTarget()) {
+	       fixed.setTarget(trace[k].sp);
+	       ref.setTarget(trace[k].sp);
+	  }
+
+	  // Heater::manage_temperature()
+	  int delta = trace[k].sp - (int)(0.5 + trace[k].pv);
+	  if (bypassing && delta < PID_BYPASS_DELTA) {
+	       bypassing = false;
+	       fixed.reset_state();
+	       ref.reset_state();
+	  }
+	  else if (!bypassing && delta > PID_BYPASS_DELTA + 10)
+	       bypassing = true;
+	  if (bypassing || trace[k].sp == 0)
+	       continue;
+
+	  int a = ref.calculate(trace[k].pv);
+	  int b = fixed.calculate(trace[k].pv);
+	  int diff = abs(a - b);
+	  calcs++;
+	  if (diff) {
+	       differ++;
+	       if (diff > maxdiff)
+		    maxdiff = diff;
+	       if (diff > OUTPUT_SCALE)
+		    bad++;
+	       if (verbose)
+		    printf("    %5d: sp %3d pv %7.2f  float %5d fixed %5d\n",
+			   k, trace[k].sp, trace[k].pv, a, b);
+	  }
+     }
+
+     printf("%-6s %-24s P %6.3f I %6.4f D %6.3f: %5d samples, %4d differ, max diff %d\n",
+	    bad ? "FAILED" : "ok", name, g->p, g->i, g->d, calcs, differ, maxdiff);
+     return bad;
+}
+
+// Run the float controller against a first order heater model and
+// record what its sensor would have read.  The targets change at the
+// given sample numbers.
+static int generate(sample_t *trace, const int *targets, int nsteps,
+		    float power, float loss, float quantum, float noise)
+{
+     FloatPID pid(gains[0].p, gains[0].i, gains[0].d);
+     float temp = 22.0;
+     bool bypassing = false;
+     unsigned seed = 12345;
+     int n = 0;
+
+     for (int s = 0; s < nsteps; s += 2) {
+	  int sp = targets[s];
+	  pid.setTarget(sp);
+	  for (int k = 0; k < targets[s + 1] && n < MAX_SAMPLES; k++, n++) {
+	       seed = seed * 1103515245 + 12345;
+	       float pv = temp + noise * ((float)((seed >> 16) & 0x7fff) / 16384.0 - 1.0);
+	       if (quantum > 0)
+		    pv = quantum * floorf(pv / quantum);
+	       trace[n].sp = sp;
+	       trace[n].pv = pv;
+
+	       int delta = sp - (int)(0.5 + pv);
+	       if (bypassing && delta < PID_BYPASS_DELTA) {
+		    bypassing = false;
+		    pid.reset_state();
+	       }
+	       else if (!bypassing && delta > PID_BYPASS_DELTA + 10)
+		    bypassing = true;
+	       int mv = 0;
+	       if (bypassing)
+		    mv = 255;
+	       else if (sp) {
+		    mv = pid.calculate(pv);
+		    if (mv < 0) mv = 0;
+		    else if (mv > 255) mv = 255;
+	       }
+	       // half a second at this output
+	       temp += 0.5 * (power * mv / 255.0 - loss * (temp - 22.0));
+	  }
+     }
+     return n;
+}
+
+static int load(const char *fname, sample_t *trace)
+{
+     FILE *fp = fopen(fname, "r");
+     if (!fp) {
+	  perror(fname);
+	  return -1;
+     }
+
+     char line[256];
+     int n = 0;
+     while (n < MAX_SAMPLES && fgets(line, sizeof(line), fp)) {
+	  if (line[0] == '#')
+	       continue;
+	  if (sscanf(line, "%d %f", &trace[n].sp, &trace[n].pv) == 2)
+	       n++;
+     }
+     fclose(fp);
+     return n;
+}
+
+int main(int argc, const char *argv[])
+{
+     static sample_t trace[MAX_SAMPLES];
+     const int ngains = sizeof(gains) / sizeof(gains[0]);
+     int bad = 0;
+     char c;
+
+     while ((c = getopt(argc, (char **)argv, ":hv?")) != GETOPTS_END) {
+	  switch(c) {
+	  case 'v' :
+	       verbose = 1;
+	       break;
+	  case 'h' :
+	  case '?' :
+	       usage(stdout, argv[0]);
+	       return(0);
+	  default :
+	       usage(stderr, argv[0]);
+	       return(1);
+	  }
+     }
+     argc -= optind;
+     argv += optind;
+
+     if (argc > 0) {
+	  for (int a = 0; a < argc; a++) {
+	       int n = load(argv[a], trace);
+	       if (n < 0)
+		    return(1);
+	       for (int g = 0; g < ngains; g++)
+		    bad += replay(argv[a], trace, n, &gains[g]);
+	  }
+     }
+     else {
+	  // { target, samples, target, samples, ... }
+	  static const int extruder[] = { 230, 600, 210, 400, 240, 400, 0, 300 };
+	  static const int platform[] = { 110, 1600, 100, 600, 0, 400 };
+	  static const int overshoot[] = { 230, 300, 150, 300, 200, 300 };
+	  int n;
+
+	  n = generate(trace, extruder, 8, 12.0, 0.03, 0.25, 0.0);
+	  for (int g = 0; g < ngains; g++)
+	       bad += replay("extruder", trace, n, &gains[g]);
+
+	  n = generate(trace, extruder, 8, 12.0, 0.03, 0.25, 1.0);
+	  for (int g = 0; g < ngains; g++)
+	       bad += replay("extruder (noisy)", trace, n, &gains[g]);
+
+	  n = generate(trace, platform, 6, 1.5, 0.01, 0.0, 0.3);
+	  for (int g = 0; g < ngains; g++)
+	       bad += replay("platform (thermistor)", trace, n, &gains[g]);
+
+	  n = generate(trace, overshoot, 6, 12.0, 0.03, 0.25, 0.5);
+	  for (int g = 0; g < ngains; g++)
+	       bad += replay("target changes", trace, n, &gains[g]);
+     }
+
+     return bad ? 1 : 0;
+}
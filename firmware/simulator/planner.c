@@ -47,9 +47,9 @@ int main(int argc, const char *argv[])
      queued = 0;
 
      if (argc < 2)
-	  inctx = s3g_open(0, NULL);
+	  inctx = s3g_open(S3G_INPUT_TYPE_FILE, NULL);
      else
-	  inctx = s3g_open(0, (void *)argv[1]);
+	  inctx = s3g_open(S3G_INPUT_TYPE_MMAP, (void *)argv[1]);
 
      
      if (!inctx)
@@ -8,6 +8,7 @@
 #include "Commands.hh"
 #include "s3g_private.h"
 #include "s3g_stdio.h"
+#include "s3g_mmap.h"
 #include "s3g.h"
 
 typedef struct {
@@ -89,6 +90,10 @@ static const s3g_command_info_t command_table_raw[] = {
      /* 156 */  {HOST_CMD_SET_ACCELERATION_TOGGLE, 1, -1, "set segment acceleration"},
      /* 157 */  {HOST_CMD_STREAM_VERSION, 20, 0, "stream version"},
      /* 158 */ 
+     /* 159 */  {HOST_CMD_STORE_MESH_POINT, 3, -1, "store auto-level mesh point"},
+     /* 160 */  {HOST_CMD_PLANNED_HEADER, 5, -1, "planned moves header"},
+     /* 161 */  {HOST_CMD_QUEUE_POINT_PLANNED, 31 + PLANNED_MOVE_SIZE, 0, "queue planned point"},
+     /* 162 */  {HOST_CMD_FILE_CHECKSUM, 4, -1, "file checksum"},
 };
 
 static const s3g_command_info_t tool_command_table_raw[] = {
@@ -218,8 +223,7 @@ static int s3g_init(void)
 s3g_context_t *s3g_open(int type, void *src)
 {
      s3g_context_t *ctx;
-
-     (void)type; // Only type is a file
+     int istat;
 
      ctx = (s3g_context_t *)calloc(1, sizeof(s3g_context_t));
      if (!ctx)
@@ -229,8 +233,22 @@ s3g_context_t *s3g_open(int type, void *src)
 	  return(NULL);
      }
 
-     if (s3g_stdio_open(ctx, src))
+     switch (type)
+     {
+     case S3G_INPUT_TYPE_MMAP :
+	  istat = s3g_mmap_open(ctx, src);
+	  break;
+
+     default :
+	  istat = s3g_stdio_open(ctx, src);
+	  break;
+     }
+
+     if (istat)
+     {
+	  free(ctx);
 	  return(NULL);
+     }
 
      return(ctx);
 }
@@ -263,6 +281,34 @@ int s3g_command_isblocking(s3g_command_t *cmd)
 	       
 }
 
+// s3g_read
+//
+// Read nbytes from the input source, storing at most maxbuf of them in buf.
+// Same semantics as the file driver read procedures.  Memory mapped input
+// sources are read straight out of the mapping without calling down to the
+// file driver.  ctx->nread tracks the offset into the input source.
+
+static ssize_t s3g_read(s3g_context_t *ctx, void *buf, size_t maxbuf,
+			size_t nbytes)
+{
+     ssize_t n;
+
+     if (ctx->map)
+     {
+	  if (nbytes > (ctx->map_len - ctx->nread))
+	       nbytes = ctx->map_len - ctx->nread;
+	  if (buf)
+	       memcpy(buf, ctx->map + ctx->nread, (nbytes < maxbuf) ? nbytes : maxbuf);
+	  ctx->nread += nbytes;
+	  return((ssize_t)nbytes);
+     }
+
+     if ((n = (*ctx->read)(ctx->r_ctx, buf, maxbuf, nbytes)) > 0)
+	  ctx->nread += (size_t)n;
+
+     return(n);
+}
+
 int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 			 unsigned char *buf, size_t maxbuf, size_t *buflen)
 {
@@ -289,7 +335,7 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 	  errno = EINVAL;
 	  return(-1);
      }
-     else if (!ctx->read)
+     else if (!ctx->read && !ctx->map)
      {
 	  fprintf(stderr, "s3g_command_get(%d): Invalid context; "
 		  "ctx->read=NULL\n", __LINE__);
@@ -307,7 +353,7 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
      // Initialize command table
      s3g_init();
 
-     if (1 != (bytes_expected = (*ctx->read)(ctx->r_ctx, buf0, maxbuf, 1)))
+     if (1 != (bytes_expected = s3g_read(ctx, buf0, maxbuf, 1)))
      {
 	  // End of file condition?
 	  if (bytes_expected == 0)
@@ -343,7 +389,7 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 
 #define GET_INT32(v) \
 	  if (maxbuf < 4) goto trunc; \
-	  if (4 != (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, 4))) \
+	  if (4 != (bytes_read = s3g_read(ctx, buf, maxbuf, 4))) \
 	       goto io_error; \
 	  memcpy(&f32.u.c, buf, 4); \
 	  buf    += bytes_read; \
@@ -352,7 +398,7 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 
 #define GET_UINT32(v) \
 	  if (maxbuf < 4) goto trunc; \
-	  if (4 != (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, 4))) \
+	  if (4 != (bytes_read = s3g_read(ctx, buf, maxbuf, 4))) \
 	       goto io_error; \
 	  memcpy(&f32.u.c, buf, 4); \
 	  buf    += bytes_read; \
@@ -361,7 +407,7 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 
 #define GET_FLOAT32(v) \
 	  if (maxbuf < 4) goto trunc; \
-	  if (4 != (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, 4))) \
+	  if (4 != (bytes_read = s3g_read(ctx, buf, maxbuf, 4))) \
 	       goto io_error; \
 	  memcpy(&f32.u.c, buf, 4); \
 	  buf    += bytes_read; \
@@ -370,7 +416,7 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 
 #define GET_UINT8(v) \
 	  if (maxbuf < 1) goto trunc; \
-	  if (1 != (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, 1))) \
+	  if (1 != (bytes_read = s3g_read(ctx, buf, maxbuf, 1))) \
 	       goto io_error; \
 	  ui8arg = buf[0]; \
 	  buf    += bytes_read; \
@@ -379,7 +425,7 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 
 #define GET_INT16(v) \
 	  if (maxbuf < 2) goto trunc; \
-	  if (2 != (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, 2))) \
+	  if (2 != (bytes_read = s3g_read(ctx, buf, maxbuf, 2))) \
 	       goto io_error; \
 	  memcpy(&f16.u.c, buf, 2); \
 	  buf    += bytes_read; \
@@ -388,7 +434,7 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 
 #define GET_UINT16(v) \
 	  if (maxbuf < 2) goto trunc; \
-	  if (2 != (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, 2))) \
+	  if (2 != (bytes_read = s3g_read(ctx, buf, maxbuf, 2))) \
 	       goto io_error; \
 	  memcpy(&f16.u.c, buf, 2); \
 	  buf    += bytes_read; \
@@ -433,7 +479,7 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
      default :
 	  // Just read the data
 	  bytes_expected = (ssize_t)(ct->cmd_len & 0x7fffffff);
-	  if ((bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf,
+	  if ((bytes_read = s3g_read(ctx, buf, maxbuf,
 					 ct->cmd_len)) != bytes_expected)
 	       goto io_error;
 
@@ -443,14 +489,14 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 
      case HOST_CMD_TOOL_COMMAND :
 	  // This command is VERY MBI specific
-	  if ((ssize_t)3 != (*ctx->read)(ctx->r_ctx, buf, maxbuf, 3))
+	  if ((ssize_t)3 != s3g_read(ctx, buf, maxbuf, 3))
 	       goto io_error;
 	  if (cmd)
 	       cmd->cmd_len = (size_t)buf[2];
 	  cmd->t.tool.subcmd_id  = buf[1];
 	  cmd->t.tool.index      = buf[0];
 	  cmd->t.tool.subcmd_len = bytes_expected = (ssize_t)buf[2];
-	  if ((bytes_read = (*ctx->read)(ctx->r_ctx, buf + 3, maxbuf - 3,
+	  if ((bytes_read = s3g_read(ctx, buf + 3, maxbuf - 3,
 					 (size_t)buf[2])) != bytes_expected)
 	       goto io_error;
 
@@ -501,6 +547,7 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 	  break;
 
      case HOST_CMD_QUEUE_POINT_NEW_EXT :
+     case HOST_CMD_QUEUE_POINT_PLANNED :
 	  // x4, y4, z4, a4, b4, dda_rate4, relative, distance 4, feedrate_mult64 2 = 31 bytes
 	  GET_INT32(queue_point_new_ext.x);
 	  GET_INT32(queue_point_new_ext.y);
@@ -511,6 +558,36 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 	  GET_UINT8(queue_point_new_ext.rel);
 	  GET_FLOAT32(queue_point_new_ext.distance);
 	  GET_INT16(queue_point_new_ext.feedrate_mult_64);
+	  if (cmd->cmd_id != HOST_CMD_QUEUE_POINT_PLANNED)
+	       break;
+
+	  // Followed by a planned_move_t of PLANNED_MOVE_SIZE bytes
+	  GET_INT16(queue_point_planned.planned.steps[0]);
+	  GET_INT16(queue_point_planned.planned.steps[1]);
+	  GET_INT16(queue_point_planned.planned.steps[2]);
+	  GET_INT16(queue_point_planned.planned.steps[3]);
+	  GET_INT16(queue_point_planned.planned.steps[4]);
+	  GET_INT32(queue_point_planned.planned.dda_rate);
+	  GET_INT32(queue_point_planned.planned.delta_mm[0]);
+	  GET_INT32(queue_point_planned.planned.delta_mm[1]);
+	  GET_INT32(queue_point_planned.planned.delta_mm[2]);
+	  GET_INT32(queue_point_planned.planned.delta_mm[3]);
+	  GET_INT32(queue_point_planned.planned.delta_mm[4]);
+	  GET_INT32(queue_point_planned.planned.millimeters);
+	  GET_INT32(queue_point_planned.planned.inverse_millimeters);
+	  GET_UINT32(queue_point_planned.planned.acceleration_st);
+	  GET_INT32(queue_point_planned.planned.acceleration);
+	  GET_INT32(queue_point_planned.planned.acceleration_rate);
+	  GET_INT32(queue_point_planned.planned.v_allowable);
+	  break;
+
+     case HOST_CMD_PLANNED_HEADER :
+	  GET_UINT8(planned_header.version);
+	  GET_UINT32(planned_header.hash);
+	  break;
+
+     case HOST_CMD_FILE_CHECKSUM :
+	  GET_UINT32(file_checksum.crc);
 	  break;
 
      case HOST_CMD_SET_POT_VALUE :
@@ -548,7 +625,7 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 	  for (;;)
 	  {
 	       unsigned char uc;
-	       if (1 != (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, 1)))
+	       if (1 != (bytes_read = s3g_read(ctx, buf, maxbuf, 1)))
 		    goto io_error;
 	       uc = buf[0];
 	       ++buf;
@@ -582,7 +659,7 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 	  for (;;)
 	  {
 	       unsigned char uc;
-	       if (1 != (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, 1)))
+	       if (1 != (bytes_read = s3g_read(ctx, buf, maxbuf, 1)))
 		    goto io_error;
 	       uc = buf[0];
 	       ++buf;
@@ -653,6 +730,70 @@ done:
      return(iret);
 }
 
+int s3g_command_read_batch(s3g_context_t *ctx, s3g_command_t *cmds,
+			   size_t maxcmds, size_t *ncmds)
+{
+     size_t n;
+     int iret;
+
+     if (ncmds)
+	  *ncmds = 0;
+
+     // An error which ended the last batch part way through
+     if (ctx && ctx->pending)
+     {
+	  iret = ctx->pending;
+	  ctx->pending = 0;
+	  return(iret);
+     }
+
+     if (!cmds || maxcmds == 0)
+     {
+	  fprintf(stderr, "s3g_command_read_batch(%d): Invalid call; cmds=%p, "
+		  "maxcmds=%lu\n", __LINE__, (void *)cmds, maxcmds);
+	  errno = EINVAL;
+	  return(-1);
+     }
+
+     iret = 0;
+     for (n = 0; n < maxcmds; n++)
+	  if ((iret = s3g_command_read_ext(ctx, cmds + n, cmds[n].cmd_raw,
+					   sizeof(cmds[n].cmd_raw), NULL)) != 0)
+	       break;
+
+     if (ncmds)
+	  *ncmds = n;
+
+     // Return the commands read before the end of the input or an error,
+     // and report it on the next call
+     if (iret != 0 && n != 0)
+     {
+	  if (iret < 0)
+	       ctx->pending = iret;
+	  iret = 0;
+     }
+
+     return(iret);
+}
+
+size_t s3g_tell(s3g_context_t *ctx)
+{
+     return(ctx ? ctx->nread : 0);
+}
+
+int s3g_seek(s3g_context_t *ctx, size_t offset)
+{
+     if (!ctx || !ctx->map || offset > ctx->map_len)
+     {
+	  errno = EINVAL;
+	  return(-1);
+     }
+
+     ctx->nread = offset;
+
+     return(0);
+}
+
 static void writef(s3g_context_t *ctx, const char *fmt, ...)
 {
 	va_list ap;
@@ -895,6 +1036,37 @@ void s3g_command_display(s3g_context_t *ctx, s3g_command_t *cmd)
 		 F(queue_point_new_ext.feedrate_mult_64));
 	  break;
 
+     case HOST_CMD_QUEUE_POINT_PLANNED :
+	  writef(ctx, "Planned move to (%d, %d, %d, %d, %d), DDA rate %d, %s relative, "
+		 "distance %f mm, feedrate*64 %d steps/s; steps (%hd, %hd, %hd, %hd, %hd), "
+		 "acceleration %u steps/s^2",
+		 F(queue_point_new_ext.x),
+		 F(queue_point_new_ext.y),
+		 F(queue_point_new_ext.z),
+		 F(queue_point_new_ext.a),
+		 F(queue_point_new_ext.b),
+		 F(queue_point_new_ext.dda_rate),
+		 axes_mask(F(queue_point_new_ext.rel), buf, sizeof(buf), 0),
+		 F(queue_point_new_ext.distance),
+		 F(queue_point_new_ext.feedrate_mult_64),
+		 F(queue_point_planned.planned.steps[0]),
+		 F(queue_point_planned.planned.steps[1]),
+		 F(queue_point_planned.planned.steps[2]),
+		 F(queue_point_planned.planned.steps[3]),
+		 F(queue_point_planned.planned.steps[4]),
+		 F(queue_point_planned.planned.acceleration_st));
+	  break;
+
+     case HOST_CMD_PLANNED_HEADER :
+	  writef(ctx, "Planned moves follow, version %hhu, planner hash 0x%08x",
+		 F(planned_header.version),
+		 F(planned_header.hash));
+	  break;
+
+     case HOST_CMD_FILE_CHECKSUM :
+	  writef(ctx, "File checksum, CRC-32 0x%08x", F(file_checksum.crc));
+	  break;
+
      case HOST_CMD_SET_POT_VALUE :
 	  writef(ctx, "Set %s axis potentiometer to %hhu",
 		 axes_names(F(digi_pot.axis), buf, sizeof(buf)),
@@ -7,6 +7,7 @@
 
 #include <inttypes.h>
 #include "Commands.hh"
+#include "PlannedBlock.hh"
 
 #ifdef __cplusplus
 extern "C" {
@@ -53,6 +54,22 @@ typedef struct {
      uint16_t feedrate_mult_64;
 } s3g_queue_point_new_ext;
 
+// A move planned ahead by s3gplan.  Begins with the same layout as
+// s3g_queue_point_new_ext, and so may be taken as one.
+typedef struct {
+     s3g_queue_point_new_ext move;
+     planned_move_t          planned;
+} s3g_queue_point_planned;
+
+typedef struct {
+     uint8_t  version;
+     uint32_t hash;
+} s3g_planned_header;
+
+typedef struct {
+     uint32_t crc;
+} s3g_file_checksum;
+
 typedef struct {
      int32_t x;
      int32_t y;
@@ -277,7 +294,7 @@ typedef struct {
 // this data structure.  You need to know from the command id
 // which member of the union to look at.
 
-#define MAX_S3G_CMD_LEN 32
+#define MAX_S3G_CMD_LEN (32 + PLANNED_MOVE_SIZE)
 
 // #define constants from the command ids are available in Commands.hh
 
@@ -292,6 +309,9 @@ typedef struct {
 	  s3g_queue_point_ext          queue_point_ext;
 	  s3g_queue_point_new          queue_point_new;
 	  s3g_queue_point_new_ext      queue_point_new_ext;
+	  s3g_queue_point_planned      queue_point_planned;
+	  s3g_planned_header           planned_header;
+	  s3g_file_checksum            file_checksum;
 	  s3g_change_tool              change_tool;
 	  s3g_enable_axes              enable_axes;
 	  s3g_set_position             set_position;
@@ -332,6 +352,7 @@ typedef struct {
 } s3g_command_t;
 
 #define S3G_INPUT_TYPE_FILE 0  // stdin or a named disk file
+#define S3G_INPUT_TYPE_MMAP 1  // named disk file, memory mapped
 
 // Obtain an s3g_context for an input source of type S3G_INPUT_TYPE_.
 // The context returned must be disposed of by calling s3g_close().
@@ -342,11 +363,17 @@ typedef struct {
 //      Input source type.  Must be one of
 //
 //         S3G_INPUT_TYPE_FILE
+//         S3G_INPUT_TYPE_MMAP
 //
 //   void *src
 //      Input source information for the selected input type
 //
 //         S3G_INPUT_TYPE_FILE -- const char *filename or NULL for stdin
+//         S3G_INPUT_TYPE_MMAP -- const char *filename.  The file is mapped
+//                                into memory and commands are decoded in
+//                                place.  stdin and other input sources which
+//                                cannot be mapped fall back to
+//                                S3G_INPUT_TYPE_FILE.
 //
 //   Return values:
 //
@@ -381,6 +408,69 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 			 unsigned char *rawbuf, size_t maxbuf, size_t *len);
 
 
+// Read up to maxcmds commands from the s3g context, storing the results in
+// the supplied array of s3g_command_t structures.  Each command's raw bytes
+// are stored in its cmd_raw field.
+//
+// Call arguments:
+//
+//   s3g_context_t *ctx
+//     Context obtained by calling s3g_open().
+//
+//   s3g_command_t *cmds
+//     Array of at least maxcmds s3g_command_t structures to store the
+//     read commands in.
+//
+//   size_t maxcmds
+//     Maximum number of commands to read.
+//
+//   size_t *ncmds
+//     Number of commands successfully read and stored in cmds.  A value
+//     less than maxcmds indicates that the end of the input was reached
+//     or that an error occurred.  May be NULL.
+//
+//  Return values:
+//
+//    0 -- Success; *ncmds commands were read.  Should the end of the
+//           input or an error follow them, it is returned by the next call
+//    1 -- End of file reached with no commands read
+//   -1 -- Read error or unrecognized command with no commands read
+//           before it
+
+int s3g_command_read_batch(s3g_context_t *ctx, s3g_command_t *cmds,
+			   size_t maxcmds, size_t *ncmds);
+
+
+// Return the offset into the input source of the next command to be read
+//
+// Call arguments:
+//
+//   s3g_context_t *ctx
+//     Context obtained by calling s3g_open().
+
+size_t s3g_tell(s3g_context_t *ctx);
+
+
+// Position a memory mapped input source so that the next command read is
+// the one starting at the given offset.  The offset should be one returned
+// by s3g_tell() for the same input.
+//
+// Call arguments:
+//
+//   s3g_context_t *ctx
+//     Context obtained by calling s3g_open() with S3G_INPUT_TYPE_MMAP.
+//
+//   size_t offset
+//     Offset into the input source.
+//
+//  Return values:
+//
+//    0 -- Success
+//   -1 -- Input source is not memory mapped or the offset is out of range
+
+int s3g_seek(s3g_context_t *ctx, size_t offset);
+
+
 // Close the s3g input source, releasing any resources
 //
 // Call arguments:
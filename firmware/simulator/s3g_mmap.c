@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "s3g_stdio.h"
+#include "s3g_mmap.h"
+
+// This driver's private context
+
+typedef struct {
+     int            fd;   // File descriptor; < 0 indicates that the file is not open
+     unsigned char *base; // Start of the mapping; NULL for an empty file
+     size_t         len;  // Length of the mapping
+} s3g_rw_mmap_ctx_t;
+
+
+// mmap_close
+//
+// Unmap and close the input source and release the allocated driver context
+//
+// Call arguments:
+//
+//   void *ctx
+//     Private driver context allocated by s3g_mmap_open().
+//
+// Return values:
+//
+//   0 -- Success
+//  -1 -- Error; check errno
+
+static s3g_close_proc_t mmap_close;
+static int mmap_close(void *ctx)
+{
+     int fd;
+     s3g_rw_mmap_ctx_t *myctx = (s3g_rw_mmap_ctx_t *)ctx;
+
+     // Sanity check
+     if (!myctx)
+     {
+	  errno = EINVAL;
+	  return(-1);
+     }
+
+     if (myctx->base)
+	  munmap(myctx->base, myctx->len);
+
+     fd = myctx->fd;
+     free(myctx);
+
+     if (fd < 0)
+     {
+	  errno = EBADF;
+	  return(-1);
+     }
+
+     return(close(fd));
+}
+
+
+// s3g_mmap_open
+// Our public open routine.  This is the only public routine for the driver.
+//
+// The file is mapped read only into our address space and the mapping is
+// handed to the s3g context via ctx->map and ctx->map_len.  Commands are
+// then decoded directly from the mapping by s3g_command_read_ext() without
+// any read() calls.  Input sources which cannot be mapped (e.g., a FIFO)
+// are handed off to the stdio driver.
+//
+// Call arguments
+//
+//   s3g_context_t *ctx
+//     s3g context to associate ourselves with.
+//
+//   void *src
+//     Input source information.  For this driver, the value is treated as
+//     a "const char *" pointer pointing to the name of a file to open in read
+//     only mode.  The file name must be the complete file name (but need not
+//     be an absolute file path).  A value of NULL (stdin) is handed off to
+//     the stdio driver.
+//
+// Return values:
+//
+//   0 -- Success
+//  -1 -- Error; check errno
+
+int s3g_mmap_open(s3g_context_t *ctx, void *src)
+{
+     s3g_rw_mmap_ctx_t *tmp;
+     const char *fname = (const char *)src;
+     struct stat sb;
+     void *base;
+     int fd;
+
+     // Sanity check
+     if (!ctx)
+     {
+	  fprintf(stderr, "s3g_mmap_open(%d): Invalid call; ctx=NULL\n", __LINE__);
+	  errno = EINVAL;
+	  return(-1);
+     }
+
+     // stdin is generally a pipe
+     if (src == NULL)
+	  return(s3g_stdio_open(ctx, src));
+
+     fd = open(fname, O_RDONLY);
+     if (fd < 0)
+     {
+	  fprintf(stderr, "s3g_open(%d): Unable to open the file \"%s\"; %s (%d)\n",
+		  __LINE__, fname, strerror(errno), errno);
+	  return(-1);
+     }
+
+     if (fstat(fd, &sb) < 0)
+     {
+	  fprintf(stderr, "s3g_open(%d): Unable to stat the file \"%s\"; %s (%d)\n",
+		  __LINE__, fname, strerror(errno), errno);
+	  close(fd);
+	  return(-1);
+     }
+
+     // Only regular files may be mapped
+     if (!S_ISREG(sb.st_mode))
+     {
+	  close(fd);
+	  return(s3g_stdio_open(ctx, src));
+     }
+
+     // mmap() refuses zero length mappings
+     base = NULL;
+     if (sb.st_size > 0)
+     {
+	  base = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	  if (base == MAP_FAILED)
+	  {
+	       fprintf(stderr, "s3g_open(%d): Unable to map the file \"%s\"; %s (%d)\n",
+		       __LINE__, fname, strerror(errno), errno);
+	       close(fd);
+	       return(-1);
+	  }
+
+	  // We only ever walk forward through the file
+	  (void)madvise(base, (size_t)sb.st_size, MADV_SEQUENTIAL);
+     }
+
+     // Allocate memory for our "driver" context
+     tmp = (s3g_rw_mmap_ctx_t *)calloc(1, sizeof(s3g_rw_mmap_ctx_t));
+     if (tmp == NULL)
+     {
+	  fprintf(stderr, "s3g_open(%d): Unable to allocate VM; %s (%d)\n",
+		  __LINE__, strerror(errno), errno);
+	  if (base)
+	       munmap(base, (size_t)sb.st_size);
+	  close(fd);
+	  return(-1);
+     }
+
+     tmp->fd   = fd;
+     tmp->base = (unsigned char *)base;
+     tmp->len  = (size_t)sb.st_size;
+
+     // All finished and happy
+     //   There's no read procedure: s3g_command_read_ext() decodes
+     //   straight out of the mapping
+     ctx->close   = mmap_close;
+     ctx->read    = NULL;
+     ctx->write   = NULL;
+     ctx->r_ctx   = tmp;
+     ctx->w_ctx   = NULL;
+     ctx->map     = base ? tmp->base : (const unsigned char *)"";
+     ctx->map_len = tmp->len;
+
+     return(0);
+}
@@ -0,0 +1,22 @@
+// s3g_mmap.h
+// Private declarations for the memory mapped file driver
+
+#ifndef S3G_MMAP_H_
+
+#define S3G_MMAP_H_
+
+#include "s3g_private.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Driver's open procedure
+
+s3g_open_proc_t s3g_mmap_open;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
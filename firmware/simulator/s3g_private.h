@@ -26,6 +26,10 @@ typedef struct {
      void             *w_ctx;    // File driver private context
      size_t            nread;    // Bytes read
      size_t            nwritten; // Bytes written
+     const unsigned char *map;   // Memory mapped input; NULL unless mapped
+     size_t            map_len;  // Length of the memory mapped input
+     int               pending;  // Error s3g_command_read_batch() has yet
+                                 //   to report, after the commands before it
 } s3g_context_t;
 #endif
 
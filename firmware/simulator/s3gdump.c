@@ -202,12 +202,16 @@ static void edensity(const s3g_command_t *cmd)
      return;
 }
 
+// Number of commands to decode per s3g_command_read_batch() call
+#define BATCH_SIZE 256
+
 int main(int argc, const char *argv[])
 {
      char c;
      s3g_context_t *ctx;
-     s3g_command_t cmd;
-     int do_edensity;
+     static s3g_command_t cmds[BATCH_SIZE];
+     size_t i, ncmds;
+     int do_edensity, istat;
 
      do_edensity = 0;
      while ((c = getopt(argc, (char **)argv, ":hE?")) != GETOPTS_END)
@@ -238,21 +242,26 @@ int main(int argc, const char *argv[])
      argv += optind;
 
      if (argc == 0)
-	  ctx = s3g_open(0, NULL);
+	  ctx = s3g_open(S3G_INPUT_TYPE_FILE, NULL);
      else
-	  ctx = s3g_open(0, (void *)argv[0]);
+	  ctx = s3g_open(S3G_INPUT_TYPE_MMAP, (void *)argv[0]);
 
      if (!ctx)
 	  // Assume that s3g_open() has complained
 	  return(1);
 
-     while (!s3g_command_read(ctx, &cmd))
+     // Print what was read before an error as well
+     do
      {
-	  if (do_edensity == 0)
-	       printf("%s (%d)\n", cmd.cmd_desc, cmd.cmd_id);
-	  else
-	       edensity(&cmd);
-     }
+	  istat = s3g_command_read_batch(ctx, cmds, BATCH_SIZE, &ncmds);
+	  for (i = 0; i < ncmds; i++)
+	  {
+	       if (do_edensity == 0)
+		    printf("%s (%d)\n", cmds[i].cmd_desc, cmds[i].cmd_id);
+	       else
+		    edensity(&cmds[i]);
+	  }
+     } while (istat == 0);
 
      s3g_close(ctx);
 
@@ -0,0 +1,338 @@
+// Tool to write the layer index of a .s3g or .x3g file, with which the
+// firmware can start a build from SD at a later layer
+//
+//     s3gindex [-l] [-m steps] [-o index-file] [-z steps-per-mm] filename
+//
+// The index is written next to the file, named as the firmware expects:
+// the last letter of the file's extension is changed to an 'i'.  See
+// src/MightyBoard/Motherboard/LayerIndex.hh for its format.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "s3g.h"
+#include "LayerIndex.hh"
+
+#if defined(__arm__)
+#define GETOPTS_END (char)-1
+#else
+#define GETOPTS_END -1
+#endif
+
+#define AXIS_COUNT 5
+#define Z_AXIS     2
+#define A_AXIS     3
+#define B_AXIS     4
+
+static void usage(FILE *f, const char *prog)
+{
+     if (f == NULL)
+	  f = stderr;
+
+     fprintf(f,
+"Usage: %s [-hl] [-m steps] [-o index-file] [-z steps-per-mm] file\n"
+"   file  -- The .s3g or .x3g file to index\n"
+"  ?, -h  -- This help message\n"
+"     -l  -- List the layers found\n"
+"     -m  -- Least change in Z steps between layers; default is 10\n"
+"     -o  -- Write the index to index-file rather than next to file\n"
+"     -z  -- Z axis steps per mm, for listing layer heights; default is 400\n",
+	     prog ? prog : "s3gindex");
+}
+
+// Name the index as the firmware looks for it
+static char *index_name(const char *fname)
+{
+     size_t len = strlen(fname);
+     char *iname;
+
+     if (len < 4 || fname[len-4] != '.')
+     {
+	  fprintf(stderr, "%s: not a .s3g or .x3g file; use -o to name the index\n",
+		  fname);
+	  return(NULL);
+     }
+
+     iname = strdup(fname);
+     if (iname)
+	  iname[len-1] = (fname[len-1] == 'G') ? 'I' : 'i';
+     return(iname);
+}
+
+static int write_index(const char *iname, size_t file_size,
+		       const layer_entry_t *entries, size_t nentries)
+{
+     layer_index_header_t header;
+     FILE *f;
+     int ok;
+
+     memset(&header, 0, sizeof(header));
+     memcpy(header.magic, LAYER_INDEX_MAGIC, sizeof(header.magic));
+     header.version    = LAYER_INDEX_VERSION;
+     header.entry_size = sizeof(layer_entry_t);
+     header.count      = (uint16_t)nentries;
+     header.file_size  = (uint32_t)file_size;
+
+     f = fopen(iname, "wb");
+     if (!f)
+     {
+	  fprintf(stderr, "Unable to create %s; %s (%d)\n",
+		  iname, strerror(errno), errno);
+	  return(-1);
+     }
+
+     ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+	  (nentries == 0 ||
+	   fwrite(entries, sizeof(layer_entry_t), nentries, f) == nentries);
+     ok = (fclose(f) == 0) && ok;
+     if (!ok)
+	  fprintf(stderr, "Error writing %s; %s (%d)\n",
+		  iname, strerror(errno), errno);
+     return(ok ? 0 : -1);
+}
+
+int main(int argc, const char *argv[])
+{
+     char c;
+     s3g_context_t *ctx;
+     s3g_command_t cmd;
+     layer_entry_t state, zchange, *entries;
+     size_t nentries, maxentries, offset, i;
+     int32_t t[AXIS_COUNT], layer_z, min_rise;
+     uint8_t rel;
+     int do_list, have_layer, istat, tool;
+     const char *iname;
+     char *iname_alloc;
+     float zsteps_mm;
+
+     do_list    = 0;
+     iname      = NULL;
+     min_rise   = 10;
+     zsteps_mm  = 400.0;
+     while ((c = getopt(argc, (char **)argv, ":hlm:o:z:?")) != GETOPTS_END)
+     {
+	  switch(c)
+	  {
+	  // Unknown switch
+	  case ':' :
+	  default :
+	       usage(stderr, argv[0]);
+	       return(1);
+
+	  // Explicit help request
+	  case 'h' :
+	  case '?' :
+	       usage(stdout, argv[0]);
+	       return(0);
+
+	  case 'l' :
+	       do_list = -1;
+	       break;
+
+	  case 'm' :
+	       min_rise = atoi(optarg);
+	       break;
+
+	  case 'o' :
+	       iname = optarg;
+	       break;
+
+	  case 'z' :
+	       zsteps_mm = (float)atof(optarg);
+	       if (zsteps_mm <= 0.0)
+	       {
+		    usage(stderr, argv[0]);
+		    return(1);
+	       }
+	       break;
+	  }
+     }
+
+     argc -= optind;
+     argv += optind;
+
+     if (argc != 1)
+     {
+	  usage(stderr, NULL);
+	  return(1);
+     }
+
+     iname_alloc = NULL;
+     if (!iname && !(iname = iname_alloc = index_name(argv[0])))
+	  return(1);
+
+     ctx = s3g_open(S3G_INPUT_TYPE_MMAP, (void *)argv[0]);
+     if (!ctx)
+	  // Assume that s3g_open() has complained
+	  return(1);
+
+     entries    = NULL;
+     nentries   = 0;
+     maxentries = 0;
+     have_layer = 0;
+     layer_z    = 0;
+     memset(&state, 0, sizeof(state));
+     zchange    = state;
+
+     // A layer begins with the command which took Z to the height at
+     // which the next extruding move is made, provided that it differs
+     // from the last layer's.  Retracts, Z hops and travel moves between
+     // layers thus stay with the layer they lead to.  Priming done at a
+     // height of its own is a layer too, often the first.
+     for (;;)
+     {
+	  offset = s3g_tell(ctx);
+	  if ((istat = s3g_command_read(ctx, &cmd)) != 0)
+	       break;
+
+	  switch (cmd.cmd_id)
+	  {
+	  default :
+	       break;
+
+	  case HOST_CMD_CHANGE_TOOL :
+	       state.tool = cmd.t.change_tool.index;
+	       break;
+
+	  case HOST_CMD_TOOL_COMMAND :
+	       tool = cmd.t.tool.index ? 1 : 0;
+	       switch (cmd.t.tool.subcmd_id)
+	       {
+	       case SLAVE_CMD_SET_TEMP :
+		    state.temperature[tool] = (int16_t)cmd.t.tool.subcmd_value;
+		    break;
+
+	       case SLAVE_CMD_SET_PLATFORM_TEMP :
+		    state.temperature[2] = (int16_t)cmd.t.tool.subcmd_value;
+		    break;
+
+	       case SLAVE_CMD_TOGGLE_FAN :
+		    if (cmd.t.tool.subcmd_value & 0x01)
+			 state.flags |= LAYER_FAN_T0 << tool;
+		    else
+			 state.flags &= ~(LAYER_FAN_T0 << tool);
+		    break;
+
+	       case SLAVE_CMD_TOGGLE_VALVE :
+		    if (cmd.t.tool.subcmd_value & 0x01)
+			 state.flags |= LAYER_FAN_EXTRA;
+		    else
+			 state.flags &= ~LAYER_FAN_EXTRA;
+		    break;
+	       }
+	       break;
+
+	  case HOST_CMD_SET_POSITION_EXT :
+	       state.position[0] = cmd.t.set_position_ext.x;
+	       state.position[1] = cmd.t.set_position_ext.y;
+	       state.position[2] = cmd.t.set_position_ext.z;
+	       state.position[3] = cmd.t.set_position_ext.a;
+	       state.position[4] = cmd.t.set_position_ext.b;
+	       break;
+
+	  // Homing leaves the position to the machine's EEPROM.  The moves
+	  // which follow it, before the first layer, settle it again.
+
+	  case HOST_CMD_QUEUE_POINT_EXT :
+	  case HOST_CMD_QUEUE_POINT_NEW :
+	  case HOST_CMD_QUEUE_POINT_NEW_EXT :
+	  case HOST_CMD_QUEUE_POINT_PLANNED :
+	       // These share a layout; see s3g.h
+	       t[0] = cmd.t.queue_point_new.x;
+	       t[1] = cmd.t.queue_point_new.y;
+	       t[2] = cmd.t.queue_point_new.z;
+	       t[3] = cmd.t.queue_point_new.a;
+	       t[4] = cmd.t.queue_point_new.b;
+	       rel  = (cmd.cmd_id == HOST_CMD_QUEUE_POINT_EXT) ? 0 :
+		    (cmd.cmd_id == HOST_CMD_QUEUE_POINT_NEW) ?
+		    cmd.t.queue_point_new.rel : cmd.t.queue_point_new_ext.rel;
+	       for (i = 0; i < AXIS_COUNT; i++)
+		    if (rel & (1 << i))
+			 t[i] += state.position[i];
+
+	       if (t[Z_AXIS] != state.position[Z_AXIS])
+	       {
+		    zchange = state;
+		    zchange.offset = (uint32_t)offset;
+	       }
+
+	       // Extruding moves are those which move both an extruder and
+	       // X or Y, as the extruders' direction depends on the machine
+	       if ((t[A_AXIS] != state.position[A_AXIS] ||
+		    t[B_AXIS] != state.position[B_AXIS]) &&
+		   (t[0] != state.position[0] || t[1] != state.position[1]) &&
+		   (!have_layer || labs((long)t[Z_AXIS] - layer_z) >= min_rise))
+	       {
+		    // The first extrusion at a new height.  Should Z never
+		    // have moved, as when it's only been set, the layer
+		    // starts here.
+		    if (zchange.offset == 0)
+		    {
+			 zchange = state;
+			 zchange.offset = (uint32_t)offset;
+		    }
+		    if (nentries >= maxentries)
+		    {
+			 size_t n = maxentries ? 2 * maxentries : 1024;
+			 layer_entry_t *tmp = (layer_entry_t *)realloc(entries,
+							 n * sizeof(layer_entry_t));
+			 if (!tmp)
+			 {
+			      fprintf(stderr, "Insufficient virtual memory\n");
+			      s3g_close(ctx);
+			      return(1);
+			 }
+			 entries    = tmp;
+			 maxentries = n;
+		    }
+		    zchange.z = t[Z_AXIS];
+		    entries[nentries++] = zchange;
+		    have_layer = -1;
+		    layer_z    = t[Z_AXIS];
+	       }
+
+	       memcpy(state.position, t, sizeof(t));
+	       break;
+	  }
+     }
+
+     if (istat < 0)
+     {
+	  fprintf(stderr, "Error reading %s at offset %lu\n",
+		  argv[0], (unsigned long)offset);
+	  s3g_close(ctx);
+	  return(1);
+     }
+
+     if (nentries > 0xffff)
+     {
+	  fprintf(stderr, "%s: only the first 65535 of %lu layers are indexed\n",
+		  argv[0], (unsigned long)nentries);
+	  nentries = 0xffff;
+     }
+
+     if (do_list)
+     {
+	  printf("layer     offset    z (mm)  tool  temperatures  fans\n");
+	  for (i = 0; i < nentries; i++)
+	       printf("%5lu %10lu  %8.3f  %4u  %3d %3d %3d   %c%c%c\n",
+		      (unsigned long)i, (unsigned long)entries[i].offset,
+		      (float)entries[i].z / zsteps_mm,
+		      entries[i].tool,
+		      entries[i].temperature[0], entries[i].temperature[1],
+		      entries[i].temperature[2],
+		      (entries[i].flags & LAYER_FAN_T0) ? '0' : '-',
+		      (entries[i].flags & LAYER_FAN_T1) ? '1' : '-',
+		      (entries[i].flags & LAYER_FAN_EXTRA) ? 'X' : '-');
+     }
+
+     istat = write_index(iname, s3g_tell(ctx), entries, nentries);
+
+     s3g_close(ctx);
+     free(entries);
+     free(iname_alloc);
+
+     return(istat ? 1 : 0);
+}
@@ -0,0 +1,311 @@
+// Tool to plan ahead the accelerated moves of a .s3g or .x3g file, so
+// that the firmware can skip that part of the planning when the build
+// is played from SD
+//
+//     s3gplan [-a x,y,z,a,b] [-e eeprom] [-m speed] infile outfile
+//
+// Each HOST_CMD_QUEUE_POINT_NEW_EXT is run through the planner and
+// rewritten as a HOST_CMD_QUEUE_POINT_PLANNED, and the file begins with
+// a HOST_CMD_PLANNED_HEADER naming the settings it was planned for.
+// See src/MightyBoard/Motherboard/PlannedBlock.hh for the format.  The
+// firmware plans a move as usual when its settings or the position it
+// starts from differ, so the planned file plays the same build either
+// way.  Index the planned file, not the original, with s3gindex.
+//
+// The settings default to those of a machine with a blank EEPROM.  For
+// the firmware to use the planning, they must match the machine's: give
+// an image of its EEPROM for its steps per mm and accelerations, and
+// its ACCELERATION_MIN_PLANNER_SPEED if that was built otherwise.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "Simulator.hh"
+#include "StepperAccelPlannerExtras.hh"
+#include "StepperAccel.hh"
+#include "Point.hh"
+#include "Steppers.hh"
+#include "StepperAccelPlanner.hh"
+#include "s3g.h"
+
+#if defined(__arm__)
+#define GETOPTS_END (char)-1
+#else
+#define GETOPTS_END -1
+#endif
+
+// Bytes of HOST_CMD_QUEUE_POINT_NEW_EXT, command id included
+#define NEW_EXT_SIZE 32
+
+static void usage(FILE *f, const char *prog)
+{
+     if (f == NULL)
+	  f = stderr;
+
+     fprintf(f,
+"Usage: %s [-h] [-a x,y,z,a,b] [-e eeprom] [-m speed] infile outfile\n"
+"       infile -- The .s3g or .x3g file to plan\n"
+"      outfile -- Where to write the planned file\n"
+" -a x,y,z,a,b -- Maximum x, y, z, a, and b accelerations (mm/s^2) of the\n"
+"                 machine the file will be printed on\n"
+"    -e eeprom -- Image of the machine's EEPROM, for its steps per mm and\n"
+"                 accelerations; -a overrides the accelerations\n"
+"     -m speed -- Minimum planner speed (mm/s) the firmware was built with;\n"
+"                 default is %d\n"
+"        ?, -h -- This help message\n",
+	     prog ? prog : "s3gplan", ACCELERATION_MIN_PLANNER_SPEED);
+}
+
+static unsigned char *put16(unsigned char *buf, uint16_t val)
+{
+     buf[0] = (unsigned char)(val & 0xff);
+     buf[1] = (unsigned char)(val >> 8);
+     return(buf + 2);
+}
+
+static unsigned char *put32(unsigned char *buf, uint32_t val)
+{
+     buf[0] = (unsigned char)(val & 0xff);
+     buf[1] = (unsigned char)((val >> 8) & 0xff);
+     buf[2] = (unsigned char)((val >> 16) & 0xff);
+     buf[3] = (unsigned char)(val >> 24);
+     return(buf + 4);
+}
+
+// Write a HOST_CMD_QUEUE_POINT_PLANNED for a move whose HOST_CMD_QUEUE_POINT_NEW_EXT
+// (or HOST_CMD_QUEUE_POINT_PLANNED) payload is in raw
+
+static int write_planned(FILE *f, const unsigned char *raw, const planned_move_t *p)
+{
+     unsigned char buf[NEW_EXT_SIZE + PLANNED_MOVE_SIZE], *ptr;
+     int i;
+
+     buf[0] = HOST_CMD_QUEUE_POINT_PLANNED;
+     memcpy(buf + 1, raw + 1, NEW_EXT_SIZE - 1);
+     ptr = buf + NEW_EXT_SIZE;
+     for (i = 0; i < STEPPER_COUNT; i++)
+	  ptr = put16(ptr, (uint16_t)p->steps[i]);
+     ptr = put32(ptr, (uint32_t)p->dda_rate);
+     for (i = 0; i < STEPPER_COUNT; i++)
+	  ptr = put32(ptr, (uint32_t)p->delta_mm[i]);
+     ptr = put32(ptr, (uint32_t)p->millimeters);
+     ptr = put32(ptr, (uint32_t)p->inverse_millimeters);
+     ptr = put32(ptr, p->acceleration_st);
+     ptr = put32(ptr, (uint32_t)p->acceleration);
+     ptr = put32(ptr, (uint32_t)p->acceleration_rate);
+     ptr = put32(ptr, (uint32_t)p->v_allowable);
+
+     return(fwrite(buf, sizeof(buf), 1, f) == 1 ? 0 : -1);
+}
+
+int main(int argc, const char *argv[])
+{
+     char c;
+     s3g_context_t *ctx;
+     s3g_command_t cmd;
+     planned_move_t rec;
+     unsigned char header[6];
+     unsigned long nmoves, nplanned;
+     int16_t vals[STEPPER_COUNT];
+     const char *eeprom_file;
+     float min_speed;
+     int have_vals, istat = 0, ok;
+     FILE *f;
+
+     eeprom_file = NULL;
+     have_vals   = 0;
+     min_speed   = -1.0;
+     while ((c = getopt(argc, (char **)argv, ":a:e:m:h?")) != GETOPTS_END)
+     {
+	  switch(c)
+	  {
+	  // Unknown switch
+	  case ':' :
+	  default :
+	       usage(stderr, argv[0]);
+	       return(1);
+
+	  // Explicit help request
+	  case 'h' :
+	  case '?' :
+	       usage(stdout, argv[0]);
+	       return(0);
+
+	  case 'a' :
+	       if (sscanf(optarg, "%hd,%hd,%hd,%hd,%hd", &vals[0], &vals[1],
+			  &vals[2], &vals[3], &vals[4]) != STEPPER_COUNT)
+	       {
+		    fprintf(stderr, "Invalid syntax for \"%s\"\n", optarg);
+		    return(1);
+	       }
+	       have_vals = -1;
+	       break;
+
+	  case 'e' :
+	       eeprom_file = optarg;
+	       break;
+
+	  case 'm' :
+	       if (sscanf(optarg, "%f", &min_speed) != 1 || min_speed < 0.0)
+	       {
+		    fprintf(stderr, "Invalid minimum planner speed \"%s\"\n", optarg);
+		    return(1);
+	       }
+	       break;
+	  }
+     }
+
+     // The EEPROM is read as the steppers are initialized
+     if (eeprom_file && !eeprom_load(eeprom_file))
+	  return(1);
+
+     steppers::init();
+     steppers::reset();
+
+     // Enable acceleration: it's off by default
+     init_extras(true);
+
+     if (have_vals)
+	  set_max_accelerations(vals);
+     if (min_speed >= 0.0)
+	  minimumPlannerSpeed = FTOFP(min_speed);
+
+     argc -= optind;
+     argv += optind;
+
+     if (argc != 2)
+     {
+	  usage(stderr, NULL);
+	  return(1);
+     }
+
+     ctx = s3g_open(S3G_INPUT_TYPE_MMAP, (void *)argv[0]);
+     if (!ctx)
+	  // Assume that s3g_open() has complained
+	  return(1);
+
+     f = fopen(argv[1], "wb");
+     if (!f)
+     {
+	  fprintf(stderr, "Unable to create %s; %s (%d)\n",
+		  argv[1], strerror(errno), errno);
+	  s3g_close(ctx);
+	  return(1);
+     }
+
+     header[0] = HOST_CMD_PLANNED_HEADER;
+     header[1] = PLANNED_MOVE_VERSION;
+     put32(header + 2, steppers::plannerHash());
+     ok = fwrite(header, sizeof(header), 1, f) == 1;
+
+     // Track the position as the firmware would, planning each move on
+     // its own.  Lookahead is left to the firmware, which plans it
+     // either way.
+     nmoves   = 0;
+     nplanned = 0;
+     while (ok && (istat = s3g_command_read(ctx, &cmd)) == 0)
+     {
+	  switch (cmd.cmd_id)
+	  {
+	  case HOST_CMD_QUEUE_POINT_NEW_EXT :
+	  case HOST_CMD_QUEUE_POINT_PLANNED :
+	  {
+	       Point target = Point(cmd.t.queue_point_new_ext.x, cmd.t.queue_point_new_ext.y,
+				    cmd.t.queue_point_new_ext.z, cmd.t.queue_point_new_ext.a,
+				    cmd.t.queue_point_new_ext.b);
+
+	       nmoves++;
+	       planner_capture = &rec;
+	       // Planned at full speed: the LCD's change of speed is applied as
+	       // the build plays
+	       steppers::setTargetNewExt(target, cmd.t.queue_point_new_ext.dda_rate,
+					 cmd.t.queue_point_new_ext.rel & 0x7f,
+					 cmd.t.queue_point_new_ext.distance,
+					 cmd.t.queue_point_new_ext.feedrate_mult_64);
+	       while (movesplanned() != 0)
+		    plan_discard_current_block();
+
+	       if (!planner_capture)
+	       {
+		    nplanned++;
+		    ok = write_planned(f, cmd.cmd_raw, &rec) == 0;
+	       }
+	       else
+	       {
+		    // Unaccelerated, no steps, or too many: leave it be
+		    planner_capture = NULL;
+		    cmd.cmd_raw[0] = HOST_CMD_QUEUE_POINT_NEW_EXT;
+		    ok = fwrite(cmd.cmd_raw, NEW_EXT_SIZE, 1, f) == 1;
+	       }
+	       continue;
+	  }
+
+	  // Planned for other settings; replaced by ours
+	  case HOST_CMD_PLANNED_HEADER :
+	       continue;
+
+	  case HOST_CMD_QUEUE_POINT_NEW :
+	  {
+	       Point target = Point(cmd.t.queue_point_new.x, cmd.t.queue_point_new.y,
+				    cmd.t.queue_point_new.z, cmd.t.queue_point_new.a,
+				    cmd.t.queue_point_new.b);
+	       steppers::setTargetNew(target, 0, cmd.t.queue_point_new.us,
+				      cmd.t.queue_point_new.rel);
+	       while (movesplanned() != 0)
+		    plan_discard_current_block();
+	       break;
+	  }
+
+	  case HOST_CMD_QUEUE_POINT_EXT :
+	  {
+	       Point target = Point(cmd.t.queue_point_ext.x, cmd.t.queue_point_ext.y,
+				    cmd.t.queue_point_ext.z, cmd.t.queue_point_ext.a,
+				    cmd.t.queue_point_ext.b);
+	       steppers::setTargetNew(target, cmd.t.queue_point_ext.dda, 0, 0);
+	       while (movesplanned() != 0)
+		    plan_discard_current_block();
+	       break;
+	  }
+
+	  case HOST_CMD_SET_POSITION_EXT :
+	  {
+	       Point target = Point(cmd.t.set_position_ext.x, cmd.t.set_position_ext.y,
+				    cmd.t.set_position_ext.z, cmd.t.set_position_ext.a,
+				    cmd.t.set_position_ext.b);
+	       steppers::definePosition(target, false);
+	       break;
+	  }
+
+	  case HOST_CMD_SET_ACCELERATION_TOGGLE :
+	       steppers::setSegmentAccelState(cmd.t.set_segment_acceleration.s != 0);
+	       break;
+
+	  default :
+	       break;
+	  }
+
+	  ok = fwrite(cmd.cmd_raw, cmd.cmd_raw_len, 1, f) == 1;
+     }
+
+     ok = (fclose(f) == 0) && ok;
+     s3g_close(ctx);
+
+     if (!ok)
+     {
+	  fprintf(stderr, "Error writing %s; %s (%d)\n",
+		  argv[1], strerror(errno), errno);
+	  return(1);
+     }
+     if (istat < 0)
+     {
+	  fprintf(stderr, "Error reading %s; planned file is incomplete\n",
+		  argv[0]);
+	  return(1);
+     }
+
+     printf("Planned %lu of %lu moves\n", nplanned, nmoves);
+     return(0);
+}
@@ -0,0 +1,192 @@
+// Tool to end a .s3g or .x3g file with a checksum, with which the
+// firmware's pre-flight scan can tell that a build reached the SD card
+// intact
+//
+//     s3gsum [-c] filename
+//
+// The file is read through command by command, and a
+// HOST_CMD_FILE_CHECKSUM holding the CRC-32 of the bytes before it is
+// written at its end, replacing the one already there.  With -c, the
+// file's checksums are checked rather than written.  See
+// src/MightyBoard/Motherboard/Preflight.hh.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "s3g.h"
+
+#if defined(__arm__)
+#define GETOPTS_END (char)-1
+#else
+#define GETOPTS_END -1
+#endif
+
+// Bytes of HOST_CMD_FILE_CHECKSUM, command id included
+#define CHECKSUM_SIZE 5
+
+static void usage(FILE *f, const char *prog)
+{
+     if (f == NULL)
+	  f = stderr;
+
+     fprintf(f,
+"Usage: %s [-ch] file\n"
+"   file  -- The .s3g or .x3g file to checksum\n"
+"  ?, -h  -- This help message\n"
+"     -c  -- Check the file's checksum rather than write it\n",
+	     prog ? prog : "s3gsum");
+}
+
+// CRC-32 as zlib computes it, less the final inversion
+static uint32_t crc32_add(uint32_t crc, const unsigned char *buf, size_t len)
+{
+     int i;
+
+     while (len-- > 0)
+     {
+	  crc ^= *buf++;
+	  for (i = 0; i < 8; i++)
+	       crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : (crc >> 1);
+     }
+     return(crc);
+}
+
+int main(int argc, const char *argv[])
+{
+     char c;
+     s3g_context_t *ctx;
+     s3g_command_t cmd;
+     unsigned char trailer[CHECKSUM_SIZE];
+     size_t offset, end;
+     uint32_t crc, before;
+     int do_check, istat, nsums, nbad, last_sum, last_bad;
+     FILE *f;
+
+     do_check = 0;
+     while ((c = getopt(argc, (char **)argv, ":ch?")) != GETOPTS_END)
+     {
+	  switch(c)
+	  {
+	  // Unknown switch
+	  case ':' :
+	  default :
+	       usage(stderr, argv[0]);
+	       return(1);
+
+	  // Explicit help request
+	  case 'h' :
+	  case '?' :
+	       usage(stdout, argv[0]);
+	       return(0);
+
+	  case 'c' :
+	       do_check = -1;
+	       break;
+	  }
+     }
+
+     argc -= optind;
+     argv += optind;
+
+     if (argc != 1)
+     {
+	  usage(stderr, NULL);
+	  return(1);
+     }
+
+     ctx = s3g_open(S3G_INPUT_TYPE_MMAP, (void *)argv[0]);
+     if (!ctx)
+	  // Assume that s3g_open() has complained
+	  return(1);
+
+     // The file is framed into commands as it's read, so that a file
+     // which is cut short or garbled doesn't get a checksum
+     crc      = 0xffffffff;
+     before   = crc;
+     offset   = 0;
+     end      = 0;
+     nsums    = 0;
+     nbad     = 0;
+     last_sum = 0;
+     last_bad = 0;
+     while ((istat = s3g_command_read(ctx, &cmd)) == 0)
+     {
+	  before   = crc;
+	  last_sum = cmd.cmd_id == HOST_CMD_FILE_CHECKSUM;
+	  last_bad = last_sum && cmd.t.file_checksum.crc != ~before;
+	  if (last_sum)
+	  {
+	       nsums++;
+	       if (last_bad)
+	       {
+		    nbad++;
+		    if (do_check)
+			 printf("Bad checksum at offset %lu: 0x%08x, should be 0x%08x\n",
+				(unsigned long)offset, cmd.t.file_checksum.crc, ~before);
+	       }
+	  }
+	  crc    = crc32_add(crc, cmd.cmd_raw, cmd.cmd_raw_len);
+	  offset = s3g_tell(ctx);
+	  end    = last_sum ? offset - CHECKSUM_SIZE : offset;
+     }
+     s3g_close(ctx);
+
+     if (istat < 0)
+     {
+	  fprintf(stderr, "Error reading %s at offset %lu\n",
+		  argv[0], (unsigned long)offset);
+	  return(1);
+     }
+
+     if (do_check)
+     {
+	  if (nsums == 0)
+	  {
+	       printf("%s has no checksum\n", argv[0]);
+	       return(1);
+	  }
+	  if (nbad != 0)
+	       return(1);
+	  printf("%s checksum ok\n", argv[0]);
+	  return(0);
+     }
+
+     // A checksum other than the last one must be right already, as the
+     // last one doesn't cover it
+     if (nbad > last_bad)
+     {
+	  fprintf(stderr, "%s has a bad checksum before its end\n", argv[0]);
+	  return(1);
+     }
+
+     // Write the checksum after the last command, over the checksum
+     // already there if that's what it is
+     if (!last_sum)
+	  before = crc;
+     trailer[0] = HOST_CMD_FILE_CHECKSUM;
+     trailer[1] = (unsigned char)(~before & 0xff);
+     trailer[2] = (unsigned char)((~before >> 8) & 0xff);
+     trailer[3] = (unsigned char)((~before >> 16) & 0xff);
+     trailer[4] = (unsigned char)(~before >> 24);
+
+     f = fopen(argv[0], "r+b");
+     if (!f)
+     {
+	  fprintf(stderr, "Unable to open %s for writing; %s (%d)\n",
+		  argv[0], strerror(errno), errno);
+	  return(1);
+     }
+     istat = fseek(f, (long)end, SEEK_SET) == 0 &&
+	  fwrite(trailer, sizeof(trailer), 1, f) == 1;
+     if ((fclose(f) != 0) || !istat)
+     {
+	  fprintf(stderr, "Error writing %s; %s (%d)\n",
+		  argv[0], strerror(errno), errno);
+	  return(1);
+     }
+
+     printf("%s checksum 0x%08x\n", argv[0], ~before);
+     return(0);
+}
@@ -0,0 +1,8 @@
+// sailtime needs the stepper axes compiled with -DSAILTIME so that they
+// agree with sailtime_planner.cc on the layout of block_t
+
+#ifndef SAILTIME
+#define SAILTIME
+#endif
+
+#include "StepperAxis.cc"
@@ -0,0 +1,8 @@
+// sailtime needs a planner.o file compiled with -DSAILTIME: its blocks
+// carry no diagnostic messages and its math skips the overflow checks
+
+#ifndef SAILTIME
+#define SAILTIME
+#endif
+
+#include "StepperAccelPlanner.cc"
@@ -0,0 +1,541 @@
+// sdemu.cc
+// SD card emulator for the SPI bus; see sdemu.hh
+//
+// Models the SPI mode command set that lib_sd/sd_raw.c uses: reset and
+// identification, single and multiple block reads and writes, ACMD23
+// pre-erase, CID/CSD and status.  Time only advances as bytes are
+// clocked or as sdemu_idle() is called, and a card which is reading or
+// programming a block answers 0xff or 0x00 until it is done.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdemu.hh"
+
+sdemu_timing_t sdemu_timing = {
+	8,      // 1 MHz SPI: f_OSC / 16 as set by sd_raw_init()
+	300,
+	30,
+	1000,
+	500,
+	250,
+	100
+};
+
+sdemu_stats_t sdemu_stats;
+
+// Simulated time in microseconds, which unlike sdemu_stats.time isn't
+// reset with the statistics
+static uint64_t now = 0;
+
+enum card_mode {
+	COMMAND,        // waiting for a command
+	READ,           // sending the blocks of a read
+	WRITE_TOKEN,    // waiting for the start of a block to write
+	WRITE_DATA      // receiving a block to write
+};
+
+// The image is kept in chunks, allocated as they are first touched
+#define CHUNK_SIZE 0x10000
+
+static uint8_t **chunks = 0;
+static uint32_t chunk_count = 0;
+static uint64_t image_size = 0;
+static uint8_t card_type;
+static bool present = false;
+static bool selected = false;
+
+static card_mode mode = COMMAND;
+static bool idle = true;          // card still in its idle state
+static bool app_cmd = false;      // last command was CMD55
+static bool crc_on = false;
+static uint8_t init_tries = 0;
+
+static uint8_t cmd[6];
+static uint8_t cmd_len = 0;
+
+// What the card has to say, in order
+static uint8_t out[600];
+static uint16_t out_head = 0, out_len = 0;
+
+static bool multi = false;        // multiple block read or write
+static uint64_t address;          // byte address of the next block
+static uint64_t ready_at = 0;     // read data or programming done
+static uint32_t erase_count = 0;  // blocks pre-erased by ACMD23
+
+static uint8_t block[514];
+static uint16_t block_len = 0;
+
+static uint8_t crc7(const uint8_t *data, uint8_t len)
+{
+	uint8_t crc = 0;
+	while ( len-- ) {
+		uint8_t d = *data++;
+		for ( uint8_t i = 0; i < 8; i++ ) {
+			crc <<= 1;
+			if ( (d & 0x80) ^ (crc & 0x80) )
+				crc ^= 0x09;
+			d <<= 1;
+		}
+	}
+	return (uint8_t)((crc << 1) | 1);
+}
+
+static uint16_t crc16(const uint8_t *data, uint16_t len)
+{
+	uint16_t crc = 0;
+	while ( len-- ) {
+		crc ^= (uint16_t)*data++ << 8;
+		for ( uint8_t i = 0; i < 8; i++ )
+			crc = ( crc & 0x8000 ) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+static void push(uint8_t b)
+{
+	if ( out_len < sizeof(out) )
+		out[(out_head + out_len++) % sizeof(out)] = b;
+}
+
+static void push_block(const uint8_t *data, uint16_t len)
+{
+	uint16_t crc = crc16(data, len);
+	push(0xfe);
+	for ( uint16_t i = 0; i < len; i++ )
+		push(data[i]);
+	push(crc >> 8);
+	push(crc & 0xff);
+}
+
+static uint8_t r1(uint8_t bits)
+{
+	return bits | ( idle ? 0x01 : 0x00 );
+}
+
+static void make_csd(uint8_t *csd)
+{
+	memset(csd, 0, 16);
+	if ( card_type == SDEMU_SDHC ) {
+		// CSD version 2.0: capacity is (C_SIZE + 1) * 512 KB
+		uint32_t c_size = (uint32_t)(image_size / (512 * 1024)) - 1;
+		csd[0] = 0x40;
+		csd[5] = 0x59;                 // READ_BL_LEN 9
+		csd[7] = (c_size >> 16) & 0x3f;
+		csd[8] = (c_size >> 8) & 0xff;
+		csd[9] = c_size & 0xff;
+	}
+	else {
+		// CSD version 1.0 with 512 byte blocks and C_SIZE_MULT 7
+		uint32_t c_size = (uint32_t)(image_size / (512 * 512)) - 1;
+		csd[5] = 0x59;
+		csd[6] = (c_size >> 10) & 0x03;
+		csd[7] = (c_size >> 2) & 0xff;
+		csd[8] = (c_size & 0x03) << 6;
+		csd[9] = 0x03;
+		csd[10] = 0x80;
+	}
+	csd[15] = crc7(csd, 15);
+}
+
+// Check a block address and convert it to a byte offset
+static bool block_address(uint32_t arg, uint64_t *offset)
+{
+	*offset = ( card_type == SDEMU_SDHC ) ? (uint64_t)arg * 512 : arg;
+	return ( (*offset & 0x1ff) == 0 ) && ( *offset + 512 <= image_size );
+}
+
+static void command()
+{
+	uint8_t index = cmd[0] & 0x3f;
+	uint32_t arg = ((uint32_t)cmd[1] << 24) | ((uint32_t)cmd[2] << 16) |
+		((uint32_t)cmd[3] << 8) | cmd[4];
+	bool app = app_cmd;
+
+	app_cmd = false;
+	sdemu_stats.commands[index]++;
+
+	// Whatever the card had left to say is dropped
+	out_len = 0;
+
+	// A command ends a multiple block read; CMD12 is the one meant for it
+	if ( mode == READ ) {
+		mode = COMMAND;
+		if ( index == 12 ) {
+			push(0xff);          // stuff byte
+			push(r1(0));
+			ready_at = sdemu_stats.time + sdemu_timing.stop;
+			return;
+		}
+	}
+
+	if ( crc_on || index == 0 || index == 8 ) {
+		if ( crc7(cmd, 5) != cmd[5] ) {
+			sdemu_stats.crc_errors++;
+			push(0xff);
+			push(r1(0x08));
+			return;
+		}
+	}
+
+	// Commands are answered after one byte
+	push(0xff);
+
+	if ( app ) {
+		switch ( index ) {
+		case 41:
+			// Report ready on the second try
+			if ( ++init_tries >= 2 )
+				idle = false;
+			push(r1(0));
+			return;
+		case 23:
+			erase_count = arg & 0x7fffff;
+			push(r1(0));
+			return;
+		default:
+			break;
+		}
+	}
+
+	switch ( index ) {
+	case 0:
+		idle = true;
+		init_tries = 0;
+		crc_on = false;
+		multi = false;
+		erase_count = 0;
+		push(r1(0));
+		break;
+
+	case 8:
+		if ( card_type == SDEMU_SD1 ) {
+			push(r1(0x04));
+			break;
+		}
+		push(r1(0));
+		push(0x00);
+		push(0x00);
+		push((arg >> 8) & 0x0f);
+		push(arg & 0xff);
+		break;
+
+	case 9: case 10: {
+		uint8_t reg[16];
+		if ( index == 9 )
+			make_csd(reg);
+		else {
+			memset(reg, 0, sizeof(reg));
+			memcpy(reg + 1, "SDEMU", 5);
+			reg[15] = crc7(reg, 15);
+		}
+		push(r1(0));
+		push(0xff);
+		push_block(reg, sizeof(reg));
+		break;
+	}
+
+	case 12:
+		push(r1(0x04));
+		break;
+
+	case 13:
+		push(r1(0));
+		push(0x00);
+		break;
+
+	case 16:
+		push(r1(arg == 512 ? 0 : 0x40));
+		break;
+
+	case 17: case 18:
+		if ( idle || !block_address(arg, &address) ) {
+			push(r1(0x40));
+			break;
+		}
+		push(r1(0));
+		multi = ( index == 18 );
+		mode = READ;
+		ready_at = sdemu_stats.time + sdemu_timing.read_access;
+		break;
+
+	case 24: case 25:
+		if ( idle || !block_address(arg, &address) ) {
+			push(r1(0x40));
+			break;
+		}
+		push(r1(0));
+		multi = ( index == 25 );
+		if ( !multi )
+			erase_count = 0;
+		mode = WRITE_TOKEN;
+		break;
+
+	case 55:
+		app_cmd = true;
+		push(r1(0));
+		break;
+
+	case 58:
+		push(r1(0));
+		push(0x80 | ( card_type == SDEMU_SDHC ? 0x40 : 0x00 ));
+		push(0xff);
+		push(0x80);
+		push(0x00);
+		break;
+
+	case 59:
+		crc_on = arg & 1;
+		push(r1(0));
+		break;
+
+	default:
+		push(r1(0x04));
+		break;
+	}
+}
+
+// The card receives a byte
+static void receive(uint8_t b)
+{
+	switch ( mode ) {
+	case COMMAND:
+	case READ:
+		if ( cmd_len == 0 && (b & 0xc0) != 0x40 )
+			return;
+		cmd[cmd_len++] = b;
+		if ( cmd_len == 6 ) {
+			cmd_len = 0;
+			command();
+		}
+		return;
+
+	case WRITE_TOKEN:
+		if ( multi && b == 0xfd ) {
+			// Stop token: the card is busy a moment, then takes commands
+			mode = COMMAND;
+			erase_count = 0;
+			push(0xff);
+			ready_at = sdemu_stats.time + sdemu_timing.stop;
+			return;
+		}
+		if ( b == ( multi ? 0xfc : 0xfe ) ) {
+			block_len = 0;
+			mode = WRITE_DATA;
+		}
+		return;
+
+	case WRITE_DATA:
+		block[block_len++] = b;
+		if ( block_len < sizeof(block) )
+			return;
+
+		if ( crc_on && crc16(block, 512) != (((uint16_t)block[512] << 8) | block[513]) ) {
+			sdemu_stats.crc_errors++;
+			push(0x0b);
+			mode = multi ? WRITE_TOKEN : COMMAND;
+			return;
+		}
+
+		memcpy(sdemu_block(address), block, 512);
+		address += 512;
+		sdemu_stats.blocks_written++;
+		push(0x05);
+
+		uint32_t program = multi ? sdemu_timing.write_multi : sdemu_timing.write_single;
+		if ( erase_count ) {
+			erase_count--;
+			program = sdemu_timing.write_erased;
+		}
+		ready_at = sdemu_stats.time + program;
+		sdemu_stats.busy_time += program;
+
+		if ( multi && address + 512 <= image_size )
+			mode = WRITE_TOKEN;
+		else
+			mode = COMMAND;
+		return;
+	}
+}
+
+// The byte the card sends
+static uint8_t send()
+{
+	if ( out_len ) {
+		uint8_t b = out[out_head];
+		out_head = (out_head + 1) % sizeof(out);
+		out_len--;
+		return b;
+	}
+
+	if ( sdemu_stats.time < ready_at ) {
+		// Reading a block shows as idle bus, programming one as busy
+		sdemu_stats.wait_bytes++;
+		return ( mode == READ ) ? 0xff : 0x00;
+	}
+
+	if ( mode == READ ) {
+		push_block(sdemu_block(address), 512);
+		address += 512;
+		sdemu_stats.blocks_read++;
+		if ( multi && address + 512 <= image_size )
+			ready_at = sdemu_stats.time + sdemu_timing.read_next;
+		else
+			mode = COMMAND;
+		return send();
+	}
+
+	return 0xff;
+}
+
+uint8_t sdemu_exchange(uint8_t b)
+{
+	sdemu_stats.bytes++;
+	sdemu_stats.time += sdemu_timing.spi_byte;
+	now += sdemu_timing.spi_byte;
+
+	if ( !present || !selected )
+		return 0xff;
+
+	uint8_t in = send();
+	receive(b);
+	return in;
+}
+
+void sdemu_select(bool sel)
+{
+	selected = sel;
+}
+
+void sdemu_idle(uint32_t us)
+{
+	sdemu_stats.time += us;
+	now += us;
+}
+
+uint32_t sdemu_centa_micros()
+{
+	return (uint32_t)( now / 100 );
+}
+
+void sdemu_insert(bool p)
+{
+	present = p && chunks != 0;
+	mode = COMMAND;
+	idle = true;
+	app_cmd = false;
+	cmd_len = 0;
+	out_len = 0;
+	ready_at = 0;
+}
+
+bool sdemu_present()
+{
+	return present;
+}
+
+void sdemu_reset_stats()
+{
+	memset(&sdemu_stats, 0, sizeof(sdemu_stats));
+	ready_at = 0;
+}
+
+uint8_t *sdemu_block(uint64_t offset)
+{
+	if ( offset + 512 > image_size )
+		return 0;
+
+	uint8_t **chunk = &chunks[offset / CHUNK_SIZE];
+	if ( !*chunk ) {
+		*chunk = (uint8_t *)calloc(1, CHUNK_SIZE);
+		if ( !*chunk ) {
+			fprintf(stderr, "sdemu: out of memory\n");
+			exit(1);
+		}
+	}
+	return *chunk + ( offset & ~(uint64_t)0x1ff & ( CHUNK_SIZE - 1 ) );
+}
+
+uint64_t sdemu_size()
+{
+	return image_size;
+}
+
+bool sdemu_create(uint64_t size, uint8_t type)
+{
+	sdemu_close();
+
+	size &= ~(uint64_t)( 512 * 1024 - 1 );
+	if ( size == 0 )
+		return false;
+	chunk_count = (uint32_t)( ( size + CHUNK_SIZE - 1 ) / CHUNK_SIZE );
+	chunks = (uint8_t **)calloc(chunk_count ? chunk_count : 1, sizeof(uint8_t *));
+	if ( !chunks )
+		return false;
+
+	image_size = size;
+	card_type = type;
+	sdemu_reset_stats();
+	sdemu_insert(true);
+	return true;
+}
+
+bool sdemu_open(const char *name, uint8_t type)
+{
+	FILE *f = fopen(name, "rb");
+	if ( !f )
+		return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	rewind(f);
+
+	if ( size < 0 || !sdemu_create((uint64_t)size, type) ) {
+		fclose(f);
+		return false;
+	}
+
+	// Chunks which are all zeroes stay unallocated
+	static uint8_t buf[CHUNK_SIZE];
+	for ( uint32_t i = 0; i < chunk_count; i++ ) {
+		size_t n = fread(buf, 1, CHUNK_SIZE, f);
+		size_t j = 0;
+		while ( j < n && buf[j] == 0 )
+			j++;
+		if ( j < n ) {
+			uint8_t *chunk = sdemu_block((uint64_t)i * CHUNK_SIZE);
+			memcpy(chunk, buf, n);
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+bool sdemu_save(const char *name)
+{
+	static const uint8_t zeroes[CHUNK_SIZE] = { 0 };
+
+	FILE *f = fopen(name, "wb");
+	if ( !f )
+		return false;
+
+	bool ok = true;
+	for ( uint32_t i = 0; ok && i < chunk_count; i++ ) {
+		uint64_t n = image_size - (uint64_t)i * CHUNK_SIZE;
+		if ( n > CHUNK_SIZE )
+			n = CHUNK_SIZE;
+		ok = fwrite(chunks[i] ? chunks[i] : zeroes, 1, n, f) == n;
+	}
+	return ( fclose(f) == 0 ) && ok;
+}
+
+void sdemu_close()
+{
+	for ( uint32_t i = 0; i < chunk_count; i++ )
+		free(chunks[i]);
+	free(chunks);
+	chunks = 0;
+	chunk_count = 0;
+	image_size = 0;
+	present = false;
+}
@@ -0,0 +1,88 @@
+// sdemu.hh
+// An SD card on the far end of the SPI bus, emulated in software and
+// backed by a disk image, so that lib_sd can run and be measured on a PC.
+// When built with -DSIMULATOR, lib_sd/sd_raw.c clocks every byte through
+// sdemu_exchange() and reads the card detect switch from sdemu_present().
+
+#ifndef SDEMU_HH_
+#define SDEMU_HH_
+
+#include <stdint.h>
+
+#define SDEMU_SDHC  0   // SD 2 high capacity card, addressed by block
+#define SDEMU_SD2   1   // SD 2 standard capacity card, addressed by byte
+#define SDEMU_SD1   2   // SD 1 card
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Card timing, all in microseconds
+typedef struct {
+	uint32_t spi_byte;       // time to clock one byte over SPI
+	uint32_t read_access;    // a read command until its data is ready
+	uint32_t read_next;      // between blocks of a multiple block read
+	uint32_t write_single;   // programming a block of a single block write
+	uint32_t write_multi;    // programming a block of a multiple block write
+	uint32_t write_erased;   // ... when the block was pre-erased by ACMD23
+	uint32_t stop;           // ending a multiple block read or write
+} sdemu_timing_t;
+
+typedef struct {
+	uint32_t commands[64];   // commands received, by index; ACMDs at
+	                         // their index like the CMDs they shadow
+	uint32_t bytes;          // bytes clocked over SPI
+	uint32_t wait_bytes;     // ... while the card was reading or busy
+	uint32_t blocks_read;
+	uint32_t blocks_written;
+	uint32_t crc_errors;     // commands or blocks with a bad CRC
+	uint64_t time;           // simulated time in microseconds
+	uint64_t busy_time;      // time spent programming blocks
+} sdemu_stats_t;
+
+extern sdemu_timing_t sdemu_timing;
+extern sdemu_stats_t sdemu_stats;
+
+// Insert a blank card of the given size in bytes, a multiple of 512 KB;
+// the image is held sparsely so that an SDHC sized card costs only the
+// blocks written to it
+bool sdemu_create(uint64_t size, uint8_t type);
+
+// Load the image and insert the card; false if the file can not be read
+bool sdemu_open(const char *image, uint8_t type);
+
+// Write the card's contents to an image file
+bool sdemu_save(const char *image);
+
+// Remove the card and free its image
+void sdemu_close();
+
+// The 512 byte block at the given byte offset, for preparing or checking
+// the image behind the firmware's back; 0 if past the end of the card
+uint8_t *sdemu_block(uint64_t offset);
+uint64_t sdemu_size();
+
+// Insert or remove the card without losing its contents
+void sdemu_insert(bool present);
+bool sdemu_present();
+
+// Chip select
+void sdemu_select(bool selected);
+
+// Clock one byte out to the card and return the byte clocked in
+uint8_t sdemu_exchange(uint8_t out);
+
+// Let time pass without SPI traffic, as while the firmware does other work
+void sdemu_idle(uint32_t us);
+
+// The simulated time in units of 100 microseconds, standing in for the
+// firmware's Motherboard::getCurrentCentaMicros() clock
+uint32_t sdemu_centa_micros();
+
+void sdemu_reset_stats();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SDEMU_HH_
@@ -0,0 +1,607 @@
+// SD card playback benchmark: runs the firmware's SD card code, lib_sd
+// and SDCard.cc, against an emulated card (sdemu.cc) and reports what
+// printing from it costs on the SPI bus
+//
+//     sdplay [-chrv] [-i image] [-k cluster-kb] [-o image] [-s card-mb]
+//            [-t sdhc|sd2|sd1] [-w us] file ...
+//
+// Without -i, a blank card is formatted, FAT32 for an SDHC card and
+// FAT16 otherwise, and each file is copied to it through lib_sd.  With
+// -i, the card is loaded from a disk image and the files are named as
+// they are on the card.  Each file is then played back a byte at a time
+// through sdcard::startPlayback() and playbackNext(), as the command
+// buffer is fed during a print, with playbackReadAhead() refilling the
+// read-ahead whenever it runs dry.  The SD commands, bytes clocked over
+// SPI and simulated time are reported for the copy and for the playback,
+// as are the read-ahead's counters.
+//
+// With -w, each byte played back costs that many microseconds of other
+// work, during which the card may read ahead or finish programming.
+// With -c, sdplay exits non-zero unless each file plays back exactly as
+// it was copied and the playback streams its blocks, rather than
+// issuing a read command for each one, and unless reads and seeks part
+// way through the file, as starting a build at a later layer does them,
+// find the right bytes, unless the pre-flight scan finds the file sound
+// without disturbing its playback, and unless pulling the card part way
+// through ends playback with the card reported missing.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sdemu.hh"
+#include "SDCard.hh"
+#include "Preflight.hh"
+#include "Eeprom.hh"
+#include "EepromMap.hh"
+#include "lib_sd/sd_raw.h"
+#include "lib_sd/partition.h"
+#include "lib_sd/fat.h"
+
+#if defined(__arm__)
+#define GETOPTS_END (char)-1
+#else
+#define GETOPTS_END -1
+#endif
+
+// Where the partition starts: 4 MB in, as SD cards come formatted
+#define PARTITION_START 8192
+
+// Bytes played back in each pass of the command loop, about one move
+#define SLICE_BYTES 32
+
+static bool use_crc = false;
+static int verbose = 0;
+
+// SDCard.cc reads the CRC setting from the EEPROM
+namespace eeprom {
+uint8_t getEeprom8(const uint16_t location, const uint8_t default_value)
+{
+     return (location == eeprom_offsets::SD_USE_CRC) ? (use_crc ? 1 : 0) :
+	  default_value;
+}
+}
+
+static void usage(FILE *f, const char *prog)
+{
+     if (f == NULL)
+	  f = stderr;
+
+     fprintf(f,
+"Usage: %s [-chrv] [-i image] [-k cluster-kb] [-o image] [-s card-mb]\n"
+"           [-t sdhc|sd2|sd1] [-w us] file ...\n"
+"       file  -- s3g or x3g file to copy to the card and play back; with -i,\n"
+"                the name of a file on the card\n"
+"      ?, -h  -- This help message\n"
+"         -c  -- Check that each file plays back as copied, that its\n"
+"                blocks are streamed, that it passes the pre-flight scan\n"
+"                and that pulling the card ends its playback\n"
+"   -i image  -- Load the card from a disk image rather than formatting it\n"
+"-k cluster-kb -- Cluster size when formatting (default 32)\n"
+"   -o image  -- Save the card to a disk image when done\n"
+"         -r  -- Have the firmware use CRCs, as with SD_USE_CRC set\n"
+"-s card-mb   -- Card size when formatting (default 4096 for SDHC, else 1024)\n"
+"-t type      -- Card type: sdhc, sd2 or sd1 (default sdhc)\n"
+"      -w us  -- Microseconds of other work per byte played back (default 0)\n"
+"         -v  -- Print each SD command's count\n",
+	     prog ? prog : "sdplay");
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+     p[0] = v & 0xff;
+     p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+     put16(p, v & 0xffff);
+     put16(p + 2, v >> 16);
+}
+
+// Set a FAT entry in both copies of the FAT
+static void fat_entry(uint64_t fat, uint32_t fat_sectors, bool fat32,
+		      uint32_t cluster, uint32_t value)
+{
+     uint32_t offset = cluster * (fat32 ? 4 : 2);
+
+     for (int copy = 0; copy < 2; copy++) {
+	  uint64_t at = fat + ((uint64_t)copy * fat_sectors * 512) + offset;
+	  uint8_t *block = sdemu_block(at & ~(uint64_t)0x1ff);
+	  if (fat32)
+	       put32(block + (at & 0x1ff), value);
+	  else
+	       put16(block + (at & 0x1ff), (uint16_t)value);
+     }
+}
+
+// Partition and format the card in the emulator, as SD Formatter would.
+// Returns false if the card and cluster sizes don't make a FAT16 or a
+// FAT32 volume that lib_sd accepts.
+static bool format(bool fat32, uint32_t cluster_kb)
+{
+     uint32_t total = (uint32_t)(sdemu_size() / 512) - PARTITION_START;
+     uint32_t spc = cluster_kb * 2;
+     uint32_t reserved = fat32 ? 32 : 1;
+     uint32_t root_sectors = fat32 ? 0 : 32;  // 512 entries
+     uint32_t entry = fat32 ? 4 : 2;
+
+     if (spc == 0 || spc > 64 || (spc & (spc - 1)))
+	  return false;
+
+     // The FAT must cover the clusters left over after the FATs
+     uint32_t fat_sectors = 1, clusters;
+     for (;;) {
+	  clusters = (total - reserved - root_sectors - 2 * fat_sectors) / spc;
+	  uint32_t need = ((clusters + 2) * entry + 511) / 512;
+	  if (need <= fat_sectors)
+	       break;
+	  fat_sectors = need;
+     }
+     if (fat32 ? clusters < 65525 : (clusters < 4085 || clusters >= 65525))
+	  return false;
+
+     // Master boot record with the one partition
+     uint8_t *mbr = sdemu_block(0);
+     uint8_t *part = mbr + 0x1be;
+     part[1] = 0xfe;
+     part[2] = part[3] = 0xff;
+     part[4] = fat32 ? PARTITION_TYPE_FAT32_LBA : PARTITION_TYPE_FAT16;
+     part[5] = 0xfe;
+     part[6] = part[7] = 0xff;
+     put32(part + 8, PARTITION_START);
+     put32(part + 12, total);
+     mbr[0x1fe] = 0x55;
+     mbr[0x1ff] = 0xaa;
+
+     uint64_t start = (uint64_t)PARTITION_START * 512;
+     uint8_t *boot = sdemu_block(start);
+     boot[0] = 0xeb;
+     boot[1] = fat32 ? 0x58 : 0x3c;
+     boot[2] = 0x90;
+     memcpy(boot + 3, "MSDOS5.0", 8);
+     put16(boot + 0x0b, 512);
+     boot[0x0d] = (uint8_t)spc;
+     put16(boot + 0x0e, (uint16_t)reserved);
+     boot[0x10] = 2;
+     put16(boot + 0x11, fat32 ? 0 : 512);
+     boot[0x15] = 0xf8;
+     put16(boot + 0x18, 63);
+     put16(boot + 0x1a, 255);
+     put32(boot + 0x1c, PARTITION_START);
+     put32(boot + 0x20, total);
+     if (fat32) {
+	  put32(boot + 0x24, fat_sectors);
+	  put32(boot + 0x2c, 2);            // root directory cluster
+	  put16(boot + 0x30, 1);            // FS information sector
+	  put16(boot + 0x32, 6);            // backup boot sector
+	  boot[0x40] = 0x80;
+	  boot[0x42] = 0x29;
+	  memcpy(boot + 0x47, "NO NAME    FAT32   ", 19);
+
+	  uint8_t *info = sdemu_block(start + 512);
+	  put32(info, 0x41615252);
+	  put32(info + 0x1e4, 0x61417272);
+	  put32(info + 0x1e8, 0xffffffff);
+	  put32(info + 0x1ec, 0xffffffff);
+	  put32(info + 0x1fc, 0xaa550000);
+	  memcpy(sdemu_block(start + 6 * 512), boot, 512);
+     }
+     else {
+	  put16(boot + 0x16, (uint16_t)fat_sectors);
+	  boot[0x24] = 0x80;
+	  boot[0x26] = 0x29;
+	  memcpy(boot + 0x2b, "NO NAME    FAT16   ", 19);
+     }
+     boot[0x1fe] = 0x55;
+     boot[0x1ff] = 0xaa;
+
+     uint64_t fat = start + (uint64_t)reserved * 512;
+     fat_entry(fat, fat_sectors, fat32, 0, fat32 ? 0x0ffffff8 : 0xfff8);
+     fat_entry(fat, fat_sectors, fat32, 1, fat32 ? 0x0fffffff : 0xffff);
+     if (fat32)
+	  fat_entry(fat, fat_sectors, fat32, 2, 0x0fffffff);
+
+     if (verbose)
+	  printf("Formatted FAT%d: %u clusters of %u KB, %u sectors per FAT\n",
+		 fat32 ? 32 : 16, clusters, cluster_kb, fat_sectors);
+     return true;
+}
+
+static void print_stats(const char *what, uint32_t length)
+{
+     uint32_t reads = sdemu_stats.commands[17] + sdemu_stats.commands[18];
+     uint32_t writes = sdemu_stats.commands[24] + sdemu_stats.commands[25];
+
+     printf("    %-9s %5u blocks read %5u written, %5u read commands %5u write commands\n",
+	    what, sdemu_stats.blocks_read, sdemu_stats.blocks_written,
+	    reads, writes);
+     printf("              %8u SPI bytes", sdemu_stats.bytes);
+     if (length)
+	  printf(" (%.3f per byte)", (double)sdemu_stats.bytes / length);
+     printf(", %u waiting, %.1f ms\n", sdemu_stats.wait_bytes,
+	    sdemu_stats.time / 1000.0);
+     if (verbose) {
+	  printf("             ");
+	  for (int i = 0; i < 64; i++)
+	       if (sdemu_stats.commands[i])
+		    printf(" CMD%d x%u", i, sdemu_stats.commands[i]);
+	  printf("\n");
+     }
+}
+
+static uint8_t *load(const char *path, uint32_t *length)
+{
+     FILE *f = fopen(path, "rb");
+     if (!f) {
+	  fprintf(stderr, "Unable to open %s\n", path);
+	  return NULL;
+     }
+     fseek(f, 0, SEEK_END);
+     long size = ftell(f);
+     rewind(f);
+
+     uint8_t *data = (uint8_t *)malloc(size > 0 ? size : 1);
+     if (!data || fread(data, 1, size, f) != (size_t)size) {
+	  fprintf(stderr, "Unable to read %s\n", path);
+	  fclose(f);
+	  free(data);
+	  return NULL;
+     }
+     fclose(f);
+     *length = (uint32_t)size;
+     return data;
+}
+
+// Copy a file to the root directory of the card through lib_sd, a
+// sector at a time.  lib_sd has room for one open partition, so the
+// firmware's hold on the card must be let go first.
+static bool copy(const char *name, const uint8_t *data, uint32_t length)
+{
+     struct partition_struct *partition;
+     struct fat_fs_struct *fs = NULL;
+     struct fat_dir_struct *root = NULL;
+     struct fat_file_struct *file = NULL;
+     struct fat_dir_entry_struct entry;
+     bool ok = false;
+
+     sdcard::reset();
+     if (!sd_raw_init(use_crc, 0))
+	  return false;
+     partition = partition_open(sd_raw_read, sd_raw_read_interval,
+				sd_raw_stream_read, sd_raw_stream_open,
+				sd_raw_write, sd_raw_write_interval, sd_raw_erasable, 0);
+     if (!partition)
+	  return false;
+     if (!(fs = fat_open(partition)) ||
+	 !fat_get_dir_entry_of_path(fs, "/", &entry) ||
+	 !(root = fat_open_dir(fs, &entry)))
+	  goto done;
+
+     while (fat_read_dir(root, &entry))
+	  if (!strcmp(entry.long_name, name)) {
+	       fat_delete_file(fs, &entry);
+	       break;
+	  }
+     fat_reset_dir(root);
+     if (!fat_create_file(root, name, &entry) ||
+	 !(file = fat_open_file(fs, &entry)))
+	  goto done;
+
+     for (uint32_t at = 0; at < length; at += 512) {
+	  uint16_t n = (length - at < 512) ? (uint16_t)(length - at) : 512;
+	  if (fat_write_file(file, data + at, n) != n)
+	       goto done;
+     }
+     ok = true;
+
+done:
+     if (file)
+	  fat_close_file(file);
+     if (root)
+	  fat_close_dir(root);
+     if (fs)
+	  fat_close(fs);
+     partition_close(partition);
+     return sd_raw_sync() && ok;
+}
+
+// Check sdcard::readFile() and playbackSeek() at a few offsets
+// through the file, back to front so that each seek goes backwards
+static bool check_seeks(char *fname, const uint8_t *data, uint32_t length)
+{
+     const int points = 8;
+     uint8_t buf[64];
+
+     if (sdcard::fileSize(fname) != length)
+	  return false;
+     for (int i = points - 1; i >= 0; i--) {
+	  uint32_t at = (uint32_t)((uint64_t)length * i / points);
+	  uint8_t n = (length - at < sizeof(buf)) ? (uint8_t)(length - at) : sizeof(buf);
+	  if (n == 0)
+	       continue;
+	  if (sdcard::readFile(fname, at, buf, n) != sdcard::SD_SUCCESS ||
+	      memcmp(buf, data + at, n))
+	       return false;
+     }
+
+     if (sdcard::startPlayback(fname) != sdcard::SD_SUCCESS)
+	  return false;
+     bool ok = true;
+     for (int i = points - 1; ok && i >= 0; i--) {
+	  uint32_t at = (uint32_t)((uint64_t)length * i / points);
+	  if (at >= length)
+	       continue;
+	  ok = sdcard::playbackSeek(at);
+	  for (uint32_t j = at; ok && j < length && j < at + 64; j++)
+	       ok = sdcard::playbackHasNext() && sdcard::playbackNext() == data[j];
+     }
+     sdcard::finishPlayback();
+     return ok;
+}
+
+// Run the pre-flight scan through the file, a slice at a time between
+// passes of playback as the command loop does while the heaters warm up,
+// and check that playback carries on undisturbed
+static bool check_preflight(char *fname, const uint8_t *data, uint32_t length,
+			    sdcard::SdErrorCode *e)
+{
+     *e = sdcard::SD_SUCCESS;
+     if (sdcard::startPlayback(fname) != sdcard::SD_SUCCESS)
+	  return false;
+     preflight::reset();
+     uint32_t played = 0;
+     bool ok = true;
+     while (ok && *e == sdcard::SD_SUCCESS && !preflight::done()) {
+	  *e = preflight::scan();
+	  for (int n = 0; ok && n < SLICE_BYTES && sdcard::playbackHasNext(); n++, played++)
+	       ok = played < length && sdcard::playbackNext() == data[played];
+	  sdcard::playbackReadAhead();
+     }
+     while (ok && played < length)
+	  ok = sdcard::playbackHasNext() && sdcard::playbackNext() == data[played++];
+     if (ok && *e == sdcard::SD_SUCCESS) {
+	  int32_t secs = preflight::secondsLeft(0);
+	  if (secs >= 0)
+	       printf("              pre-flight: %d s of moves and delays\n", secs);
+	  else
+	       printf("              pre-flight: no timed moves or delays\n");
+     }
+     sdcard::finishPlayback();
+     return ok;
+}
+
+// Pull the card part way through playback, as the command loop plays it,
+// and check that playback ends with the card reported missing rather
+// than waiting on it for ever
+static bool check_removal(char *fname, uint32_t length)
+{
+     const uint32_t pull_at = 2000;
+     const uint32_t max_passes = 1000000;
+
+     // The rest of a shorter file may already have been read ahead
+     if (length < pull_at + 3 * 512)
+	  return true;
+     if (sdcard::startPlayback(fname) != sdcard::SD_SUCCESS)
+	  return false;
+     uint32_t played = 0, passes = 0;
+     while (sdcard::playbackHasNext() && passes++ < max_passes) {
+	  for (int n = 0; n < SLICE_BYTES && sdcard::playbackHasNext() &&
+		    sdcard::playbackReady(); n++) {
+	       sdcard::playbackNext();
+	       if (++played == pull_at)
+		    sdemu_insert(false);
+	  }
+	  sdcard::playbackReadAhead();
+	  sdemu_idle(100);
+     }
+     bool ok = !sdcard::playbackHasNext() &&
+	  sdcard::sdAvailable == sdcard::SD_ERR_NO_CARD_PRESENT;
+     sdcard::finishPlayback();
+     sdemu_insert(true);
+     return ok;
+}
+
+int main(int argc, const char *argv[])
+{
+     const char *image = NULL, *save = NULL;
+     uint8_t type = SDEMU_SDHC;
+     uint32_t cluster_kb = 32, card_mb = 0, work = 0;
+     int check = 0, status = 0;
+     char c;
+
+     while ((c = getopt(argc, (char **)argv, ":chi:k:o:rs:t:vw:?")) != GETOPTS_END) {
+	  switch(c) {
+	  case 'c' :
+	       check = 1;
+	       break;
+	  case 'i' :
+	       image = optarg;
+	       break;
+	  case 'k' :
+	       cluster_kb = atoi(optarg);
+	       break;
+	  case 'o' :
+	       save = optarg;
+	       break;
+	  case 'r' :
+	       use_crc = true;
+	       break;
+	  case 's' :
+	       card_mb = atoi(optarg);
+	       break;
+	  case 't' :
+	       if (!strcmp(optarg, "sdhc"))
+		    type = SDEMU_SDHC;
+	       else if (!strcmp(optarg, "sd2"))
+		    type = SDEMU_SD2;
+	       else if (!strcmp(optarg, "sd1"))
+		    type = SDEMU_SD1;
+	       else {
+		    usage(stderr, argv[0]);
+		    return(1);
+	       }
+	       break;
+	  case 'v' :
+	       verbose = 1;
+	       break;
+	  case 'w' :
+	       work = atoi(optarg);
+	       break;
+	  case 'h' :
+	  case '?' :
+	       usage(stdout, argv[0]);
+	       return(0);
+	  default :
+	       usage(stderr, argv[0]);
+	       return(1);
+	  }
+     }
+     const char *prog = argv[0];
+     argc -= optind;
+     argv += optind;
+
+     if (argc == 0) {
+	  usage(stderr, prog);
+	  return(1);
+     }
+
+     if (image) {
+	  if (!sdemu_open(image, type)) {
+	       fprintf(stderr, "Unable to load the card image %s\n", image);
+	       return(1);
+	  }
+     }
+     else {
+	  // Standard capacity cards are addressed by byte, and the CSD
+	  // as sdemu builds it describes at most 1 GB
+	  if (card_mb == 0)
+	       card_mb = (type == SDEMU_SDHC) ? 4096 : 1024;
+	  if (type != SDEMU_SDHC && card_mb > 1024)
+	       card_mb = 1024;
+	  if (!sdemu_create((uint64_t)card_mb << 20, type) ||
+	      !format(type == SDEMU_SDHC, cluster_kb)) {
+	       fprintf(stderr, "Unable to format a %u MB card with %u KB clusters\n",
+		       card_mb, cluster_kb);
+	       return(1);
+	  }
+     }
+
+     for (int i = 0; i < argc; i++) {
+	  const char *name = strrchr(argv[i], '/');
+	  name = name ? name + 1 : argv[i];
+
+	  uint8_t *data = NULL;
+	  uint32_t length = 0;
+	  if (!image) {
+	       if (!(data = load(argv[i], &length))) {
+		    status = 1;
+		    continue;
+	       }
+	       sdemu_reset_stats();
+	       if (!copy(name, data, length)) {
+		    printf("FAILED %s: could not copy it to the card\n", name);
+		    free(data);
+		    status = 1;
+		    continue;
+	       }
+	       printf("%s: %u bytes\n", name, length);
+	       print_stats("copy", length);
+	  }
+	  else
+	       printf("%s\n", name);
+
+	  // Open the card as the LCD menu does before it starts a print,
+	  // then count opening the file and streaming it separately
+	  sdcard::reset();
+	  if (sdcard::directoryReset() != sdcard::SD_SUCCESS) {
+	       printf("FAILED %s: the firmware could not open the card\n", name);
+	       free(data);
+	       status = 1;
+	       continue;
+	  }
+	  sdemu_reset_stats();
+
+	  char fname[256];
+	  strncpy(fname, name, sizeof(fname) - 1);
+	  fname[sizeof(fname) - 1] = '\0';
+	  if (sdcard::startPlayback(fname) != sdcard::SD_SUCCESS) {
+	       printf("FAILED %s: the firmware could not open it\n", name);
+	       free(data);
+	       status = 1;
+	       continue;
+	  }
+	  print_stats("open", 0);
+
+	  sdemu_reset_stats();
+	  uint32_t played = 0, mismatched = 0;
+	  while (sdcard::playbackHasNext()) {
+	       // As runCommandSlice() does: take what's been read ahead, up
+	       // to what a command takes from the command buffer in a pass
+	       // of the command loop, then let the read-ahead have the card
+	       for (int n = 0; n < SLICE_BYTES && sdcard::playbackHasNext() &&
+			 sdcard::playbackReady(); n++) {
+		    uint8_t b = sdcard::playbackNext();
+		    if (data && (played >= length || data[played] != b))
+			 mismatched++;
+		    played++;
+		    if (work)
+			 sdemu_idle(work);
+	       }
+	       sdcard::playbackReadAhead();
+	  }
+	  sdcard::finishPlayback();
+	  print_stats("playback", played);
+
+	  sdcard::ReadAheadStats ahead;
+	  sdcard::readAheadStats(&ahead);
+	  printf("              %u refills, %.1f ms, longest %.1f ms; %u stalls, %.1f ms\n",
+		 ahead.refills, ahead.refillTime / 10.0, ahead.refillMax / 10.0,
+		 ahead.stalls, ahead.stallTime / 10.0);
+
+	  if (check) {
+	       sdcard::SdErrorCode e;
+	       // A streamed file needs a read command to start with, and
+	       // then no more than one for each cluster it is fragmented at
+	       uint32_t reads = sdemu_stats.commands[17] + sdemu_stats.commands[18];
+	       uint32_t blocks = (played + 511) / 512;
+	       if (data && (mismatched || played != length)) {
+		    printf("FAILED %s: played back %u bytes, %u of them wrong\n",
+			   name, played, mismatched);
+		    status = 1;
+	       }
+	       else if (reads > 1 + blocks / 4) {
+		    printf("FAILED %s: %u read commands for %u blocks\n",
+			   name, reads, blocks);
+		    status = 1;
+	       }
+	       else if (data && !check_seeks(fname, data, length)) {
+		    printf("FAILED %s: reading part way through went wrong\n", name);
+		    status = 1;
+	       }
+	       else if (data && !check_preflight(fname, data, length, &e)) {
+		    printf("FAILED %s: the pre-flight scan disturbed playback\n", name);
+		    status = 1;
+	       }
+	       else if (data && e != sdcard::SD_SUCCESS) {
+		    printf("FAILED %s: the pre-flight scan found error %d\n", name, e);
+		    status = 1;
+	       }
+	       else if (data && !check_removal(fname, length)) {
+		    printf("FAILED %s: playback went on waiting for a pulled card\n", name);
+		    status = 1;
+	       }
+	       else
+		    printf("ok     %s\n", name);
+	  }
+	  free(data);
+     }
+
+     sdcard::reset();
+     if (save && !sdemu_save(save)) {
+	  fprintf(stderr, "Unable to save the card image to %s\n", save);
+	  status = 1;
+     }
+     sdemu_close();
+     return(status);
+}
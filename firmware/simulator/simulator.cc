@@ -3,6 +3,14 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdarg.h>
+#include <errno.h>
+#if defined(SAILTIME)
+#include <math.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#endif
 
 #include "Simulator.hh"
 #include "StepperAccelPlannerExtras.hh"
@@ -42,6 +50,9 @@ typedef struct {
      char buf[1024];
 } myctx_t;
 
+static myctx_t myctx;
+static int show_moves = 0;
+
 static s3g_write_proc_t display;
 static ssize_t display(void *ctx_, unsigned char *str, size_t len)
 {
@@ -65,13 +76,13 @@ static ssize_t display(void *ctx_, unsigned char *str, size_t len)
 
 #if defined(SAILTIME)
 #define PROGNAME "sailtime"
-#define OPTIONS "[-? | -h] [-a x,y,z,a,b] [-c x,y,z,a,b]"
-#define GETOPTS ":a:c:h?"
+#define OPTIONS "[-? | -h] [-a x,y,z,a,b] [-c x,y,z,a,b] [-l file] [-j jobs] [-p jobs [-v]]"
+#define GETOPTS ":a:c:hj:l:p:v?"
 #define REPORT 0
 #else
 #define PROGNAME "planner"
-#define OPTIONS "[-? | -h] [-a x,y,z,a,b] [-c x,y,z,a,b] [-mstu] [-d mask] [-r rate]"
-#define GETOPTS ":a:c:hd:mr:stu?"
+#define OPTIONS "[-? | -h] [-a x,y,z,a,b] [-c x,y,z,a,b] [-l file] [-mstu] [-d mask] [-r rate]"
+#define GETOPTS ":a:c:hd:l:mr:stu?"
 #define REPORT -1
 #endif
 
@@ -85,6 +96,14 @@ static void usage(FILE *f, const char *prog)
 "         file -- The name of the .s3g or .x3g file to dump.  If not supplied then stdin is dumped\n"
 " -a x,y,z,a,b -- Maximum x, y, z, a, and b accelerations (mm/s^2)\n"
 " -c x,y,z,a,b -- Maximum x, y, z, a, and b speed changes (mm/s)\n"
+"      -l file -- Write per layer print time, distance and speed statistics to\n"
+"                 \"file\"; JSON if the name ends in .json, otherwise CSV\n"
+#if defined(SAILTIME)
+"      -j jobs -- Estimate every file and directory of .s3g/.x3g files listed,\n"
+"                 running \"jobs\" estimates at a time, and output a CSV report\n"
+"      -p jobs -- Split the file into segments and plan \"jobs\" segments at a time\n"
+"           -v -- With -p, also estimate the file serially and compare the two\n"
+#endif
 #if !defined(SAILTIME)
 "      -d mask -- Selectively enable debugging with a bit mask \"mask\"\n"
 "           -m -- Display actual s3g/x3g move commands and\n"
@@ -110,19 +129,888 @@ static void usage(FILE *f, const char *prog)
 	     DEFAULT_MAX_SPEED_CHANGE_A);
 }
 
+// Track the total filament extruded by a move
+
+static void track_filament(const Point &target, uint8_t relative)
+{
+     for (int i = 0; i < 2; i ++ )
+     {
+	  if ( relative & (1 << (A_AXIS + i)))
+	  {
+	       filamentLength[i] += (int64_t)target[A_AXIS + i];
+	       lastFilamentPosition[i] += target[A_AXIS + i];
+	  }
+	  else
+	  {
+	       filamentLength[i] += (int64_t)(target[A_AXIS + i] - lastFilamentPosition[i]);
+	       lastFilamentPosition[i] = target[A_AXIS + i];
+	  }
+     }
+}
+
+// Commands other than these wait for the planned moves to complete.  The
+// planner is empty after them and so they make safe points at which to
+// split a build into independently planned segments.
+
+static bool drains_planner(const s3g_command_t *cmd)
+{
+     return(cmd->cmd_id != HOST_CMD_TOOL_COMMAND &&
+	    cmd->cmd_id != HOST_CMD_ENABLE_AXES &&
+	    cmd->cmd_id != HOST_CMD_SET_BUILD_PERCENT &&
+	    cmd->cmd_id != HOST_CMD_CHANGE_TOOL &&
+	    cmd->cmd_id != HOST_CMD_SET_POSITION_EXT &&
+	    cmd->cmd_id != HOST_CMD_QUEUE_POINT_NEW &&
+	    cmd->cmd_id != HOST_CMD_QUEUE_POINT_NEW_EXT &&
+	    cmd->cmd_id != HOST_CMD_QUEUE_POINT_PLANNED &&
+	    cmd->cmd_id != HOST_CMD_PLANNED_HEADER &&
+	    cmd->cmd_id != HOST_CMD_FILE_CHECKSUM &&
+	    cmd->cmd_id != HOST_CMD_QUEUE_POINT_EXT &&
+	    cmd->cmd_id != HOST_CMD_SET_ACCELERATION_TOGGLE &&
+	    cmd->cmd_id != HOST_CMD_RECALL_HOME_POSITION);
+}
+
+// When scanning, moves update the planner position the same as
+// steppers::setTargetNew() and setTargetNewExt() would but are not
+// planned.  Used to find the machine state at the start of a segment
+// without planning everything which precedes it.
+
+static bool scanning = false;
+static bool segment_accel = true;
+static int32_t scan_offsets[STEPPER_COUNT];
+
+static void scan_move(const Point &target, uint8_t relative, bool moves)
+{
+     int32_t pos[STEPPER_COUNT];
+     bool changed = false;
+
+     for (uint8_t i = 0; i < STEPPER_COUNT; i++)
+     {
+	  pos[i] = target[i] + scan_offsets[i];
+	  if (relative & (1 << i))
+	       pos[i] += planner_position[i];
+	  if (pos[i] != planner_position[i])
+	       changed = true;
+     }
+
+     // Moves with no steps or no distance leave the position unchanged
+     if (changed && moves)
+	  memcpy(planner_position, pos, sizeof(pos));
+}
+
+// Run a single command through the simulated planner
+
+static void simulate_command(s3g_context_t *ctx, s3g_command_t *cmd)
+{
+     // Convert the command to human readable text; sailtime never shows it
+     myctx.buf[0] = '\0';
+#if !defined(SAILTIME)
+     if (!scanning)
+	  s3g_command_display(ctx, cmd);
+#endif
+
+     if (cmd->cmd_id == HOST_CMD_QUEUE_POINT_NEW)
+     {
+	  Point target = Point(cmd->t.queue_point_new.x, cmd->t.queue_point_new.y,
+			       cmd->t.queue_point_new.z, cmd->t.queue_point_new.a, 
+			       cmd->t.queue_point_new.b);
+
+	  track_filament(target, cmd->t.queue_point_new.rel);
+
+	  if (scanning)
+	  {
+	       scan_move(target, cmd->t.queue_point_new.rel, true);
+	       return;
+	  }
+
+	  steppers::setTargetNew(target, 0, cmd->t.queue_point_new.us, cmd->t.queue_point_new.rel);
+
+	  if (show_moves && myctx.buf[0]) pending_notice("%s\n", myctx.buf);
+	  handle_pending_notices();
+
+	  if (movesplanned() >= (BLOCK_BUFFER_SIZE >> 1)) plan_dump_current_block(1, REPORT);
+     }
+     else if (cmd->cmd_id == HOST_CMD_QUEUE_POINT_NEW_EXT ||
+	      cmd->cmd_id == HOST_CMD_QUEUE_POINT_PLANNED)
+     {
+	  Point target = Point(cmd->t.queue_point_new_ext.x, cmd->t.queue_point_new_ext.y,
+			       cmd->t.queue_point_new_ext.z, cmd->t.queue_point_new_ext.a,
+			       cmd->t.queue_point_new_ext.b);
+
+	  track_filament(target, cmd->t.queue_point_new.rel);
+
+	  if (scanning)
+	  {
+	       scan_move(target, cmd->t.queue_point_new_ext.rel,
+			 cmd->t.queue_point_new_ext.distance != 0.0);
+	       return;
+	  }
+
+	  if (cmd->cmd_id == HOST_CMD_QUEUE_POINT_PLANNED)
+	       steppers::setTargetPlanned(target, cmd->t.queue_point_new_ext.dda_rate,
+					  cmd->t.queue_point_new_ext.rel,
+					  cmd->t.queue_point_new_ext.distance,
+					  cmd->t.queue_point_new_ext.feedrate_mult_64,
+					  &cmd->t.queue_point_planned.planned);
+	  else
+	       steppers::setTargetNewExt(target, cmd->t.queue_point_new_ext.dda_rate,
+					 cmd->t.queue_point_new_ext.rel,
+					 cmd->t.queue_point_new_ext.distance,
+					 cmd->t.queue_point_new_ext.feedrate_mult_64);
+
+	  if (show_moves && myctx.buf[0]) pending_notice("%s\n", myctx.buf);
+	  handle_pending_notices();
+
+	  if (movesplanned() >= (BLOCK_BUFFER_SIZE >> 1)) plan_dump_current_block(1, REPORT);
+     }
+     else if (cmd->cmd_id == HOST_CMD_QUEUE_POINT_EXT)
+     {
+	  Point target = Point(cmd->t.queue_point_ext.x, cmd->t.queue_point_ext.y,
+			       cmd->t.queue_point_ext.z, cmd->t.queue_point_ext.a,
+			       cmd->t.queue_point_ext.b);
+
+	  track_filament(target, 0);
+
+	  if (scanning)
+	  {
+	       scan_move(target, 0, true);
+	       return;
+	  }
+
+	  steppers::setTargetNew(target, cmd->t.queue_point_ext.dda, 0, 0);
+	  if (show_moves && myctx.buf[0]) pending_notice("%s\n", myctx.buf);
+
+	  handle_pending_notices();
+
+	  if (movesplanned() >= (BLOCK_BUFFER_SIZE >> 1)) plan_dump_current_block(1, REPORT);
+     }
+     else if (cmd->cmd_id == HOST_CMD_SET_POSITION_EXT)
+     {
+	  Point target = Point(cmd->t.set_position_ext.x, cmd->t.set_position_ext.y,
+			       cmd->t.set_position_ext.z, cmd->t.set_position_ext.a,
+			       cmd->t.set_position_ext.b);
+
+	  lastFilamentPosition[0] = target[A_AXIS];
+	  lastFilamentPosition[1] = target[B_AXIS];
+
+	  steppers::definePosition(target, false);
+
+	  if (myctx.buf[0]) pending_notice("%s\n", myctx.buf);
+	  handle_pending_notices();
+     }
+     else if (cmd->cmd_id == HOST_CMD_SET_ACCELERATION_TOGGLE)
+     {
+	  segment_accel = (cmd->t.set_segment_acceleration.s != 0) ? true : false;
+	  steppers::setSegmentAccelState(segment_accel);
+	  if (myctx.buf[0]) pending_notice("%s\n", myctx.buf);
+     }
+     else if (cmd->cmd_id == HOST_CMD_PLANNED_HEADER)
+     {
+	  steppers::setPlannedKey(cmd->t.planned_header.version,
+				  cmd->t.planned_header.hash);
+	  if (myctx.buf[0]) pending_notice("%s\n", myctx.buf);
+     }
+     else if (cmd->cmd_id == HOST_CMD_RECALL_HOME_POSITION)
+     {
+	  // Assume A and B axis have 0 for their home positions
+	  if (cmd->t.recall_home_position.axes & (1 << A_AXIS))
+	       lastFilamentPosition[0] = 0;
+	  if (cmd->t.recall_home_position.axes & (1 << B_AXIS))
+	       lastFilamentPosition[0] = 0;
+     }
+     else
+     {
+	  // Dump queued blocks?
+	  if (drains_planner(cmd))
+	  {
+	       bool warn = movesplanned() != 0;
+	       if (warn && REPORT) {
+		   printf("*** >>> Draining planning buffer <<< ***\n");
+		   fflush(stdout);
+	       }
+	       while (movesplanned() != 0)
+		   plan_dump_current_block(1, REPORT);
+	       if (warn && REPORT) {
+		   printf("*** >>> Planning buffer drained <<< ***\n");
+		   fflush(stdout);
+	       }
+	  }
+
+	  if (myctx.buf[0] != '\0')
+	  {
+	       if (cmd->cmd_id == HOST_CMD_CHANGE_TOOL ||
+		   cmd->cmd_id == HOST_CMD_ENABLE_AXES ||
+		   cmd->cmd_id == HOST_CMD_SET_BUILD_PERCENT ||
+		   cmd->cmd_id == HOST_CMD_SET_POSITION_EXT ||
+		   cmd->cmd_id == HOST_CMD_TOOL_COMMAND)
+		    pending_notice("%s\n", myctx.buf);
+	       else
+	       {
+		    puts(myctx.buf);
+	       }
+	  }
+     }
+}
+
+// Run the commands from the input source through the simulated planner
+// and then drain the planner.  Stops at the end of the input or upon
+// reaching the offset "end" into the input, whichever comes first.
+
+static void simulate(s3g_context_t *ctx, size_t end)
+{
+     s3g_command_t cmd;
+
+     // Add a writer to use when converting an .s3g packet to 
+     // human readable text
+     s3g_add_writer(ctx, &display, &myctx);
+
+     // Now loop over the input .s3g stream | file
+     while (s3g_tell(ctx) < end && !s3g_command_read(ctx, &cmd))
+	  simulate_command(ctx, &cmd);
+
+     // Dump any remaining blocks
+     while (movesplanned() != 0)
+	 plan_dump_current_block(1, REPORT);
+}
+
+#if defined(SAILTIME)
+
+// Worker processes.  Each estimate runs in its own forked worker: the
+// planner keeps its state in globals shared with the firmware, and a
+// worker gets a private copy of them.
+
+typedef void task_proc_t(void *arg, int fd);
+
+typedef struct {
+     task_proc_t *proc;    // Run by the worker which sends its result down fd
+     void        *arg;     // Argument for proc
+     void        *result;  // Where to store the worker's result
+     size_t       len;     // Length of the result
+     pid_t        pid;
+     int          fd;
+     int          status;  // 0 once the result has been received
+} task_t;
+
+static void task_init(task_t *task, task_proc_t *proc, void *arg,
+		      void *result, size_t len)
+{
+     memset(task, 0, sizeof(task_t));
+     task->proc   = proc;
+     task->arg    = arg;
+     task->result = result;
+     task->len    = len;
+     task->fd     = -1;
+     task->status = -1;
+}
+
+// Called by a worker to send its result to the parent and exit
+
+static void task_reply(int fd, const void *result, size_t len)
+{
+     if (write(fd, result, len) != (ssize_t)len)
+	  _exit(1);
+     _exit(0);
+}
+
+static int task_start(task_t *task)
+{
+     int fds[2];
+
+     if (pipe(fds))
+     {
+	  fprintf(stderr, "task_start(%d): Unable to create a pipe; %s (%d)\n",
+		  __LINE__, strerror(errno), errno);
+	  return(-1);
+     }
+
+     // Don't let the worker inherit (and later flush) our buffered output
+     fflush(stdout);
+     fflush(stderr);
+
+     if ((task->pid = fork()) < 0)
+     {
+	  fprintf(stderr, "task_start(%d): Unable to fork; %s (%d)\n",
+		  __LINE__, strerror(errno), errno);
+	  close(fds[0]);
+	  close(fds[1]);
+	  return(-1);
+     }
+     else if (task->pid == 0)
+     {
+	  close(fds[0]);
+
+	  // Keep stray output off of our report
+	  dup2(2, 1);
+
+	  (*task->proc)(task->arg, fds[1]);
+	  _exit(1);
+     }
+
+     close(fds[1]);
+     task->fd = fds[0];
+
+     return(0);
+}
+
+static void task_finish(task_t *task, int wstatus)
+{
+     if (read(task->fd, task->result, task->len) == (ssize_t)task->len &&
+	 WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0)
+	  task->status = 0;
+     else
+	  task->status = -1;
+
+     close(task->fd);
+     task->fd  = -1;
+     task->pid = 0;
+}
+
+// Run the tasks, no more than maxrun at a time.  Returns 0 if every
+// task delivered its result
+
+static int run_tasks(task_t *tasks, size_t ntasks, int maxrun)
+{
+     size_t i, next = 0;
+     int iret = 0, running = 0;
+
+     while (next < ntasks || running > 0)
+     {
+	  while (running < maxrun && next < ntasks)
+	  {
+	       if (task_start(&tasks[next++]))
+		    continue;
+	       running++;
+	  }
+
+	  if (running == 0)
+	       break;
+
+	  int wstatus;
+	  pid_t pid = wait(&wstatus);
+	  if (pid < 0)
+	  {
+	       if (errno == EINTR)
+		    continue;
+	       fprintf(stderr, "run_tasks(%d): wait() failed; %s (%d)\n",
+		       __LINE__, strerror(errno), errno);
+	       return(1);
+	  }
+
+	  for (i = 0; i < next; i++)
+	  {
+	       if (tasks[i].pid == pid)
+	       {
+		    task_finish(&tasks[i], wstatus);
+		    running--;
+		    break;
+	       }
+	  }
+     }
+
+     for (i = 0; i < ntasks; i++)
+	  if (tasks[i].status)
+	       iret = 1;
+
+     return(iret);
+}
+
+static const char *format_time(char *buf, size_t maxbuf, double seconds)
+{
+     int t = (int)seconds;
+
+     snprintf(buf, maxbuf, "%02d:%02d:%05.2f", t / 3600, (t / 60) % 60,
+	      seconds - (double)(t - t % 60));
+
+     return(buf);
+}
+
+// Batch estimation of many files
+
+typedef struct {
+     int    status;    // 0 on success
+     double seconds;   // Estimated print time
+     float  filament;  // Filament used (mm)
+} job_result_t;
+
+typedef struct {
+     char         *path;
+     job_result_t  result;
+} job_t;
+
+static job_t *jobs = NULL;
+static size_t njobs = 0, maxjobs = 0;
+
+static int job_add(const char *path)
+{
+     if (njobs >= maxjobs)
+     {
+	  size_t n = maxjobs ? 2 * maxjobs : 64;
+	  job_t *tmp = (job_t *)realloc(jobs, n * sizeof(job_t));
+	  if (!tmp)
+	  {
+	       fprintf(stderr, "job_add(%d): Insufficient virtual memory\n", __LINE__);
+	       return(-1);
+	  }
+	  jobs    = tmp;
+	  maxjobs = n;
+     }
+
+     memset(&jobs[njobs], 0, sizeof(job_t));
+     if (!(jobs[njobs].path = strdup(path)))
+     {
+	  fprintf(stderr, "job_add(%d): Insufficient virtual memory\n", __LINE__);
+	  return(-1);
+     }
+     njobs++;
+
+     return(0);
+}
+
+static int job_filter(const struct dirent *d)
+{
+     const char *ext = strrchr(d->d_name, '.');
+
+     return(ext && (!strcasecmp(ext, ".s3g") || !strcasecmp(ext, ".x3g")));
+}
+
+// Queue a file or, for a directory, the .s3g and .x3g files within it
+
+static int job_add_path(const char *path)
+{
+     struct stat sb;
+     struct dirent **list;
+     int i, n, iret;
+     char buf[4096];
+
+     if (stat(path, &sb) || !S_ISDIR(sb.st_mode))
+	  return(job_add(path));
+
+     if ((n = scandir(path, &list, job_filter, alphasort)) < 0)
+     {
+	  fprintf(stderr, "job_add_path(%d): Unable to read the directory \"%s\"; %s (%d)\n",
+		  __LINE__, path, strerror(errno), errno);
+	  return(-1);
+     }
+
+     iret = 0;
+     for (i = 0; i < n; i++)
+     {
+	  snprintf(buf, sizeof(buf), "%s/%s", path, list[i]->d_name);
+	  if (!iret)
+	       iret = job_add(buf);
+	  free(list[i]);
+     }
+     free(list);
+
+     return(iret);
+}
+
+static void job_run(void *arg, int fd)
+{
+     job_t *job = (job_t *)arg;
+     job_result_t result;
+     s3g_context_t *ctx;
+
+     memset(&result, 0, sizeof(result));
+     if ((ctx = s3g_open(S3G_INPUT_TYPE_MMAP, (void *)job->path)))
+     {
+	  simulate(ctx, (size_t)-1);
+	  s3g_close(ctx);
+	  result.seconds  = plan_total_time();
+	  result.filament = filamentUsed();
+     }
+     else
+	  result.status = 1;
+
+     task_reply(fd, &result, sizeof(result));
+}
+
+static void csv_quote(FILE *f, const char *str)
+{
+     fputc('"', f);
+     for (; *str; str++)
+     {
+	  if (*str == '"')
+	       fputc('"', f);
+	  fputc(*str, f);
+     }
+     fputc('"', f);
+}
+
+// Estimate every queued job, no more than maxrun at a time, and
+// then write the CSV report in the order the jobs were queued
+
+static int run_jobs(int maxrun)
+{
+     size_t i;
+     int iret = 0;
+     task_t *tasks;
+     char buf[32];
+
+     if (!(tasks = (task_t *)calloc(njobs, sizeof(task_t))))
+     {
+	  fprintf(stderr, "run_jobs(%d): Insufficient virtual memory\n", __LINE__);
+	  return(1);
+     }
+     for (i = 0; i < njobs; i++)
+	  task_init(&tasks[i], job_run, &jobs[i], &jobs[i].result,
+		    sizeof(job_result_t));
+
+     run_tasks(tasks, njobs, maxrun);
+
+     printf("file,seconds,time,filament_mm,status\n");
+     for (i = 0; i < njobs; i++)
+     {
+	  const job_result_t *r = &jobs[i].result;
+
+	  csv_quote(stdout, jobs[i].path);
+	  if (tasks[i].status || r->status)
+	  {
+	       printf(",,,,error\n");
+	       iret = 1;
+	  }
+	  else
+	       printf(",%f,%s,%f,ok\n", r->seconds,
+		      format_time(buf, sizeof(buf), r->seconds), r->filament);
+	  free(jobs[i].path);
+     }
+     free(tasks);
+     free(jobs);
+     jobs = NULL;
+     njobs = maxjobs = 0;
+
+     return(iret);
+}
+
+// Segment parallel estimation of a single file.  The file is split at
+// commands which drain the planner.  Other than the speed at which the
+// first move enters, everything the planner carries across such a point
+// is determined by the preceding commands and not their planning.  A
+// quick scan which tracks positions without planning finds that state at
+// each split and the segments are then planned concurrently.
+
+typedef struct {
+     size_t  start;                       // Offset of the segment's first command
+     size_t  end;                         // Offset past its last command
+     int32_t position[STEPPER_COUNT];     // Planner position at the start
+     int32_t filament_position[2];        // lastFilamentPosition[] at the start
+     bool    accel;                       // Segment acceleration enabled
+     FPTYPE  entry_speed;                 // Final speed of the preceding segment
+} segment_t;
+
+typedef struct {
+     uint64_t ticks;                      // Print time for the segment (step timer ticks)
+     uint64_t head_ticks;                 // Print time up to its first drain
+     size_t   head_end;                   // Offset just past its first drain
+     uint32_t blocks;                     // Number of blocks planned
+     int64_t  filament[2];                // Filament extruded by the segment (steps)
+     FPTYPE   final_speed;                // Final speed of its last planned move
+} segment_result_t;
+
+// Input shared by the segment workers; each gets a private copy
+// of the context and hence its own input offset
+static s3g_context_t *segment_ctx = NULL;
+
+static void segment_save(segment_t *seg, size_t start)
+{
+     memset(seg, 0, sizeof(segment_t));
+     seg->start = start;
+     seg->end   = (size_t)-1;
+     for (uint8_t i = 0; i < STEPPER_COUNT; i++)
+	  seg->position[i] = planner_position[i];
+     seg->filament_position[0] = lastFilamentPosition[0];
+     seg->filament_position[1] = lastFilamentPosition[1];
+     seg->accel = segment_accel;
+     seg->entry_speed = plan_get_final_speed();
+}
+
+static void segment_run(void *arg, int fd)
+{
+     segment_t *seg = (segment_t *)arg;
+     segment_result_t result;
+     s3g_command_t cmd;
+
+     if (s3g_seek(segment_ctx, seg->start))
+	  _exit(1);
+
+     plan_set_position(seg->position[X_AXIS], seg->position[Y_AXIS],
+		       seg->position[Z_AXIS], seg->position[A_AXIS],
+		       seg->position[B_AXIS]);
+     plan_set_final_speed(seg->entry_speed);
+     segment_accel = seg->accel;
+     steppers::setSegmentAccelState(segment_accel);
+     lastFilamentPosition[0] = seg->filament_position[0];
+     lastFilamentPosition[1] = seg->filament_position[1];
+     filamentLength[0] = filamentLength[1] = 0;
+
+     memset(&result, 0, sizeof(result));
+     s3g_add_writer(segment_ctx, &display, &myctx);
+     while (s3g_tell(segment_ctx) < seg->end &&
+	    !s3g_command_read(segment_ctx, &cmd))
+     {
+	  simulate_command(segment_ctx, &cmd);
+
+	  // Only the moves up to the first drain which follows a planned
+	  // block depend upon the entry speed
+	  if (!result.head_end && drains_planner(&cmd) && plan_total_blocks() != 0)
+	  {
+	       result.head_end     = s3g_tell(segment_ctx);
+	       result.head_ticks   = plan_total_ticks();
+	  }
+     }
+
+     while (movesplanned() != 0)
+	 plan_dump_current_block(1, REPORT);
+
+     result.ticks       = plan_total_ticks();
+     result.blocks      = plan_total_blocks();
+     result.filament[0] = filamentLength[0];
+     result.filament[1] = filamentLength[1];
+     result.final_speed = plan_get_final_speed();
+     if (!result.head_end)
+     {
+	  result.head_end     = seg->end;
+	  result.head_ticks   = result.ticks;
+     }
+
+     task_reply(fd, &result, sizeof(result));
+}
+
+// Split the input into segments of at least min_len bytes.  The first
+// segment starts from the current machine state.
+
+static segment_t *scan_segments(s3g_context_t *ctx, size_t min_len, size_t *nsegs)
+{
+     s3g_command_t cmd;
+     segment_t *segs, *tmp;
+     size_t n = 0, maxsegs = 64;
+     Point p = steppers::getPlannerPosition();
+
+     // The toolhead offsets setTargetNew() adds to X and Y
+     memset(scan_offsets, 0, sizeof(scan_offsets));
+     scan_offsets[X_AXIS] = planner_position[X_AXIS] - p[X_AXIS];
+     scan_offsets[Y_AXIS] = planner_position[Y_AXIS] - p[Y_AXIS];
+
+     if (!(segs = (segment_t *)malloc(maxsegs * sizeof(segment_t))))
+	  goto nomem;
+     segment_save(&segs[n++], s3g_tell(ctx));
+
+     scanning = true;
+     while (!s3g_command_read(ctx, &cmd))
+     {
+	  simulate_command(ctx, &cmd);
+	  if (!drains_planner(&cmd) ||
+	      (s3g_tell(ctx) - segs[n-1].start) < min_len)
+	       continue;
+
+	  if (n >= maxsegs)
+	  {
+	       if (!(tmp = (segment_t *)realloc(segs, 2 * maxsegs * sizeof(segment_t))))
+	       {
+		    free(segs);
+		    scanning = false;
+		    goto nomem;
+	       }
+	       segs = tmp;
+	       maxsegs *= 2;
+	  }
+	  segs[n-1].end = s3g_tell(ctx);
+	  segment_save(&segs[n++], s3g_tell(ctx));
+     }
+     scanning = false;
+
+     *nsegs = n;
+     return(segs);
+
+nomem:
+     fprintf(stderr, "scan_segments(%d): Insufficient virtual memory\n", __LINE__);
+     return(NULL);
+}
+
+static FPTYPE entry_limit(FPTYPE final_speed)
+{
+     return((final_speed < minimumPlannerSpeed) ? final_speed : minimumPlannerSpeed);
+}
+
+static int estimate_segments(const char *path, int maxrun, bool verify)
+{
+     s3g_context_t *ctx;
+     segment_t *segs, *heads = NULL, whole;
+     segment_result_t *results = NULL, *head_results = NULL, serial;
+     task_t *tasks = NULL;
+     size_t *head_index = NULL;
+     struct stat sb;
+     size_t i, nsegs, nheads, nreplanned;
+     int iret = 1;
+     FPTYPE final_speed;
+     uint64_t ticks = 0;
+     int64_t filament[2] = {0, 0};
+
+     if (!(ctx = s3g_open(S3G_INPUT_TYPE_MMAP, (void *)path)))
+	  return(1);
+
+     if (stat(path, &sb) || s3g_seek(ctx, 0))
+     {
+	  fprintf(stderr, "The -p switch requires a regular file to read\n");
+	  s3g_close(ctx);
+	  return(1);
+     }
+
+     // The whole file, planned serially, for verification
+     segment_save(&whole, 0);
+
+     // Aim for a few segments per worker to balance the load
+     if (!(segs = scan_segments(ctx, (size_t)sb.st_size / (4 * maxrun) + 1, &nsegs)))
+     {
+	  s3g_close(ctx);
+	  return(1);
+     }
+
+     results      = (segment_result_t *)calloc(nsegs, sizeof(segment_result_t));
+     head_results = (segment_result_t *)calloc(nsegs, sizeof(segment_result_t));
+     heads        = (segment_t *)calloc(nsegs, sizeof(segment_t));
+     head_index   = (size_t *)calloc(nsegs, sizeof(size_t));
+     tasks        = (task_t *)calloc(nsegs + 1, sizeof(task_t));
+     if (!results || !head_results || !heads || !head_index || !tasks)
+     {
+	  fprintf(stderr, "estimate_segments(%d): Insufficient virtual memory\n", __LINE__);
+	  goto done;
+     }
+
+     // Until the preceding segment has been planned, assume that a
+     // segment's first move enters at the minimum planner speed
+     for (i = 0; i < nsegs; i++)
+     {
+	  if (i != 0)
+	       segs[i].entry_speed = minimumPlannerSpeed;
+	  task_init(&tasks[i], segment_run, &segs[i], &results[i],
+		    sizeof(segment_result_t));
+     }
+     if (verify)
+	  task_init(&tasks[nsegs], segment_run, &whole, &serial,
+		    sizeof(segment_result_t));
+
+     segment_ctx = ctx;
+     if (run_tasks(tasks, verify ? nsegs + 1 : nsegs, maxrun))
+     {
+	  fprintf(stderr, "estimate_segments(%d): One or more segments failed\n", __LINE__);
+	  goto done;
+     }
+
+     // Reconcile the segment boundaries.  The first move after the planner
+     // drains enters at the lesser of the minimum planner speed and the
+     // preceding move's final speed.  Where the preceding segment ended
+     // slower than assumed, replan the segment up to the first drain after
+     // its first planned block: nothing after that depends upon the entry
+     // speed.  A segment with no such drain is replanned whole and so may
+     // itself end at a different speed, changing what the next segment
+     // enters at: repeat until no segment needs replanning.
+     nreplanned = 0;
+     do
+     {
+	  nheads = 0;
+	  final_speed = results[0].blocks ? results[0].final_speed : segs[0].entry_speed;
+	  for (i = 1; i < nsegs; i++)
+	  {
+	       if (results[i].blocks &&
+		   entry_limit(final_speed) != entry_limit(segs[i].entry_speed))
+	       {
+		    segs[i].entry_speed = final_speed;
+		    heads[nheads] = segs[i];
+		    heads[nheads].end = results[i].head_end;
+		    head_index[nheads] = i;
+		    task_init(&tasks[nheads], segment_run, &heads[nheads],
+			      &head_results[nheads], sizeof(segment_result_t));
+		    nheads++;
+	       }
+	       if (results[i].blocks)
+		    final_speed = results[i].final_speed;
+	  }
+
+	  if (nheads && run_tasks(tasks, nheads, maxrun))
+	  {
+	       fprintf(stderr, "estimate_segments(%d): Unable to replan one or more segments\n", __LINE__);
+	       goto done;
+	  }
+	  for (i = 0; i < nheads; i++)
+	  {
+	       segment_result_t *r = &results[head_index[i]];
+
+	       r->ticks += head_results[i].ticks - r->head_ticks;
+	       r->head_ticks = head_results[i].ticks;
+	       if (r->head_end == segs[head_index[i]].end)
+		    r->final_speed = head_results[i].final_speed;
+	  }
+	  nreplanned += nheads;
+     } while (nheads);
+
+     for (i = 0; i < nsegs; i++)
+     {
+	  ticks       += results[i].ticks;
+	  filament[0] += results[i].filament[0];
+	  filament[1] += results[i].filament[1];
+     }
+
+     plan_set_total_ticks(ticks);
+     plan_dump_run_data(-1);
+     iret = 0;
+
+     if (verify)
+     {
+	  char buf[32];
+	  double serial_seconds = (double)serial.ticks / 2000000.0;
+
+	  printf("Planned %lu segments in parallel, %lu partially replanned\n",
+		 (unsigned long)nsegs, (unsigned long)nreplanned);
+	  printf("Serial print time is %s (%f seconds); difference is %f seconds\n",
+		 format_time(buf, sizeof(buf), serial_seconds), serial_seconds,
+		 fabs(plan_total_time() - serial_seconds));
+
+	  // Both are sums of whole step timer ticks: they must agree exactly
+	  if (ticks != serial.ticks ||
+	      filament[0] != serial.filament[0] || filament[1] != serial.filament[1])
+	  {
+	       printf("*** Parallel and serial estimates DIFFER ***\n");
+	       iret = 1;
+	  }
+	  else
+	       printf("Parallel and serial estimates agree\n");
+     }
+
+done:
+     if (tasks)
+	  free(tasks);
+     if (head_index)
+	  free(head_index);
+     if (heads)
+	  free(heads);
+     if (head_results)
+	  free(head_results);
+     if (results)
+	  free(results);
+     free(segs);
+     s3g_close(ctx);
+
+     return(iret);
+}
+
+#endif
+
 int main(int argc, const char *argv[])
 {
      char c;
-     s3g_command_t cmd;
      s3g_context_t *ctx;
-     myctx_t myctx;
-     int show_moves = 0;
+     const char *layer_file = NULL;
+#if defined(SAILTIME)
+     int maxrun = 0, maxseg = 0;
+     bool verify = false;
+#endif
 
      steppers::init();
      steppers::reset();
 
      // Enable acceleration: it's off by default
      init_extras(true);
+     segment_accel = steppers::acceleration;
 
      pending_notices[0] = '\0';
 
@@ -188,20 +1076,7 @@ int main(int argc, const char *argv[])
 	       vals[index++] = v;
 
 	       if (c == 'a')
-	       {
-		    int j;
-		    for (j = 0; j < STEPPER_COUNT; j++)
-		    {
-			 float steps_per_mm = (float)replicator_axis_steps_per_mm::axis_steps_per_mm[j] / 1000000.0f;
-			 max_acceleration_units_per_sq_second[j] = (uint32_t)vals[j];
-			 // Limit the max accelerations so that the calculation of block->acceleration & JKN Advance K2
-			 // can be performed without overflow issues
-			 if (max_acceleration_units_per_sq_second[j] > (uint32_t)((float)0xFFFFF / steps_per_mm))
-			      max_acceleration_units_per_sq_second[j] = (uint32_t)((float)0xFFFFF / steps_per_mm);
-			 axis_steps_per_sqr_second[j] = (uint32_t)((float)max_acceleration_units_per_sq_second[j] * steps_per_mm);
-			 axis_accel_step_cutoff[j] = (uint32_t)0xffffffff / axis_steps_per_sqr_second[j];
-		    }
-	       }
+		    set_max_accelerations(vals);
 	       else
 	       {
 		    int j;
@@ -225,6 +1100,12 @@ int main(int argc, const char *argv[])
 	  }
 	  break;
 
+	  // Per layer statistics
+	  case 'l' :
+	       layer_file = optarg;
+	       plan_layer_stats(true);
+	       break;
+
 	  // Show moves
 	  case 'm' :
 	       show_moves = 1;
@@ -248,6 +1129,35 @@ int main(int argc, const char *argv[])
 	  }
 	  break;
 
+#if defined(SAILTIME)
+          // Batch estimation with this many workers
+	  case 'j' :
+	       maxrun = atoi(optarg);
+	       if (maxrun <= 0)
+	       {
+		    fprintf(stderr, "The -j switch requires a positive number of jobs\n");
+		    usage(stderr, argv[0]);
+		    return(1);
+	       }
+	       break;
+
+          // Segment parallel estimation with this many workers
+	  case 'p' :
+	       maxseg = atoi(optarg);
+	       if (maxseg <= 0)
+	       {
+		    fprintf(stderr, "The -p switch requires a positive number of jobs\n");
+		    usage(stderr, argv[0]);
+		    return(1);
+	       }
+	       break;
+
+          // Verify segment parallel estimates
+	  case 'v' :
+	       verify = true;
+	       break;
+#endif
+
           // Display speeds as well as rates
 	  case 's' :
 	       simulator_dump_speeds = true;
@@ -262,178 +1172,74 @@ int main(int argc, const char *argv[])
 
      argc -= optind;
      argv += optind;
-     if (argc == 0)
-	  // Open stdin
-	  ctx = s3g_open(0, NULL);
-     else
-	  // Open the specified file
-	  ctx = s3g_open(0, (void *)argv[0]);
 
-     if (!ctx)
-	  // Assume that s3g_open() has complained
+#if defined(SAILTIME)
+     if (layer_file && (maxrun > 0 || maxseg > 0))
+     {
+	  fprintf(stderr, "The -l switch may not be used with -j or -p\n");
 	  return(1);
+     }
 
-     // Add a writer to use when converting an .s3g packet to 
-     // human readable text
-     s3g_add_writer(ctx, &display, &myctx);
-
-     // Now loop over the input .s3g stream | file
-
-     while (!s3g_command_read(ctx, &cmd))
+     if (maxrun > 0)
      {
-	  // Convert the command to human readable text
-	  myctx.buf[0] = '\0';
-	  s3g_command_display(ctx, &cmd);
+	  int i;
 
-	  if (cmd.cmd_id == HOST_CMD_QUEUE_POINT_NEW)
+	  if (argc == 0)
 	  {
-	       Point target = Point(cmd.t.queue_point_new.x, cmd.t.queue_point_new.y,
-				    cmd.t.queue_point_new.z, cmd.t.queue_point_new.a, 
-				    cmd.t.queue_point_new.b);
-
-	       int32_t ab[2] = { target[A_AXIS], target[B_AXIS] };
-	       for (int i = 0; i < 2; i ++ )
-	       {
-		    if ( cmd.t.queue_point_new.rel & (1 << (A_AXIS + i)))
-		    {
-			 filamentLength[i] += (int64_t)ab[i];
-			 lastFilamentPosition[i] += ab[i];
-		    }
-		    else
-		    {
-			 filamentLength[i] += (int64_t)(ab[i] - lastFilamentPosition[i]);
-			 lastFilamentPosition[i] = ab[i];
-		    }
-	       }
-
-	       steppers::setTargetNew(target, 0, cmd.t.queue_point_new.us, cmd.t.queue_point_new.rel);
-
-	       if (show_moves && myctx.buf[0]) pending_notice("%s\n", myctx.buf);
-	       handle_pending_notices();
-
-	       if (movesplanned() >= (BLOCK_BUFFER_SIZE >> 1)) plan_dump_current_block(1, REPORT);
+	       fprintf(stderr, "The -j switch requires one or more files or directories\n");
+	       return(1);
 	  }
-	  else if (cmd.cmd_id == HOST_CMD_QUEUE_POINT_NEW_EXT)
+	  for (i = 0; i < argc; i++)
+	       if (job_add_path(argv[i]))
+		    return(1);
+	  return(run_jobs(maxrun));
+     }
+     else if (maxseg > 0)
+     {
+	  if (argc != 1)
 	  {
-	       Point target = Point(cmd.t.queue_point_new_ext.x, cmd.t.queue_point_new_ext.y,
-				    cmd.t.queue_point_new_ext.z, cmd.t.queue_point_new_ext.a,
-				    cmd.t.queue_point_new_ext.b);
-
-	       int32_t ab[2] = { target[A_AXIS], target[B_AXIS] };
-	       for (int i = 0; i < 2; i ++ )
-	       {
-		    if ( cmd.t.queue_point_new.rel & (1 << (A_AXIS + i)))
-		    {
-			 filamentLength[i] += (int64_t)ab[i];
-			 lastFilamentPosition[i] += ab[i];
-		    }
-		    else
-		    {
-			 filamentLength[i] += (int64_t)(ab[i] - lastFilamentPosition[i]);
-			 lastFilamentPosition[i] = ab[i];
-		    }
-	       }
-
-	       steppers::setTargetNewExt(target, cmd.t.queue_point_new_ext.dda_rate,
-					 cmd.t.queue_point_new_ext.rel,
-					 cmd.t.queue_point_new_ext.distance,
-					 cmd.t.queue_point_new_ext.feedrate_mult_64);
-
-	       if (show_moves && myctx.buf[0]) pending_notice("%s\n", myctx.buf);
-	       handle_pending_notices();
-
-	       if (movesplanned() >= (BLOCK_BUFFER_SIZE >> 1)) plan_dump_current_block(1, REPORT);
+	       fprintf(stderr, "The -p switch requires a single file\n");
+	       return(1);
 	  }
-	  else if (cmd.cmd_id == HOST_CMD_QUEUE_POINT_EXT)
-	  {
-	       Point target = Point(cmd.t.queue_point_ext.x, cmd.t.queue_point_ext.y,
-				    cmd.t.queue_point_ext.z, cmd.t.queue_point_ext.a,
-				    cmd.t.queue_point_ext.b);
+	  return(estimate_segments(argv[0], maxseg, verify));
+     }
+#endif
 
-	       filamentLength[0] += (int64_t)(target[A_AXIS] - lastFilamentPosition[0]);
-	       filamentLength[1] += (int64_t)(target[B_AXIS] - lastFilamentPosition[1]);
-	       lastFilamentPosition[0] = target[A_AXIS];
-	       lastFilamentPosition[1] = target[B_AXIS];
+     if (argc == 0)
+	  // Open stdin
+	  ctx = s3g_open(S3G_INPUT_TYPE_FILE, NULL);
+     else
+	  // Open and map the specified file
+	  ctx = s3g_open(S3G_INPUT_TYPE_MMAP, (void *)argv[0]);
 
-	       steppers::setTargetNew(target, cmd.t.queue_point_ext.dda, 0, 0);
-	       if (show_moves && myctx.buf[0]) pending_notice("%s\n", myctx.buf);
+     if (!ctx)
+	  // Assume that s3g_open() has complained
+	  return(1);
 
-	       handle_pending_notices();
+     simulate(ctx, (size_t)-1);
 
-	       if (movesplanned() >= (BLOCK_BUFFER_SIZE >> 1)) plan_dump_current_block(1, REPORT);
-	  }
-	  else if (cmd.cmd_id == HOST_CMD_SET_POSITION_EXT)
-	  {
-	       Point target = Point(cmd.t.set_position_ext.x, cmd.t.set_position_ext.y,
-				    cmd.t.set_position_ext.z, cmd.t.set_position_ext.a,
-				    cmd.t.set_position_ext.b);
+     s3g_close(ctx);
 
-	       lastFilamentPosition[0] = target[A_AXIS];
-	       lastFilamentPosition[1] = target[B_AXIS];
+     plan_dump_run_data((REPORT) ? 0 : -1);
 
-	       steppers::definePosition(target, false);
+     if (layer_file)
+     {
+	  size_t len = strlen(layer_file);
+	  FILE *f = fopen(layer_file, "w");
 
-	       if (myctx.buf[0]) pending_notice("%s\n", myctx.buf);
-	       handle_pending_notices();
-	  }
-	  else if (cmd.cmd_id == HOST_CMD_SET_ACCELERATION_TOGGLE)
-	  {
-	       steppers::setSegmentAccelState((cmd.t.set_segment_acceleration.s != 0) ? true : false);		  
-	       if (myctx.buf[0]) pending_notice("%s\n", myctx.buf);
-	  }
-	  else if (cmd.cmd_id == HOST_CMD_RECALL_HOME_POSITION)
-	  {
-	       // Assume A and B axis have 0 for their home positions
-	       if (cmd.t.recall_home_position.axes & (1 << A_AXIS))
-		    lastFilamentPosition[0] = 0;
-	       if (cmd.t.recall_home_position.axes & (1 << B_AXIS))
-		    lastFilamentPosition[0] = 0;
-	  }
-	  else
+	  if (!f)
 	  {
-	       // Dump queued blocks?
-	       if (cmd.cmd_id != HOST_CMD_TOOL_COMMAND &&
-		   cmd.cmd_id != HOST_CMD_ENABLE_AXES &&
-		   cmd.cmd_id != HOST_CMD_SET_BUILD_PERCENT &&
-		   cmd.cmd_id != HOST_CMD_CHANGE_TOOL &&
-		   cmd.cmd_id != HOST_CMD_SET_POSITION_EXT)
-	       {
-		    bool warn = movesplanned() != 0;
-		    if (warn && REPORT) {
-			printf("*** >>> Draining planning buffer <<< ***\n");
-			fflush(stdout);
-		    }
-		    while (movesplanned() != 0)
-			plan_dump_current_block(1, REPORT);
-		    if (warn && REPORT) {
-			printf("*** >>> Planning buffer drained <<< ***\n");
-			fflush(stdout);
-		    }
-	       }
-
-	       if (myctx.buf[0] != '\0')
-	       {
-		    if (cmd.cmd_id == HOST_CMD_CHANGE_TOOL ||
-			cmd.cmd_id == HOST_CMD_ENABLE_AXES ||
-			cmd.cmd_id == HOST_CMD_SET_BUILD_PERCENT ||
-			cmd.cmd_id == HOST_CMD_SET_POSITION_EXT ||
-			cmd.cmd_id == HOST_CMD_TOOL_COMMAND)
-			 pending_notice("%s\n", myctx.buf);
-		    else
-		    {
-			 puts(myctx.buf);
-		    }
-	       }
+	       fprintf(stderr, "Unable to open the file \"%s\"; %s (%d)\n",
+		       layer_file, strerror(errno), errno);
+	       return(1);
 	  }
+	  int istat = plan_dump_layer_stats(f,
+	       (len >= 5 && !strcasecmp(layer_file + len - 5, ".json")) ?
+	       LAYER_STATS_JSON : LAYER_STATS_CSV);
+	  fclose(f);
+	  if (istat)
+	       return(1);
      }
 
-     // Dump any remaining blocks
-     while (movesplanned() != 0)
-	 plan_dump_current_block(1, REPORT);
-
-     s3g_close(ctx);
-
-     plan_dump_run_data((REPORT) ? 0 : -1);
-
      return(0);
 }
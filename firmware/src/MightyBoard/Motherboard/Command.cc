@@ -45,10 +45,19 @@
 #include "SkewTilt.hh"
 #endif
 
+#if defined(SD_PREFLIGHT)
+#include "Preflight.hh"
+#endif
+
 namespace command {
 
 static bool sdCardError;
 
+#if defined(SD_PREFLIGHT)
+// Error from the pre-flight scan, held until the build isn't paused
+static sdcard::SdErrorCode preflightError = sdcard::SD_SUCCESS;
+#endif
+
 #if defined(PSTOP_SUPPORT)
 // When non-zero, a P-Stop has been requested
 bool pstop_triggered = 0;
@@ -139,6 +148,18 @@ static uint32_t home_feedrate;
 static uint16_t home_timeout_s;
 #endif
 
+#if defined(SD_RESUME)
+// SD file offset the build resumed from; the file's commands follow
+// those queued by queueResume()
+static uint32_t resume_offset = 0;
+#endif
+
+#if defined(SD_LAYER_INDEX)
+// Set by skipToLayer(): playback skips from the first layer to another
+static bool skip_pending = false;
+static layer_entry_t skip_first, skip_layer;
+#endif
+
 #if defined(AUTO_LEVEL)
 static uint8_t alevel_state;
 #if defined(PSTOP_SUPPORT) && defined(PSTOP_ZMIN_LEVEL)
@@ -231,6 +252,60 @@ void alevel_update(Point &newPoint) {
      }
 }
 
+#if defined(AUTO_LEVEL_MESH)
+
+// Number of mesh nodes stored since node 0
+static uint8_t mesh_nodes_stored;
+
+// Store the current position as node (index % cols, index / cols) of
+// the auto-level mesh.  Node 0 starts a new mesh, which is marked as
+// complete once cols x rows nodes have been stored.  The nodes must lie
+// in order of increasing X and Y.  An unusable mesh size, such as
+// cols == 0, erases the mesh.
+static void storeMeshPoint(uint8_t cols, uint8_t rows, uint8_t index) {
+     auto_level_mesh_t *mesh = (auto_level_mesh_t *)eeprom_offsets::ALEVEL_MESH;
+     uint8_t size[2] = { 0, 0 };
+     uint8_t nodes = cols * rows;
+
+     if ( cols < 2 || cols > ALEVEL_MESH_MAX_SIDE ||
+	  rows < 2 || rows > ALEVEL_MESH_MAX_SIDE || index >= nodes ) {
+	  mesh_nodes_stored = 0;
+	  cli();
+	  eeprom_write_block(size, &mesh->cols, sizeof(size));
+	  sei();
+	  return;
+     }
+
+     Point p = steppers::getPlannerPosition();
+     int32_t dz = 0;
+
+     cli();
+     if ( index == 0 ) {
+	  // The mesh is incomplete until all its nodes are stored
+	  mesh_nodes_stored = 0;
+	  eeprom_write_block(size, &mesh->cols, sizeof(size));
+	  eeprom_write_block(&p.coordinates[0], mesh->p0, sizeof(mesh->p0));
+     }
+     else {
+	  eeprom_read_block(&dz, &mesh->p0[Z_AXIS], sizeof(int32_t));
+	  dz = p[Z_AXIS] - dz;
+	  if ( dz > 0x7fff ) dz = 0x7fff;
+	  else if ( dz < -0x7fff ) dz = -0x7fff;
+     }
+     int16_t dz16 = (int16_t)dz;
+     eeprom_write_block(&dz16, &mesh->dz[index], sizeof(int16_t));
+     if ( index == nodes - 1 )
+	  eeprom_write_block(&p.coordinates[0], mesh->p1, sizeof(mesh->p1));
+     if ( ++mesh_nodes_stored == nodes ) {
+	  size[0] = cols;
+	  size[1] = rows;
+	  eeprom_write_block(size, &mesh->cols, sizeof(size));
+     }
+     sei();
+}
+
+#endif
+
 #endif
 
 static void heatersOff() {
@@ -259,6 +334,16 @@ static void cancelMidBuild() {
      host::stopBuild();
 }
 
+// Message to display while cancelling a build for an SD card error
+static const prog_uchar *sdErrorMessage(sdcard::SdErrorCode e) {
+     if ( e == sdcard::SD_ERR_NO_CARD_PRESENT ) return NOCARD_MSG;
+     if ( e == sdcard::SD_ERR_CRC ) return CARDCRC_MSG;
+#if defined(SD_PREFLIGHT)
+     if ( e == sdcard::SD_ERR_FILE_CORRUPT ) return CARDFILE_MSG;
+#endif
+     return CARDERROR_MSG;
+}
+
 //Called when filament is extracted via the filament menu during a pause.
 //It prevents noodle from being primed into the extruder on resume
 
@@ -424,7 +509,7 @@ void buildReset() {
 	lastFilamentPosition[0] = lastFilamentPosition[1] = 0;
 
 #ifdef DITTO_PRINT
-	if (( eeprom::getEeprom8(eeprom_offsets::TOOL_COUNT, 1) == 2 ) && ( eeprom::getEeprom8(eeprom_offsets::DITTO_PRINT_ENABLED, 0) ))
+	if (( eeprom::settings.toolCount == 2 ) && ( eeprom::settings.dittoPrintEnabled ))
 		dittoPrinting = true;
 	else	dittoPrinting = false;
 #endif
@@ -469,8 +554,228 @@ void reset() {
 	buildPercentage = 101;
 	command_buffer.reset();
 	mode = READY;
+#if defined(SD_RESUME)
+	resume_offset = 0;
+#endif
+#if defined(SD_LAYER_INDEX)
+	skip_pending = false;
+#endif
+#if defined(SD_PREFLIGHT)
+	preflight::reset();
+	preflightError = sdcard::SD_SUCCESS;
+#endif
+}
+
+#if defined(SD_RESUME) || defined(SD_LAYER_INDEX)
+
+// How far to lift the nozzle off the part while X and Y are homed, and
+// the step interval of the moves there and back
+#define RESUME_LIFT_MM		5
+#define RESUME_US_PER_STEP	500
+
+// Homing as the utility scripts do it
+#define RESUME_HOME_US_PER_STEP	361
+#define RESUME_HOME_TIMEOUT_S	20
+
+#define RESUME_HEAT_TIMEOUT_S	1200
+
+static void push16(uint16_t value) {
+	push((uint8_t)value);
+	push((uint8_t)(value >> 8));
+}
+
+static void push32(uint32_t value) {
+	push16((uint16_t)value);
+	push16((uint16_t)(value >> 16));
+}
+
+static void pushPosition(const int32_t *position, int32_t z) {
+	for ( uint8_t i = 0; i < STEPPER_COUNT; i++ )
+		push32(( i == Z_AXIS ) ? z : position[i]);
+}
+
+#endif
+
+#if defined(SD_RESUME)
+
+void queueResume(const checkpoint_t *checkpoint) {
+	const int32_t *position = checkpoint->position;
+	int32_t z = position[Z_AXIS];
+
+	resume_offset = checkpoint->offset;
+	int32_t lift = (int32_t)(RESUME_LIFT_MM * stepperAxisStepsPerMM(Z_AXIS));
+
+	// Stands in for the notification at the top of the file
+	push(HOST_CMD_BUILD_START_NOTIFICATION);
+	push32(0);
+	push(0);
+
+	// Heat up while homing
+	for ( uint8_t i = 0; i < 3; i++ ) {
+		if ( checkpoint->temperature[i] <= 0 )
+			continue;
+		push(HOST_CMD_TOOL_COMMAND);
+		push(( i == 2 ) ? 0 : i);
+		push(( i == 2 ) ? SLAVE_CMD_SET_PLATFORM_TEMP : SLAVE_CMD_SET_TEMP);
+		push(2);
+		push16((uint16_t)checkpoint->temperature[i]);
+	}
+	push(HOST_CMD_CHANGE_TOOL);
+	push(checkpoint->tool);
+
+	// Z has to be taken as where the power loss left it, skew and all.
+	// Lift the nozzle clear of the part and home X and Y.
+	push(HOST_CMD_SET_POSITION_EXT);
+	pushPosition(position, z + checkpoint->zskew);
+	push(HOST_CMD_QUEUE_POINT_EXT);
+	pushPosition(position, z + checkpoint->zskew + lift);
+	push32(RESUME_US_PER_STEP);
+
+	uint8_t home_max = eeprom::getEeprom8(eeprom_offsets::AXIS_HOME_DIRECTION, 0x1b);
+	for ( uint8_t max = 0; max < 2; max++ ) {
+		uint8_t axes = ( max ? home_max : ~home_max ) & ((1 << X_AXIS) | (1 << Y_AXIS));
+		if ( !axes )
+			continue;
+		push(max ? HOST_CMD_FIND_AXES_MAXIMUM : HOST_CMD_FIND_AXES_MINIMUM);
+		push(axes);
+		push32(RESUME_HOME_US_PER_STEP);
+		push16(RESUME_HOME_TIMEOUT_S);
+	}
+	push(HOST_CMD_RECALL_HOME_POSITION);
+	push((1 << X_AXIS) | (1 << Y_AXIS));
+
+#if defined(AUTO_LEVEL)
+	// Turn auto-level back on with the probing the build already did
+	if ( checkpoint->flags & CHECKPOINT_ALEVEL ) {
+		alevel_state |= 7;
+		push(HOST_CMD_RECALL_HOME_POSITION);
+		push((1 << A_AXIS) | (1 << B_AXIS));
+	}
+#endif
+
+	// Wait for the heaters, the checkpoint's tool last so that it's the
+	// one selected afterwards
+	if ( checkpoint->temperature[2] > 0 ) {
+		push(HOST_CMD_WAIT_FOR_PLATFORM);
+		push(0);
+		push16(100);
+		push16(RESUME_HEAT_TIMEOUT_S);
+	}
+	for ( uint8_t i = 1; i <= 2; i++ ) {
+		uint8_t tool = (checkpoint->tool + i) % 2;
+		if ( checkpoint->temperature[tool] <= 0 )
+			continue;
+		push(HOST_CMD_WAIT_FOR_TOOL);
+		push(tool);
+		push16(100);
+		push16(RESUME_HEAT_TIMEOUT_S);
+	}
+
+	// Return to where the checkpoint's command began; the build carries
+	// on from there
+	push(HOST_CMD_QUEUE_POINT_EXT);
+	pushPosition(position, z + lift);
+	push32(RESUME_US_PER_STEP);
+	push(HOST_CMD_QUEUE_POINT_EXT);
+	pushPosition(position, z);
+	push32(RESUME_US_PER_STEP);
 }
 
+#endif
+
+#if defined(SD_LAYER_INDEX)
+
+// The most bytes queueLayerSkip() pushes
+#define LAYER_SKIP_MAX_BYTES	160
+
+void skipToLayer(const layer_entry_t *first, const layer_entry_t *layer) {
+	skip_first = *first;
+	skip_layer = *layer;
+	skip_pending = true;
+}
+
+// Called as playback reaches the first layer
+static void queueLayerSkip() {
+	const layer_entry_t *from = &skip_first;
+	const layer_entry_t *to = &skip_layer;
+
+	skip_pending = false;
+	// On failure playback ends, and the build is cancelled as for
+	// any other card error
+	if ( !sdcard::playbackSeek(to->offset) )
+		return;
+#if defined(SD_RESUME)
+	resume_offset = to->offset;
+#endif
+
+	// Settings the skipped layers changed
+	for ( uint8_t i = 0; i < 3; i++ ) {
+		if ( to->temperature[i] == from->temperature[i] )
+			continue;
+		push(HOST_CMD_TOOL_COMMAND);
+		push(( i == 2 ) ? 0 : i);
+		push(( i == 2 ) ? SLAVE_CMD_SET_PLATFORM_TEMP : SLAVE_CMD_SET_TEMP);
+		push(2);
+		push16((uint16_t)to->temperature[i]);
+	}
+	for ( uint8_t i = 0; i < 3; i++ ) {
+		uint8_t fan = LAYER_FAN_T0 << i;
+		if ( !((to->flags ^ from->flags) & fan) )
+			continue;
+		push(HOST_CMD_TOOL_COMMAND);
+		push(( i == 2 ) ? 0 : i);
+		push(( fan == LAYER_FAN_EXTRA ) ? SLAVE_CMD_TOGGLE_VALVE : SLAVE_CMD_TOGGLE_FAN);
+		push(1);
+		push(( to->flags & fan ) ? 1 : 0);
+	}
+	if ( to->tool != from->tool ) {
+		push(HOST_CMD_CHANGE_TOOL);
+		push(to->tool);
+	}
+
+	// The extruders are taken to be where the layer has them, so that
+	// the skipped extrusion isn't made up for
+	int32_t position[STEPPER_COUNT];
+	for ( uint8_t i = 0; i < STEPPER_COUNT; i++ )
+		position[i] = ( i < A_AXIS ) ? from->position[i] : to->position[i];
+	push(HOST_CMD_SET_POSITION_EXT);
+	pushPosition(position, from->position[Z_AXIS]);
+
+	// Rise clear of the first layer's priming to above the layer, and
+	// wait there for any heater the layer has hotter
+	int32_t lift = (int32_t)(RESUME_LIFT_MM * stepperAxisStepsPerMM(Z_AXIS));
+	int32_t zclear = ( ( to->position[Z_AXIS] > from->position[Z_AXIS] ) ?
+			   to->position[Z_AXIS] : from->position[Z_AXIS] ) + lift;
+	push(HOST_CMD_QUEUE_POINT_EXT);
+	pushPosition(position, zclear);
+	push32(RESUME_US_PER_STEP);
+	if ( to->temperature[2] > from->temperature[2] ) {
+		push(HOST_CMD_WAIT_FOR_PLATFORM);
+		push(0);
+		push16(100);
+		push16(RESUME_HEAT_TIMEOUT_S);
+	}
+	for ( uint8_t i = 1; i <= 2; i++ ) {
+		uint8_t tool = (to->tool + i) % 2;
+		if ( to->temperature[tool] <= from->temperature[tool] )
+			continue;
+		push(HOST_CMD_WAIT_FOR_TOOL);
+		push(tool);
+		push16(100);
+		push16(RESUME_HEAT_TIMEOUT_S);
+	}
+
+	// Across and down onto the layer
+	push(HOST_CMD_QUEUE_POINT_EXT);
+	pushPosition(to->position, to->position[Z_AXIS] + lift);
+	push32(RESUME_US_PER_STEP);
+	push(HOST_CMD_QUEUE_POINT_EXT);
+	pushPosition(to->position, to->position[Z_AXIS]);
+	push32(RESUME_US_PER_STEP);
+}
+
+#endif
+
 bool isWaiting() {
 	return (mode == WAIT_ON_BUTTON);
 }
@@ -640,17 +945,13 @@ void platformAccess(bool clearPlatform) {
    steppers::alterSpeed = as;
 }
 
-//Adds the filament used during this build for a particular extruder
+//Resets the filament used during this build for a particular extruder
+//once it has been added to the lifetime counter
 void addFilamentUsedForExtruder(uint8_t extruder) {
         //Need to do this to get the absolute amount
         int64_t fl = getFilamentLength(extruder);
 
         if ( fl > 0 ) {
-		int16_t offset = eeprom_offsets::FILAMENT_LIFETIME + extruder * sizeof(int64_t);
-                int64_t filamentUsed = eeprom::getEepromInt64(offset, 0);
-                filamentUsed += fl;
-                eeprom::setEepromInt64(offset, filamentUsed);
-
                 //We've used it up, so reset it
                 lastFilamentLength[extruder] = filamentLength[extruder];
                 filamentLength[extruder] = 0;
@@ -658,7 +959,11 @@ void addFilamentUsedForExtruder(uint8_t extruder) {
 }
 
 //Adds the filament used during this build
-void addFilamentUsed() {
+void addFilamentUsed(uint32_t seconds) {
+	// Added through the journal, which must first hold all that's used
+	host::logCounters();
+	eeprom::addCounters(getFilamentLength(0), getFilamentLength(1), seconds);
+
 	addFilamentUsedForExtruder(0);	//A
 	addFilamentUsedForExtruder(1);	//B
 }
@@ -717,12 +1022,25 @@ static void pstop_incr() {
      }
 }
 
+#if defined(SD_RESUME)
+uint32_t getSDOffset() {
+	if ( !sdcard::isPlaying() )
+		return 0;
+	// Commands queued by queueResume() come before the file's
+	uint32_t offset = sdcard::playbackOffset() - command_buffer.getLength();
+	return ( offset >= resume_offset ) ? offset : 0;
+}
+#endif
+
 // Handle movement comands -- called from a few places
 static void handleMovementCommand(const uint8_t &command) {
         // Motherboard::getBoard().resetUserInputTimeout();  // call already made by our caller
 	if (command == HOST_CMD_QUEUE_POINT_EXT) {
 		// check for completion
 		if (command_buffer.getLength() >= 25) {
+#if defined(SD_RESUME)
+			steppers::setSourceOffset(getSDOffset());
+#endif
 			pop8(); // remove the command code
 			mode = MOVING;
 
@@ -754,6 +1072,9 @@ static void handleMovementCommand(const uint8_t &command) {
 	 else if (command == HOST_CMD_QUEUE_POINT_NEW) {
 		// check for completion
 		if (command_buffer.getLength() >= 26) {
+#if defined(SD_RESUME)
+			steppers::setSourceOffset(getSDOffset());
+#endif
 			pop8(); // remove the command code
 			mode = MOVING;
 
@@ -802,9 +1123,20 @@ static void handleMovementCommand(const uint8_t &command) {
 			steppers::setTargetNew(Point(x,y,z,a,b), 0, us, relative);
 		}
 	}
-	else if (command == HOST_CMD_QUEUE_POINT_NEW_EXT ) {
+	else if (command == HOST_CMD_QUEUE_POINT_NEW_EXT
+#if defined(SD_PLANNED)
+		 || command == HOST_CMD_QUEUE_POINT_PLANNED
+#endif
+		) {
+		uint8_t length = 32;
+#if defined(SD_PLANNED)
+		if ( command == HOST_CMD_QUEUE_POINT_PLANNED ) length += PLANNED_MOVE_SIZE;
+#endif
 		// check for completion
-		if (command_buffer.getLength() >= 32) {
+		if (command_buffer.getLength() >= length) {
+#if defined(SD_RESUME)
+			steppers::setSourceOffset(getSDOffset());
+#endif
 			pop8(); // remove the command code
 			mode = MOVING;
 
@@ -819,6 +1151,23 @@ static void handleMovementCommand(const uint8_t &command) {
 			float *distance = (float *)&distanceInt32;
 			int16_t feedrateMult64 = pop16();
 
+#if defined(SD_PLANNED)
+			planned_move_t planned;
+			if ( command == HOST_CMD_QUEUE_POINT_PLANNED ) {
+				for ( uint8_t i = 0; i < STEPPER_COUNT; i++ )
+					planned.steps[i] = pop16();
+				planned.dda_rate = pop32();
+				for ( uint8_t i = 0; i < STEPPER_COUNT; i++ )
+					planned.delta_mm[i] = pop32();
+				planned.millimeters         = pop32();
+				planned.inverse_millimeters = pop32();
+				planned.acceleration_st     = pop32();
+				planned.acceleration        = pop32();
+				planned.acceleration_rate   = pop32();
+				planned.v_allowable         = pop32();
+			}
+#endif
+
 #ifdef DITTO_PRINT
    			if ( dittoPrinting ) {
 				if ( currentToolIndex == 0 ) {
@@ -854,6 +1203,13 @@ static void handleMovementCommand(const uint8_t &command) {
 			// Positions must be known at this point; okay to do a pstop and
 			// its attendant platform clearing
 			pstop_incr();
+#endif
+#if defined(SD_PLANNED)
+			if ( command == HOST_CMD_QUEUE_POINT_PLANNED )
+				steppers::setTargetPlanned(Point(x,y,z,a,b), dda_rate,
+							   relative | steppers::alterSpeed,
+							   *distance, feedrateMult64, &planned);
+			else
 #endif
 			steppers::setTargetNewExt(Point(x,y,z,a,b), dda_rate,
 						  relative | steppers::alterSpeed,
@@ -881,12 +1237,21 @@ bool processExtruderCommandPacket(int8_t overrideToolIndex) {
 		switch (command) {
 		case SLAVE_CMD_SET_TEMP:
 			temp = (int16_t)command_buffer[4] + (int16_t)( command_buffer[5] << 8 );
-			if ( temp == 0 ) addFilamentUsed();
+			// A build adds the filament it used when it ends, so that
+			// the planner isn't held up while the EEPROM is written; until
+			// then the counter journal holds it
+			if ( temp == 0 ) {
+				host::BuildState state = host::getBuildState();
+				if ( state != host::BUILD_RUNNING && state != host::BUILD_PAUSED &&
+				     state != host::BUILD_CANCELLING )
+					addFilamentUsed();
+			}
 
 			/// Handle override gcode temp
 			if (( temp ) && ( altTemp[toolIndex] ||
-					   (eeprom::getEeprom8(eeprom_offsets::OVERRIDE_GCODE_TEMP, DEFAULT_OVERRIDE_GCODE_TEMP)) ))
-			    temp = altTemp[toolIndex] ? (int16_t)altTemp[toolIndex] : eeprom::getEeprom16(eeprom_offsets::PREHEAT_SETTINGS + toolIndex * sizeof(int16_t), DEFAULT_PREHEAT_TEMP);
+					   eeprom::settings.overrideGcodeTemp ))
+			    temp = altTemp[toolIndex] ? (int16_t)altTemp[toolIndex] :
+				    ( toolIndex ? eeprom::settings.preheatLeftTemp : eeprom::settings.preheatRightTemp );
 
 #ifdef DEBUG_NO_HEAT_NO_WAIT
 			temp  = 0;
@@ -925,8 +1290,8 @@ bool processExtruderCommandPacket(int8_t overrideToolIndex) {
 			temp = 0;
 #endif
 			/// Handle override gcode temp
-			if (( temp ) && ( eeprom::getEeprom8(eeprom_offsets::OVERRIDE_GCODE_TEMP, 0) )) {
-				temp = eeprom::getEeprom16(eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_PLATFORM_TEMP, 100);
+			if (( temp ) && ( eeprom::settings.overrideGcodeTemp )) {
+				temp = eeprom::settings.preheatPlatformTemp;
 			}
 
 			board.getPlatformHeater().set_target_temperature(temp);
@@ -1028,7 +1393,7 @@ void handlePauseState(void) {
 
 		    //If we're pausing, and we have HEAT_DURING_PAUSE switched off, switch off the heaters
 		    //if (( ! cancelling ) && ( ! (eeprom::getEeprom8(eeprom_offsets::HEAT_DURING_PAUSE, DEFAULT_HEAT_DURING_PAUSE) )))
-		    if ( coldPause || !(eeprom::getEeprom8(eeprom_offsets::HEAT_DURING_PAUSE, DEFAULT_HEAT_DURING_PAUSE)) )
+		    if ( coldPause || !eeprom::settings.heatDuringPause )
 			heatersOff();
 		    if ( coldPause ) {
 #ifdef HAS_RGB_LED
@@ -1186,8 +1551,23 @@ void runCommandSlice() {
     // get command from SD card if building from SD
     if ( sdcard::isPlaying() ) {
 	while (command_buffer.getRemainingCapacity() > 0 && sdcard::playbackHasNext()) {
+#if defined(SD_LAYER_INDEX)
+	    if ( skip_pending && sdcard::playbackOffset() == skip_first.offset ) {
+		// Wait for room to queue the way to the layer
+		if ( command_buffer.getRemainingCapacity() < LAYER_SKIP_MAX_BYTES ) break;
+		queueLayerSkip();
+		continue;
+	    }
+#endif
+#if defined(SD_READ_AHEAD)
+	    // Leave waiting on the card to the read-ahead
+	    if ( !sdcard::playbackReady() ) break;
+#endif
 	    command_buffer.push(sdcard::playbackNext());
 	}
+#if defined(SD_READ_AHEAD)
+	sdcard::playbackReadAhead();
+#endif
 
 	// Deal with any end of file conditions
 	if( !sdcard::playbackHasNext() ) {
@@ -1205,9 +1585,7 @@ void runCommandSlice() {
 		sdCardError = true;
 
 		// Establish an error message to display while cancelling the build
-		if ( sdcard::sdAvailable == sdcard::SD_ERR_NO_CARD_PRESENT ) pauseErrorMessage = NOCARD_MSG;
-		else if ( sdcard::sdAvailable == sdcard::SD_ERR_CRC ) pauseErrorMessage = CARDCRC_MSG;
-		else pauseErrorMessage = CARDERROR_MSG;
+		pauseErrorMessage = sdErrorMessage(sdcard::sdAvailable);
 
 		// Now cancel the build
 		cancelMidBuild();
@@ -1330,6 +1708,27 @@ void runCommandSlice() {
 			mode = READY;
 	}
 
+#if defined(SD_PREFLIGHT)
+	// Scan the rest of the build file while the card would otherwise sit
+	// idle waiting on the heaters
+	if ( ( mode == WAIT_ON_TOOL || mode == WAIT_ON_PLATFORM ) && sdcard::isPlaying() &&
+	     !preflight::done() ) {
+		sdcard::SdErrorCode e = preflight::scan();
+		if ( e != sdcard::SD_SUCCESS )
+			preflightError = e;
+	}
+
+	// The scan returns an error only once, so one found while paused is
+	// kept until the build is unpaused and then cancels it
+	if ( preflightError != sdcard::SD_SUCCESS && paused == PAUSE_STATE_NONE ) {
+		sdCardError = true;
+		pauseErrorMessage = sdErrorMessage(preflightError);
+		preflightError = sdcard::SD_SUCCESS;
+		cancelMidBuild();
+		return;
+	}
+#endif
+
 	if ( mode == WAIT_ON_TOOL ) {
 		if ( tool_wait_timeout.hasElapsed() ) {
 			Motherboard::getBoard().errorResponse(EXTRUDER_TIMEOUT_MSG);
@@ -1413,6 +1812,9 @@ void runCommandSlice() {
 			if ((command != HOST_CMD_QUEUE_POINT_EXT) &&
  			    (command != HOST_CMD_QUEUE_POINT_NEW) &&
 			    (command != HOST_CMD_QUEUE_POINT_NEW_EXT ) &&
+#if defined(SD_PLANNED)
+			    (command != HOST_CMD_QUEUE_POINT_PLANNED ) &&
+#endif
 			    (command != HOST_CMD_ENABLE_AXES ) &&
 			    (command != HOST_CMD_CHANGE_TOOL ) &&
 			    (command != HOST_CMD_SET_POSITION_EXT) &&
@@ -1426,7 +1828,11 @@ void runCommandSlice() {
        	                 }
 
 		if (command == HOST_CMD_QUEUE_POINT_EXT || command == HOST_CMD_QUEUE_POINT_NEW ||
-		     command == HOST_CMD_QUEUE_POINT_NEW_EXT ) {
+		     command == HOST_CMD_QUEUE_POINT_NEW_EXT
+#if defined(SD_PLANNED)
+		     || command == HOST_CMD_QUEUE_POINT_PLANNED
+#endif
+		     ) {
 					handleMovementCommand(command);
 			}  else if (command == HOST_CMD_CHANGE_TOOL) {
 				if (command_buffer.getLength() >= 2) {
@@ -1704,6 +2110,11 @@ void runCommandSlice() {
 					     // M132 AB -- initialize and enable skew
 					     // alevel_state must have bits 0, 1, and 2 set
 					     uint8_t alevel_valid = 1;
+#if defined(AUTO_LEVEL_MESH)
+					     // skew_init() uses a stored mesh in place
+					     // of the three probing points
+					     if ( skew_mesh_stored() ) alevel_state |= 7;
+#endif
 					     if ( 7 == (alevel_state & 7) ) {
 						  // Attempt to enable auto-level
 						  auto_level_t alevel_data;
@@ -2003,6 +2414,34 @@ void runCommandSlice() {
 					if ( *zPos < 0.001 )	*zPos = 0.0;
 					pauseAtZPos(stepperAxisMMToSteps(*zPos, Z_AXIS));
 				}
+#if defined(AUTO_LEVEL_MESH)
+			} else if ( command == HOST_CMD_STORE_MESH_POINT ) {
+				if ( command_buffer.getLength() >= 4 ) {
+					pop8(); // remove the command code
+					uint8_t cols = pop8();
+					uint8_t rows = pop8();
+					uint8_t index = pop8();
+					LINE_NUMBER_INCR;
+					storeMeshPoint(cols, rows, index);
+				}
+#endif
+#if defined(SD_PLANNED)
+			} else if ( command == HOST_CMD_PLANNED_HEADER ) {
+				if ( command_buffer.getLength() >= 6 ) {
+					pop8(); // remove the command code
+					uint8_t version = pop8();
+					uint32_t hash = pop32();
+					LINE_NUMBER_INCR;
+					steppers::setPlannedKey(version, hash);
+				}
+#endif
+			} else if ( command == HOST_CMD_FILE_CHECKSUM ) {
+				// Checked by the pre-flight scan, if at all
+				if ( command_buffer.getLength() >= 5 ) {
+					pop8(); // remove the command code
+					pop32();
+					LINE_NUMBER_INCR;
+				}
 		        } else {
 		        }
 		}
@@ -2024,8 +2463,17 @@ int32_t estimatedTimeLeftInSeconds(void) {
 	//Safety guard against insufficient information, we return 0 if this is the case
 	if (( buildPercentage == 101 ) || ( buildPercentage == 0 ) ||
 	    ( buildPercentage == startingBuildTimePercentage ) ||
-	    (startingBuildTimePercentage == 0 ) || (elapsedSecondsSinceBuildStart == 0))
+	    (startingBuildTimePercentage == 0 ) || (elapsedSecondsSinceBuildStart == 0)) {
+#if defined(SD_PREFLIGHT)
+		// Until then, the nominal time of the rest of the file
+		if ( sdcard::isPlaying() ) {
+			int32_t secs = preflight::secondsLeft(sdcard::playbackOffset());
+			if ( secs > 0 )
+				return secs;
+		}
+#endif
 		return 0;
+	}
 
 	//The build time is not calculated from the start of the build, it's calculated from the first non zero build
 	//percentage update sent in the .s3g or from the host
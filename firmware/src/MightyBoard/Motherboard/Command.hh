@@ -20,6 +20,12 @@
 
 #include <stdint.h>
 #include "Configuration.hh"
+#if defined(SD_RESUME)
+#include "EepromMap.hh"
+#endif
+#if defined(SD_LAYER_INDEX)
+#include "LayerIndex.hh"
+#endif
 
 
 //Pause states are used internally to determine various scenarios, so the
@@ -93,8 +99,8 @@ void buildReset();
 /// State which needs to be reset at the end of a build
 void buildDone();
 
-/// Adds the filament used in this build to eeprom
-void addFilamentUsed();
+/// Adds the filament used in this build, and seconds of print time, to eeprom
+void addFilamentUsed(uint32_t seconds = 0);
 
 /// Run the command thread slice.
 void runCommandSlice();
@@ -173,6 +179,32 @@ void clearLineNumber();
 
 #endif
 
+#if defined(SD_RESUME)
+
+/// SD file offset of the next command to run
+/// \return 0 if commands aren't coming from the SD card
+uint32_t getSDOffset();
+
+/// Queue the commands which bring the machine back to a checkpoint:
+/// heat up, home X and Y, and return to where the checkpoint's command
+/// began.  The build from SD then goes on from the checkpoint's offset.
+void queueResume(const checkpoint_t *checkpoint);
+
+#endif
+
+#if defined(SD_LAYER_INDEX)
+
+/// Go on from a later layer of the build being played from SD.  The
+/// build's start sequence is run as usual; once it's been read, playback
+/// skips to the layer, queueing the moves and settings which take the
+/// machine from where the first layer begins to where this one does.
+/// Call after reset().
+/// \param[in] first Index entry of the build's first layer
+/// \param[in] layer Index entry of the layer to go on from
+void skipToLayer(const layer_entry_t *first, const layer_entry_t *layer);
+
+#endif
+
 /// if we update the line_counter  to allow overflow, we'll need to update the BuildStats Screen implementation
 const static uint32_t MAX_LINE_COUNT = 1000000000;
 
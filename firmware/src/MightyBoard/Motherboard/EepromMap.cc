@@ -64,15 +64,25 @@ void setDefaultCoolingFan(uint16_t eeprom_base){
 }
 
 
+/**
+ * Store PID gains
+ * @param eeprom_base start of PID block of EEPROM. Can be extruder or HPB
+ */
+void setPID(uint16_t eeprom_base, float p, float i, float d)
+{
+	setEepromFixed16(( eeprom_base + pid_eeprom_offsets::P_TERM_OFFSET ), p);
+	setEepromFixed16(( eeprom_base + pid_eeprom_offsets::I_TERM_OFFSET ), i);
+	setEepromFixed16(( eeprom_base + pid_eeprom_offsets::D_TERM_OFFSET ), d);
+}
+
+
 /**
  * Start of PID block of EEPROM. Can be extruder or HPB
  * @param eeprom_base
  */
 void setDefaultPID(uint16_t eeprom_base)
 {
-	setEepromFixed16(( eeprom_base + pid_eeprom_offsets::P_TERM_OFFSET ), DEFAULT_P_VALUE);
-	setEepromFixed16(( eeprom_base + pid_eeprom_offsets::I_TERM_OFFSET ), DEFAULT_I_VALUE);
-	setEepromFixed16(( eeprom_base + pid_eeprom_offsets::D_TERM_OFFSET ), DEFAULT_D_VALUE);
+	setPID(eeprom_base, DEFAULT_P_VALUE, DEFAULT_I_VALUE, DEFAULT_D_VALUE);
 }
 
 
@@ -311,6 +321,9 @@ void factoryResetEEPROM()
 			       A_POT_DEFAULT,
 			       B_POT_DEFAULT };
 
+	// Nothing pending may land on top of the defaults
+	flushSettings();
+
 	/// Write 'MainBoard' settings
 	eeprom_write_block(THE_REPLICATOR_STR,
 			   (uint8_t*)eeprom_offsets::MACHINE_NAME,sizeof(THE_REPLICATOR_STR));
@@ -421,6 +434,9 @@ void factoryResetEEPROM()
 		  sizeof(uint32_t)*5);
 	}
 
+	// No auto level mesh
+	eeprom_write_byte((uint8_t*)eeprom_offsets::ALEVEL_MESH, 0);
+
 #ifdef PSTOP_SUPPORT
 	eeprom_write_byte((uint8_t*)eeprom_offsets::PSTOP_ENABLE,   DEFAULT_PSTOP_ENABLE);
 	eeprom_write_byte((uint8_t*)eeprom_offsets::PSTOP_INVERTED, DEFAULT_PSTOP_INVERTED);
@@ -430,6 +446,7 @@ void factoryResetEEPROM()
 	eeprom_write_byte((uint8_t*)eeprom_offsets::TEMP_SENSOR_TYPES, DEFAULT_TEMP_SENSOR_TYPES);
 #endif
 
+	loadSettings();
 }
 
 void setToolHeadCount(uint8_t count) {
@@ -447,7 +464,7 @@ void setToolHeadCount(uint8_t count) {
 	if ( count != 1 )
 	        count = 2;
 #endif
-	eeprom_write_byte((uint8_t*)eeprom_offsets::TOOL_COUNT, count);
+	setSetting(SETTING_toolCount, count);
 
 	// update XY axis offsets to match tool head settings
 	SETDEFAULTAXISHOMEPOSITIONS(false);
@@ -461,12 +478,12 @@ bool isSingleTool(){
 	// MBI tested with == 1 BUT when writing this same value,
         //  they treat a value > 2 as implying 1.  SOOO, a better test
 	//  is to consider single anything which is != 2.
-	return (getEeprom8(eeprom_offsets::TOOL_COUNT, 1) != 2);
+	return (settings.toolCount != 2);
 }
 //#endif
 
 bool hasHBP() {
-	return (getEeprom8(eeprom_offsets::HBP_PRESENT, 1) == 1);
+	return (settings.hbpPresent == 1);
 }
 
 //
@@ -474,7 +491,9 @@ void storeToolheadToleranceDefaults(){
 
 	// assume t0 to t1 distance is in specifications (0 steps tolerance error)
 	uint32_t offsets[3] = {0,0,0};
+	flushSettings();
 	eeprom_write_block((uint8_t*)&(offsets[0]),(uint8_t*)(eeprom_offsets::TOOLHEAD_OFFSET_SETTINGS), 12 );
+	loadSettings();
 }
 
 void getBuildTime(uint16_t *hours, uint8_t *minutes) {
@@ -71,6 +71,69 @@ typedef struct {
      int32_t  p3[3];      // Probed point 3, units of steps
 } auto_level_t;
 
+// A mesh of probed heights, cols x rows nodes.  Node (i, j) is probed
+// at X = p0[0] + i * (p1[0] - p0[0]) / (cols - 1) and likewise for Y;
+// it is stored as dz[j * cols + i].
+#define ALEVEL_MESH_MAX_SIDE  7
+#define ALEVEL_MESH_MAX_NODES (ALEVEL_MESH_MAX_SIDE * ALEVEL_MESH_MAX_SIDE)
+
+typedef struct {
+     uint8_t  cols;       // Nodes along X; 0 if no mesh is stored
+     uint8_t  rows;       // Nodes along Y
+     int32_t  p0[3];      // Probed node (0, 0), units of steps
+     int32_t  p1[2];      // X and Y of node (cols - 1, rows - 1), units of steps
+     int16_t  dz[ALEVEL_MESH_MAX_NODES]; // Z of each node less p0[2], units of steps
+} auto_level_mesh_t;
+
+// Where a build from SD can pick up again after a power loss: the file
+// offset of a command none of whose moves had run, and the machine's
+// state as it began.  Positions have the toolhead offsets and the
+// auto-level skew removed.
+typedef struct {
+     uint32_t offset;         // File offset of the command; 0 if there is no checkpoint
+     int32_t  position[5];    // X, Y, Z, A and B, units of steps
+     int32_t  zskew;          // What auto-level added to Z there, units of steps
+     int16_t  temperature[3]; // Set temperatures of tool 0, tool 1 and the platform
+     uint8_t  tool;           // Active toolhead
+     uint8_t  flags;          // CHECKPOINT_ALEVEL if auto-level was on
+} checkpoint_t;
+
+#define CHECKPOINT_ALEVEL 0x01
+
+// Room for the name of the checkpoint's file, NUL included
+#define CHECKPOINT_FILE_LEN 32
+
+// One entry of the counter journal: what the build in progress has added
+// to the lifetime counters but not yet written to them, and where it
+// could resume from.  The CRC and then the sequence number are written
+// last, so that a record torn by a power loss is never taken for the
+// latest one.
+typedef struct {
+     int32_t  filament[2]; // Filament extruded by A and B, units of steps
+     uint32_t seconds;     // Print time, including seconds short of a minute
+                           // left over from the lifetime print time
+     checkpoint_t checkpoint;
+     uint16_t crc;         // CRC-16 of the bytes above
+     uint8_t  seq;         // Numbers the records 0 to 0xfe; 0xff is erased
+} counter_record_t;
+
+// The new totals of the lifetime counters while they are added to.  It
+// names the journal record which no longer holds what is added; once
+// that record is the latest, the totals are committed to.  Its sequence
+// number is erased once the lifetime counters hold them.
+typedef struct {
+     int64_t  lifetime[2]; // FILAMENT_LIFETIME's new totals
+     uint16_t hours;       // and TOTAL_BUILD_TIME's
+     uint8_t  minutes;
+     uint16_t crc;         // CRC-16 of the bytes above
+     uint8_t  seq;         // The record's sequence number; 0xff if none
+} counter_commit_t;
+
+// Every record rewrites the sequence number and CRC of its slot.  At a
+// record every 30 seconds, 60 slots rewrite each slot every 30 minutes,
+// so cells good for 100,000 writes last 50,000 hours of printing.
+#define COUNTER_LOG_RECORDS 60
+
 #define ALEVEL_MAX_ZPROBE_HITS_DEFAULT  3
 #define ALEVEL_ZPROBE_HITS_RESET_MM 3
 
@@ -436,6 +499,30 @@ const static uint16_t FREE_EEPROM_STARTS        = 0x020C;
 
 //Sailfish specific settings work backwards from the end of the eeprom 0xFFF
 
+//Lifetime counter totals being committed to, counter_commit_t
+// 2 x 64 bit + 16 bit + 8 bit + 16 bit + 8 bit = 22 bytes
+//$BEGIN_ENTRY
+//$type:B $ignore:True
+const static uint16_t COUNTER_COMMIT            = 0x02A5;
+
+//Name of the file the checkpoint in the counter journal belongs to
+// CHECKPOINT_FILE_LEN = 32 bytes, NUL terminated
+//$BEGIN_ENTRY
+//$type:B $ignore:True
+const static uint16_t CHECKPOINT_FILE           = 0x02BB;
+
+//Journal of the build's counters, COUNTER_LOG_RECORDS x counter_record_t
+// 60 x 51 bytes = 3060 bytes
+//$BEGIN_ENTRY
+//$type:B $ignore:True
+const static uint16_t COUNTER_LOG               = 0x02DB;
+
+//Auto level mesh of probed heights, auto_level_mesh_t
+// 2 x 8 bit + 5 x 32 bit + 49 x 16 bit = 120 bytes
+//$BEGIN_ENTRY
+//$type:B $ignore:True
+const static uint16_t ALEVEL_MESH               = 0x0ECF;
+
 //Azteeg X3 temp sensor types
 //Bitmap with 0 == thermistor, 1 == Type K thermocouple
 //  bit 0 -- Tool 0
@@ -830,6 +917,7 @@ namespace eeprom {
     void fullResetEEPROM();
     void setToolHeadCount(uint8_t count);
     void setCustomColor(uint8_t red, uint8_t green, uint8_t blue);
+    void setPID(uint16_t eeprom_base, float p, float i, float d);
     bool isSingleTool();
     bool hasHBP();
     void setDefaultsAcceleration();
@@ -839,5 +927,89 @@ namespace eeprom {
     void getBuildTime(uint16_t *hours, uint8_t *minutes);
     void setBuildTime(uint16_t hours, uint8_t minutes);
     bool heatLights();
+
+/**
+ * Settings consulted while a build is running, shadowed in RAM so that
+ * reading one is a load and changing one from the menus does not stall
+ * the main loop while the EEPROM is programmed.  Each entry is
+ *   S(type, name, eeprom offset, default when the EEPROM is erased)
+ */
+#define EEPROM_SETTINGS(S) \
+    S(uint8_t,  toolCount,            eeprom_offsets::TOOL_COUNT, 1) \
+    S(uint8_t,  hbpPresent,           eeprom_offsets::HBP_PRESENT, 1) \
+    S(uint8_t,  dittoPrintEnabled,    eeprom_offsets::DITTO_PRINT_ENABLED, 0) \
+    S(uint8_t,  overrideGcodeTemp,    eeprom_offsets::OVERRIDE_GCODE_TEMP, DEFAULT_OVERRIDE_GCODE_TEMP) \
+    S(uint8_t,  heatDuringPause,      eeprom_offsets::HEAT_DURING_PAUSE, DEFAULT_HEAT_DURING_PAUSE) \
+    S(uint8_t,  clearForEstop,        eeprom_offsets::CLEAR_FOR_ESTOP, 0) \
+    S(uint8_t,  extruderHold,         eeprom_offsets::EXTRUDER_HOLD, DEFAULT_EXTRUDER_HOLD) \
+    S(uint8_t,  toolheadOffsetSystem, eeprom_offsets::TOOLHEAD_OFFSET_SYSTEM, DEFAULT_TOOLHEAD_OFFSET_SYSTEM) \
+    S(uint16_t, preheatRightTemp,     eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_RIGHT_TEMP, DEFAULT_PREHEAT_TEMP) \
+    S(uint16_t, preheatLeftTemp,      eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_LEFT_TEMP, DEFAULT_PREHEAT_TEMP) \
+    S(uint16_t, preheatPlatformTemp,  eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_PLATFORM_TEMP, DEFAULT_PREHEAT_HBP) \
+    S(uint32_t, toolheadOffsetX,      eeprom_offsets::TOOLHEAD_OFFSET_SETTINGS + 0, 0) \
+    S(uint32_t, toolheadOffsetY,      eeprom_offsets::TOOLHEAD_OFFSET_SETTINGS + 4, 0)
+
+#define EEPROM_SETTING_FIELD(type, name, offset, dflt) type name;
+#define EEPROM_SETTING_ID(type, name, offset, dflt) SETTING_##name,
+
+    struct Settings {
+        EEPROM_SETTINGS(EEPROM_SETTING_FIELD)
+    };
+
+    enum {
+        EEPROM_SETTINGS(EEPROM_SETTING_ID)
+        SETTING_COUNT
+    };
+
+    extern Settings settings;
+
+    /// Read the shadowed settings from the EEPROM, writing back any
+    /// pending changes first
+    void loadSettings();
+
+    /// Change a setting now and queue it for writing to the EEPROM
+    void setSetting(uint8_t id, uint32_t value);
+
+    /// Start programming at most one byte of a pending setting; returns
+    /// at once if the EEPROM is still busy with the last one
+    void runEepromSlice();
+
+    /// Write back all pending settings and the pending counter record,
+    /// waiting for each byte.  Call this before writing the EEPROM
+    /// directly and loadSettings() after.
+    void flushSettings();
+
+    /// Find the latest counter record, finish adding to the lifetime
+    /// counters if a power loss cut that short, and add what the record
+    /// holds if a power loss kept the build from doing so
+    void initCounterLog();
+
+    /// Queue a counter record for the build in progress.  Records are
+    /// written round the journal by runEepromSlice() so that no one
+    /// cell wears out.
+    void logCounters(int64_t filamentA, int64_t filamentB, uint32_t seconds);
+
+    /// Add part of what the last counter record holds to the lifetime
+    /// counters, through the journal so that a power loss can neither
+    /// lose it nor add it twice.  Seconds short of a whole minute are
+    /// carried over in the journal.  Waits for the EEPROM.
+    void addCounters(int64_t filamentA, int64_t filamentB, uint32_t seconds);
+
+#if defined(SD_RESUME)
+    /// Set the checkpoint which the next counter record carries;
+    /// 0 clears it
+    void setCheckpoint(const checkpoint_t *checkpoint);
+
+    /// The checkpoint of the last build from SD, as journaled
+    /// \return 0 if that build ended or never set one
+    const checkpoint_t *getCheckpoint();
+
+    /// Name the file that checkpoints belong to, rewriting only the
+    /// bytes which change.  The name must fit in CHECKPOINT_FILE_LEN.
+    void setCheckpointFile(const char *name);
+
+    /// Read back the name given to setCheckpointFile()
+    void getCheckpointFile(char *name, uint8_t size);
+#endif
 }
 #endif // EEPROMMAP_HH
@@ -20,6 +20,7 @@
 #include <string.h>
 #include "Commands.hh"
 #include "Steppers.hh"
+#include "SkewTilt.hh"
 #include "Configuration.hh"
 #if HONOR_DEBUG_PACKETS
 #include "DebugPacketProcessor.hh"
@@ -52,11 +53,17 @@ bool processExtruderQueryPacket(const InPacket& from_host, OutPacket& to_host);
 Timeout packet_in_timeout;
 Timeout cancel_timeout;
 Timeout do_host_reset_timeout;
+Timeout counter_log_timeout;
 bool buildWasCancelled;
 
 #define HOST_PACKET_TIMEOUT_MS 200
 #define HOST_PACKET_TIMEOUT_MICROS (1000L*HOST_PACKET_TIMEOUT_MS)
 
+// How often a build journals its counters so that a power loss costs
+// the lifetime counters no more than this.  The journal's endurance, given
+// with COUNTER_LOG_RECORDS, is worked out for this interval.
+#define COUNTER_LOG_INTERVAL_MICROS (30L*1000000L)
+
 //#define HOST_TOOL_RESPONSE_TIMEOUT_MS 50
 //#define HOST_TOOL_RESPONSE_TIMEOUT_MICROS (1000L*HOST_TOOL_RESPONSE_TIMEOUT_MS)
 
@@ -98,6 +105,28 @@ bool do_host_reset = false;
 bool hard_reset = false;
 bool cancelBuild = false;
 
+#if defined(SD_RESUME)
+/// Whether the build from SD is of a file in the root directory, the
+/// only one resumeBuildFromSD() looks in
+static bool checkpointFile = false;
+
+/// Note where the build from SD could resume from, for the next counter
+/// record.  Nothing is noted while paused: the machine isn't where the
+/// build left it.
+static void checkpoint() {
+	checkpoint_t cp;
+
+	if ( currentState != HOST_STATE_BUILDING_FROM_SD || buildState != BUILD_RUNNING ||
+	     command::pauseState() != PAUSE_STATE_NONE || !checkpointFile )
+		return;
+	if ( !steppers::getCheckpoint(command::getSDOffset(), &cp) )
+		return;
+	for ( uint8_t i = 0; i < 3; i++ )
+		cp.temperature[i] = Motherboard::getBoard().getHeater(i).get_set_temperature();
+	eeprom::setCheckpoint(&cp);
+}
+#endif
+
 void runHostSlice() {
 	// If we're cancelling the build, and we have completed pausing,
 	// then we cancel the build
@@ -105,6 +134,16 @@ void runHostSlice() {
 		stopBuildNow();
 	}
 
+	if ( print_time_state != PRINT_TIME_OTHER ) {
+		if ( !counter_log_timeout.isActive() || counter_log_timeout.hasElapsed() ) {
+#if defined(SD_RESUME)
+			checkpoint();
+#endif
+			logCounters();
+			counter_log_timeout.start(COUNTER_LOG_INTERVAL_MICROS);
+		}
+	}
+
         InPacket& in = UART::getHostUART().in;
         OutPacket& out = UART::getHostUART().out;
 	if (out.isSending() &&
@@ -374,8 +413,12 @@ inline void handleCaptureToFile(const InPacket& from_host, OutPacket& to_host) {
 }
     // stop capture to SD
 inline void handleEndCapture(const InPacket& from_host, OutPacket& to_host) {
+	uint16_t stalls, dropped;
 	to_host.append8(RC_OK);
 	to_host.append32(sdcard::finishCapture());
+	sdcard::captureStats(&stalls, &dropped);
+	to_host.append16(stalls);
+	to_host.append16(dropped);
 	sdcard::reset();
 }
 
@@ -390,6 +433,18 @@ inline void handlePlayback(const InPacket& from_host, OutPacket& to_host) {
 	to_host.append8(startBuildFromSD(buildName,0));
 }
 
+#if defined(SD_LAYER_INDEX)
+    // playback from SD, starting at a layer
+inline void handlePlaybackLayer(const InPacket& from_host, OutPacket& to_host) {
+	to_host.append8(RC_OK);
+	uint16_t layer = from_host.read16(1);
+	for (uint8_t idx = 3; (idx < from_host.getLength()) && (idx < sizeof(buildName) + 2); idx++)
+		buildName[idx-3] = from_host.read8(idx);
+	buildName[sizeof(buildName)-1] = '\0';
+	to_host.append8(startBuildFromSDAtLayer(layer));
+}
+#endif
+
     // retrieve SD file names
 void handleNextFilename(const InPacket& from_host, OutPacket& to_host) {
 	to_host.append8(RC_OK);
@@ -445,6 +500,7 @@ void handleReadEeprom(const InPacket& from_host, OutPacket& to_host) {
     uint16_t offset = from_host.read16(1);
     uint8_t length = from_host.read8(3);
     uint8_t data[length];
+    eeprom::flushSettings();
     eeprom_read_block(data, (const void*) offset, length);
     to_host.append8(RC_OK);
     for (int i = 0; i < length; i++) {
@@ -459,6 +515,7 @@ void handleWriteEeprom(const InPacket& from_host, OutPacket& to_host) {
     uint16_t offset = from_host.read16(1);
     uint8_t length = from_host.read8(3);
     uint8_t data[length];
+    eeprom::flushSettings();
     eeprom_read_block(data, (const void*) offset, length);
     for (int i = 0; i < length; i++) {
         data[i] = from_host.read8(i + 4);
@@ -466,6 +523,7 @@ void handleWriteEeprom(const InPacket& from_host, OutPacket& to_host) {
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
 		eeprom_write_block(data, (void*) offset, length);
 	}
+    eeprom::loadSettings();
     to_host.append8(RC_OK);
     to_host.append8(length);
 }
@@ -575,6 +633,24 @@ inline void handleGetBuildStats(OutPacket& to_host) {
 	to_host.append32(0); // line number reporting not supported
 #endif
         to_host.append32(0); // open spot for filament detect info
+#if defined(AUTO_LEVEL)
+	// auto-level transforms this build, and how many were memo hits
+	uint32_t lookups, hits;
+	skew_memo_stats(&lookups, &hits);
+	to_host.append32(lookups);
+	to_host.append32(hits);
+#endif
+#if defined(SD_READ_AHEAD)
+	// SD read-ahead of this or the last build from SD, times in 100 us.
+	// The refill count is left out to fit the packet; it's about the
+	// file's size over 512.
+	sdcard::ReadAheadStats ahead;
+	sdcard::readAheadStats(&ahead);
+	to_host.append32(ahead.refillTime);
+	to_host.append16(ahead.refillMax);
+	to_host.append16(( ahead.stalls > 0xffff ) ? 0xffff : (uint16_t)ahead.stalls);
+	to_host.append32(ahead.stallTime);
+#endif
 }
 /// get current print stats if printing, or last print stats if not printing
 inline void handleGetBoardStatus(OutPacket& to_host) {
@@ -582,6 +658,40 @@ inline void handleGetBoardStatus(OutPacket& to_host) {
 	to_host.append8(board_status);
 }
 
+#ifdef HEATER_AUTOTUNE
+
+/// start tuning a heater's PID gains: heater (0 or 1 for an extruder,
+/// 2 for the platform), temperature, cycles and Autotune::Rule.  Replies
+/// 1 if tuning started.
+inline void handleHeaterAutotune(const InPacket& from_host, OutPacket& to_host) {
+	if ( currentState != HOST_STATE_READY ) {
+		to_host.append8(RC_BOT_BUILDING);
+		return;
+	}
+	uint8_t id = from_host.read8(1);
+	bool started = ( id <= 2 ) &&
+		Motherboard::getBoard().getHeater(id).start_autotune((int16_t)from_host.read16(2),
+								     from_host.read8(4), from_host.read8(5));
+	to_host.append8(RC_OK);
+	to_host.append8(started ? 1 : 0);
+}
+
+/// report the heater tuned last, Autotune::State, cycles completed and
+/// to run, and the gains found as 8.8 fixed point like the EEPROM
+inline void handleAutotuneStatus(OutPacket& to_host) {
+	const Autotune& tuner = Heater::get_autotune();
+	to_host.append8(RC_OK);
+	to_host.append8(tuner.getId());
+	to_host.append8(tuner.getState());
+	to_host.append8(tuner.getCycle());
+	to_host.append8(tuner.getCycles());
+	to_host.append16((uint16_t)(tuner.p * 256.0));
+	to_host.append16((uint16_t)(tuner.i * 256.0));
+	to_host.append16((uint16_t)(tuner.d * 256.0));
+}
+
+#endif
+
 // query packets (non action, not queued)
 bool processQueryPacket(const InPacket& from_host, OutPacket& to_host) {
 	if (from_host.getLength() >= 1) {
@@ -609,7 +719,7 @@ bool processQueryPacket(const InPacket& from_host, OutPacket& to_host) {
 				if (currentState == HOST_STATE_BUILDING ||
 				    currentState == HOST_STATE_BUILDING_FROM_SD ||
 				    currentState == HOST_STATE_BUILDING_ONBOARD) {
-				     if (1 == eeprom::getEeprom8(eeprom_offsets::CLEAR_FOR_ESTOP, 0)) {
+				     if (1 == eeprom::settings.clearForEstop) {
 					  buildState = BUILD_CANCELED;
 					  stopBuild();
 					  resetMe = false;
@@ -646,6 +756,11 @@ bool processQueryPacket(const InPacket& from_host, OutPacket& to_host) {
 			case HOST_CMD_PLAYBACK_CAPTURE:
 				handlePlayback(from_host,to_host);
 				return true;
+#if defined(SD_LAYER_INDEX)
+			case HOST_CMD_PLAYBACK_LAYER:
+				handlePlaybackLayer(from_host,to_host);
+				return true;
+#endif
 			case HOST_CMD_NEXT_FILENAME:
 				handleNextFilename(from_host,to_host);
 				return true;
@@ -680,6 +795,14 @@ bool processQueryPacket(const InPacket& from_host, OutPacket& to_host) {
 			case HOST_CMD_ADVANCED_VERSION:
 				handleGetAdvancedVersion(from_host, to_host);
 				return true;
+#ifdef HEATER_AUTOTUNE
+			case HOST_CMD_HEATER_AUTOTUNE:
+				handleHeaterAutotune(from_host, to_host);
+				return true;
+			case HOST_CMD_AUTOTUNE_STATUS:
+				handleAutotuneStatus(to_host);
+				return true;
+#endif
 			}
 		}
 	}
@@ -748,20 +871,31 @@ void pausePrintTime() {
      print_time_state = PRINT_TIME_PAUSED;
 }
 
+uint32_t getPrintSeconds(void) {
+     return (uint32_t)(deltaPrintTime() + print_time_accum);
+}
+
 void stopPrintTime() {
     // Set last_print_hours & last_print_minutes
     // We do this call so that the global variables are set and
     //   can be returned by getPrintTime() when no print is active
     getPrintTime(last_print_hours, last_print_minutes);
 
+    // Save the information along with the filament used, which the
+    // build left to now
+    uint32_t seconds = ( print_time_state == PRINT_TIME_OTHER ) ? 0 : getPrintSeconds();
+    command::addFilamentUsed(seconds);
     print_time_state = PRINT_TIME_OTHER;
-
-    // Save the information
-    eeprom::updateBuildTime(last_print_hours, last_print_minutes);
+#if defined(SD_RESUME)
+    eeprom::setCheckpoint(0);
+#endif
+    logCounters();
+    eeprom::flushSettings();
 }
 
-uint32_t getPrintSeconds(void) {
-     return (uint32_t)(deltaPrintTime() + print_time_accum);
+void logCounters() {
+     eeprom::logCounters(command::getFilamentLength(0), command::getFilamentLength(1),
+			 ( print_time_state == PRINT_TIME_OTHER ) ? 0 : getPrintSeconds());
 }
 
 /// returns time hours and minutes since the start of the print
@@ -778,6 +912,18 @@ void getPrintTime(uint16_t& hours, uint8_t& minutes) {
     return;
 }
 
+/// Put the machine in the state to build from the file just opened
+static void beginBuildFromSD() {
+	// clear heater temps
+	Motherboard::heatersOff(true);
+
+	command::reset();
+	steppers::reset();
+	steppers::abort();
+	buildWasCancelled = false;
+	currentState = HOST_STATE_BUILDING_FROM_SD;
+}
+
 sdcard::SdErrorCode startBuildFromSD(char *fname, uint8_t flen) {
 	sdcard::SdErrorCode e;
 
@@ -795,17 +941,83 @@ sdcard::SdErrorCode startBuildFromSD(char *fname, uint8_t flen) {
 		return e;
 	}
 
-	// clear heater temps
-	Motherboard::heatersOff(true);
+#if defined(SD_RESUME)
+	// Forget the last build's checkpoint before naming this one's file.
+	// Only the file's name is kept, so a build from any other directory
+	// gets no checkpoints.
+	eeprom::setCheckpoint(0);
+	logCounters();
+	eeprom::flushSettings();
+	checkpointFile = sdcard::inRootDirectory();
+	if ( checkpointFile )
+		eeprom::setCheckpointFile(buildName);
+#endif
 
-	command::reset();
-	steppers::reset();
-	steppers::abort();
-	buildWasCancelled = false;
-	currentState = HOST_STATE_BUILDING_FROM_SD;
+	beginBuildFromSD();
+	return e;
+}
 
+#if defined(SD_RESUME)
+sdcard::SdErrorCode resumeBuildFromSD() {
+	const checkpoint_t *cp = eeprom::getCheckpoint();
+	if ( !cp )
+		return sdcard::SD_ERR_GENERIC;
+
+	// The file is in the root directory
+	if ( !sdcard::inRootDirectory() )
+		sdcard::forceReinit();
+	eeprom::getCheckpointFile(buildName, sizeof(buildName));
+	sdcard::SdErrorCode e = sdcard::startPlayback(buildName, cp->offset);
+	if (e == sdcard::SD_CWD) return sdcard::SD_ERR_FILE_NOT_FOUND;
+	if (e != sdcard::SD_SUCCESS) return e;
+
+	checkpointFile = true;
+	beginBuildFromSD();
+	command::queueResume(cp);
+	lastFileIndex = 255;
 	return e;
 }
+#endif
+#if defined(SD_LAYER_INDEX)
+sdcard::SdErrorCode startBuildFromSDAtLayer(uint16_t layer) {
+	if ( layer == 0 )
+		return startBuildFromSD(buildName, 0);
+
+	// The index is named for the build file, the last letter of its
+	// extension changed to an 'i'
+	uint8_t len = strlen(buildName);
+	if ( !sdcard::isJobFile(buildName, len) )
+		return sdcard::SD_ERR_FILE_NOT_FOUND;
+	char indexName[MAX_FILE_LEN];
+	memcpy(indexName, buildName, len + 1);
+	indexName[len-1] = ( buildName[len-1] == 'G' ) ? 'I' : 'i';
+
+	layer_index_header_t header;
+	sdcard::SdErrorCode e = sdcard::readFile(indexName, 0, &header, sizeof(header));
+	if ( e != sdcard::SD_SUCCESS )
+		return e;
+	if ( memcmp(header.magic, LAYER_INDEX_MAGIC, sizeof(header.magic)) ||
+	     header.version != LAYER_INDEX_VERSION ||
+	     header.entry_size != sizeof(layer_entry_t) ||
+	     layer >= header.count ||
+	     header.file_size != sdcard::fileSize(buildName) )
+		return sdcard::SD_ERR_GENERIC;
+
+	layer_entry_t first, entry;
+	e = sdcard::readFile(indexName, sizeof(header), &first, sizeof(first));
+	if ( e == sdcard::SD_SUCCESS )
+		e = sdcard::readFile(indexName, sizeof(header) + (uint32_t)layer * sizeof(entry),
+				     &entry, sizeof(entry));
+	if ( e != sdcard::SD_SUCCESS )
+		return e;
+
+	e = startBuildFromSD(buildName, 0);
+	if ( e == sdcard::SD_SUCCESS && sdcard::isPlaying() )
+		command::skipToLayer(&first, &entry);
+	return e;
+}
+#endif
+
 // start build from utility script
 void startOnboardBuild(uint8_t  build){
     buildWasCancelled = false;
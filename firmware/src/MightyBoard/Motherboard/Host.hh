@@ -75,6 +75,20 @@ BuildState getBuildState();
 /// \return True if build started successfully.
 sdcard::SdErrorCode startBuildFromSD(char *fname, uint8_t flen);
 
+#if defined(SD_RESUME)
+/// Resume the build from SD which last set a checkpoint, from there.
+/// \return SD_SUCCESS if the build resumed
+sdcard::SdErrorCode resumeBuildFromSD();
+#endif
+
+#if defined(SD_LAYER_INDEX)
+/// Start the build from SD named by buildName at a later layer, found
+/// in the file's layer index.
+/// \param[in] layer Index entry of the layer; 0 is the first layer
+/// \return SD_SUCCESS if the build started
+sdcard::SdErrorCode startBuildFromSDAtLayer(uint16_t layer);
+#endif
+
 /// start build from onboard script 
 /// no error check here yet, should not have read errors
 void startOnboardBuild(uint8_t  build);
@@ -109,6 +123,10 @@ void startPrintTime();
 /// stop print timer and  update local variables
 void stopPrintTime();
 
+/// journal the filament and print time which the build has yet to add
+/// to the lifetime counters
+void logCounters();
+
 #if defined(BUILD_STATS) || defined(ESTIMATE_TIME)
 
 /// return true if the build has completed (either from USB or SD card)
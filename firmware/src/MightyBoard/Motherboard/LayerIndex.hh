@@ -0,0 +1,47 @@
+#ifndef __LAYER_INDEX_HH__
+#define __LAYER_INDEX_HH__
+
+// Layer index for a .s3g or .x3g build file, so that a build from SD can
+// start part way through without parsing what comes before.  The index
+// is a sidecar file named after the build file with the last letter of
+// its extension changed to an 'i': PART.X3G is indexed by PART.X3I.
+// simulator/s3gindex writes it.
+//
+// The file is a layer_index_header_t followed by count layer_entry_t's,
+// all little endian.  Entry 0 is the first layer; everything before its
+// offset is the build's start sequence (homing, heating, priming), which
+// is played as usual before skipping to the layer wanted.
+
+#include <stdint.h>
+
+#define LAYER_INDEX_MAGIC	"S3GI"
+#define LAYER_INDEX_VERSION	1
+
+// layer_entry_t flags: the state of the fans as the layer begins
+#define LAYER_FAN_T0		0x01	// Tool 0's fan, SLAVE_CMD_TOGGLE_FAN
+#define LAYER_FAN_T1		0x02	// Tool 1's fan
+#define LAYER_FAN_EXTRA		0x04	// The extra fan, SLAVE_CMD_TOGGLE_VALVE
+
+typedef struct {
+     char     magic[4];       // LAYER_INDEX_MAGIC, without a NUL
+     uint8_t  version;        // LAYER_INDEX_VERSION
+     uint8_t  entry_size;     // sizeof(layer_entry_t)
+     uint16_t count;          // Number of entries which follow
+     uint32_t file_size;      // Size of the build file; a mismatch means the
+                              //   index is stale
+     uint32_t reserved;
+} layer_index_header_t;
+
+// Where a layer begins: the offset of its first command, and the state
+// the commands before it left behind.  Positions are as the build file
+// has them, before tool offsets or auto-level.
+typedef struct {
+     uint32_t offset;         // File offset of the layer's first command
+     int32_t  z;              // Height the layer is extruded at, units of steps
+     int32_t  position[5];    // X, Y, Z, A and B, units of steps
+     int16_t  temperature[3]; // Set temperatures of tool 0, tool 1 and the platform
+     uint8_t  tool;           // Active toolhead
+     uint8_t  flags;          // LAYER_FAN_ bits
+} layer_entry_t;
+
+#endif // __LAYER_INDEX_HH__
@@ -181,6 +181,10 @@ int main() {
 #endif
 	DEBUG_VALUE(DEBUG_MAIN | 0x01);
 
+	// Settings are read from RAM from here on, starting with
+	// Motherboard::init()
+	eeprom::loadSettings();
+
 	// Motherboard::init() will call initClocks() which will init
 	// pstop_enabled.  That needs to be done before reset() below
 	// initializes the steppers (which needs to know if P-Stop is
@@ -192,6 +196,9 @@ int main() {
 	reset(true);
 	DEBUG_VALUE(DEBUG_MAIN | 0x0D);
 
+	// Recover the counters of a build cut short by a power loss
+	eeprom::initCounterLog();
+
 	sei();
 	while (1) {
 		// Host interaction thread.
@@ -202,6 +209,8 @@ int main() {
 		board.runMotherboardSlice();
                 // Stepper slice
                 steppers::runSteppersSlice();
+		// Settings write back
+		eeprom::runEepromSlice();
 
 		//Alert if SRAM/stack has been corrupted by running out of SRAM
 #if defined(STACK_PAINT) && defined(DEBUG_SRAM_MONITOR)
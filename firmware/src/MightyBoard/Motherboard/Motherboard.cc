@@ -357,8 +357,10 @@ void Motherboard::reset(bool hard_reset) {
 		interfaceBoard.pushScreen(&splashScreen);
 		DEBUG_VALUE(DEBUG_MOTHERBOARD | 0x0A);
 
-		if ( hard_reset )
+		if ( hard_reset ) {
+			lcd.flush(true);
 			_delay_ms(3000);
+		}
 
 		DEBUG_VALUE(DEBUG_MOTHERBOARD | 0x0B);
 
@@ -651,6 +653,8 @@ void Motherboard::runMotherboardSlice() {
 			interface_update_timeout.start(interfaceBoard.getUpdateRate());
 			interface_updated = true;
 		}
+		// send a few changed characters to the LCD
+		lcd.flush();
 	}
 
 #if defined(SAMPLE_INTERVAL_MICROS_THERMISTOR)
@@ -948,6 +952,15 @@ ISR(TIMER5_COMPA_vect) {
 	  mcount = 0;
      }
 
+     // Clock the thermocouples one bit at a time
+#if defined(USE_THERMOCOUPLE_DUAL)
+#if BOARD_TYPE == BOARD_TYPE_MIGHTYBOARD_G
+     Motherboard::getBoard().getThermocoupleReader().sampleTick();
+#endif
+#else
+     Thermocouple::sampleTick();
+#endif
+
 #if defined(FF_CREATOR_X) && defined(__AVR_ATmega2560__)  ///add by FF_OU, impletement a softPWM to lower the HBP output
      //softpwm
     if (pwmcnt < PWM_H) {
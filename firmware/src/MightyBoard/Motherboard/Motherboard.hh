@@ -222,6 +222,8 @@ public:
 	void setUsingPlatform(bool is_using);
 	static void setExtra(bool on);
 	Heater& getPlatformHeater() { return platform_heater; }
+	/// \param[in] id 0 or 1 for an extruder heater, 2 for the platform heater
+	Heater& getHeater(uint8_t id) { return (id == 2) ? platform_heater : getExtruderBoard(id).getExtruderHeater(); }
 
 	InterfaceBoard& getInterfaceBoard() { return interfaceBoard; }	
 
@@ -0,0 +1,45 @@
+#ifndef __PLANNED_BLOCK_HH__
+#define __PLANNED_BLOCK_HH__
+
+// Pre-planned moves for builds played from SD.  simulator/s3gplan runs
+// a build through the planner and rewrites each accelerated
+// HOST_CMD_QUEUE_POINT_NEW_EXT as a HOST_CMD_QUEUE_POINT_PLANNED: the
+// same 31 byte payload followed by a planned_move_t, which holds what
+// setTargetNewExt() and plan_buffer_line() work out from the move alone.
+// Junction speeds, the slowdown and any change of speed from the LCD
+// depend on the moves around it and so are still planned as the build
+// plays.
+//
+// Those results depend on the machine's steps per mm, its maximum
+// accelerations and the minimum planner speed.  The rewritten build thus
+// begins with a HOST_CMD_PLANNED_HEADER carrying PLANNED_MOVE_VERSION and
+// steppers::plannerHash() of the settings it was planned for.  Should
+// they not match, or a move not start from where it was planned to (a
+// tool change, homing, auto-level skew, ditto printing), the move is
+// planned as usual from its HOST_CMD_QUEUE_POINT_NEW_EXT payload.
+//
+// The fields are sent little endian in the order declared.  FPTYPE
+// values are the raw fixed point numbers.
+
+#include <stdint.h>
+
+#define PLANNED_MOVE_VERSION	1
+#define PLANNED_MOVE_SIZE	58	// Bytes of planned_move_t on the wire
+
+typedef struct {
+     int16_t  steps[5];             // Signed steps per motor; moves with
+                                    //   more than 32767 aren't planned
+     int32_t  dda_rate;             // Master axis steps/s, before any
+                                    //   change of speed from the LCD
+     int32_t  delta_mm[5];          // FPTYPE, mm per axis
+     int32_t  millimeters;          // FPTYPE, length of the move
+     int32_t  inverse_millimeters;  // FPTYPE, 1 / millimeters
+     uint32_t acceleration_st;      // steps/s^2
+     int32_t  acceleration;         // FPTYPE, mm/s^2
+     int32_t  acceleration_rate;    // acceleration_st scaled for st_interrupt()
+     int32_t  v_allowable;          // FPTYPE, speed reached by accelerating
+                                    //   the length of the move from the
+                                    //   minimum planner speed
+} planned_move_t;
+
+#endif // __PLANNED_BLOCK_HH__
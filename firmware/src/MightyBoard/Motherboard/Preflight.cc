@@ -0,0 +1,292 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#if defined(SD_PREFLIGHT)
+
+#include "Preflight.hh"
+#include "Commands.hh"
+#ifndef SIMULATOR
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(addr) (*(addr))
+#define pgm_read_dword(addr) (*(addr))
+#endif
+
+namespace preflight {
+
+// Bytes read from the card at a time, into a buffer on the stack
+#define SCAN_CHUNK	64
+
+// Bytes scanned by each call of scan()
+#define SCAN_SLICE	512
+
+// A longer command can't fit in Command.cc's command buffer
+#define MAX_COMMAND	512
+
+// The time scanned is recorded at this many evenly spaced offsets of the
+// file, in units of MARK_SECONDS
+#define MARKS		16
+#define MARK_SECONDS	4
+
+// Lengths of the commands played from SD, command id included, from
+// HOST_CMD_FIND_AXES_MINIMUM on.  As Command.cc plays them.
+#define LEN_BAD		0	// Not played: the command loop would stall on it
+#define LEN_TOOL	0xff	// 4 bytes and the payload length held in byte 3
+#define LEN_STRING	0xfe	// 5 bytes and a NUL terminated string
+
+#define FIRST_COMMAND	HOST_CMD_FIND_AXES_MINIMUM
+
+static const uint8_t lengths[] PROGMEM = {
+	8,		// HOST_CMD_FIND_AXES_MINIMUM
+	8,		// HOST_CMD_FIND_AXES_MAXIMUM
+	5,		// HOST_CMD_DELAY
+	2,		// HOST_CMD_CHANGE_TOOL
+	6,		// HOST_CMD_WAIT_FOR_TOOL
+	LEN_TOOL,	// HOST_CMD_TOOL_COMMAND
+	2,		// HOST_CMD_ENABLE_AXES
+	LEN_BAD,	// 138
+	25,		// HOST_CMD_QUEUE_POINT_EXT
+	21,		// HOST_CMD_SET_POSITION_EXT
+	6,		// HOST_CMD_WAIT_FOR_PLATFORM
+	26,		// HOST_CMD_QUEUE_POINT_NEW
+	2,		// HOST_CMD_STORE_HOME_POSITION
+	2,		// HOST_CMD_RECALL_HOME_POSITION
+	3,		// HOST_CMD_SET_POT_VALUE
+	6,		// HOST_CMD_SET_RGB_LED
+	6,		// HOST_CMD_SET_BEEP
+	5,		// HOST_CMD_PAUSE_FOR_BUTTON
+	LEN_STRING,	// HOST_CMD_DISPLAY_MESSAGE
+	3,		// HOST_CMD_SET_BUILD_PERCENT
+	2,		// HOST_CMD_QUEUE_SONG
+	2,		// HOST_CMD_RESET_TO_FACTORY
+	LEN_STRING,	// HOST_CMD_BUILD_START_NOTIFICATION
+	2,		// HOST_CMD_BUILD_END_NOTIFICATION
+	32,		// HOST_CMD_QUEUE_POINT_NEW_EXT
+	2,		// HOST_CMD_SET_ACCELERATION_TOGGLE
+	21,		// HOST_CMD_STREAM_VERSION
+	5,		// HOST_CMD_PAUSE_AT_ZPOS
+#if defined(AUTO_LEVEL_MESH)
+	4,		// HOST_CMD_STORE_MESH_POINT
+#else
+	LEN_BAD,
+#endif
+#if defined(SD_PLANNED)
+	6,		// HOST_CMD_PLANNED_HEADER
+	90,		// HOST_CMD_QUEUE_POINT_PLANNED
+#else
+	LEN_BAD,
+	LEN_BAD,
+#endif
+	5		// HOST_CMD_FILE_CHECKSUM
+};
+
+#define LAST_COMMAND	( FIRST_COMMAND + sizeof(lengths) - 1 )
+
+// CRC-32 as zlib and Ethernet compute it, a nibble at a time
+static const uint32_t crcTable[16] PROGMEM = {
+	0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+	0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+	0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+	0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+enum State {
+	START = 0,		// Not yet begun
+	SCANNING = 1,
+	DONE = 2,		// Scanned the whole file
+	FAILED = 3		// Stopped at an error
+};
+
+static uint8_t state;
+static uint32_t size;		// of the file
+static uint32_t offset;		// next byte to scan
+static uint32_t crc;		// of the bytes scanned, not yet inverted
+static uint32_t commandCrc;	// of the bytes before the current command
+static uint8_t command;		// id of the current command
+static uint16_t pos;		// bytes of it scanned; 0 between commands
+static uint16_t length;		// its length; 0 until the end of a string
+static uint32_t word;		// the last 4 bytes scanned, little endian
+static uint32_t distance;	// float, mm of the current move
+static float seconds;		// nominal time of the commands scanned
+static uint8_t marked;		// marks recorded
+static uint16_t marks[MARKS];	// time scanned at each mark
+
+void reset() {
+	state = START;
+}
+
+bool done() {
+	return state >= DONE;
+}
+
+static void addCrc(uint8_t b) {
+	crc = pgm_read_dword(&crcTable[( crc ^ b ) & 0x0f]) ^ ( crc >> 4 );
+	crc = pgm_read_dword(&crcTable[( crc ^ ( b >> 4 ) ) & 0x0f]) ^ ( crc >> 4 );
+}
+
+// Take what's needed from byte index of the current command, now at the
+// top of word.  Returns false if the file is bad.
+static bool scanField(uint16_t index) {
+	switch ( command ) {
+	case HOST_CMD_QUEUE_POINT_NEW_EXT:
+#if defined(SD_PLANNED)
+	case HOST_CMD_QUEUE_POINT_PLANNED:
+#endif
+		// Distance in bytes 26-29 and mm/s * 64 in 30-31
+		if ( index == 29 )
+			distance = word;
+		else if ( index == 31 ) {
+			int16_t feedrateMult64 = (int16_t)( word >> 16 );
+			float *mm = (float *)&distance;
+			if ( feedrateMult64 > 0 && *mm > 0.0 )
+				seconds += *mm * 64.0 / (float)feedrateMult64;
+		}
+		break;
+
+	case HOST_CMD_QUEUE_POINT_NEW:
+		// Microseconds in bytes 21-24
+		if ( index == 24 )
+			seconds += (float)word / 1000000.0;
+		break;
+
+	case HOST_CMD_DELAY:
+		// Milliseconds in bytes 1-4
+		if ( index == 4 )
+			seconds += (float)word / 1000.0;
+		break;
+
+	case HOST_CMD_FILE_CHECKSUM:
+		if ( index == 4 && word != ~commandCrc )
+			return false;
+		break;
+
+	default:
+		break;
+	}
+	return true;
+}
+
+// Frame the file into commands a byte at a time.  Returns false if the
+// file is bad.
+static bool scanByte(uint8_t b) {
+	if ( pos == 0 ) {
+		if ( b < FIRST_COMMAND || b > LAST_COMMAND )
+			return false;
+		uint8_t len = pgm_read_byte(&lengths[b - FIRST_COMMAND]);
+		if ( len == LEN_BAD )
+			return false;
+		command = b;
+		commandCrc = crc;
+		if ( len == LEN_TOOL )
+			length = 4;
+		else if ( len == LEN_STRING )
+			length = 0;
+		else
+			length = len;
+	}
+	else {
+		word = ( word >> 8 ) | ( (uint32_t)b << 24 );
+		if ( command == HOST_CMD_TOOL_COMMAND && pos == 3 )
+			length = 4 + b;
+		else if ( length == 0 && pos >= 5 && b == 0 )
+			length = pos + 1;
+		if ( !scanField(pos) )
+			return false;
+	}
+	addCrc(b);
+	if ( ++pos == length )
+		pos = 0;
+	else if ( pos >= MAX_COMMAND )
+		return false;
+	return true;
+}
+
+// Record the time scanned at the marks passed
+static void mark() {
+	uint32_t spacing = size / MARKS;
+	while ( marked < MARKS &&
+		( marked == MARKS - 1 ? size : ( marked + 1 ) * spacing ) <= offset ) {
+		float t = seconds / MARK_SECONDS;
+		marks[marked++] = ( t < 65535.0 ) ? (uint16_t)t : 0xffff;
+	}
+}
+
+static sdcard::SdErrorCode fail(sdcard::SdErrorCode e) {
+	state = FAILED;
+	return e;
+}
+
+sdcard::SdErrorCode scan() {
+	if ( state >= DONE )
+		return sdcard::SD_SUCCESS;
+
+	if ( state == START ) {
+		size = sdcard::playbackSize();
+		offset = 0;
+		crc = 0xffffffff;
+		pos = 0;
+		seconds = 0.0;
+		marked = 0;
+		state = SCANNING;
+	}
+
+	uint8_t buffer[SCAN_CHUNK];
+	for ( uint16_t n = 0; n < SCAN_SLICE; n += SCAN_CHUNK ) {
+		uint8_t read;
+		sdcard::SdErrorCode e = sdcard::playbackScan(offset, buffer, SCAN_CHUNK, &read);
+		if ( e != sdcard::SD_SUCCESS )
+			return fail(e);
+		for ( uint8_t i = 0; i < read; i++ )
+			if ( !scanByte(buffer[i]) )
+				return fail(sdcard::SD_ERR_FILE_CORRUPT);
+		offset += read;
+		mark();
+
+		if ( read < SCAN_CHUNK ) {
+			// At the end of the file, which mustn't cut a command short
+			if ( pos != 0 )
+				return fail(sdcard::SD_ERR_FILE_CORRUPT);
+			state = DONE;
+			break;
+		}
+	}
+	return sdcard::SD_SUCCESS;
+}
+
+int32_t secondsLeft(uint32_t played) {
+	if ( state != DONE || marks[MARKS - 1] == 0 )
+		return -1;
+	if ( played > size )
+		played = size;
+
+	// Interpolate the time played between the marks either side
+	uint32_t spacing = size / MARKS;
+	uint8_t k = spacing ? (uint8_t)( played / spacing ) : MARKS - 1;
+	if ( k > MARKS - 1 )
+		k = MARKS - 1;
+	uint32_t start = k * spacing;
+	uint32_t end = ( k == MARKS - 1 ) ? size : start + spacing;
+	float before = k ? (float)marks[k - 1] : 0.0;
+	float t = before;
+	if ( end > start )
+		t += ( (float)marks[k] - before ) * (float)( played - start ) / (float)( end - start );
+
+	return (int32_t)( ( (float)marks[MARKS - 1] - t ) * MARK_SECONDS );
+}
+
+} // namespace preflight
+
+#endif // SD_PREFLIGHT
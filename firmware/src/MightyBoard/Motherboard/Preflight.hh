@@ -0,0 +1,64 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef PREFLIGHT_HH_
+#define PREFLIGHT_HH_
+
+#include <stdint.h>
+#include "SDCard.hh"
+
+/// Pre-flight scan of a build played from SD.  While the build waits
+/// for its heaters, the command loop has the card to itself, so the
+/// whole file is read through once a sector at a time.  The scan
+///
+///   - reads every sector, so a card or file that can't be read ends the
+///     build before it starts rather than part way through;
+///   - frames the file into commands with the lengths Command.cc plays
+///     them with, so that a truncated file or one holding a command the
+///     firmware doesn't play (and so would stall on) is caught;
+///   - checks the CRC-32 held by a HOST_CMD_FILE_CHECKSUM, if the file
+///     has one (simulator/s3gsum adds it), against the bytes before it;
+///   - adds up the nominal time of the moves and delays, for an estimate
+///     of the time left before the build sends its first percentage.
+///
+/// The scan starts from the beginning of the file whatever byte playback
+/// starts from.
+namespace preflight {
+
+    /// Forget the last build's scan.
+    void reset();
+
+
+    /// Scan the next part of the file being played back: at most a
+    /// sector, so that it costs no more than a pass of the command loop
+    /// spent reading ahead.
+    /// \return SD_SUCCESS, or the reason the build can't be played.  An
+    /// error is returned once, after which the scan is done.
+    sdcard::SdErrorCode scan();
+
+
+    /// Check whether the whole file has been scanned.
+    /// \return True once the scan has finished, successfully or not
+    bool done();
+
+
+    /// Nominal time left in the build, from the scan.
+    /// \param[in] offset Byte of the file played back up to
+    /// \return Seconds, or -1 until the file has been scanned without error
+    int32_t secondsLeft(uint32_t offset);
+
+} // namespace preflight
+
+#endif // PREFLIGHT_HH_
@@ -17,14 +17,18 @@
 
 #include "SDCard.hh"
 
+#ifndef SIMULATOR
 #include <avr/io.h>
+#endif
 #include <string.h>
 #include "lib_sd/sd-reader_config.h"
 #include "lib_sd/fat.h"
 #include "lib_sd/sd_raw.h"
 #include "lib_sd/partition.h"
+#ifndef SIMULATOR
 #include "Motherboard.hh"
 #include "Menu_locales.hh"
+#endif
 #include "Eeprom.hh"
 #include "EepromMap.hh"
 
@@ -49,8 +53,37 @@ uint8_t sdErrno;
 static struct partition_struct* partition = 0;
 static struct fat_fs_struct* fs = 0;
 static struct fat_dir_struct* cwd = 0; // current working directory
+static bool cwdIsRoot = true;
 static struct fat_file_struct* file = 0;
 
+#if defined(SD_INDEX)
+
+// Index of the current working directory.  It is built in one pass
+// over the directory the first time it's needed, and dropped when the
+// card is reinitialized, the working directory changes, or a file is
+// created or deleted.  For each directory entry, in directory order, it
+// keeps one byte: whether the LCD menu lists the entry, whether it's a
+// folder, and a hash of its name.  Every INDEX_STRIDE entries it also
+// keeps the position of the directory handle, so that any entry is at
+// most INDEX_STRIDE reads away.  Entries past the first INDEX_MAX are
+// not indexed.
+
+#define INDEX_MAX    255
+#define INDEX_STRIDE 8
+
+#define INDEX_LISTED 0x80
+#define INDEX_DIR    0x40
+#define INDEX_HASH   0x3f
+
+static bool indexValid = false;
+static bool indexTruncated;
+static uint8_t indexLength;
+static uint8_t indexListed;
+static uint8_t indexFlags[INDEX_MAX];
+static struct fat_dir_pos_struct indexPos[(INDEX_MAX + INDEX_STRIDE - 1) / INDEX_STRIDE];
+
+#endif
+
 void forceReinit() {
 #ifndef BROKEN_SD
 	mustReinit = true;
@@ -62,8 +95,11 @@ static bool openPartition()
   /* open first partition */
   partition = partition_open(sd_raw_read,
                              sd_raw_read_interval,
+                             sd_raw_stream_read,
+                             sd_raw_stream_open,
                              sd_raw_write,
                              sd_raw_write_interval,
+                             sd_raw_erasable,
                              0);
 
   if(!partition)
@@ -73,8 +109,11 @@ static bool openPartition()
     */
     partition = partition_open(sd_raw_read,
                                sd_raw_read_interval,
+                               sd_raw_stream_read,
+                               sd_raw_stream_open,
                                sd_raw_write,
                                sd_raw_write_interval,
+                               sd_raw_erasable,
                                -1);
   }
   return partition != 0;
@@ -95,6 +134,7 @@ static SdErrorCode changeWorkingDir(struct fat_dir_entry_struct *newDir)
 		struct fat_dir_entry_struct rootdirectory;
 		fat_get_dir_entry_of_path(fs, "/", &rootdirectory);
 		cwd = fat_open_dir(fs, &rootdirectory);
+		cwdIsRoot = true;
 		return cwd ? SD_SUCCESS : SD_ERR_NO_ROOT;
 	}
 
@@ -104,6 +144,12 @@ static SdErrorCode changeWorkingDir(struct fat_dir_entry_struct *newDir)
 
 	fat_close_dir(cwd);
 	cwd = tmp;
+	// The root directory, and any ".." entry leading back to it, are
+	// cluster 0
+	cwdIsRoot = newDir->cluster == 0;
+#if defined(SD_INDEX)
+	indexValid = false;
+#endif
 
 	return SD_SUCCESS;
 }
@@ -259,8 +305,142 @@ void directoryNextEntry(char* buffer, uint8_t bufsize, uint8_t *buflen, bool *is
 	}
 }
 
+//Returns true if the file is an s3g/x3g file
+
+bool isJobFile(const char *filename, uint8_t len) {
+	if ((len >= 4) &&
+	    (filename[len-4] == '.') &&
+	    ((filename[len-3] == 's') || (filename[len-3] == 'x') ||
+	     (filename[len-3] == 'S') || (filename[len-3] == 'X')) &&
+	    (filename[len-2] == '3') &&
+	    ((filename[len-1] == 'g') || (filename[len-1] == 'G'))) return true;
+	return false;
+}
+
+#if defined(SD_INDEX)
+
+static uint8_t nameHash(const char *name)
+{
+	uint8_t h = 0;
+	while ( *name )
+		h = ( h << 1 ) + ( h >> 7 ) + (uint8_t)*name++;
+	return ( h ^ ( h >> 6 ) ) & INDEX_HASH;
+}
+
+static bool buildIndex()
+{
+	struct fat_dir_entry_struct entry;
+
+	if ( indexValid )
+		return true;
+	if ( !cwd )
+		return false;
+
+	indexLength = 0;
+	indexListed = 0;
+	indexTruncated = false;
+
+	fat_reset_dir(cwd);
+	while ( true ) {
+		if ( ( indexLength % INDEX_STRIDE ) == 0 )
+			fat_tell_dir(cwd, &indexPos[indexLength / INDEX_STRIDE]);
+		if ( !fat_read_dir(cwd, &entry) )
+			break;
+		if ( indexLength == INDEX_MAX ) {
+			indexTruncated = true;
+			break;
+		}
+
+		// List what directoryNextEntry() returns, less dot-folders
+		// (but not "..") and files other than s3g/x3g files
+		const char *name = entry.long_name;
+		uint8_t flags = nameHash(name);
+		if ( name[0] &&
+		     !( entry.attributes & ( FAT_ATTRIB_HIDDEN | FAT_ATTRIB_SYSTEM | FAT_ATTRIB_VOLUME ) ) ) {
+			if ( entry.attributes & FAT_ATTRIB_DIR ) {
+				flags |= INDEX_DIR;
+				if ( name[0] != '.' || ( name[1] == '.' && name[2] == 0 ) )
+					flags |= INDEX_LISTED;
+			}
+			else if ( isJobFile(name, strlen(name)) )
+				flags |= INDEX_LISTED;
+		}
+		if ( flags & INDEX_LISTED )
+			indexListed++;
+		indexFlags[indexLength++] = flags;
+	}
+
+	indexValid = true;
+	return true;
+}
+
+// Read the i-th entry of the index
+
+static bool readIndexEntry(uint8_t i, struct fat_dir_entry_struct* dir_entry)
+{
+	fat_seek_dir(cwd, &indexPos[i / INDEX_STRIDE]);
+	for ( i %= INDEX_STRIDE; ; i-- ) {
+		if ( !fat_read_dir(cwd, dir_entry) )
+			return false;
+		if ( i == 0 )
+			return true;
+	}
+}
+
+uint8_t indexCount()
+{
+	if ( mustReinit && initCard() != SD_SUCCESS )
+		return 0;
+	return buildIndex() ? indexListed : 0;
+}
+
+bool indexEntry(uint8_t index, char* buffer, uint8_t bufsize, uint8_t *buflen, bool *isDir)
+{
+	struct fat_dir_entry_struct entry;
+
+	buffer[0] = 0;
+	*buflen = 0;
+	*isDir = false;
+
+	if ( mustReinit && initCard() != SD_SUCCESS )
+		return false;
+	if ( !buildIndex() )
+		return false;
+
+	for ( uint8_t i = 0; i < indexLength; i++ ) {
+		if ( !( indexFlags[i] & INDEX_LISTED ) || index-- )
+			continue;
+		if ( !readIndexEntry(i, &entry) )
+			return false;
+		uint8_t j;
+		bufsize--;  // Assumes bufsize > 0
+		for ( j = 0; j < bufsize && entry.long_name[j] != 0; j++ )
+			buffer[j] = entry.long_name[j];
+		buffer[j] = 0;
+		*buflen = j;
+		*isDir = ( indexFlags[i] & INDEX_DIR ) != 0;
+		return true;
+	}
+	return false;
+}
+
+#endif
+
 static bool findFileInDir(const char* name, struct fat_dir_entry_struct* dir_entry)
 {
+#if defined(SD_INDEX)
+	// Only read the entries whose name hashes the same
+	if ( buildIndex() ) {
+		uint8_t h = nameHash(name);
+		for ( uint8_t i = 0; i < indexLength; i++ )
+			if ( ( indexFlags[i] & INDEX_HASH ) == h &&
+			     readIndexEntry(i, dir_entry) &&
+			     strcmp(dir_entry->long_name, name) == 0 )
+				return true;
+		if ( !indexTruncated )
+			return false;
+	}
+#endif
 	fat_reset_dir(cwd);
 	while ( fat_read_dir(cwd, dir_entry) )
 		if ( strcmp(dir_entry->long_name, name) == 0 )
@@ -280,6 +460,11 @@ bool changeDirectory(const char* dname)
 	return ( changeWorkingDir(&dirEntry) == SD_SUCCESS );
 }
 
+bool inRootDirectory()
+{
+	return cwdIsRoot;
+}
+
 static void finishFile() {
 	if ( file == 0 )
 		return;
@@ -323,12 +508,18 @@ static void deleteFile(char *name)
 
 	if ( findFileInDir(name, &fileEntry) )
 		fat_delete_file(fs, &fileEntry);
+#if defined(SD_INDEX)
+	indexValid = false;
+#endif
 }
 
 static bool createFile(char *name)
 {
 	struct fat_dir_entry_struct fileEntry;
 
+#if defined(SD_INDEX)
+	indexValid = false;
+#endif
 	return fat_create_file(cwd, name, &fileEntry) != 0;
 }
 
@@ -336,6 +527,89 @@ static bool capturing = false;
 static bool playing = false;
 static uint32_t capturedBytes = 0L;
 
+#if defined(S3G_CAPTURE_2_SD) || defined(EEPROM_MENU_ENABLE)
+
+// Captured data is gathered here and handed to the card a whole buffer
+// at a time.  A full sector lets each write skip reading back the old
+// block, and the card programs it while the next one fills.
+#if defined(__AVR_ATmega2560__)
+#define CAPTURE_BUFFER_SIZE 512
+#else
+#define CAPTURE_BUFFER_SIZE 64
+#endif
+
+#endif
+
+#if defined(SD_READ_AHEAD)
+// Playback reads the card a sector at a time into one of two buffers,
+// which the command parser empties while the other is refilled
+#define READ_AHEAD_SIZE 512
+
+// After the parser has waited this long, in units of 100 microseconds,
+// the card is waited on rather than polled
+#define AHEAD_STALL_LIMIT 5000
+#endif
+
+#if defined(S3G_CAPTURE_2_SD) || defined(EEPROM_MENU_ENABLE) || defined(SD_READ_AHEAD)
+// A file is never captured and played back at once, so the two share
+// their buffers
+static union {
+#if defined(S3G_CAPTURE_2_SD) || defined(EEPROM_MENU_ENABLE)
+	uint8_t capture[CAPTURE_BUFFER_SIZE];
+#endif
+#if defined(SD_READ_AHEAD)
+	uint8_t ahead[2][READ_AHEAD_SIZE];
+#endif
+} buffers;
+#endif
+
+#if defined(S3G_CAPTURE_2_SD) || defined(EEPROM_MENU_ENABLE)
+
+static uint16_t captureLength = 0;
+static uint16_t capturePackets = 0;   // packets with bytes in the buffer
+static uint16_t captureStalls = 0;    // flushes which waited on the card
+static uint16_t captureDropped = 0;   // packets lost to failed writes
+
+static bool flushCapture()
+{
+	if ( captureLength == 0 )
+		return true;
+
+	if ( sd_raw_busy() )
+		captureStalls++;
+
+	intptr_t written = ( file == 0 ) ? -1 :
+		fat_write_file(file, buffers.capture, captureLength);
+	bool ok = written == (intptr_t)captureLength;
+	if ( written > 0 )
+		capturedBytes += written;
+	if ( !ok )
+		captureDropped += capturePackets;
+
+	captureLength = 0;
+	capturePackets = 0;
+	return ok;
+}
+
+static bool captureBytes(const uint8_t *data, uint8_t length)
+{
+	bool ok = true;
+	while ( length-- ) {
+		buffers.capture[captureLength++] = *data++;
+		if ( captureLength == CAPTURE_BUFFER_SIZE && !flushCapture() )
+			ok = false;
+	}
+	return ok;
+}
+
+void captureStats(uint16_t *stalls, uint16_t *dropped)
+{
+	*stalls = captureStalls;
+	*dropped = captureDropped;
+}
+
+#endif
+
 bool isPlaying() {
 	return playing;
 }
@@ -363,6 +637,12 @@ SdErrorCode startCapture(char* filename)
 	return SD_ERR_CARD_LOCKED;
     
     capturedBytes = 0L;
+#if defined(S3G_CAPTURE_2_SD) || defined(EEPROM_MENU_ENABLE)
+    captureLength = 0;
+    capturePackets = 0;
+    captureStalls = 0;
+    captureDropped = 0;
+#endif
 
     // Always operate in truncation mode.
     deleteFile(filename);
@@ -381,10 +661,10 @@ SdErrorCode startCapture(char* filename)
 void capturePacket(const Packet& packet)
 {
 	if (file == 0) return;
-	// Casting away volatile is OK in this instance; we know where the
-	// data is located and that fat_write_file isn't caching
-	fat_write_file(file, (uint8_t*)packet.getData(), packet.getLength());
-	capturedBytes += packet.getLength();
+	// Casting away volatile is OK in this instance; the packet is
+	// copied out before it is reused
+	capturePackets++;
+	captureBytes((uint8_t*)packet.getData(), packet.getLength());
 }
 
 #endif
@@ -393,7 +673,7 @@ void capturePacket(const Packet& packet)
 
 /// Writes b to the open file
 bool writeByte(uint8_t b) {
-    return ( (intptr_t)1 == fat_write_file(file, (uint8_t *)&b, (uintptr_t)1) );
+    return captureBytes(&b, 1);
 }
 
 #endif
@@ -401,14 +681,176 @@ bool writeByte(uint8_t b) {
 uint32_t finishCapture()
 {
 	if ( capturing ) {
+#if defined(S3G_CAPTURE_2_SD) || defined(EEPROM_MENU_ENABLE)
+		flushCapture();
+#endif
 		finishFile();
 		capturing = false;
 	}
 	return capturedBytes;
 }
 
-static uint8_t next_byte;
 static bool has_more = false;
+static uint32_t playback_offset = 0;
+
+#if defined(SD_READ_AHEAD)
+
+// The buffer being played is emptied before the other one, which holds
+// the bytes that follow it if it isn't empty too.  The card is read into
+// whichever is empty when playbackReadAhead() finds it ready, so that a
+// slow card only holds up the command parser once both have been played.
+
+static uint16_t aheadLength[2];    // bytes in each buffer; 0 when played
+static uint16_t aheadPos;          // next byte of the buffer being played
+static uint8_t aheadPlay;          // which buffer is being played
+static uint32_t aheadOffset;       // where in the file the next read starts
+static bool aheadEnd;              // nothing more to read
+static SdErrorCode aheadError;     // why, to report once the buffers are played
+static bool aheadStalled;          // the parser is waiting on the card
+static bool aheadStreaming;        // the card is streaming from aheadOffset
+static uint32_t stallStart;
+static ReadAheadStats aheadStats;
+
+// Time in units of 100 microseconds; the simulator's card emulation
+// keeps the time in place of the board
+static uint32_t aheadClock() {
+#ifdef SIMULATOR
+	return sdemu_centa_micros();
+#else
+	uint8_t wrap;
+	return Motherboard::getBoard().getCurrentCentaMicros(&wrap);
+#endif
+}
+
+// Read the file into buffer i, up to the next sector boundary so that
+// the reads after the first one are of whole sectors.  The refill is
+// timed from start, when the card was first asked for the data.
+static void readAhead(uint8_t i, uint32_t start) {
+	uint16_t want = READ_AHEAD_SIZE - (uint16_t)( aheadOffset & ( READ_AHEAD_SIZE - 1 ) );
+	intptr_t read = fat_read_file(file, buffers.ahead[i], want);
+	uint32_t end = aheadClock();
+
+	aheadStreaming = true;
+	if ( read > 0 ) {
+		aheadLength[i] = (uint16_t)read;
+		aheadOffset += read;
+	}
+	else {
+		// fat_read_file() only returns an error on the first call
+		// which encounters it, so remember it
+		aheadEnd = true;
+		if ( read < 0 ) {
+			if ( !sd_raw_available() )
+				aheadError = SD_ERR_NO_CARD_PRESENT;
+			else
+				aheadError = ( fat_errno == FAT_ERR_CRC ) ? SD_ERR_CRC : SD_ERR_READ;
+		}
+	}
+
+	aheadStats.refills++;
+	aheadStats.refillTime += end - start;
+	if ( end - start > aheadStats.refillMax )
+		aheadStats.refillMax = ( end - start > 0xffff ) ? 0xffff : (uint16_t)( end - start );
+	if ( aheadStalled ) {
+		aheadStalled = false;
+		aheadStats.stallTime += end - stallStart;
+	}
+}
+
+// Once the buffers are played and nothing more can be read, end playback
+static void checkAheadEnd() {
+	if ( aheadEnd && aheadLength[aheadPlay] == 0 ) {
+		has_more = false;
+		if ( aheadError != SD_SUCCESS )
+			sdAvailable = aheadError;
+	}
+}
+
+// Empty the buffers and read the file from offset on
+static void restartAhead(uint32_t offset) {
+	aheadLength[0] = aheadLength[1] = 0;
+	aheadPos = 0;
+	aheadPlay = 0;
+	aheadOffset = offset;
+	aheadEnd = false;
+	aheadError = SD_SUCCESS;
+	aheadStalled = false;
+	has_more = true;
+	readAhead(0, aheadClock());
+	checkAheadEnd();
+}
+
+bool playbackHasNext() {
+	return has_more;
+}
+
+bool playbackReady() {
+	if ( aheadLength[aheadPlay] )
+		return true;
+	if ( has_more && !aheadStalled ) {
+		aheadStalled = true;
+		stallStart = aheadClock();
+		aheadStats.stalls++;
+	}
+	return false;
+}
+
+void playbackReadAhead() {
+	if ( !playing || aheadEnd )
+		return;
+	uint8_t i = aheadPlay;
+	if ( aheadLength[i] ) {
+		i ^= 1;
+		if ( aheadLength[i] )
+			return;
+	}
+	// After a pre-flight scan read, ask the card for the file again
+	// and let it fetch while the parser goes on
+	if ( !aheadStreaming ) {
+		aheadStreaming = true;
+		fat_stream_file(file);
+		return;
+	}
+	// Rather than wait for the card, try again on the next call.  But a
+	// card which has been pulled, or has kept the parser waiting too
+	// long, is waited on so that the read times out with an error.
+	uint32_t start = aheadClock();
+	if ( !sd_raw_stream_ready() && sd_raw_available() &&
+	     !( aheadStalled && start - stallStart > AHEAD_STALL_LIMIT ) )
+		return;
+	readAhead(i, start);
+	checkAheadEnd();
+}
+
+uint8_t playbackNext() {
+	if ( !playbackReady() ) {
+		if ( !has_more )
+			return 0;
+		// Nothing read ahead; wait on the card
+		readAhead(aheadPlay, aheadClock());
+		checkAheadEnd();
+		if ( !has_more )
+			return 0;
+	}
+	uint8_t rv = buffers.ahead[aheadPlay][aheadPos++];
+	playback_offset++;
+	if ( aheadPos == aheadLength[aheadPlay] ) {
+		// Played out; go on with the other buffer
+		aheadLength[aheadPlay] = 0;
+		aheadPlay ^= 1;
+		aheadPos = 0;
+		checkAheadEnd();
+	}
+	return rv;
+}
+
+void readAheadStats(ReadAheadStats *stats) {
+	*stats = aheadStats;
+}
+
+#else // !SD_READ_AHEAD
+
+static uint8_t next_byte;
 //static bool retry = false;
 
 void fetchNextByte() {
@@ -445,11 +887,27 @@ bool playbackHasNext() {
 
 uint8_t playbackNext() {
   uint8_t rv = next_byte;
+  playback_offset++;
   fetchNextByte();
   return rv;
 }
 
-SdErrorCode startPlayback(char* filename) {
+#endif // !SD_READ_AHEAD
+
+uint32_t playbackOffset() {
+  return playback_offset;
+}
+
+// Position the open file so that the next read is of the byte at offset.
+// Checked against the file's size: with FAT_WRITE_SUPPORT, seeking past
+// the end would grow the file.
+static bool seekFile(uint32_t offset) {
+    int32_t pos = (int32_t)offset;
+    return ( offset < fat_get_file_size(file) ) &&
+	fat_seek_file(file, &pos, FAT_SEEK_SET);
+}
+
+SdErrorCode startPlayback(char* filename, uint32_t offset) {
 #ifndef BROKEN_SD
     if ( mustReinit ) {
 	SdErrorCode rsp = initCard();
@@ -471,13 +929,91 @@ SdErrorCode startPlayback(char* filename) {
 	// The file was a directory and we successfully moved into it
 	return SD_CWD;
 
+    // Look up where the file's clusters are now, rather than in the
+    // FAT at each cluster boundary during the print
+    fat_map_file(file);
+
+    // Resuming part way through.  With the file mapped, the next read
+    // finds its cluster in the extents rather than walking the FAT.
+    if ( offset && !seekFile(offset) ) {
+	finishFile();
+	return SD_ERR_READ;
+    }
+    playback_offset = offset;
+
     // open_filesize = fat_get_file_size(file);
     playing = true;
+#if defined(SD_READ_AHEAD)
+    memset(&aheadStats, 0, sizeof(aheadStats));
+    restartAhead(offset);
+#else
     has_more = true;
     fetchNextByte();
+#endif
     return SD_SUCCESS;
 }
 
+#if defined(SD_LAYER_INDEX)
+bool playbackSeek(uint32_t offset) {
+    if ( !playing )
+	return false;
+    // The byte fetched ahead is at playback_offset
+    if ( !seekFile(offset) ) {
+	has_more = false;
+	sdAvailable = SD_ERR_READ;
+	return false;
+    }
+    playback_offset = offset;
+#if defined(SD_READ_AHEAD)
+    restartAhead(offset);
+#else
+    has_more = true;
+    fetchNextByte();
+#endif
+    return has_more;
+}
+
+#endif
+
+#if defined(SD_LAYER_INDEX) || defined(SD_PREFLIGHT)
+uint32_t playbackSize() {
+    return playing ? fat_get_file_size(file) : 0;
+}
+#endif
+
+#if defined(SD_PREFLIGHT)
+SdErrorCode playbackScan(uint32_t offset, uint8_t* buffer, uint8_t length,
+			 uint8_t* read) {
+    *read = 0;
+    if ( !playing )
+	return SD_ERR_GENERIC;
+    if ( offset >= fat_get_file_size(file) )
+	return SD_SUCCESS;
+
+    // Where playback reads from next: past the byte fetched ahead, or
+    // the end of the read-ahead
+    int32_t resume = 0;
+    fat_seek_file(file, &resume, FAT_SEEK_CUR);
+
+    SdErrorCode e = SD_SUCCESS;
+    intptr_t n = seekFile(offset) ? fat_read_file(file, buffer, length) : -1;
+    if ( n >= 0 )
+	*read = (uint8_t)n;
+    else if ( !sd_raw_available() )
+	e = SD_ERR_NO_CARD_PRESENT;
+    else
+	e = ( fat_errno == FAT_ERR_CRC ) ? SD_ERR_CRC : SD_ERR_READ;
+
+    fat_seek_file(file, &resume, FAT_SEEK_SET);
+
+#if defined(SD_READ_AHEAD)
+    // The read took the card's stream away from playback
+    aheadStreaming = false;
+#endif
+    return e;
+}
+#endif
+
 void finishPlayback() {
 	if ( !playing ) return;
 	finishFile();
@@ -502,6 +1038,9 @@ void reset() {
 		partition = 0;
 	}
 	// open_filesize = 0;
+#if defined(SD_INDEX)
+	indexValid = false;
+#endif
 #ifndef BROKEN_SD
 	mustReinit = true;
 #endif
@@ -523,4 +1062,42 @@ bool fileExists(const char* name)
   return findFileInDir(name, &fileEntry);
 }
 
+#if defined(SD_LAYER_INDEX)
+uint32_t fileSize(const char* name)
+{
+  struct fat_dir_entry_struct fileEntry;
+
+  if ( directoryReset() != SD_SUCCESS ||
+       !findFileInDir(name, &fileEntry) ||
+       ( fileEntry.attributes & FAT_ATTRIB_DIR ) )
+	  return 0;
+  return fileEntry.file_size;
+}
+
+SdErrorCode readFile(const char* name, uint32_t offset, void* buffer, uint8_t length)
+{
+  struct fat_dir_entry_struct fileEntry;
+
+  // The playback or capture file would be closed under them
+  if ( playing || capturing )
+	  return SD_ERR_GENERIC;
+
+  SdErrorCode e = directoryReset();
+  if ( e != SD_SUCCESS )
+	  return e;
+  if ( !findFileInDir(name, &fileEntry) || ( fileEntry.attributes & FAT_ATTRIB_DIR ) )
+	  return SD_ERR_FILE_NOT_FOUND;
+  if ( offset + length > fileEntry.file_size )
+	  return SD_ERR_READ;
+
+  file = fat_open_file(fs, &fileEntry);
+  if ( file == 0 )
+	  return SD_ERR_GENERIC;
+  bool ok = ( offset == 0 || seekFile(offset) ) &&
+	  ( fat_read_file(file, (uint8_t *)buffer, length) == length );
+  finishFile();
+  return ok ? SD_SUCCESS : SD_ERR_READ;
+}
+#endif
+
 } // namespace sdcard
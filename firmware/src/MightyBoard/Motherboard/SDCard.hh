@@ -44,14 +44,15 @@ namespace sdcard {
       SD_ERR_CRC              = 11, ///< CRC check failed
       SD_ERR_READ             = 12, ///< SD card read error
       SD_ERR_DEGRADED         = 13, ///< SD card comms only working at low speeds
+      SD_ERR_FILE_CORRUPT     = 14, ///< The file read fine but isn't a valid build
 #if defined(SD_DEBUG)
-      SD_ERR_1                = 14,
-      SD_ERR_2                = 15,
-      SD_ERR_3                = 16,
-      SD_ERR_4                = 17,
-      SD_ERR_5                = 18,
-      SD_ERR_6                = 19,
-      SD_ERR_7                = 20
+      SD_ERR_1                = 15,
+      SD_ERR_2                = 16,
+      SD_ERR_3                = 17,
+      SD_ERR_4                = 18,
+      SD_ERR_5                = 19,
+      SD_ERR_6                = 20,
+      SD_ERR_7                = 21
 #endif
 
     } SdErrorCode;
@@ -79,6 +80,30 @@ namespace sdcard {
 			    uint8_t* fileLength = 0, bool *isDir = 0);
 
 
+    /// Check whether a file name ends in .s3g or .x3g
+    /// \param[in] filename Name of the file
+    /// \param[in] len Length of the name
+    /// \return True if the file is an s3g/x3g file
+    bool isJobFile(const char* filename, uint8_t len);
+
+#if defined(SD_INDEX)
+    /// Count the entries in the current directory that the LCD menu lists:
+    /// s3g/x3g files, and folders other than dot-folders (".." excepted).
+    /// Served from the directory index, which is built on first use.
+    /// \return Number of entries, or 0 if the card can't be read
+    uint8_t indexCount();
+
+
+    /// Get the name of an entry counted by indexCount().
+    /// \param[in] index Which entry, counting from 0
+    /// \param[in] buffer Character buffer to store name in
+    /// \param[in] bufsize Size of buffer
+    /// \return True if successful
+    bool indexEntry(uint8_t index, char* buffer, uint8_t bufsize,
+		    uint8_t* fileLength, bool* isDir);
+#endif
+
+
     /// Begin capturing bufffered commands to a new file with the given filename.
     /// Returns an SD card error/success code.
     /// \param[in] filename Name of file to write to
@@ -100,6 +125,13 @@ namespace sdcard {
     /// \return Number of bytes written to the card.
     uint32_t finishCapture();
 
+#if defined(S3G_CAPTURE_2_SD) || defined(EEPROM_MENU_ENABLE)
+    /// Get the counters of the current or last capture.
+    /// \param[out] stalls Buffer flushes which had to wait for the card
+    /// \param[out] dropped Packets lost because the card would not take them
+    void captureStats(uint16_t *stalls, uint16_t *dropped);
+#endif
+
 
     /// Check whether a job is being captured to SD card
     /// \return True if we're capturing buffered commands to a file, false otherwise
@@ -109,8 +141,9 @@ namespace sdcard {
     /// Begin playing back commands from a file on the SD card.
     /// Returns an SD card error/success code
     /// \param[in] filename Name of file to write to
+    /// \param[in] offset Byte of the file to start from
     /// \return SD_SUCCESS if successful
-    SdErrorCode startPlayback(char* filename);
+    SdErrorCode startPlayback(char* filename, uint32_t offset = 0);
 
 
     /// See if there is more data available in the playback file.
@@ -123,6 +156,76 @@ namespace sdcard {
     uint8_t playbackNext();
 
 
+#if defined(SD_READ_AHEAD)
+    /// See if the next byte has been read ahead, so that playbackNext()
+    /// returns it without waiting on the card.  Each time it hasn't
+    /// while there's more to play counts as a stall.
+    /// \return True if playbackNext() won't read the card
+    bool playbackReady();
+
+
+    /// Read the card into an empty read-ahead buffer, if any, provided
+    /// the card has the data ready.  Reads at most one sector, so that
+    /// calling it once for each pass of the command loop costs no more
+    /// than a sector's transfer over SPI, and no wait on the card.
+    void playbackReadAhead();
+
+
+    /// Counters of the read-ahead during the current or last playback.
+    /// Times are in units of 100 microseconds.
+    typedef struct {
+      uint32_t refills;     ///< Reads of the card into a buffer
+      uint32_t refillTime;  ///< Time spent reading the card
+      uint16_t refillMax;   ///< Longest read of the card
+      uint32_t stalls;      ///< Times the next byte hadn't been read ahead
+      uint32_t stallTime;   ///< Time from those until it had been
+    } ReadAheadStats;
+
+
+    /// Get the read-ahead counters of the current or last playback.
+    /// \param[out] stats Where to store them
+    void readAheadStats(ReadAheadStats *stats);
+#endif
+
+
+    /// Offset in the file of the byte playbackNext() will return next.
+    /// \return Bytes of the file played back so far, including any
+    /// skipped by startPlayback()
+    uint32_t playbackOffset();
+
+
+#if defined(SD_LAYER_INDEX)
+    /// Carry on playback from another part of the file.
+    /// \param[in] offset Byte of the file to go on from
+    /// \return False if the file can't be read there, in which case
+    /// playback ends with sdAvailable set to the error
+    bool playbackSeek(uint32_t offset);
+#endif
+
+
+#if defined(SD_LAYER_INDEX) || defined(SD_PREFLIGHT)
+    /// Size of the file being played back.
+    /// \return Size in bytes, or 0 if nothing is playing
+    uint32_t playbackSize();
+#endif
+
+
+#if defined(SD_PREFLIGHT)
+    /// Read any part of the file being played back, leaving playback to
+    /// carry on where it was.  Doesn't touch the read-ahead buffers; the
+    /// next playbackReadAhead() starts the card streaming the file again
+    /// from where they go on.
+    /// \param[in] offset Byte of the file to start from
+    /// \param[out] buffer Where to store the bytes read
+    /// \param[in] length How many bytes to read
+    /// \param[out] read How many were read: fewer than length only at
+    /// the end of the file
+    /// \return SD_SUCCESS unless the card could not be read
+    SdErrorCode playbackScan(uint32_t offset, uint8_t* buffer, uint8_t length,
+			     uint8_t* read);
+#endif
+
+
     /// Halt playback.  Should be called at the end of playback, or on manual
     /// halt; frees up resources.
     void finishPlayback();
@@ -134,6 +237,22 @@ namespace sdcard {
     /// Return true if file name exists on the SDCard
     bool fileExists(const char* name);
 
+#if defined(SD_LAYER_INDEX)
+    /// Return the size of a file in the current directory
+    /// \return Size in bytes, or 0 if there is no such file
+    uint32_t fileSize(const char* name);
+
+
+    /// Read part of a file in the current directory.  Not while a file
+    /// is being played back or captured.
+    /// \param[in] name Name of the file
+    /// \param[in] offset Byte of the file to start from
+    /// \param[out] buffer Where to store the bytes read
+    /// \param[in] length How many bytes to read
+    /// \return SD_SUCCESS if all length bytes were read
+    SdErrorCode readFile(const char* name, uint32_t offset, void* buffer, uint8_t length);
+#endif
+
     /// Force the SD and FAT16 file system to be re-initialized
     /// and set the root directory as the current working directory
     void forceReinit();
@@ -141,6 +260,9 @@ namespace sdcard {
     /// Change our current working directory to the specified directory
     bool changeDirectory(const char *name);
 
+    /// Check whether the current working directory is the root directory
+    bool inRootDirectory();
+
 } // namespace sdcard
 
 #endif // SDCARD_HH_
@@ -49,6 +49,34 @@
  *
  *    z-skew = z - (d + x * Nx + y * Ny ) / Nz
  *
+ * Rather than divide by Nz for every point, we write that relative to
+ * P1 and precompute the two slopes -Nx / Nz and -Ny / Nz as 16.16 fixed
+ * point,
+ *
+ *    z-skew = z - z1 - (x - x1) * (-Nx / Nz) - (y - y1) * (-Ny / Nz)
+ *
+ * which leaves two multiplies and three additions per point.
+ *
+ * Mesh transform
+ * --------------
+ *  Probe the build platform's Z height at the nodes of a grid of
+ *  cols x rows points spaced evenly between (x0, y0) and (x1, y1).
+ *  Within each cell of the grid, the height is interpolated bilinearly
+ *  from the heights z00, z10, z01, z11 at the cell's corners,
+ *
+ *    u = (x - x0) / cell-width  - i,  for cell column i
+ *    v = (y - y0) / cell-height - j,  for cell row j
+ *    z = (1-v) * (z00 + u * (z10 - z00)) + v * (z01 + u * (z11 - z01))
+ *
+ *  Outside of the grid, the height at the nearest edge is used.  The
+ *  reciprocals of the cell width and height are computed once, so that
+ *  u and v are found with a multiply and a shift rather than a division.
+ *
+ *  The mesh is not a plane, so a straight move across a cell boundary
+ *  does not follow it.  Such moves are split at the cell boundaries
+ *  where the mesh and the move's straight line differ by more than
+ *  ALEVEL_MESH_SPLIT_TOLERANCE.
+ *
  * Tilt transform
  * --------------
  *  Probe the build platform's Z height at three points, P1, P2, and P3,
@@ -95,7 +123,7 @@
 #include <util/atomic.h>
 #include <avr/eeprom.h>
 
-#if defined(AUTO_LEVEL_TILT)
+#if defined(AUTO_LEVEL_TILT) || defined(AUTO_LEVEL_MESH)
 #include <math.h>
 #endif
 
@@ -103,13 +131,9 @@
 #include "EepromMap.hh"
 #include "SkewTilt.hh"
 
-// Coefficients for the equation of the plane
-//
-//   dot-product(P, N) + d = 0
-//   N = normal = ( skew_data[0], skew_data[1], skew_data[2] )
-//   d = skew_data[3]
+// Slopes of the plane, -Nx / Nz and -Ny / Nz, as 16.16 fixed point
 
-static int32_t skew_data[4];
+static int32_t skew_slope[2];
 
 // Maximum difference in Z between the three probing points
 // we need to initialize this since it's also used for error
@@ -126,10 +150,46 @@ static int32_t skew_zdelta = ALEVEL_NOT_ACTIVE;
 // skewing activated
 bool skew_active = false;
 
-// reference point.  Needed to compute d and needed when coordinate
+// reference point.  The plane passes through it; moved when coordinate
 // space is translated
 static int32_t r[3];
 
+// Memo of the last point transformed.  Moves which leave X and Y alone
+// (Z moves, retracts, extrude only) find their transform here, and a
+// move along one axis only recomputes that axis' term.  memo_term[] is
+// the plane's term for that axis, or for a mesh the cell coordinate.
+static int32_t memo_p[2];
+static int32_t memo_term[2];
+static int32_t memo_z;
+static bool memo_valid = false;
+
+// Transforms and memo hits since skew_init()
+static uint32_t memo_lookups;
+static uint32_t memo_hits;
+
+#if defined(AUTO_LEVEL_MESH)
+
+// Number of mesh nodes along X and Y; 0 when the plane is in use
+static uint8_t mesh_n[2];
+
+// X and Y of node (0, 0), moved when coordinate space is translated
+static int32_t mesh_origin[2];
+
+// Width and height of a cell, and of the whole mesh
+static int32_t mesh_cell[2];
+static int32_t mesh_span[2];
+
+// 2^28 / cell width and height
+static int32_t mesh_inverse[2];
+
+// Z offset of the node heights, moved when coordinate space is translated
+static int32_t mesh_z;
+
+// Node heights less mesh_z, row by row
+static int16_t mesh_dz[ALEVEL_MESH_MAX_NODES];
+
+#endif
+
 static void crossProduct(const int32_t *V1, const int32_t *V2, int32_t *N)
 {
      // Scale down to prevent 32bit overflow
@@ -138,16 +198,107 @@ static void crossProduct(const int32_t *V1, const int32_t *V2, int32_t *N)
      N[2] = (V1[0] * V2[1] - V1[1] * V2[0]) / 512;
 }
 
-static void skew_constant(void)
+static void probe_offsets(int32_t *probeOffsets)
+{
+#if !defined(ZYYX_3D_PRINTER)
+     cli();
+     eeprom_read_block(probeOffsets, (void *)eeprom_offsets::ALEVEL_PROBE_OFFSETS,
+		       2*sizeof(int32_t));
+     sei();
+#else
+     probeOffsets[0] = -stepperAxisMMToSteps(27, X_AXIS);
+     probeOffsets[1] = 0;
+#endif
+}
+
+#if defined(AUTO_LEVEL_MESH)
+
+// Position of p along the mesh's X (axis 0) or Y (axis 1) in cells,
+// as 16.16 fixed point, clamped to the mesh
+
+static int32_t mesh_coord(int32_t p, uint8_t axis)
+{
+     p -= mesh_origin[axis];
+     if ( p <= 0 ) return 0;
+     if ( p >= mesh_span[axis] ) return (int32_t)(mesh_n[axis] - 1) << 16;
+     // p is under 6 cells, so this cannot overflow
+     return ( p * mesh_inverse[axis] ) >> 12;
+}
+
+// Cell of the mesh that p lies in, along X (axis 0) or Y (axis 1):
+// -1 before the first node and n - 1 past the last
+
+static int8_t mesh_cell_of(int32_t p, uint8_t axis)
+{
+     p -= mesh_origin[axis];
+     if ( p < 0 ) return -1;
+     if ( p >= mesh_span[axis] ) return mesh_n[axis] - 1;
+     return ( p * mesh_inverse[axis] ) >> 28;
+}
+
+// Height of the mesh at cell coordinates u and v from mesh_coord()
+
+static int32_t mesh_interp(int32_t u, int32_t v)
+{
+     uint8_t i = u >> 16;
+     uint8_t j = v >> 16;
+     u &= 0xffff;
+     v &= 0xffff;
+
+     // On the far edges, use the far side of the last cell
+     if ( i == mesh_n[0] - 1 ) { i--; u = 0x10000; }
+     if ( j == mesh_n[1] - 1 ) { j--; v = 0x10000; }
+
+     // Node heights differ by at most 0x7fff so these cannot overflow
+     const int16_t *z = &mesh_dz[j * mesh_n[0] + i];
+     int32_t z0 = z[0] + ( ( (int32_t)(z[1] - z[0]) * u ) >> 16 );
+     z += mesh_n[0];
+     int32_t z1 = z[0] + ( ( (int32_t)(z[1] - z[0]) * u ) >> 16 );
+
+     return mesh_z + z0 + ( ( ( z1 - z0 ) * v ) >> 16 );
+}
+
+static int32_t mesh_height(const int32_t *P)
 {
-     // Determine by solving for d using a point in the plane previously saved
-     skew_data[3] = - ( r[0] * skew_data[0] + r[1] * skew_data[1] + r[2] * skew_data[2] );
+     return mesh_interp(mesh_coord(P[0], 0), mesh_coord(P[1], 1));
 }
 
+#endif
+
 int32_t skew(const int32_t *P)
 {
-     // z - ( x * Nx + y * Ny ) / Nz
-     return ( - ( skew_data[3] + P[0] * skew_data[0] + P[1] * skew_data[1] ) / skew_data[2] );
+     memo_lookups++;
+     if ( memo_valid && P[0] == memo_p[0] && P[1] == memo_p[1] ) {
+	  memo_hits++;
+	  return memo_z;
+     }
+
+     for ( uint8_t axis = 0; axis < 2; axis++ ) {
+	  if ( memo_valid && P[axis] == memo_p[axis] )
+	       continue;
+	  memo_p[axis] = P[axis];
+#if defined(AUTO_LEVEL_MESH)
+	  if ( mesh_n[0] ) {
+	       memo_term[axis] = mesh_coord(P[axis], axis);
+	       continue;
+	  }
+#endif
+	  memo_term[axis] = ( ( P[axis] - r[axis] ) * skew_slope[axis] ) >> 16;
+     }
+     memo_valid = true;
+
+#if defined(AUTO_LEVEL_MESH)
+     if ( mesh_n[0] )
+	  return memo_z = mesh_interp(memo_term[0], memo_term[1]);
+#endif
+     // z1 + (x - x1) * (-Nx / Nz) + (y - y1) * (-Ny / Nz)
+     return memo_z = r[2] + memo_term[0] + memo_term[1];
+}
+
+void skew_memo_stats(uint32_t *lookups, uint32_t *hits)
+{
+     *lookups = memo_lookups;
+     *hits = memo_hits;
 }
 
 void skew_update(const int32_t *delta)
@@ -156,9 +307,158 @@ void skew_update(const int32_t *delta)
      r[1] += delta[1];
      r[2] += delta[2];
 
-     skew_constant();
+#if defined(AUTO_LEVEL_MESH)
+     mesh_origin[0] += delta[0];
+     mesh_origin[1] += delta[1];
+     mesh_z += delta[2];
+#endif
+
+     // The memoized point moves with the coordinate space; its terms,
+     // relative to r or the mesh origin, do not change
+     memo_p[0] += delta[0];
+     memo_p[1] += delta[1];
+     memo_z += delta[2];
+}
+
+#if defined(AUTO_LEVEL_MESH)
+
+bool skew_mesh_stored(void)
+{
+     uint8_t n[2];
+
+     cli();
+     eeprom_read_block(n, (void *)eeprom_offsets::ALEVEL_MESH, 2);
+     sei();
+
+     return n[0] >= 2 && n[0] <= ALEVEL_MESH_MAX_SIDE &&
+	  n[1] >= 2 && n[1] <= ALEVEL_MESH_MAX_SIDE;
+}
+
+static bool skew_mesh_init(int32_t maxz, int32_t zoffset)
+{
+     auto_level_mesh_t mesh;
+     int32_t probeOffsets[2];
+
+     cli();
+     eeprom_read_block(&mesh, (void *)eeprom_offsets::ALEVEL_MESH, sizeof(mesh));
+     sei();
+
+     uint8_t nodes = mesh.cols * mesh.rows;
+     int16_t zmin = 0, zmax = 0;
+     for ( uint8_t k = 0; k < nodes; k++ ) {
+	  if ( mesh.dz[k] < zmin ) zmin = mesh.dz[k];
+	  else if ( mesh.dz[k] > zmax ) zmax = mesh.dz[k];
+     }
+
+     // Make sure the maximal height difference doesn't exceed maxz,
+     // nor the 0x7fff that mesh_height() relies on
+     skew_zdelta = (int32_t)zmax - (int32_t)zmin;
+     if ( skew_zdelta > maxz || skew_zdelta > 0x7fff ) {
+	  skew_zdelta = ALEVEL_BAD_LEVEL;
+	  return false;
+     }
+
+     mesh_n[0] = mesh.cols;
+     mesh_n[1] = mesh.rows;
+     for ( uint8_t axis = 0; axis < 2; axis++ ) {
+	  // The nodes must be probed in order of increasing X and Y
+	  mesh_cell[axis] = ( mesh.p1[axis] - mesh.p0[axis] ) / ( mesh_n[axis] - 1 );
+	  if ( mesh_cell[axis] <= 0 ) {
+	       mesh_n[0] = 0;
+	       skew_zdelta = ALEVEL_COLINEAR;
+	       return false;
+	  }
+	  mesh_span[axis] = mesh_cell[axis] * ( mesh_n[axis] - 1 );
+	  mesh_inverse[axis] = ( 1L << 28 ) / mesh_cell[axis];
+     }
+
+     for ( uint8_t k = 0; k < nodes; k++ )
+	  mesh_dz[k] = mesh.dz[k];
+
+     // As for the plane, the nodes were probed with the probe and are
+     // offset to the nozzle
+     probe_offsets(probeOffsets);
+     mesh_origin[0] = mesh.p0[0] + probeOffsets[0];
+     mesh_origin[1] = mesh.p0[1] + probeOffsets[1];
+     mesh_z = mesh.p0[2] - zoffset;
+
+     skew_active = true;
+
+     return true;
+}
+
+bool skew_split(const int32_t *A, const int32_t *B, int32_t *S, float *t)
+{
+     if ( !mesh_n[0] || ( A[0] == B[0] && A[1] == B[1] ) ) return false;
+
+     // Within a cell, the mesh is close enough to straight
+     if ( mesh_cell_of(A[0], 0) == mesh_cell_of(B[0], 0) &&
+	  mesh_cell_of(A[1], 1) == mesh_cell_of(B[1], 1) )
+	  return false;
+
+     // Where the move crosses cell boundaries, in order along the move:
+     // the fraction of the move, the mesh height there, and which
+     // boundary it is (axis << 4 | node).  The end of the move follows.
+     float f[2 * ALEVEL_MESH_MAX_SIDE + 1];
+     int32_t z[2 * ALEVEL_MESH_MAX_SIDE + 1];
+     uint8_t line[2 * ALEVEL_MESH_MAX_SIDE + 1];
+     uint8_t n = 0;
+     int32_t P[2];
+
+     for ( uint8_t axis = 0; axis < 2; axis++ ) {
+	  int32_t a = A[axis], b = B[axis];
+	  int32_t x = mesh_origin[axis];
+	  for ( uint8_t k = 0; k < mesh_n[axis]; k++, x += mesh_cell[axis] ) {
+	       // The boundary must lie strictly between A and B, so that
+	       // both pieces of the move have steps along this axis
+	       if ( ( x <= a && x <= b ) || ( x >= a && x >= b ) )
+		    continue;
+	       float g = (float)( x - a ) / (float)( b - a );
+	       P[0] = A[0] + (int32_t)( g * (float)( B[0] - A[0] ) );
+	       P[1] = A[1] + (int32_t)( g * (float)( B[1] - A[1] ) );
+	       P[axis] = x;
+	       uint8_t m = n++;
+	       for ( ; m && f[m - 1] > g; m-- ) {
+		    f[m] = f[m - 1];
+		    z[m] = z[m - 1];
+		    line[m] = line[m - 1];
+	       }
+	       f[m] = g;
+	       z[m] = mesh_height(P);
+	       line[m] = ( axis << 4 ) | k;
+	  }
+     }
+     f[n] = 1.0;
+     z[n] = mesh_height(B);
+
+     // Keep the longest first piece whose straight line passes within
+     // the tolerance of the mesh at every boundary it crosses
+     int32_t za = mesh_height(A);
+     uint8_t e = n;
+     for ( ; e > 0; e-- ) {
+	  uint8_t k = 0;
+	  // | z[k] - (za + (z[e] - za) * f[k] / f[e]) | <= tolerance
+	  for ( ; k < e; k++ )
+	       if ( fabs( (float)( z[k] - za ) * f[e] - (float)( z[e] - za ) * f[k] ) >
+		    ALEVEL_MESH_SPLIT_TOLERANCE * f[e] )
+		    break;
+	  if ( k == e )
+	       break;
+     }
+
+     if ( e == n ) return false;
+
+     // Split exactly on the boundary so that it is behind the next piece
+     uint8_t axis = line[e] >> 4;
+     S[0] = A[0] + (int32_t)( f[e] * (float)( B[0] - A[0] ) );
+     S[1] = A[1] + (int32_t)( f[e] * (float)( B[1] - A[1] ) );
+     S[axis] = mesh_origin[axis] + ( line[e] & 0x0f ) * mesh_cell[axis];
+     *t = f[e];
+     return true;
 }
 
+#endif
+
 bool skew_check(int32_t maxz, int32_t zoffset,
 	       const int32_t *P1, const int32_t *P2, const int32_t *P3)
 {
@@ -182,6 +482,14 @@ bool skew_init(int32_t maxz, int32_t zoffset,
      int32_t probeComps[3], probeOffsets[2], V1[3], V2[3], ztmp;
 
      skew_deinit();
+     memo_lookups = 0;
+     memo_hits = 0;
+
+#if defined(AUTO_LEVEL_MESH)
+     // A stored mesh replaces the probing points
+     if ( skew_mesh_stored() )
+	  return skew_mesh_init(maxz, zoffset);
+#endif
 
      // Check for a too far out of level condition
      V1[2] = P2[2] - P1[2];
@@ -202,16 +510,8 @@ bool skew_init(int32_t maxz, int32_t zoffset,
      cli();
      eeprom_read_block(probeComps, (void *)eeprom_offsets::ALEVEL_PROBE_COMP_SETTINGS,
 		       3*sizeof(int32_t));
-#if !defined(ZYYX_3D_PRINTER)
-     eeprom_read_block(probeOffsets, (void *)eeprom_offsets::ALEVEL_PROBE_OFFSETS,
-		       2*sizeof(int32_t));
-#endif
      sei();
-
-#if defined(ZYYX_3D_PRINTER)
-     probeOffsets[0] = -stepperAxisMMToSteps(27, X_AXIS);
-     probeOffsets[1] = 0;
-#endif
+     probe_offsets(probeOffsets);
 
      V1[0] = P2[0] - P1[0];
      V1[1] = P2[1] - P1[1];
@@ -221,30 +521,39 @@ bool skew_init(int32_t maxz, int32_t zoffset,
      V2[1] = P3[1] - P1[1];
      V2[2] += probeComps[2] - probeComps[0]; // (P3[2] + probeComps[2]) - (P1[2] + probeComps[0])
 
-     // Compute the normal to the plane and store
-     // in skew_data[0], [1], [2]
-     crossProduct(V1, V2, skew_data);
+     // Compute the normal to the plane
+     int32_t N[3];
+     crossProduct(V1, V2, N);
 
      // This should never happen: it indicates that either the
      //   probing points fail to define a plane (are co-linear), or
      //   the plane is parallel to the Z axis!  In that case, the
      //   ztmp > skew_zdata test should have triggered a failure
-     if ( skew_data[2] == 0 ) {
-	  skew_zdelta = ( skew_data[0] == 0 && skew_data[1] == 0 ) ?
+     if ( N[2] == 0 ) {
+	  skew_zdelta = ( N[0] == 0 && N[1] == 0 ) ?
 	       ALEVEL_COLINEAR : ALEVEL_BAD_LEVEL;
 	  return false;
      }
 
      // We want the upward pointing normal
-     if ( skew_data[2] < 0 )
+     if ( N[2] < 0 )
      {
-	  skew_data[0] = -skew_data[0];
-	  skew_data[1] = -skew_data[1];
-	  skew_data[2] = -skew_data[2];
+	  N[0] = -N[0];
+	  N[1] = -N[1];
+	  N[2] = -N[2];
      }
 
-     // Save P1 as a reference point in case we need
-     // to recompute d when the coordinate system is
+     // Slopes of 1/2 or more would overflow skew(); the probing points
+     // are then far too far out of level anyway
+     if ( labs(N[0]) >= N[2] / 2 || labs(N[1]) >= N[2] / 2 ) {
+	  skew_zdelta = ALEVEL_BAD_LEVEL;
+	  return false;
+     }
+     skew_slope[0] = (int32_t)( -65536.0 * (float)N[0] / (float)N[2] );
+     skew_slope[1] = (int32_t)( -65536.0 * (float)N[1] / (float)N[2] );
+
+     // Save P1 as the reference point that skew() measures
+     // from, and that we move when the coordinate system is
      // translated.
      //
      // We make
@@ -253,8 +562,8 @@ bool skew_init(int32_t maxz, int32_t zoffset,
      //
      // where Zoffset is the distance between the probe tip
      // and the tip of the extruder nozzle.  We only need to
-     // account for this once.  If and when we update the skew
-     // constant, we do so using the relative displacement and
+     // account for this once.  If and when we update the
+     // reference point, we do so using the relative displacement and
      // not the absolute.  As such, we do not need to know Zoffset
      // then.
 
@@ -262,9 +571,6 @@ bool skew_init(int32_t maxz, int32_t zoffset,
      r[1] = P1[1] + probeOffsets[1];
      r[2] = P1[2] - zoffset;
 
-     // Calculate the constant d using the reference point
-     skew_constant();
-
      // And we're good to go
      skew_active = true;
 
@@ -273,10 +579,13 @@ bool skew_init(int32_t maxz, int32_t zoffset,
 
 void skew_deinit(void)
 {
-     skew_data[0] = 0;
-     skew_data[1] = 0;
-     skew_data[2] = 1;
-     skew_data[3] = 0;
+     skew_slope[0] = 0;
+     skew_slope[1] = 0;
+     r[0] = r[1] = r[2] = 0;
+#if defined(AUTO_LEVEL_MESH)
+     mesh_n[0] = 0;
+#endif
+     memo_valid   = false;
      skew_zdelta  = ALEVEL_NOT_ACTIVE;
      skew_active  = false;
 }
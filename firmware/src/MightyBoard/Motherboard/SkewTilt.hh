@@ -26,6 +26,28 @@ extern void skew_deinit(void);
 // Otherwise, returns the max Z difference (in steps) between probed points
 extern int32_t skew_status(void);
 
+// Number of calls to skew() since skew_init(), and how many of them
+// were for the same X and Y as the call before
+extern void skew_memo_stats(uint32_t *lookups, uint32_t *hits);
+
+#if defined(AUTO_LEVEL_MESH)
+
+// Moves which cross mesh cells are split where the mesh height departs
+// from a straight line between the ends of the move by more than this
+// many Z steps
+#define ALEVEL_MESH_SPLIT_TOLERANCE 8
+
+// Returns true if a complete mesh is stored in EEPROM.  skew_init() then
+// uses the mesh instead of the three probing points.
+extern bool skew_mesh_stored(void);
+
+// Returns true if the move from A to B should be split to follow the
+// mesh, with the X and Y of the split in S and the fraction of the move
+// at which it lies in *t.  Only X and Y of A and B are used.
+extern bool skew_split(const int32_t *A, const int32_t *B, int32_t *S, float *t);
+
+#endif
+
 #if defined(AUTO_LEVEL_TILT)
 
 extern Point tilt(Point &P);
@@ -75,6 +75,12 @@
 #include "Motherboard.hh"
 #endif
 
+// The simulator cross checks the fixed point math against floating point
+// and attaches diagnostics to each block.  sailtime only wants the times.
+#if defined(SIMULATOR) && !defined(SAILTIME)
+#define SIMULATOR_CHECKS
+#endif
+
 #ifdef abs
 #undef abs
 #endif
@@ -133,6 +139,23 @@ FPTYPE		minimumSegmentTime;
 int32_t		planner_position[STEPPER_COUNT];			//rescaled from extern when axisStepsPerMM are changed by gcode
 int32_t		planner_target[STEPPER_COUNT];
 
+#if defined(SD_RESUME)
+// SD file offset of the command whose move is queued next, given to
+// that move's first block only
+uint32_t	planner_source_offset = 0;
+#endif
+
+#if defined(SD_PLANNED)
+// What s3gplan worked out ahead of time for the move queued next; taken
+// in place of planning the parts of it which depend on the move alone
+const planned_move_t *planner_planned = NULL;
+#ifdef SIMULATOR
+// Where s3gplan wants those parts of the next accelerated move stored;
+// cleared once they have been
+planned_move_t	*planner_capture = NULL;
+#endif
+#endif
+
 static FPTYPE	prev_speed[STEPPER_COUNT];
 static FPTYPE   prev_final_speed = 0;
 
@@ -340,10 +363,12 @@ FORCE_INLINE int32_t intersection_distance(int32_t initial_rate_sq, int32_t fina
 FORCE_INLINE FPTYPE final_speed_step_rate(uint32_t acceleration, uint32_t initial_velocity, int32_t distance) {
      uint32_t v2 = initial_velocity * initial_velocity;
 
-#ifdef SIMULATOR
+#ifdef SIMULATOR_CHECKS
      uint64_t sum2 = (uint64_t)initial_velocity * (uint64_t)initial_velocity +
 	  2 * (uint64_t)acceleration * (uint64_t)distance;
      float fres = (sum2 > 0) ? sqrt((float)sum2) : 0.0;
+#endif
+#ifdef SIMULATOR
      FPTYPE result;
 #endif
 
@@ -379,6 +404,7 @@ FORCE_INLINE FPTYPE final_speed_step_rate(uint32_t acceleration, uint32_t initia
      }
 
 #ifdef SIMULATOR
+#ifdef SIMULATOR_CHECKS
      if ((fres != 0.0) && ((fabsf(fres - FPTOF(result))/fres) > 0.01)) {
 	  char buf[1024];
 	  snprintf(buf, sizeof(buf), "!!! final_speed_step_rate(%d, %d, %d): fixed result = %f; "
@@ -387,6 +413,7 @@ FORCE_INLINE FPTYPE final_speed_step_rate(uint32_t acceleration, uint32_t initia
 	  if (sblock)	strlcat(sblock->message, buf, sizeof(sblock->message));
 	  else		printf("%s", buf);
      }
+#endif
      return result;
 #endif
 }
@@ -580,7 +607,7 @@ void calculate_trapezoid_for_block(block_t *block, FPTYPE entry_factor, FPTYPE e
 				#endif
 			}
 
-			#ifdef SIMULATOR
+			#ifdef SIMULATOR_CHECKS
 				// Owing to roundoff errors, it's not abnormal to see values of -1
 				if ( (advance_lead_entry < -1) || (advance_lead_exit < -1) || (advance_pressure_relax < 0) || (advance_pressure_relax >> 8) > 0x7fff) {
 					char buf[1024];
@@ -639,7 +666,7 @@ void calculate_trapezoid_for_block(block_t *block, FPTYPE entry_factor, FPTYPE e
 
 FORCE_INLINE FPTYPE initial_speed(FPTYPE acceleration, FPTYPE target_velocity, FPTYPE distance) {
 	#ifdef FIXED
-		#ifdef SIMULATOR
+		#ifdef SIMULATOR_CHECKS
 			FPTYPE acceleration_original = acceleration;
 			FPTYPE distance_original = distance;
 			FPTYPE target_velocity_original = target_velocity;
@@ -699,6 +726,7 @@ FORCE_INLINE FPTYPE initial_speed(FPTYPE acceleration, FPTYPE target_velocity, F
 			if (n > 6)		result >>= (n - 6);
 			else			result <<= (6 - n);
 
+			#ifdef SIMULATOR_CHECKS
 			if ((fres != 0.0) && ((fabsf(fres - FPTOF(result))/fres) > 0.05)) {
 				char buf[1024];
 				snprintf(buf, sizeof(buf),
@@ -710,6 +738,7 @@ FORCE_INLINE FPTYPE initial_speed(FPTYPE acceleration, FPTYPE target_velocity, F
 				if (sblock)	strlcat(sblock->message, buf, sizeof(sblock->message));
 				else		printf("%s", buf);
 			}
+			#endif
 
 			return result;
 		#endif // SIMULATOR
@@ -760,7 +789,7 @@ FORCE_INLINE FPTYPE initial_speed(FPTYPE acceleration, FPTYPE target_velocity, F
 FORCE_INLINE FPTYPE final_speed(FPTYPE acceleration, FPTYPE initial_velocity, FPTYPE distance) {
 	#ifdef FIXED
 		//  static int counts = 0;
-		#ifdef SIMULATOR
+		#ifdef SIMULATOR_CHECKS
 			FPTYPE acceleration_original = acceleration;
 			FPTYPE distance_original = distance;
 			FPTYPE initial_velocity_original = initial_velocity;
@@ -844,6 +873,7 @@ FORCE_INLINE FPTYPE final_speed(FPTYPE acceleration, FPTYPE initial_velocity, FP
 			if (n > 6)	result >>= (n - 6);
 			else		result <<= (6 - n);
 
+			#ifdef SIMULATOR_CHECKS
 			if ((fres != 0.0) && ((fabsf(fres - FPTOF(result))/fres) > 0.05)) {
 				char buf[1024];
 				snprintf(buf, sizeof(buf),
@@ -855,6 +885,7 @@ FORCE_INLINE FPTYPE final_speed(FPTYPE acceleration, FPTYPE initial_velocity, FP
 				if (sblock)	strlcat(sblock->message, buf, sizeof(sblock->message));
 				else		printf("%s", buf);
 			}
+			#endif
 			return result;
 		#endif // SIMULATOR
 	#else
@@ -1077,6 +1108,159 @@ void plan_init(FPTYPE extruderAdvanceK, FPTYPE extruderAdvanceK2, bool zhold) {
 
 
 
+// Set the block's acceleration for the trapezoid generator, limited by
+// each axis it moves.  Depends on the block's steps and length alone.
+
+static void plan_acceleration(block_t *block, FPTYPE inverse_millimeters)
+{
+	// We're here limited to a max step event count of 0xffff
+	// For the Z-axis -- the highest res axis -- that amounts to 163.8 mm (65,535/400)
+	// Can increase by shifting right more
+
+	FPTYPE steps_per_mm;
+	if (block->step_event_count < 0x7fff)
+		steps_per_mm = FPMULT2(ITOFP((int32_t)block->step_event_count), inverse_millimeters);
+	else if (block->step_event_count < 0xffff)
+		steps_per_mm = FPMULT2(ITOFP((int32_t)block->step_event_count >> 1), inverse_millimeters << 1);
+	else if (block->step_event_count < 0x1ffff)
+		// Someone had a Z resolution of 630 steps/mm which made a 115.5 mm Z travel exceed 0xffff steps
+		steps_per_mm = FPMULT2(ITOFP((int32_t)block->step_event_count >> 2), inverse_millimeters << 2);
+	else
+		// Switch to floating point.  But if someone has this high of resolution for X | Y
+		// then they have bigger problems: not enough CPU cycles to run the stepper interrupt
+		// at the necessary frequency.
+		steps_per_mm = FTOFP(FPTOF(inverse_millimeters) * (float)block->step_event_count);
+
+	// Limit acceleration per axis
+	// Start with the max axial acceleration for an axis
+	// with block->step_event_count since we're going to require
+	// acceleration_st <= max_acceleration[master-axis] anyway
+	block->acceleration_st = axis_steps_per_sqr_second[planner_master_steps_index]; // *
+	// (uint32_t)FPTOI(steps_per_mm); // convert to: acceleration steps/sec^2
+
+	// Now skip this axis in our checks
+	uint8_t axes = planner_axes & ~(1 << planner_master_steps_index);
+
+	//Assumptions made, due to the high value of acceleration_st / p_retract acceleration, dropped
+	//ceil and floating point multiply
+
+	//   Note, we've previously limited step_event_count to 0xffff = 65,536 steps
+	//   However, the product of the step count and the max per axis acceleration in steps/s^2 can
+	//   overflow a uint32_t for moves with a lot of steps....  So, to prevent overflows, we escape
+	//   to 64bits when step_event_count > 0xffffffff / axis_steps_per_sqr_second[i]
+
+	for (uint8_t i = 0; i < STEPPER_COUNT; i++) {
+	     if ( axes & (1 << i ) ) {
+		  if (block->step_event_count <= axis_accel_step_cutoff[i]) {
+		       // We're below the cutoff: do the comparisons in 32 bits
+		       if ((block->acceleration_st * (uint32_t)block->steps[i]) > (axis_steps_per_sqr_second[i] * block->step_event_count))
+			    // We only need to reduce the acceleration to
+			    //
+			    //   axis_steps_per_sqr_second[i] * ( step_event_count / steps[i] )
+			    //
+			    //   block->acceleration_st = (axis_steps_per_sqr_second[i] * (uint32_t)block->step_event_count) / (uint32_t)block->steps[i];
+			    //
+			    // However, that's computationally more expensive and, more importantly,
+			    // doesn't typically yield faster results.  Typically, we're reducing the
+			    // acceleration along the axis with step_event_count steps in which
+			    // case that ratio of step counts is unity and the division was
+			    // unnecessary.  The other axes then require no further reduction in the
+			    // acceleration.  So, we just reduce the acceleration to the max for the
+			    // axis in question.
+			    //
+			    // Note that Marlin does the same thing, although there's no code comments
+			    // in Marlin indicating if any thought was given to the matter or not.
+			    block->acceleration_st = axis_steps_per_sqr_second[i];
+		  } else {
+		       // Above the cutoffs: do the comparisons in 64 bits
+		       if (((uint64_t)block->acceleration_st * (uint64_t)block->steps[i]) >
+			   ((uint64_t)axis_steps_per_sqr_second[i] * (uint64_t)block->step_event_count))
+			    // block->acceleration_st = (uint32_t)(((uint64_t)axis_steps_per_sqr_second[i] * (uint64_t)block->step_event_count) / (uint64_t)block->steps[i]);
+			    block->acceleration_st = axis_steps_per_sqr_second[i];
+		  }
+	     }
+	}
+
+	// Acceleration limit to prevent overflow is 
+	if	(block->acceleration_st <= 0x7FFF)
+		// Acceleration limit to prevent overflow is 0x7FFF / axis-steps-per-mm
+		// good up to about 81.9175 mm/s^2 @ 400 steps/mm || 341.32 mm/s^2 @ 96 steps/mm
+		block->acceleration = FPDIV(ITOFP((int32_t)block->acceleration_st), steps_per_mm);
+	else if (block->acceleration_st <= 0x1FFFF)
+		// Acceleration limit to prevent overflow is 0x1FFFF / axis-steps-per-mm
+		// good up to about 327.67 mm/s^2 @ 400 steps/mm || 1,365.3 mm/s^2 @ 96 steps/mm
+		block->acceleration = FPDIV(ITOFP(((int32_t)block->acceleration_st)>>2), (steps_per_mm>>2));
+	else if (block->acceleration_st <= 0x7FFFF)
+		// Acceleration limit to prevent overflow is 0x7FFFF / axis-steps-per-mm
+		// good up to 1311 mm/s^2 @ 400 steps/mm || 5,461 mm/s^2 @ 96 steps/mm
+		block->acceleration = FPDIV(ITOFP(((int32_t)block->acceleration_st)>>4), (steps_per_mm>>4));
+	else
+		// Acceleration limit to prevent overflow is 0xFFFFF / axis-steps-per-mm
+		// good up to 2,621 mm/s^2 @ 400 steps/mm || 10,922 mm/s^2 @ 96 steps/mm
+		// STOP HERE SINCE JKN Advance K2 calculations limit accel to 0xFFFFF / axis-steps-per-mm
+		block->acceleration = FPDIV(ITOFP(((int32_t)block->acceleration_st)>>5), (steps_per_mm>>5));
+
+	#if 0
+		else if (block->acceleration_st <= 0x1FFFFF)
+			// Acceleration limit to prevent overflow is 0x1FFFFF / axis-steps-per-mm
+			// good up to 5,243 mm/s^2 @ 400 steps/mm || 21,845 mm/s^2 @ 96 steps/mm
+			block->acceleration = FPDIV(ITOFP(((int32_t)block->acceleration_st)>>6), (steps_per_mm>>6));
+		else
+			// Acceleration limit to prevent overflow is 0x7FFFFF / axis-steps-permm
+			// good up to 20,972 mm/s^2 @ 400 steps/mm || 87,379 mm/s^2 @ 96 steps/mm
+			block->acceleration = FPDIV(ITOFP(((int32_t)block->acceleration_st)>>8), (steps_per_mm>>8));
+	#endif
+
+	// The value 8.388608 derives from the timer frequency used for
+	// st_interrupt().  That interrupt is driven by a timer counter which
+	// ticks at a frequency of 2 MHz.  To convert counter values to seconds
+	// the counter value needs to be divided by 2000000.  So that we
+	// can do integer arithmetic (rather than floating point), we first
+	// multiply the acceleration by the counter value and THEN divide the
+	// result by 2000000.  However, the divide can be done by a shift and
+	// it turns out that it is convenient to use >> 24 which is a divide
+	// by approximately 16777216.  That's too large by about 8.388608.
+	// Therefore, we pre-scale the acceleration here by 8.388608
+
+	//This can potentially overflow in fixed point, due to a large block->acceleration_st,
+	//so we don't use fixed point for this calculation
+	#ifdef FIXED
+		block->acceleration_rate = (int32_t)(((int64_t)block->acceleration_st * 137439) >> 14);
+	#else
+		block->acceleration_rate = (int32_t)((FPTYPE)block->acceleration_st * 8.388608);
+	#endif
+}
+
+
+
+#if defined(SD_PLANNED) && defined(SIMULATOR)
+
+// Store the parts of an accelerated block which depend on the move alone
+// for s3gplan to write out.  Moves with more steps than a planned_move_t
+// holds are left unplanned.
+
+static void plan_capture(block_t *block, const uint32_t &dda_rate, FPTYPE inverse_millimeters, FPTYPE v_allowable)
+{
+	for ( uint8_t i = 0; i < STEPPER_COUNT; i ++ )
+		if ( block->steps[i] > 0x7fff ) return;
+
+	for ( uint8_t i = 0; i < STEPPER_COUNT; i ++ ) {
+		planner_capture->steps[i] = (int16_t)(( block->direction_bits & (1 << i) ) ?
+						      -block->steps[i] : block->steps[i]);
+		planner_capture->delta_mm[i] = delta_mm[i];
+	}
+	planner_capture->dda_rate            = (int32_t)dda_rate;
+	planner_capture->millimeters         = block->millimeters;
+	planner_capture->inverse_millimeters = inverse_millimeters;
+	planner_capture->acceleration_st     = block->acceleration_st;
+	planner_capture->acceleration        = block->acceleration;
+	planner_capture->acceleration_rate   = block->acceleration_rate;
+	planner_capture->v_allowable         = v_allowable;
+	planner_capture = NULL;
+}
+
+#endif
+
 // Add a new linear movement to the buffer. 
 // planner_target[5] should be set outside this function prior to entry to denote the 
 // absolute target position in steps.
@@ -1105,6 +1289,16 @@ void plan_buffer_line(FPTYPE feed_rate, const uint32_t &dda_rate, const uint8_t
 	// Note the active toolhead
 	block->active_toolhead = active_toolhead;
 
+#if defined(SD_RESUME)
+	block->source_offset = planner_source_offset;
+	planner_source_offset = 0;
+#endif
+
+#if defined(SD_PLANNED)
+	const planned_move_t *planned = planner_planned;
+	planner_planned = NULL;
+#endif
+
 	CRITICAL_SECTION_START;
 	for ( uint8_t i = 0; i < STEPPER_COUNT; i ++ )
 		block->starting_position[i] = planner_position[i];
@@ -1114,7 +1308,9 @@ void plan_buffer_line(FPTYPE feed_rate, const uint32_t &dda_rate, const uint8_t
 		// Track how many times this block is worked on by the planner
 		// Namely, how many times it is passed to calculate_trapezoid_for_block()
 		block->planned = 0;
-		block->message[0] = '\0';
+		#ifdef SIMULATOR_CHECKS
+			block->message[0] = '\0';
+		#endif
 		sblock = block;
 	#endif
 
@@ -1247,10 +1443,18 @@ void plan_buffer_line(FPTYPE feed_rate, const uint32_t &dda_rate, const uint8_t
 	//If we have a feed_rate, we calculate some stuff early, because it's also needed for non-accelerated blocks
 	if ( feed_rate != 0 ) {
 		FPTYPE inverse_second;
-		if ( extruder_only_move )	block->millimeters = FPABS(delta_mm[A_AXIS + block->active_extruder]);
-		else				block->millimeters = planner_distance;
+#if defined(SD_PLANNED)
+		if ( planned ) {
+			block->millimeters = planned->millimeters;
+			inverse_millimeters = planned->inverse_millimeters;
+		} else
+#endif
+		{
+			if ( extruder_only_move )	block->millimeters = FPABS(delta_mm[A_AXIS + block->active_extruder]);
+			else				block->millimeters = planner_distance;
 
-		inverse_millimeters = FPDIV(KCONSTANT_1, block->millimeters);  // Inverse millimeters to remove multiple divides 
+			inverse_millimeters = FPDIV(KCONSTANT_1, block->millimeters);  // Inverse millimeters to remove multiple divides 
+		}
 
 		// Calculate speed in mm/second for each axis. No divide by zero due to previous checks.
 		inverse_second = FPMULT2(feed_rate, inverse_millimeters);
@@ -1354,7 +1558,7 @@ void plan_buffer_line(FPTYPE feed_rate, const uint32_t &dda_rate, const uint8_t
 			// block->nominal_rate <= 0x7fff (32,767 steps/s)
 			block->nominal_rate = (uint32_t)FPTOI(FPMULT2( ITOFP((int32_t)block->nominal_rate), FPDIV(feed_rate, originalFeedRate)));
 
-			#ifdef SIMULATOR
+			#ifdef SIMULATOR_CHECKS
 				char buf[1024];
 				snprintf(buf, sizeof(buf),
 					 "!!! Minimum segment time kicked in: old feed rate=%f; new feed rate=%f !!!\n",
@@ -1368,124 +1572,15 @@ void plan_buffer_line(FPTYPE feed_rate, const uint32_t &dda_rate, const uint8_t
 	block->nominal_speed	= feed_rate; // (mm/sec) Always > 0
 
 	// Compute and limit the acceleration rate for the trapezoid generator.
+#if defined(SD_PLANNED)
+	if ( planned ) {
+		block->acceleration_st   = planned->acceleration_st;
+		block->acceleration      = planned->acceleration;
+		block->acceleration_rate = planned->acceleration_rate;
+	} else
+#endif
+		plan_acceleration(block, inverse_millimeters);
 
-	// We're here limited to a max step event count of 0xffff
-	// For the Z-axis -- the highest res axis -- that amounts to 163.8 mm (65,535/400)
-	// Can increase by shifting right more
-
-	FPTYPE steps_per_mm;
-	if (block->step_event_count < 0x7fff)
-		steps_per_mm = FPMULT2(ITOFP((int32_t)block->step_event_count), inverse_millimeters);
-	else if (block->step_event_count < 0xffff)
-		steps_per_mm = FPMULT2(ITOFP((int32_t)block->step_event_count >> 1), inverse_millimeters << 1);
-	else if (block->step_event_count < 0x1ffff)
-		// Someone had a Z resolution of 630 steps/mm which made a 115.5 mm Z travel exceed 0xffff steps
-		steps_per_mm = FPMULT2(ITOFP((int32_t)block->step_event_count >> 2), inverse_millimeters << 2);
-	else
-		// Switch to floating point.  But if someone has this high of resolution for X | Y
-		// then they have bigger problems: not enough CPU cycles to run the stepper interrupt
-		// at the necessary frequency.
-		steps_per_mm = FTOFP(FPTOF(inverse_millimeters) * (float)block->step_event_count);
-
-	// Limit acceleration per axis
-	// Start with the max axial acceleration for an axis
-	// with block->step_event_count since we're going to require
-	// acceleration_st <= max_acceleration[master-axis] anyway
-	block->acceleration_st = axis_steps_per_sqr_second[planner_master_steps_index]; // *
-	// (uint32_t)FPTOI(steps_per_mm); // convert to: acceleration steps/sec^2
-
-	// Now skip this axis in our checks
-	uint8_t axes = planner_axes & ~(1 << planner_master_steps_index);
-
-	//Assumptions made, due to the high value of acceleration_st / p_retract acceleration, dropped
-	//ceil and floating point multiply
-
-	//   Note, we've previously limited step_event_count to 0xffff = 65,536 steps
-	//   However, the product of the step count and the max per axis acceleration in steps/s^2 can
-	//   overflow a uint32_t for moves with a lot of steps....  So, to prevent overflows, we escape
-	//   to 64bits when step_event_count > 0xffffffff / axis_steps_per_sqr_second[i]
-
-	for (uint8_t i = 0; i < STEPPER_COUNT; i++) {
-	     if ( axes & (1 << i ) ) {
-		  if (block->step_event_count <= axis_accel_step_cutoff[i]) {
-		       // We're below the cutoff: do the comparisons in 32 bits
-		       if ((block->acceleration_st * (uint32_t)block->steps[i]) > (axis_steps_per_sqr_second[i] * block->step_event_count))
-			    // We only need to reduce the acceleration to
-			    //
-			    //   axis_steps_per_sqr_second[i] * ( step_event_count / steps[i] )
-			    //
-			    //   block->acceleration_st = (axis_steps_per_sqr_second[i] * (uint32_t)block->step_event_count) / (uint32_t)block->steps[i];
-			    //
-			    // However, that's computationally more expensive and, more importantly,
-			    // doesn't typically yield faster results.  Typically, we're reducing the
-			    // acceleration along the axis with step_event_count steps in which
-			    // case that ratio of step counts is unity and the division was
-			    // unnecessary.  The other axes then require no further reduction in the
-			    // acceleration.  So, we just reduce the acceleration to the max for the
-			    // axis in question.
-			    //
-			    // Note that Marlin does the same thing, although there's no code comments
-			    // in Marlin indicating if any thought was given to the matter or not.
-			    block->acceleration_st = axis_steps_per_sqr_second[i];
-		  } else {
-		       // Above the cutoffs: do the comparisons in 64 bits
-		       if (((uint64_t)block->acceleration_st * (uint64_t)block->steps[i]) >
-			   ((uint64_t)axis_steps_per_sqr_second[i] * (uint64_t)block->step_event_count))
-			    // block->acceleration_st = (uint32_t)(((uint64_t)axis_steps_per_sqr_second[i] * (uint64_t)block->step_event_count) / (uint64_t)block->steps[i]);
-			    block->acceleration_st = axis_steps_per_sqr_second[i];
-		  }
-	     }
-	}
-
-	// Acceleration limit to prevent overflow is 
-	if	(block->acceleration_st <= 0x7FFF)
-		// Acceleration limit to prevent overflow is 0x7FFF / axis-steps-per-mm
-		// good up to about 81.9175 mm/s^2 @ 400 steps/mm || 341.32 mm/s^2 @ 96 steps/mm
-		block->acceleration = FPDIV(ITOFP((int32_t)block->acceleration_st), steps_per_mm);
-	else if (block->acceleration_st <= 0x1FFFF)
-		// Acceleration limit to prevent overflow is 0x1FFFF / axis-steps-per-mm
-		// good up to about 327.67 mm/s^2 @ 400 steps/mm || 1,365.3 mm/s^2 @ 96 steps/mm
-		block->acceleration = FPDIV(ITOFP(((int32_t)block->acceleration_st)>>2), (steps_per_mm>>2));
-	else if (block->acceleration_st <= 0x7FFFF)
-		// Acceleration limit to prevent overflow is 0x7FFFF / axis-steps-per-mm
-		// good up to 1311 mm/s^2 @ 400 steps/mm || 5,461 mm/s^2 @ 96 steps/mm
-		block->acceleration = FPDIV(ITOFP(((int32_t)block->acceleration_st)>>4), (steps_per_mm>>4));
-	else
-		// Acceleration limit to prevent overflow is 0xFFFFF / axis-steps-per-mm
-		// good up to 2,621 mm/s^2 @ 400 steps/mm || 10,922 mm/s^2 @ 96 steps/mm
-		// STOP HERE SINCE JKN Advance K2 calculations limit accel to 0xFFFFF / axis-steps-per-mm
-		block->acceleration = FPDIV(ITOFP(((int32_t)block->acceleration_st)>>5), (steps_per_mm>>5));
-
-	#if 0
-		else if (block->acceleration_st <= 0x1FFFFF)
-			// Acceleration limit to prevent overflow is 0x1FFFFF / axis-steps-per-mm
-			// good up to 5,243 mm/s^2 @ 400 steps/mm || 21,845 mm/s^2 @ 96 steps/mm
-			block->acceleration = FPDIV(ITOFP(((int32_t)block->acceleration_st)>>6), (steps_per_mm>>6));
-		else
-			// Acceleration limit to prevent overflow is 0x7FFFFF / axis-steps-permm
-			// good up to 20,972 mm/s^2 @ 400 steps/mm || 87,379 mm/s^2 @ 96 steps/mm
-			block->acceleration = FPDIV(ITOFP(((int32_t)block->acceleration_st)>>8), (steps_per_mm>>8));
-	#endif
-
-	// The value 8.388608 derives from the timer frequency used for
-	// st_interrupt().  That interrupt is driven by a timer counter which
-	// ticks at a frequency of 2 MHz.  To convert counter values to seconds
-	// the counter value needs to be divided by 2000000.  So that we
-	// can do integer arithmetic (rather than floating point), we first
-	// multiply the acceleration by the counter value and THEN divide the
-	// result by 2000000.  However, the divide can be done by a shift and
-	// it turns out that it is convenient to use >> 24 which is a divide
-	// by approximately 16777216.  That's too large by about 8.388608.
-	// Therefore, we pre-scale the acceleration here by 8.388608
-
-	//This can potentially overflow in fixed point, due to a large block->acceleration_st,
-	//so we don't use fixed point for this calculation
-	#ifdef FIXED
-		block->acceleration_rate = (int32_t)(((int64_t)block->acceleration_st * 137439) >> 14);
-	#else
-		block->acceleration_rate = (int32_t)((FPTYPE)block->acceleration_st * 8.388608);
-	#endif
-  
 	//START OF YET_ANOTHER_JERK
 
 	FPTYPE scaling = KCONSTANT_1;
@@ -1556,7 +1651,17 @@ void plan_buffer_line(FPTYPE feed_rate, const uint32_t &dda_rate, const uint8_t
 
 	// It's the max. speed we can achieve if we accelerate the entire length of the block
 	//   starting with an initial speed of minimumPlannerSpeed
-	FPTYPE v_allowable = final_speed(block->acceleration,minimumPlannerSpeed,block->millimeters);
+	FPTYPE v_allowable;
+#if defined(SD_PLANNED)
+	if ( planned )	v_allowable = planned->v_allowable;
+	else
+#endif
+		v_allowable = final_speed(block->acceleration,minimumPlannerSpeed,block->millimeters);
+
+#if defined(SD_PLANNED) && defined(SIMULATOR)
+	if ( planner_capture && inverse_millimeters != 0 )
+		plan_capture(block, dda_rate, inverse_millimeters, v_allowable);
+#endif
 
 	// And this will typically produce a larger value
 	if (vmax_junction < minimumPlannerSpeed) {
@@ -1672,6 +1777,61 @@ void plan_set_e_position(const int32_t &a, const int32_t &b)
 }
 
 
+#ifdef SIMULATOR
+
+FPTYPE plan_get_final_speed(void)
+{
+	return prev_final_speed;
+}
+
+void plan_set_final_speed(FPTYPE speed)
+{
+	prev_final_speed = speed;
+}
+
+#endif
+
+
+
+#ifdef HEATER_FEED_FORWARD
+
+//Average the extrusion rate of the command pipeline for the heater feed forward.
+//Moves are timed at their nominal rate; acceleration is ignored.  Steps in either
+//direction count, as retracts are short and rare.  Only the part of the move which
+//ends the horizon is counted.  Called from the main loop; the stepper interrupt
+//only ever advances block_buffer_tail, so at worst a just finished block is counted.
+
+uint16_t plan_extrusion_rate(uint8_t extruder, uint16_t horizon_ms) {
+	uint32_t steps = 0;
+	uint32_t ms = 0;
+	uint8_t block_index = block_buffer_tail;
+
+	while ( block_index != block_buffer_head && ms < horizon_ms ) {
+		block_t *block = &block_buffer[block_index];
+		block_index = next_block_index(block_index);
+		if ( block->nominal_rate == 0 ) continue;
+
+		uint32_t block_steps = (uint32_t)block->steps[A_AXIS + extruder];
+		uint32_t block_ms = ( block->step_event_count < 0x400000 ) ?
+			(block->step_event_count * 1000) / block->nominal_rate : horizon_ms;
+		if ( block_ms == 0 ) block_ms = 1;
+		if ( ms + block_ms > horizon_ms ) {
+			block_steps = ( block_steps < 0x10000 ) ? (block_steps * (horizon_ms - ms)) / block_ms :
+				(block_steps / block_ms) * (horizon_ms - ms);
+			block_ms = horizon_ms - ms;
+		}
+		steps += block_steps;
+		ms += block_ms;
+	}
+
+	if ( ms == 0 ) return 0;
+	uint32_t rate = (steps * 1000) / ms;
+	return ( rate > 0xffff ) ? 0xffff : (uint16_t)rate;
+}
+
+#endif
+
+
 
 #ifdef ACCEL_STATS
 
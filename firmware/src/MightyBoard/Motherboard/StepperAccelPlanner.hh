@@ -37,6 +37,10 @@
 	#include "Simulator.hh"
 #endif
 
+#if defined(SD_PLANNED)
+	#include "PlannedBlock.hh"
+#endif
+
 #ifndef FORCE_INLINE
 	#ifdef SIMULATOR
 		#define FORCE_INLINE inline
@@ -80,7 +84,8 @@
 	#define KCONSTANT_1000		65536000	//ftok(1000.0)
         #define KCONSTANT_1000000_LSR_16 1000000        //ftok(1000000.0) >> 16
 
-	#ifndef SIMULATOR
+	// sailtime uses the raw operations; the simulator checks them for overflow
+	#if !defined(SIMULATOR) || defined(SAILTIME)
 		//Type Conversions
 		#define FPTOI(x)		ktoli(x)	//FPTYPE  -> int32_t
 		#define FPTOI16(x)		ktoi(x)		//FPTYPE  -> int16_t
@@ -219,6 +224,9 @@ typedef struct {
 	unsigned char	direction_bits;				// The direction bit set for this block (refers to *_DIRECTION_BIT in config.h)
 	unsigned char	active_extruder;			// Selects the active extruder
 	uint8_t		active_toolhead;			// The toolhead currently active.  Note this isn't the same as active extruder
+	#if defined(SD_RESUME)
+		uint32_t source_offset;				// SD file offset of the command this block starts; 0 if it starts none
+	#endif
 	#ifdef JKN_ADVANCE
 		bool	use_advance_lead;
 		int16_t	advance_lead_entry;
@@ -250,7 +258,9 @@ typedef struct {
 	#ifdef SIMULATOR
 		FPTYPE	feed_rate;				// Original feed rate before being modified for nomimal_speed
 		int	planned;				// Count of the number of times the block was passed to caclulate_trapezoid_for_block()
-		char	message[1024];
+		#ifndef SAILTIME
+			char	message[1024];			// Diagnostics printed when the block is dumped
+		#endif
 	#endif
 
 	#ifdef DEBUG_BLOCK_BY_MOVE_INDEX
@@ -271,6 +281,14 @@ void plan_buffer_line(FPTYPE feed_rate, const uint32_t &dda_rate, const uint8_t
 void plan_set_position(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &a, const int32_t &b);
 void plan_set_e_position(const int32_t &a, const int32_t &b);
 
+#ifdef SIMULATOR
+// Final speed of the most recently planned block.  The first block planned
+// after the buffer empties enters at no more than this speed.  Lets the
+// simulator resume planning part way through a build.
+FPTYPE plan_get_final_speed(void);
+void plan_set_final_speed(FPTYPE speed);
+#endif
+
 
 #ifndef SIMULATOR
 	#define SIMULATOR_RECORD(x...)
@@ -316,10 +334,27 @@ extern int32_t          delta_ab[3];
 extern bool             extrusion_seen[EXTRUDERS];
 #endif
 
+#if defined(SD_RESUME)
+extern uint32_t         planner_source_offset;
+#endif
+
+#if defined(SD_PLANNED)
+extern const planned_move_t *planner_planned;
+#ifdef SIMULATOR
+extern planned_move_t  *planner_capture;
+#endif
+#endif
+
 #ifdef ACCEL_STATS
 	extern void accelStatsGet(float *minSpeed, float *avgSpeed, float *maxSpeed);
 #endif
 
+#ifdef HEATER_FEED_FORWARD
+	// Average extrusion rate in steps/second of the queued moves for the
+	// given extruder (0 = A, 1 = B) over the next horizon_ms milliseconds
+	extern uint16_t plan_extrusion_rate(uint8_t extruder, uint16_t horizon_ms);
+#endif
+
 
 // Called when the current block is no longer needed. Discards the block and makes the memory
 // availible for new blocks.    
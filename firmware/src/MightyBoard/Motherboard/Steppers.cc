@@ -116,6 +116,21 @@ static bool segmentAccelState = true;
 
 static Point tolerance_offset_T0;
 static Point tolerance_offset_T1;
+
+#if defined(AUTO_LEVEL_MESH)
+// The rest of a move split to follow the auto-level mesh, queued by
+// runSteppersSlice() when the planner has room for it
+static bool split_pending = false;
+static Point split_target;
+static int32_t split_dda_rate;
+static uint8_t split_relative;
+static float split_distance;
+static int16_t split_feedrateMult64;
+#endif
+#if defined(SD_PLANNED)
+// True once a HOST_CMD_PLANNED_HEADER matching the settings is seen
+static bool planned_key_ok = false;
+#endif
 Point *tool_offsets;
 uint8_t toolIndex = 0;
 
@@ -128,6 +143,9 @@ uint16_t debugTimer = 0;
 
 
 bool isRunning() {
+#if defined(AUTO_LEVEL_MESH)
+	if ( split_pending ) return true;
+#endif
 	return is_running || is_homing;
 }
 
@@ -293,14 +311,12 @@ void loadToleranceOffsets() {
 		int32_t fourMM = ((int32_t)stepperAxisStepsPerMM(0)) << 2;
 
 		// The X Toolhead offset in units of steps
-		int32_t xToolheadOffset = (int32_t)(eeprom::getEeprom32(eeprom_offsets::TOOLHEAD_OFFSET_SETTINGS + 0, 0));
-		int32_t yToolheadOffset = (int32_t)(eeprom::getEeprom32(eeprom_offsets::TOOLHEAD_OFFSET_SETTINGS + 4, 0));
+		int32_t xToolheadOffset = (int32_t)eeprom::settings.toolheadOffsetX;
+		int32_t yToolheadOffset = (int32_t)eeprom::settings.toolheadOffsetY;
 
 #ifdef TOOLHEAD_OFFSET_SYSTEM
 		// See which toolhead offset system is used
-		uint8_t toolhead_system =
-			eeprom::getEeprom8(eeprom_offsets::TOOLHEAD_OFFSET_SYSTEM,
-					   DEFAULT_TOOLHEAD_OFFSET_SYSTEM);
+		uint8_t toolhead_system = eeprom::settings.toolheadOffsetSystem;
 		if ( toolhead_system == 0 ) {
 
 			// OLD SYSTEM: stored offset is the deviation from the
@@ -516,7 +532,7 @@ void reset() {
 	// melt chamber pressure and the free-wheeling pinch gear.  To combat this, the firmware has an
 	// option to leave the extruder stepper motors engaged throughout an entire build, ignoring any
 	// gcode / s3g command to disable the extruder stepper motors.
-	extruder_hold[0] = ((eeprom::getEeprom8(eeprom_offsets::EXTRUDER_HOLD, DEFAULT_EXTRUDER_HOLD)) != 0);
+	extruder_hold[0] = (eeprom::settings.extruderHold != 0);
 	extruder_hold[1] = extruder_hold[0];
 
 #ifdef PLANNER_OFF
@@ -528,6 +544,11 @@ void reset() {
 	alterSpeed  = 0x00;
 	speedFactor = KCONSTANT_1;
 
+#if defined(SD_PLANNED)
+	// The settings may have changed since the build was planned
+	planned_key_ok = false;
+#endif
+
 #if defined(PSTOP_SUPPORT) && defined(PSTOP_ZMIN_LEVEL) && defined(AUTO_LEVEL)
 	command::max_zprobe_hits = (uint8_t)eeprom::getEeprom8(
 	     eeprom_offsets::ALEVEL_MAX_ZPROBE_HITS,
@@ -573,6 +594,9 @@ void abort() {
 
         is_running = false;
         is_homing = false;
+#if defined(AUTO_LEVEL_MESH)
+	split_pending = false;
+#endif
 
 	stepperAxisInit(false);
 
@@ -592,6 +616,10 @@ Point removeOffsets(const Point &position) {
 void definePosition(const Point& position_in, bool home) {
 	Point position_offset = position_in;
 
+#if defined(AUTO_LEVEL_MESH)
+	split_pending = false;
+#endif
+
 	for ( uint8_t i = 0; i < STEPPER_COUNT; i++ ) {
 		stepperAxis[i].hasDefinePosition = true;
 
@@ -676,6 +704,63 @@ const Point getStepperPosition(uint8_t *toolIndex) {
 
 #endif
 
+#if defined(SD_RESUME)
+
+void setSourceOffset(uint32_t offset) {
+	planner_source_offset = offset;
+}
+
+bool getCheckpoint(uint32_t idle_offset, checkpoint_t *checkpoint) {
+	int32_t *position = checkpoint->position;
+	uint8_t tool;
+
+#if defined(AUTO_LEVEL_MESH)
+	// The rest of a split move has yet to be queued
+	if ( split_pending ) return false;
+#endif
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if ( block_buffer_head != block_buffer_tail ) {
+			// Every block before the one at the tail has run, and
+			// that one began at its starting position
+			block_t *block = &block_buffer[block_buffer_tail];
+			checkpoint->offset = block->source_offset;
+			tool = block->active_toolhead;
+			for ( uint8_t i = 0; i < STEPPER_COUNT; i++ )
+				position[i] = block->starting_position[i];
+		}
+		else {
+			checkpoint->offset = idle_offset;
+			tool = toolIndex;
+			for ( uint8_t i = 0; i < STEPPER_COUNT; i++ )
+				position[i] = planner_position[i];
+		}
+	}
+
+	if ( !checkpoint->offset )
+		return false;
+
+	// As getStepperPosition(), remove the toolhead offset and then the skew
+	tool %= 2;
+	Point *cp_tool_offsets = ( tool == 1 ) ? &tolerance_offset_T1 : &tolerance_offset_T0;
+	for ( uint8_t i = 0; i < STEPPER_COUNT; i++ )
+		position[i] -= (*cp_tool_offsets)[i];
+
+	checkpoint->tool = tool;
+	checkpoint->zskew = 0;
+	checkpoint->flags = 0;
+#if defined(AUTO_LEVEL)
+	if ( skew_active ) {
+		checkpoint->zskew = skew(position);
+		position[Z_AXIS] -= checkpoint->zskew;
+		checkpoint->flags |= CHECKPOINT_ALEVEL;
+	}
+#endif
+	return true;
+}
+
+#endif
+
 
 void setTargetNew(const Point& target, int32_t dda_interval, int32_t us, uint8_t relative) {
 	// Convert relative coordinates into absolute coordinates
@@ -685,6 +770,12 @@ void setTargetNew(const Point& target, int32_t dda_interval, int32_t us, uint8_t
 		  planner_target[i] += planner_position[i];
 	}
 
+#if defined(AUTO_LEVEL_MESH)
+	// Only a pause or the like moves elsewhere before a split move
+	// is finished; go straight there from where the move got to
+	split_pending = false;
+#endif
+
 #if defined(AUTO_LEVEL)
 	// Apply the skew before the toolhead offsets
 	// The skew transform is computed using coordinates which have had
@@ -800,6 +891,33 @@ void setTargetNewExt(const Point& target, int32_t dda_rate, uint8_t relative, fl
 		  planner_target[i] += planner_position[i];
 	}
 
+#if defined(AUTO_LEVEL_MESH)
+	split_pending = false;
+	if ( skew_active ) {
+	     // Where the move starts, without the toolhead offsets and skew
+	     int32_t start[STEPPER_COUNT];
+	     for ( uint8_t i = 0; i < STEPPER_COUNT; i++ )
+		  start[i] = planner_position[i] - (*tool_offsets)[i];
+	     int32_t split[2];
+	     float t;
+	     if ( skew_split(start, planner_target, split, &t) ) {
+		  // Move to the split now and leave the rest for later
+		  start[Z_AXIS] -= skew(start);
+		  for ( uint8_t i = 0; i < STEPPER_COUNT; i++ ) {
+		       split_target[i] = planner_target[i];
+		       planner_target[i] = ( i < 2 ) ? split[i] : start[i] +
+			    (int32_t)(t * (float)(planner_target[i] - start[i]));
+		  }
+		  split_dda_rate = dda_rate;
+		  split_relative = relative & ~((1 << STEPPER_COUNT) - 1);
+		  split_distance = distance * (1.0 - t);
+		  split_feedrateMult64 = feedrateMult64;
+		  split_pending = true;
+		  distance *= t;
+	     }
+	}
+#endif
+
 #if defined(AUTO_LEVEL)
 	// Apply the skew before the toolhead offsets
 	// The skew transform is computed using coordinates which have had
@@ -977,6 +1095,135 @@ void setTargetNewExt(const Point& target, int32_t dda_rate, uint8_t relative, fl
 }
 
 
+#if defined(SD_PLANNED)
+
+static uint32_t hashBytes(uint32_t hash, const void *data, uint8_t len) {
+	// FNV-1a
+	const uint8_t *p = (const uint8_t *)data;
+	while ( len-- )
+		hash = (hash ^ *p++) * 16777619UL;
+	return hash;
+}
+
+uint32_t plannerHash() {
+	uint8_t flavor = 0;
+#if defined(CORE_XYZ)
+	flavor = 2;
+#elif defined(CORE_XY)
+	flavor = 1;
+#endif
+#ifdef FIXED
+	flavor |= 0x80;
+#endif
+	uint32_t hash = 2166136261UL;
+	hash = hashBytes(hash, &flavor, sizeof(flavor));
+	hash = hashBytes(hash, axis_steps_per_unit_inverse, sizeof(axis_steps_per_unit_inverse));
+	hash = hashBytes(hash, axis_steps_per_sqr_second, sizeof(axis_steps_per_sqr_second));
+	return hashBytes(hash, &minimumPlannerSpeed, sizeof(minimumPlannerSpeed));
+}
+
+void setPlannedKey(uint8_t version, uint32_t hash) {
+	planned_key_ok = ( version == PLANNED_MOVE_VERSION ) && ( hash == plannerHash() );
+}
+
+void setTargetPlanned(const Point& target, int32_t dda_rate, uint8_t relative, float distance,
+		      int16_t feedrateMult64, const planned_move_t *planned) {
+	if ( !planned_key_ok || !acceleration || !segmentAccelState
+#if defined(AUTO_LEVEL)
+	     || skew_active
+#endif
+		) {
+		setTargetNewExt(target, dda_rate, relative, distance, feedrateMult64);
+		return;
+	}
+
+#if defined(AUTO_LEVEL_MESH)
+	split_pending = false;
+#endif
+
+	// Convert relative coordinates into absolute coordinates and add
+	// in the toolhead offsets
+	for ( uint8_t i = 0; i < STEPPER_COUNT; i++ ) {
+	     planner_target[i] = target[i];
+	     if ( (relative & (1 << i)) != 0 )
+		  planner_target[i] += planner_position[i];
+	}
+	planner_target[X_AXIS] += (*tool_offsets)[X_AXIS];
+	planner_target[Y_AXIS] += (*tool_offsets)[Y_AXIS];
+
+	// The steps the motors make, which must be those planned for
+	int32_t delta[STEPPER_COUNT];
+	for ( uint8_t i = 0; i < STEPPER_COUNT; i++ )
+		delta[i] = planner_target[i] - planner_position[i];
+#if defined(CORE_XYZ)
+	delta_ab[X_AXIS] = delta[Z_AXIS] + delta[Y_AXIS] + delta[X_AXIS];
+	delta_ab[Y_AXIS] = delta[Z_AXIS] + delta[Y_AXIS] - delta[X_AXIS];
+	delta_ab[Z_AXIS] = delta[Z_AXIS] - delta[Y_AXIS] - delta[X_AXIS];
+	for ( uint8_t i = 0; i <= Z_AXIS; i++ )
+		delta[i] = delta_ab[i];
+#elif defined(CORE_XY)
+	delta_ab[X_AXIS] = delta[X_AXIS] + delta[Y_AXIS];
+	delta_ab[Y_AXIS] = delta[X_AXIS] - delta[Y_AXIS];
+	delta[X_AXIS] = delta_ab[X_AXIS];
+	delta[Y_AXIS] = delta_ab[Y_AXIS];
+#endif
+	for ( uint8_t i = 0; i < STEPPER_COUNT; i++ ) {
+		if ( delta[i] != planned->steps[i] ) {
+			setTargetNewExt(target, dda_rate, relative, distance, feedrateMult64);
+			return;
+		}
+	}
+
+	int32_t max_delta = 0;
+	planner_master_steps_index = 0;
+	planner_axes = 0;
+	for ( uint8_t i = 0; i < STEPPER_COUNT; i++ ) {
+		planner_steps[i] = labs(delta[i]);
+		delta_mm[i] = planned->delta_mm[i];
+		if ( planner_steps[i] ) {
+		     planner_axes |= 1 << i;
+		     if ( planner_steps[i] > max_delta ) {
+			  planner_master_steps_index = i;
+			  max_delta = planner_steps[i];
+		     }
+		}
+	}
+
+	if ( !planner_axes )
+	     return;
+
+	planner_master_steps = (uint32_t)max_delta;
+
+	FPTYPE feedrate = ITOFP((int32_t)feedrateMult64);
+
+	//Feed rate was multiplied by 64 before it was sent, undo
+#ifdef FIXED
+	feedrate >>= 6;
+#else
+	feedrate /= 64.0;
+#endif
+
+	dda_rate = planned->dda_rate;
+	if ( relative & 0x80 ) {
+#ifdef FIXED
+		feedrate = FPMULT2(feedrate, speedFactor);
+		dda_rate = (int32_t)((float)dda_rate * FPTOF(speedFactor));
+#else
+		feedrate *= speedFactor;
+		dda_rate = (int32_t)((float)dda_rate * speedFactor);
+#endif // FIXED
+	}
+
+	planner_planned = planned;
+	plan_buffer_line(feedrate, dda_rate, toolIndex, true, toolIndex);
+
+	if ( movesplanned() >=  plannerMaxBufferSize)      is_running = true;
+	else                                               is_running = false;
+}
+
+#endif
+
+
 //Step positions for homing.  We shift by >> 1 so that we can add
 //tool_offsets without overflow
 #if !defined(CORE_XY) && !defined(CORE_XY_STEPPER) && !defined(CORE_XYZ)
@@ -1135,6 +1382,14 @@ void deprimeEnable(bool enable) {
 
 
 void runSteppersSlice() {
+#if defined(AUTO_LEVEL_MESH)
+	// Queue the rest of a move split to follow the auto-level mesh.  It
+	// may be split again.
+	if ( split_pending && movesplanned() < plannerMaxBufferSize )
+	     setTargetNewExt(split_target, split_dda_rate, split_relative,
+			     split_distance, split_feedrateMult64);
+#endif
+
 #if 0
 #ifdef DEBUG_VALUE
 	uint8_t bufferUsed = movesplanned();
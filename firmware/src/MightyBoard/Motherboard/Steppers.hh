@@ -27,6 +27,7 @@
 #include "Point.hh"
 #include "StepperAccel.hh"
 #include "Motherboard.hh"
+#include "EepromMap.hh"
 #else
 #include "Configuration.hh"
 #include "Types.hh"
@@ -77,6 +78,21 @@ namespace steppers {
     /// When accelerated, this is the position right now
     const Point getStepperPosition(uint8_t *toolIndex);
 
+#if defined(SD_RESUME)
+    /// Tag the next move queued with the SD file offset of its command.
+    /// Moves left untagged, such as the rest of a split move, are never
+    /// taken as checkpoints.
+    void setSourceOffset(uint32_t offset);
+
+    /// Find where the build could resume from: the command whose move is
+    /// running now, or the next command if no move is queued, and the
+    /// position, toolhead and skew it began with.
+    /// \param[in] idle_offset SD file offset of the next command
+    /// \param[out] checkpoint All but the temperatures are set
+    /// \return false if the move running doesn't begin a command
+    bool getCheckpoint(uint32_t idle_offset, checkpoint_t *checkpoint);
+#endif
+
     /// Instruct the stepper subsystem to move the machine to the
     /// given position.
     /// \param[in] target Position to move to
@@ -97,6 +113,24 @@ namespace steppers {
     /// \param[in] feedrate of the move in mm's per second multiplied by 64
     void setTargetNewExt(const Point& target, int32_t dda_rate, uint8_t relative, float distance, int16_t feedrateMult64);
 
+#if defined(SD_PLANNED)
+    /// Hash of the settings on which moves planned ahead by s3gplan depend
+    /// \return Hash to compare with that of a HOST_CMD_PLANNED_HEADER
+    uint32_t plannerHash();
+
+    /// Take up or pass over the moves planned ahead in the build from here on
+    /// \param[in] version PLANNED_MOVE_VERSION of the build
+    /// \param[in] hash plannerHash() the build was planned for
+    void setPlannedKey(uint8_t version, uint32_t hash);
+
+    /// As setTargetNewExt(), but with what depends on the move alone
+    /// planned ahead.  Planned as usual should the settings, the start
+    /// of the move or auto-level skew differ from what was planned for.
+    /// \param[in] planned What s3gplan worked out for the move
+    void setTargetPlanned(const Point& target, int32_t dda_rate, uint8_t relative, float distance,
+			  int16_t feedrateMult64, const planned_move_t *planned);
+#endif
+
     /// Home one or more axes
     /// \param[in] maximums If true, home in the positive direction
     /// \param[in] axes_enabled Bitfield specifiying which axes to
@@ -18,10 +18,115 @@
 // Based on I2C master code by Peter Fleury <pfleury@gmx.ch>
 // http://jump.to/fleury
 #include <util/twi.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
 #include "TWI.hh"
 
 static bool twi_init_complete = false;
 
+// Queue of interrupt driven writes.  Each write is stored as the device
+// address, the number of data bytes and then the data bytes.  The size
+// must be a power of two.
+#define TWI_QUEUE_SIZE 64
+#define TWI_QUEUE_MASK (TWI_QUEUE_SIZE - 1)
+
+static volatile uint8_t twi_queue[TWI_QUEUE_SIZE];
+static volatile uint8_t twi_queue_head = 0;  // Next byte to fill
+static volatile uint8_t twi_queue_tail = 0;  // Next byte to send
+static volatile uint8_t twi_remaining = 0;   // Data bytes left in the write being sent
+static volatile bool twi_addressed = false;  // The write being sent has taken its address
+static volatile bool twi_queue_busy = false;
+
+// Wait for the interrupt driven writes to finish so that the caller
+// may drive the bus itself
+static void TWI_wait() {
+  while (twi_queue_busy)
+    ;
+  while (TWCR & (1 << TWSTO))
+    ;
+}
+
+uint8_t TWI_queue_space() {
+  return TWI_QUEUE_MASK - ((twi_queue_head - twi_queue_tail) & TWI_QUEUE_MASK);
+}
+
+bool TWI_queue_write(uint8_t address, const uint8_t *data, uint8_t length) {
+  if (TWI_queue_space() < (uint8_t)(length + 2))
+    return false;
+
+  uint8_t head = twi_queue_head;
+  twi_queue[head] = address;
+  head = (head + 1) & TWI_QUEUE_MASK;
+  twi_queue[head] = length;
+  head = (head + 1) & TWI_QUEUE_MASK;
+  while (length--) {
+    twi_queue[head] = *data++;
+    head = (head + 1) & TWI_QUEUE_MASK;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    twi_queue_head = head;
+    if (!twi_queue_busy) {
+      // Wait out the STOP from the last write and then send a START;
+      // the interrupt takes it from there
+      while (TWCR & (1 << TWSTO))
+        ;
+      twi_queue_busy = true;
+      TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE);
+    }
+  }
+
+  return true;
+}
+
+ISR(TWI_vect) {
+  uint8_t tail = twi_queue_tail;
+
+  switch (TW_STATUS & 0xF8) {
+  case TW_START:
+  case TW_REP_START:
+    // send the device address of the next write
+    TWDR = twi_queue[tail] | TW_WRITE;
+    tail = (tail + 1) & TWI_QUEUE_MASK;
+    twi_remaining = twi_queue[tail];
+    twi_queue_tail = (tail + 1) & TWI_QUEUE_MASK;
+    twi_addressed = true;
+    TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE);
+    return;
+
+  case TW_MT_SLA_ACK:
+  case TW_MT_DATA_ACK:
+    if (twi_remaining) {
+      TWDR = twi_queue[tail];
+      twi_queue_tail = (tail + 1) & TWI_QUEUE_MASK;
+      twi_remaining--;
+      TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE);
+      return;
+    }
+    break;
+
+  default:
+    // NACK, lost arbitration or bus error: drop what is left of this
+    // write.  If the error came before the START, the write is still
+    // whole at the tail and is dropped with its address and length;
+    // otherwise it would be retried for as long as the bus stays bad.
+    if (!twi_addressed)
+      twi_remaining = twi_queue[(tail + 1) & TWI_QUEUE_MASK] + 2;
+    twi_queue_tail = (tail + twi_remaining) & TWI_QUEUE_MASK;
+    twi_remaining = 0;
+    break;
+  }
+  twi_addressed = false;
+
+  // This write is done; send a STOP and then START the next one, if any
+  if (twi_queue_tail != twi_queue_head) {
+    TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE) | (1 << TWSTO) | (1 << TWSTA);
+  } else {
+    TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTO);
+    twi_queue_busy = false;
+  }
+}
+
 // Alias function for compatibility with original API.
 void TWI_init(bool force_reinit) {
   // If we've already done this, return.
@@ -49,6 +154,8 @@ uint8_t TWI_write_data(uint8_t address, uint8_t *data, uint8_t length) {
   uint8_t twst;
   uint8_t err = 0;
 
+  TWI_wait();
+
   // send START condition
   TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN);
 
@@ -107,6 +214,8 @@ uint8_t TWI_write_byte(uint8_t address, uint8_t data) {
   uint8_t twst;
   uint8_t err = 0;
 
+  TWI_wait();
+
   // send START condition
   TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN);
 
@@ -166,6 +275,8 @@ uint8_t TWI_read_byte(uint8_t address, uint8_t *data, uint8_t length) {
   uint8_t twst;
   uint8_t err = 0;
 
+  TWI_wait();
+
   // send START condition
   TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN);
 
@@ -26,4 +26,14 @@ uint8_t TWI_write_data(uint8_t address, uint8_t * data, uint8_t length);
 uint8_t TWI_read_byte(uint8_t address, uint8_t * data, uint8_t length);
 uint8_t TWI_write_byte(uint8_t address, uint8_t data);
 
+// Interrupt driven writes.  TWI_queue_write() queues a write of length
+// bytes to the device at address and returns at once; the TWI interrupt
+// sends queued writes in order.  Returns false, queueing nothing, when
+// there is no room.  The waiting routines above first let the queue
+// empty.
+bool TWI_queue_write(uint8_t address, const uint8_t *data, uint8_t length);
+
+// Bytes free in the write queue
+uint8_t TWI_queue_space();
+
 #endif
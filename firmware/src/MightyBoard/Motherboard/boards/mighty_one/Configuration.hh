@@ -44,6 +44,16 @@
 //  etc.
 #define MICROSTEPPING   4
 
+// --- Heater feed forward ---
+// While printing, add heater PWM in proportion to the extrusion rate of
+// the queued moves so that an extruder heater is already supplying the
+// power to melt the filament when the flow arrives.  The gain is in PWM
+// counts per 1000 extruder steps/second and the rate is averaged over the
+// next HEATER_FEED_FORWARD_HORIZON milliseconds of moves.  The gain was
+// picked with simulator/heatsim.  Comment out to disable.
+#define HEATER_FEED_FORWARD		80
+#define HEATER_FEED_FORWARD_HORIZON	2000
+
 #ifndef SIMULATOR
 
 // This file details the pin assignments and features of the MakerBot Mightyboard rev E
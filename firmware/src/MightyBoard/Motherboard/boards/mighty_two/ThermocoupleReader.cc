@@ -20,10 +20,16 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 
+#include <util/delay.h>
 #include "ThermocoupleReader.hh"
 #include "Configuration.hh"
 #include "TemperatureTable.hh"
 
+// Timer ticks (100 us) to wait after update() takes a read before the
+// sampler starts the next one.  This leaves a fresh read waiting a little
+// before the motherboard slice next asks for one.
+#define THERM_SAMPLE_DELAY_TICKS ((uint16_t)(SAMPLE_INTERVAL_MICROS_THERMOCOUPLE / 100L) - 200)
+
 /*
  * Thermocouple Reader Constructor
  * Create a new thermocouple instance, and attach it to the given pins.
@@ -37,7 +43,8 @@ ThermocoupleReader::ThermocoupleReader(const Pin& do_p,const Pin& sck_p,const Pi
      cs_pin(cs_p),
      sck_pin(sck_p),
      do_pin(do_p),
-     di_pin(di_p)
+     di_pin(di_p),
+     sample_state(THERM_SAMPLE_IDLE)
 {
 }
 
@@ -47,6 +54,14 @@ ThermocoupleReader::ThermocoupleReader(const Pin& do_p,const Pin& sck_p,const Pi
  */
 void ThermocoupleReader::init() {
 
+     // stop the background sampler while we talk to the ADC directly
+     uint8_t state = sample_state;
+     sample_state = THERM_SAMPLE_IDLE;
+     if ( state == THERM_SAMPLE_SHIFT )
+	  // a read was cut short: hold the clock low past the ADS1118's
+	  // 28 ms serial interface timeout so the config is framed correctly
+	  _delay_ms(30);
+
      do_pin.setDirection(true);
      sck_pin.setDirection(true);
      di_pin.setDirection(false);
@@ -70,6 +85,11 @@ void ThermocoupleReader::init() {
      error_code = TemperatureSensor::SS_OK;
 
      initConfig();
+
+     // the first background read sends the channel one config again
+     sample_config = configFor(config_state);
+     sample_delay = 0;
+     sample_state = THERM_SAMPLE_WAIT;
 }
 
 /*
@@ -142,73 +162,18 @@ static float ColdReadToCelsius(int16_t adc)
 }
 
 /*
- * Get a new read from the ADC.  This function is called by the motherboard slice at regular intervals
- * and cycles between channel 1 channel 2 and cold junction temperature, reading one value each fucntion call
+ * Take the last read from the background sampler.  This function is called by the motherboard slice at regular
+ * intervals and cycles between channel 1 channel 2 and cold junction temperature, consuming one value each fucntion call
  *
  */
 uint8_t ThermocoupleReader::update() {
 
-     sck_pin.setValue(false);
-
-     // check that data ready flag is low
-     // if it is high, return false so the calling function knows to try again
-     if ( di_pin.getValue() )
+     // the background sampler has not finished a read yet
+     // return busy so the calling function knows to try again
+     if ( sample_state != THERM_SAMPLE_READY )
 	  return THERM_ADC_BUSY;
 
-     uint16_t config = 0;
-
-     // the config register determines the output for the next read
-     switch ( config_state ) {
-     case THERM_CHANNEL_ONE :
-	  config = channel_one_config;
-	  break;
-     case THERM_CHANNEL_TWO :
-	  config = channel_two_config;
-	  break;
-     case THERM_COLD_JUNCTION :
-	  config = cold_temp_config;
-	  break;
-     default :
-	  break;
-     }
-
-     uint16_t config_reg = 0;
-     uint16_t raw = 0;
-
-     /// the ADS1118 uses bidirection SPI communication
-     /// the sensor returns 4 bytes of data per read.  the first two bytes are the
-     /// ADC bits.  the second two bytes are the config register bits
-     /// the mightyboard (master) sends the desired configuration register in the first
-     /// two bytes and sends dummy data for the second two bytes
-
-     // read the temperature register
-     for (int i = 0; i < 16; i++) {
-
-	  // shift out config register data
-	  do_pin.setValue((config & 0b01) != 0);
-	  config >>= 1;
-
-	  sck_pin.setValue(true);
-	  raw = raw << 1;
-	  if ( di_pin.getValue() ) {raw = raw | 0x01; }
-
-	  sck_pin.setValue(false);
-     }
-
-     // read back the config reg
-     for (int i = 0; i < 16; i++) {
-
-	  // shift out dummy data
-	  do_pin.setValue(false);
-
-	  sck_pin.setValue(true);
-	  config_reg = config_reg << 1;
-	  if ( di_pin.getValue() ) { config_reg = config_reg | 0x01; }
-
-	  sck_pin.setValue(false);
-     }
-
-     sck_pin.setValue(false);
+     uint16_t raw = sample_raw;
 
      float temp;
      /// store read to the temperature variable
@@ -276,6 +241,81 @@ uint8_t ThermocoupleReader::update() {
 	  break;
      }
 
+     /// queue the config for the next read and hand the ADC back to the sampler
+     sample_config = configFor(config_state);
+     sample_delay = THERM_SAMPLE_DELAY_TICKS;
+     sample_state = THERM_SAMPLE_WAIT;
+
      // return true when temperature update is successful
      return THERM_READY;
 }
+
+/*
+ * Config register which selects the given read for the following conversion
+ *
+ */
+uint16_t ThermocoupleReader::configFor(uint8_t state) {
+     switch ( state ) {
+     case THERM_CHANNEL_TWO :
+	  return channel_two_config;
+     case THERM_COLD_JUNCTION :
+	  return cold_temp_config;
+     default :
+	  return channel_one_config;
+     }
+}
+
+/*
+ * Background sampler, called from the 10 kHz timer interrupt.  Each call
+ * clocks one bit of the 32 bit ADS1118 transaction, so a read takes ~3.2 ms
+ * of interrupt time in small slices instead of blocking the main loop.
+ *
+ * PORTE is shared with heater outputs written from the main loop.  A main
+ * loop read-modify-write can only restore a stale DO or SCK level between
+ * ticks: SCK is always low there and DO is only sampled on the rising edge
+ * we generate within a tick, so that is harmless.
+ *
+ */
+void ThermocoupleReader::sampleTick() {
+
+     switch ( sample_state ) {
+     default :
+	  return;
+     case THERM_SAMPLE_WAIT :
+	  if ( sample_delay ) {
+	       sample_delay--;
+	       return;
+	  }
+	  // data ready flag is low when a conversion is waiting
+	  if ( di_pin.getValue() )
+	       return;
+	  shift_out = sample_config;
+	  shift_in = 0;
+	  shift_bits = 32;
+	  sample_state = THERM_SAMPLE_SHIFT;
+	  // Fall thru
+     case THERM_SAMPLE_SHIFT :
+	  break;
+     }
+
+     /// the first two bytes send the config register and return the ADC bits
+     /// the second two bytes send dummy data and return the config register, which we ignore
+     if ( shift_bits > 16 ) {
+	  do_pin.setValue((shift_out & 0b01) != 0);
+	  shift_out >>= 1;
+
+	  sck_pin.setValue(true);
+	  shift_in = shift_in << 1;
+	  if ( di_pin.getValue() ) { shift_in = shift_in | 0x01; }
+     }
+     else {
+	  do_pin.setValue(false);
+	  sck_pin.setValue(true);
+     }
+     sck_pin.setValue(false);
+
+     if ( --shift_bits == 0 ) {
+	  sample_raw = shift_in;
+	  sample_state = THERM_SAMPLE_READY;
+     }
+}
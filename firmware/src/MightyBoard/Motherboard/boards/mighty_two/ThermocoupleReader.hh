@@ -79,8 +79,16 @@
 #define THERM_CHANNEL_HBP	2
 #define THERM_COLD_JUNCTION	3
 
+/// states of the background sampler driven by sampleTick()
+#define THERM_SAMPLE_IDLE	0	///< pins not initialized; do nothing
+#define THERM_SAMPLE_WAIT	1	///< waiting to start the next read
+#define THERM_SAMPLE_SHIFT	2	///< clocking the 32 bit transaction
+#define THERM_SAMPLE_READY	3	///< read complete, waiting for update()
+
 /// The thermocouple module provides a bitbanging driver that can read the
 /// temperature from the ADS1118 sensor, and also report on any error conditions.
+/// The ADS1118 is clocked one bit per call of sampleTick() from the 10 kHz
+/// timer interrupt; update() only converts the last completed read.
 /// \ingroup SoftwareLibraries
 class ThermocoupleReader {
 
@@ -106,6 +114,19 @@ private:
 
      uint8_t last_temp_updated;
 
+     // Background sampler.  sample_state is the handshake between the
+     // interrupt and update(): the interrupt owns the shift variables and
+     // sample_delay until it publishes sample_raw with THERM_SAMPLE_READY,
+     // after which update() owns everything until it sets THERM_SAMPLE_WAIT.
+     volatile uint8_t sample_state;
+     volatile uint16_t sample_raw;    // last completed ADC read
+     volatile uint16_t sample_config; // config register to send with the next read
+     volatile uint16_t sample_delay;  // ticks to wait before starting the next read
+     uint16_t shift_out, shift_in;
+     uint8_t shift_bits;
+
+     uint16_t configFor(uint8_t state);
+
 public:
      /// Create a new thermocouple instance, and attach it to the given pins.
      /// \param [in] do_p Data Out: MOSI (output).
@@ -119,6 +140,10 @@ public:
 
      uint8_t update();
 
+     /// Clock one bit of the background ADC read.  Called from the
+     /// 10 kHz timer interrupt.
+     void sampleTick();
+
      uint8_t getLastUpdated() { return last_temp_updated; }
 
      TemperatureSensor::SensorState GetChannelTemperature(uint8_t channel, volatile float &read_temperature);
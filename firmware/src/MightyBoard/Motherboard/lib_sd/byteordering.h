@@ -53,7 +53,8 @@ extern "C"
  * \returns The given 32-bit integer converted to little-endian byte order.
  */
 
-#if DOXYGEN || LITTLE_ENDIAN || __AVR__
+#if DOXYGEN || LITTLE_ENDIAN || __AVR__ || \
+    (defined(SIMULATOR) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
 #define HTOL16(val) (val)
 #define HTOL32(val) (val)
 #elif BIG_ENDIAN
@@ -164,15 +164,32 @@ struct fat_fs_struct
     cluster_t cluster_free;
 };
 
+#if FAT_EXTENT_COUNT
+struct fat_extent_struct
+{
+    cluster_t cluster;
+    cluster_t length;
+};
+#endif
+
 struct fat_file_struct
 {
     struct fat_fs_struct* fs;
     struct fat_dir_entry_struct dir_entry;
     offset_t pos;
     cluster_t pos_cluster;
+    /* cluster ending right at pos when pos_cluster is 0 */
+    cluster_t pos_cluster_end;
 #if FAT_DELAY_DIRENTRY_UPDATE
     uint8_t needs_write;
 #endif
+#if FAT_EXTENT_COUNT
+    /* the cluster chain as far as known, in runs of contiguous clusters */
+    struct fat_extent_struct extents[FAT_EXTENT_COUNT];
+    uint8_t extent_count;
+    /* the last run ends the chain */
+    uint8_t extents_complete;
+#endif
 };
 
 struct fat_dir_struct
@@ -209,6 +226,17 @@ static uint8_t fat_read_header(struct fat_fs_struct* fs);
 static cluster_t fat_get_next_cluster(const struct fat_fs_struct* fs, cluster_t cluster_num);
 static offset_t fat_cluster_offset(const struct fat_fs_struct* fs, cluster_t cluster_num);
 static uint8_t fat_dir_entry_read_callback(uint8_t* buffer, offset_t offset, void* p);
+static cluster_t fat_file_pos_cluster(struct fat_file_struct* fd);
+#if FAT_EXTENT_COUNT
+static void fat_reset_extents(struct fat_file_struct* fd);
+static void fat_add_extent(struct fat_file_struct* fd, cluster_t cluster_num, cluster_t cluster_num_next);
+static cluster_t fat_file_next_cluster(struct fat_file_struct* fd, cluster_t cluster_num);
+static cluster_t fat_file_skip(const struct fat_file_struct* fd, uint32_t* pos);
+#else
+#define fat_reset_extents(fd)
+#define fat_add_extent(fd, cluster_num, cluster_num_next)
+#define fat_file_next_cluster(fd, cluster_num) fat_get_next_cluster((fd)->fs, cluster_num)
+#endif
 #if FAT_LFN_SUPPORT
 static uint8_t fat_calc_83_checksum(const uint8_t* file_name_83);
 #endif
@@ -1018,14 +1046,176 @@ struct fat_file_struct* fat_open_file(struct fat_fs_struct* fs, const struct fat
     fd->fs = fs;
     fd->pos = 0;
     fd->pos_cluster = dir_entry->cluster;
+    fd->pos_cluster_end = 0;
 
 #if FAT_DELAY_DIRENTRY_UPDATE
     fd->needs_write = 0;
 #endif
+    fat_reset_extents(fd);
 
     return fd;
 }
 
+#if FAT_EXTENT_COUNT
+/**
+ * \ingroup fat_file
+ * Forgets the cluster chain of a file but for its first cluster.
+ *
+ * \param[in] fd The file handle.
+ */
+void fat_reset_extents(struct fat_file_struct* fd)
+{
+    fd->extent_count = 0;
+    fd->extents_complete = 0;
+    if(fd->dir_entry.cluster)
+    {
+        fd->extents[0].cluster = fd->dir_entry.cluster;
+        fd->extents[0].length = 1;
+        fd->extent_count = 1;
+    }
+}
+
+/**
+ * \ingroup fat_file
+ * Remembers the cluster following another in a file's chain.
+ *
+ * Only a cluster following the last known one is taken, so that the
+ * runs stay in file order.  Once they are full, the rest of the chain
+ * is left to the FAT.
+ *
+ * \param[in] fd The file handle.
+ * \param[in] cluster_num The cluster.
+ * \param[in] cluster_num_next The cluster following it, 0 if it ends the chain.
+ */
+void fat_add_extent(struct fat_file_struct* fd, cluster_t cluster_num, cluster_t cluster_num_next)
+{
+    if(!fd->extent_count)
+        return;
+
+    struct fat_extent_struct* extent = &fd->extents[fd->extent_count - 1];
+    if(cluster_num != extent->cluster + extent->length - 1)
+        return;
+
+    fd->extents_complete = !cluster_num_next;
+    if(!cluster_num_next)
+        return;
+
+    if(cluster_num_next == cluster_num + 1)
+    {
+        ++extent->length;
+    }
+    else if(fd->extent_count < FAT_EXTENT_COUNT)
+    {
+        ++extent;
+        extent->cluster = cluster_num_next;
+        extent->length = 1;
+        ++fd->extent_count;
+    }
+}
+
+/**
+ * \ingroup fat_file
+ * Retrieves the cluster following another in a file's chain,
+ * from the known runs if possible and else from the FAT.
+ *
+ * \param[in] fd The file handle.
+ * \param[in] cluster_num The cluster.
+ * \returns The next cluster, or 0 at the end of the chain or on failure.
+ */
+cluster_t fat_file_next_cluster(struct fat_file_struct* fd, cluster_t cluster_num)
+{
+    const struct fat_extent_struct* extent = fd->extents;
+    for(uint8_t i = 0; i < fd->extent_count; ++i, ++extent)
+    {
+        cluster_t n = cluster_num - extent->cluster;
+        if(n >= extent->length)
+            continue;
+
+        if(n + 1 < extent->length)
+            return cluster_num + 1;
+        if(i + 1 < fd->extent_count)
+            return extent[1].cluster;
+        if(fd->extents_complete)
+        {
+            fat_errno = FAT_ERR_BAD;
+            return 0;
+        }
+        break;
+    }
+
+    cluster_t cluster_num_next = fat_get_next_cluster(fd->fs, cluster_num);
+    if(cluster_num_next || fat_errno == FAT_ERR_BAD)
+        fat_add_extent(fd, cluster_num, cluster_num_next);
+    return cluster_num_next;
+}
+
+/**
+ * \ingroup fat_file
+ * Finds the cluster holding a file position, or the known cluster
+ * closest before it.
+ *
+ * \param[in] fd The file handle.
+ * \param[in,out] pos The file position; on return, its offset
+ *                    from the start of the cluster returned.
+ * \returns The cluster.
+ */
+cluster_t fat_file_skip(const struct fat_file_struct* fd, uint32_t* pos)
+{
+    uint16_t cluster_size = fd->fs->header.cluster_size;
+    uint32_t index = *pos / cluster_size;
+    uint32_t start = 0;
+    uint32_t skipped = 0;
+    cluster_t cluster_num = fd->dir_entry.cluster;
+
+    const struct fat_extent_struct* extent = fd->extents;
+    for(uint8_t i = 0; i < fd->extent_count && skipped < index; ++i, ++extent)
+    {
+        uint32_t n = index - start;
+        if(n >= extent->length)
+            n = extent->length - 1;
+        cluster_num = extent->cluster + n;
+        skipped = start + n;
+        start += extent->length;
+    }
+
+    *pos -= skipped * cluster_size;
+    return cluster_num;
+}
+
+#endif
+
+/**
+ * \ingroup fat_file
+ * Looks up the whole cluster chain of a file in the FAT, so that
+ * reading and seeking through it later need not.
+ *
+ * \param[in] fd The file handle.
+ * \returns 0 if the chain does not fit into FAT_EXTENT_COUNT runs or on failure, 1 on success.
+ */
+uint8_t fat_map_file(struct fat_file_struct* fd)
+{
+#if FAT_EXTENT_COUNT
+    if(!fd)
+        return 0;
+
+    while(fd->extent_count && !fd->extents_complete)
+    {
+        struct fat_extent_struct* extent = &fd->extents[fd->extent_count - 1];
+        cluster_t length = extent->length;
+        uint8_t count = fd->extent_count;
+        if(!fat_file_next_cluster(fd, extent->cluster + length - 1))
+            return fd->extents_complete;
+        if(fd->extent_count == count && extent->length == length)
+            /* the next run does not fit */
+            return 0;
+    }
+    return 1;
+#else
+    (void)fd;
+    return 0;
+#endif
+}
+
 /**
  * \ingroup fat_file
  * Closes a file.
@@ -1051,6 +1241,41 @@ void fat_close_file(struct fat_file_struct* fd)
     }
 }
 
+/**
+ * \ingroup fat_file
+ * Finds the cluster holding the current position of a file.
+ *
+ * \param[in] fd The file handle.
+ * \returns The cluster, or 0 if the file has none or on failure.
+ */
+cluster_t fat_file_pos_cluster(struct fat_file_struct* fd)
+{
+    /* continue after the cluster which the last read ended with */
+    if(!fd->pos_cluster && fd->pos_cluster_end)
+        return fat_file_next_cluster(fd, fd->pos_cluster_end);
+    if(fd->pos_cluster)
+        return fd->pos_cluster;
+
+    cluster_t cluster_num = fd->dir_entry.cluster;
+    if(!cluster_num || !fd->pos)
+        return cluster_num;
+
+    uint16_t cluster_size = fd->fs->header.cluster_size;
+    uint32_t pos = fd->pos;
+#if FAT_EXTENT_COUNT
+    cluster_num = fat_file_skip(fd, &pos);
+#endif
+    while(pos >= cluster_size)
+    {
+        pos -= cluster_size;
+        cluster_num = fat_file_next_cluster(fd, cluster_num);
+        if(!cluster_num)
+            // fat_errno handled by fat_get_next_cluster()
+            return 0;
+    }
+    return cluster_num;
+}
+
 /**
  * \ingroup fat_file
  * Reads data from a file.
@@ -1081,38 +1306,20 @@ intptr_t fat_read_file(struct fat_file_struct* fd, uint8_t* buffer, uintptr_t bu
         return 0;
     
     uint16_t cluster_size = fd->fs->header.cluster_size;
-    cluster_t cluster_num = fd->pos_cluster;
     uintptr_t buffer_left = buffer_len;
     uint16_t first_cluster_offset = (uint16_t) (fd->pos & (cluster_size - 1));
 
     /* find cluster in which to start reading */
+    cluster_t cluster_num = fat_file_pos_cluster(fd);
     if(!cluster_num)
     {
-        cluster_num = fd->dir_entry.cluster;
-        
-        if(!cluster_num)
-        {
-            if(!fd->pos)
-                return 0;
-            else
-	    {
-		fat_errno = FAT_ERR_BAD;
-                return -1;
-	    }
-        }
-
-        if(fd->pos)
-        {
-            uint32_t pos = fd->pos;
-            while(pos >= cluster_size)
-            {
-                pos -= cluster_size;
-                cluster_num = fat_get_next_cluster(fd->fs, cluster_num);
-                if(!cluster_num)
-		    // fd_errno handled by fat_get_next_cluster()
-                    return -1;
-            }
-        }
+        if(!fd->pos && !fd->dir_entry.cluster)
+            return 0;
+        // fat_errno handled by fat_get_next_cluster(), unless the file
+        // has no clusters
+        if(!fat_errno)
+            fat_errno = FAT_ERR_BAD;
+        return -1;
     }
     
     /* read data */
@@ -1124,8 +1331,10 @@ intptr_t fat_read_file(struct fat_file_struct* fd, uint8_t* buffer, uintptr_t bu
         if(copy_length > buffer_left)
             copy_length = buffer_left;
 
-        /* read data */
-        if(!fd->fs->partition->device_read(cluster_offset, buffer, copy_length))
+        /* read data; file data is mostly read in order, so keep
+         * the card sending blocks rather than ask for each one
+         */
+        if(!fd->fs->partition->device_read_stream(cluster_offset, buffer, copy_length))
 	{
 	    // Original fat.c code did
             //   return buffer_len - buffer_left;
@@ -1146,13 +1355,15 @@ intptr_t fat_read_file(struct fat_file_struct* fd, uint8_t* buffer, uintptr_t bu
         if(first_cluster_offset + copy_length >= cluster_size)
         {
             /* we are on a cluster boundary, so get the next cluster */
-            if((cluster_num = fat_get_next_cluster(fd->fs, cluster_num)))
+            cluster_t cluster_num_prev = cluster_num;
+            if((cluster_num = fat_file_next_cluster(fd, cluster_num)))
             {
                 first_cluster_offset = 0;
             }
             else
             {
                 fd->pos_cluster = 0;
+                fd->pos_cluster_end = cluster_num_prev;
                 return buffer_len - buffer_left;
             }
         }
@@ -1164,6 +1375,37 @@ intptr_t fat_read_file(struct fat_file_struct* fd, uint8_t* buffer, uintptr_t bu
     return buffer_len;
 }
 
+/**
+ * \ingroup fat_file
+ * Asks the card for the data at the current position of a file, ahead
+ * of the fat_read_file() which will want it.
+ *
+ * Reads of other parts of the card stop the multiple block read which
+ * fat_read_file() keeps going; this starts it again where the file
+ * goes on from, so that the next read finds its data on the way.
+ *
+ * \param[in] fd The file handle.
+ * \returns 0 at the end of the file, if the partition can't stream, or on
+ *          failure, 1 on success.
+ * \see fat_read_file
+ */
+uint8_t fat_stream_file(struct fat_file_struct* fd)
+{
+    if(!fd || fd->pos >= fd->dir_entry.file_size)
+        return 0;
+    if(!fd->fs->partition->device_stream_open)
+        return 0;
+    fat_errno = 0;
+
+    cluster_t cluster_num = fat_file_pos_cluster(fd);
+    if(!cluster_num)
+        return 0;
+    fd->pos_cluster = cluster_num;
+
+    uint16_t cluster_size = fd->fs->header.cluster_size;
+    return fd->fs->partition->device_stream_open(fat_cluster_offset(fd->fs, cluster_num) + (fd->pos & (cluster_size - 1)));
+}
+
 #if DOXYGEN || FAT_WRITE_SUPPORT
 /**
  * \ingroup fat_file
@@ -1191,6 +1433,24 @@ intptr_t fat_write_file(struct fat_file_struct* fd, const uint8_t* buffer, uintp
     uintptr_t buffer_left = buffer_len;
     uint16_t first_cluster_offset = (uint16_t) (fd->pos & (cluster_size - 1));
 
+    /* continue after the cluster which the last write ended with,
+     * rather than walk the whole chain again
+     */
+    if(!cluster_num && fd->pos_cluster_end)
+    {
+        cluster_num = fat_file_next_cluster(fd, fd->pos_cluster_end);
+        if(!cluster_num)
+        {
+            cluster_num = fat_append_clusters(fd->fs, fd->pos_cluster_end, 1);
+            if(!cluster_num)
+            {
+                fat_errno = FAT_ERR_FILESYSFULL;
+                return -1;
+            }
+            fat_add_extent(fd, fd->pos_cluster_end, cluster_num);
+        }
+    }
+
     /* find cluster in which to start writing */
     if(!cluster_num)
     {
@@ -1207,6 +1467,7 @@ intptr_t fat_write_file(struct fat_file_struct* fd, const uint8_t* buffer, uintp
 		    fat_errno = FAT_ERR_FILESYSFULL;
 		    return -1;
 		}
+                fat_reset_extents(fd);
             }
             else
             {
@@ -1219,10 +1480,13 @@ intptr_t fat_write_file(struct fat_file_struct* fd, const uint8_t* buffer, uintp
         {
             uint32_t pos = fd->pos;
             cluster_t cluster_num_next;
+#if FAT_EXTENT_COUNT
+            cluster_num = fat_file_skip(fd, &pos);
+#endif
             while(pos >= cluster_size)
             {
                 pos -= cluster_size;
-                cluster_num_next = fat_get_next_cluster(fd->fs, cluster_num);
+                cluster_num_next = fat_file_next_cluster(fd, cluster_num);
                 if(!cluster_num_next)
 		{
 		    if (pos != 0)
@@ -1238,6 +1502,7 @@ intptr_t fat_write_file(struct fat_file_struct* fd, const uint8_t* buffer, uintp
 			fat_errno = FAT_ERR_FILESYSFULL;
 			return -1;
 		    }
+		    fat_add_extent(fd, cluster_num, cluster_num_next);
 		}
 
                 cluster_num = cluster_num_next;
@@ -1254,6 +1519,10 @@ intptr_t fat_write_file(struct fat_file_struct* fd, const uint8_t* buffer, uintp
         if(write_length > buffer_left)
             write_length = buffer_left;
 
+        /* appended data fills the rest of the cluster in order */
+        if(fd->pos >= fd->dir_entry.file_size && fd->fs->partition->device_erasable)
+            fd->fs->partition->device_erasable(cluster_offset - first_cluster_offset, cluster_offset - first_cluster_offset + cluster_size);
+
         /* write data which fits into the current cluster */
         if(!fd->fs->partition->device_write(cluster_offset, buffer, write_length))
             break;
@@ -1266,13 +1535,18 @@ intptr_t fat_write_file(struct fat_file_struct* fd, const uint8_t* buffer, uintp
         if(first_cluster_offset + write_length >= cluster_size)
         {
             /* we are on a cluster boundary, so get the next cluster */
-            cluster_t cluster_num_next = fat_get_next_cluster(fd->fs, cluster_num);
+            cluster_t cluster_num_next = fat_file_next_cluster(fd, cluster_num);
             if(!cluster_num_next && buffer_left > 0)
+            {
                 /* we reached the last cluster, append a new one */
                 cluster_num_next = fat_append_clusters(fd->fs, cluster_num, 1);
+                if(cluster_num_next)
+                    fat_add_extent(fd, cluster_num, cluster_num_next);
+            }
             if(!cluster_num_next)
             {
                 fd->pos_cluster = 0;
+                fd->pos_cluster_end = cluster_num;
                 break;
             }
 
@@ -1370,6 +1644,7 @@ uint8_t fat_seek_file(struct fat_file_struct* fd, int32_t* offset, uint8_t whenc
 
     fd->pos = new_pos;
     fd->pos_cluster = 0;
+    fd->pos_cluster_end = 0;
 
     *offset = (int32_t) new_pos;
     return 1;
@@ -1463,11 +1738,14 @@ uint8_t fat_resize_file(struct fat_file_struct* fd, uint32_t size)
 
     } while(0);
 
+    fat_reset_extents(fd);
+
     /* correct file position */
     if(size < fd->pos)
     {
         fd->pos = size;
         fd->pos_cluster = 0;
+        fd->pos_cluster_end = 0;
     }
 
     return 1;
@@ -1667,6 +1945,42 @@ uint8_t fat_reset_dir(struct fat_dir_struct* dd)
     return 1;
 }
 
+/**
+ * \ingroup fat_dir
+ * Saves the position of a directory handle.
+ *
+ * \param[in] dd The directory handle.
+ * \param[out] pos Pointer to a buffer into which to write the position.
+ * \see fat_seek_dir
+ */
+void fat_tell_dir(const struct fat_dir_struct* dd, struct fat_dir_pos_struct* pos)
+{
+    pos->cluster = dd->entry_cluster;
+    pos->offset = dd->entry_offset;
+}
+
+/**
+ * \ingroup fat_dir
+ * Moves a directory handle to a position saved by fat_tell_dir().
+ *
+ * Reading then continues with the directory entry which followed
+ * that position.  The directory must not have been changed since.
+ *
+ * \param[in] dd The directory handle.
+ * \param[in] pos The position to move to.
+ * \returns 0 on failure, 1 on success.
+ * \see fat_tell_dir
+ */
+uint8_t fat_seek_dir(struct fat_dir_struct* dd, const struct fat_dir_pos_struct* pos)
+{
+    if(!dd)
+        return 0;
+
+    dd->entry_cluster = pos->cluster;
+    dd->entry_offset = pos->offset;
+    return 1;
+}
+
 /**
  * \ingroup fat_fs
  * Callback function for reading a directory entry.
@@ -1996,7 +2310,7 @@ uint8_t fat_write_dir_entry(const struct fat_fs_struct* fs, struct fat_dir_entry
 
     /* generate 8.3 file name */
     memset(&buffer[0], ' ', 11);
-    char* name_ext = strrchr(name, '.');
+    const char* name_ext = strrchr(name, '.');
     if(name_ext && *++name_ext)
     {
         uint8_t name_ext_len = strlen(name_ext);
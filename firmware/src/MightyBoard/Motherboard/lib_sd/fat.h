@@ -103,20 +103,38 @@ struct fat_dir_entry_struct
     offset_t entry_offset;
 };
 
+/**
+ * \ingroup fat_dir
+ * The position of a directory handle.
+ *
+ * \see fat_tell_dir, fat_seek_dir
+ */
+struct fat_dir_pos_struct
+{
+    /** The cluster the handle reads next. */
+    cluster_t cluster;
+    /** The offset within that cluster. */
+    uint16_t offset;
+};
+
 struct fat_fs_struct* fat_open(struct partition_struct* partition);
 void fat_close(struct fat_fs_struct* fs);
 
 struct fat_file_struct* fat_open_file(struct fat_fs_struct* fs, const struct fat_dir_entry_struct* dir_entry);
 void fat_close_file(struct fat_file_struct* fd);
 intptr_t fat_read_file(struct fat_file_struct* fd, uint8_t* buffer, uintptr_t buffer_len);
+uint8_t fat_stream_file(struct fat_file_struct* fd);
 intptr_t fat_write_file(struct fat_file_struct* fd, const uint8_t* buffer, uintptr_t buffer_len);
 uint8_t fat_seek_file(struct fat_file_struct* fd, int32_t* offset, uint8_t whence);
 uint8_t fat_resize_file(struct fat_file_struct* fd, uint32_t size);
+uint8_t fat_map_file(struct fat_file_struct* fd);
 
 struct fat_dir_struct* fat_open_dir(struct fat_fs_struct* fs, const struct fat_dir_entry_struct* dir_entry);
 void fat_close_dir(struct fat_dir_struct* dd);
 uint8_t fat_read_dir(struct fat_dir_struct* dd, struct fat_dir_entry_struct* dir_entry);
 uint8_t fat_reset_dir(struct fat_dir_struct* dd);
+void fat_tell_dir(const struct fat_dir_struct* dd, struct fat_dir_pos_struct* pos);
+uint8_t fat_seek_dir(struct fat_dir_struct* dd, const struct fat_dir_pos_struct* pos);
 
 uint8_t fat_create_file(struct fat_dir_struct* parent, const char* file, struct fat_dir_entry_struct* dir_entry);
 uint8_t fat_delete_file(struct fat_fs_struct* fs, struct fat_dir_entry_struct* dir_entry);
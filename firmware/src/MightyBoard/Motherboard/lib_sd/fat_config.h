@@ -120,6 +120,16 @@ void get_datetime(uint16_t* year, uint8_t* month, uint8_t* day, uint8_t* hour, u
  */
 #define FAT_DIR_COUNT 2
 
+/**
+ * \ingroup fat_config
+ * Number of runs of contiguous clusters remembered per open file.
+ *
+ * A file's cluster chain is then read from the FAT only once, and
+ * following or seeking through it costs no card access.  Set to 0
+ * to always follow the chain in the FAT.
+ */
+#define FAT_EXTENT_COUNT 8
+
 /**
  * @}
  */
@@ -51,8 +51,11 @@ static struct partition_struct partition_handles[PARTITION_COUNT];
  *
  * \param[in] device_read A function pointer which is used to read from the disk.
  * \param[in] device_read_interval A function pointer which is used to read in constant intervals from the disk.
+ * \param[in] device_read_stream A function pointer which is used to read file data from the disk, or 0.
+ * \param[in] device_stream_open A function pointer which is used to start the disk streaming file data, or 0.
  * \param[in] device_write A function pointer which is used to write to the disk.
  * \param[in] device_write_interval A function pointer which is used to write a data stream to disk.
+ * \param[in] device_erasable A function pointer which is used to announce writes in order to disk, or 0.
  * \param[in] index The index of the partition which should be opened, range 0 to 3.
  *                  A negative value is allowed as well. In this case, the partition opened is
  *                  not checked for existance, begins at offset zero, has a length of zero
@@ -61,7 +64,7 @@ static struct partition_struct partition_handles[PARTITION_COUNT];
  * \returns 0 on failure, a partition descriptor on success.
  * \see partition_close
  */
-struct partition_struct* partition_open(device_read_t device_read, device_read_interval_t device_read_interval, device_write_t device_write, device_write_interval_t device_write_interval, int8_t index)
+struct partition_struct* partition_open(device_read_t device_read, device_read_interval_t device_read_interval, device_read_t device_read_stream, device_stream_open_t device_stream_open, device_write_t device_write, device_write_interval_t device_write_interval, device_erasable_t device_erasable, int8_t index)
 {
     struct partition_struct* new_partition = 0;
     uint8_t buffer[0x10];
@@ -104,8 +107,11 @@ struct partition_struct* partition_open(device_read_t device_read, device_read_i
     /* fill partition descriptor */
     new_partition->device_read = device_read;
     new_partition->device_read_interval = device_read_interval;
+    new_partition->device_read_stream = device_read_stream ? device_read_stream : device_read;
+    new_partition->device_stream_open = device_stream_open;
     new_partition->device_write = device_write;
     new_partition->device_write_interval = device_write_interval;
+    new_partition->device_erasable = device_erasable;
 
     if(index >= 0)
     {
@@ -109,6 +109,17 @@ typedef uint8_t (*device_read_callback_t)(uint8_t* buffer, offset_t offset, void
  * \see device_read_t
  */
 typedef uint8_t (*device_read_interval_t)(offset_t offset, uint8_t* buffer, uintptr_t interval, uintptr_t length, device_read_callback_t callback, void* p);
+/**
+ * A function pointer used to start streaming from the partition.
+ *
+ * The device goes on sending data from \c offset onwards, so that a
+ * following read of that data need not ask for it.
+ *
+ * \param[in] offset The offset on the device from which to stream.
+ * \returns 0 on failure, 1 on success
+ * \see device_read_t
+ */
+typedef uint8_t (*device_stream_open_t)(offset_t offset);
 /**
  * A function pointer used to write to the partition.
  *
@@ -146,6 +157,15 @@ typedef uintptr_t (*device_write_callback_t)(uint8_t* buffer, offset_t offset, v
  * \see device_write_t
  */
 typedef uint8_t (*device_write_interval_t)(offset_t offset, uint8_t* buffer, uintptr_t length, device_write_callback_t callback, void* p);
+/**
+ * A function pointer used to announce that a range of the partition is
+ * about to be written in order, so that the device may erase it ahead.
+ *
+ * \param[in] offset The offset on the device of the first byte.
+ * \param[in] end The offset just past the last byte.
+ * \see device_write_t
+ */
+typedef void (*device_erasable_t)(offset_t offset, offset_t end);
 
 /**
  * Describes a partition.
@@ -166,6 +186,23 @@ struct partition_struct
      *       not to the start of the partition.
      */
     device_read_interval_t device_read_interval;
+    /**
+     * The function which reads data from the partition which is mostly
+     * read in order, keeping the device streaming after it.  May be 0,
+     * in which case \c device_read is used.
+     *
+     * \note The offset given to this function is relative to the whole disk,
+     *       not to the start of the partition.
+     */
+    device_read_t device_read_stream;
+    /**
+     * The function which starts the device streaming, ahead of a read
+     * through \c device_read_stream.  May be 0.
+     *
+     * \note The offset given to this function is relative to the whole disk,
+     *       not to the start of the partition.
+     */
+    device_stream_open_t device_stream_open;
     /**
      * The function which writes data to the partition.
      *
@@ -180,6 +217,14 @@ struct partition_struct
      *       not to the start of the partition.
      */
     device_write_interval_t device_write_interval;
+    /**
+     * The function which announces writes in order to the partition.
+     * May be 0.
+     *
+     * \note The offsets given to this function are relative to the whole disk,
+     *       not to the start of the partition.
+     */
+    device_erasable_t device_erasable;
 
     /**
      * The type of the partition.
@@ -197,7 +242,7 @@ struct partition_struct
     uint32_t length;
 };
 
-struct partition_struct* partition_open(device_read_t device_read, device_read_interval_t device_read_interval, device_write_t device_write, device_write_interval_t device_write_interval, int8_t index);
+struct partition_struct* partition_open(device_read_t device_read, device_read_interval_t device_read_interval, device_read_t device_read_stream, device_stream_open_t device_stream_open, device_write_t device_write, device_write_interval_t device_write_interval, device_erasable_t device_erasable, int8_t index);
 uint8_t partition_close(struct partition_struct* partition);
 
 /**
@@ -8,11 +8,15 @@
  */
 
 #include <string.h>
+#ifndef SIMULATOR
 #include <avr/io.h>
+#endif
 #include "sd_raw.h"
+#ifndef SIMULATOR
 #include <util/delay.h>
 #include "Configuration.hh"
 #include "Pin.hh"
+#endif
 
 #if !SD_RAW_SAVE_RAM
 #include "sd_crc.h"
@@ -167,6 +171,39 @@ static uint8_t raw_block_written;
 /* card type state */
 static uint8_t sd_raw_card_type;
 
+/* no multiple block transfer is open */
+#define NO_STREAM ((offset_t) -1)
+
+static uint8_t sd_raw_wait_ready();
+
+#if !SD_RAW_SAVE_RAM
+/* address of the next block of an open multiple block read */
+static offset_t raw_read_address;
+/* flag to have sd_raw_read() fetch blocks with a multiple block read */
+static uint8_t raw_read_streaming;
+
+static uint8_t sd_raw_rec_block(offset_t block_address);
+static void sd_raw_end_read();
+#endif
+
+#if SD_RAW_WRITE_SUPPORT
+/* ACMD23: arg0[22:0]: number of blocks, response R1 */
+#define CMD_SET_WR_BLK_ERASE_COUNT 0x17
+
+/* flag to remember that the card may still be programming a block */
+static uint8_t raw_busy;
+/* address of the next block of an open multiple block write */
+static offset_t raw_stream_address;
+/* range of blocks which the caller is about to write in order */
+static offset_t raw_erase_address;
+static offset_t raw_erase_end;
+
+static void sd_raw_end_stream();
+#if SD_RAW_WRITE_BUFFERING
+static uint8_t sd_raw_flush();
+#endif
+#endif
+
 /* private helper functions */
 static void sd_raw_send_byte(uint8_t b);
 static uint8_t sd_raw_rec_byte();
@@ -205,6 +242,7 @@ uint8_t sd_raw_init(bool use_crc, uint8_t speed)
     configure_pin_sck();
     configure_pin_miso();
 
+#ifndef SIMULATOR
     /* initialize SPI with lowest frequency; max. 400kHz during identification mode of card */
     SPCR = (0 << SPIE) | /* SPI Interrupt Enable */
            (1 << SPE)  | /* SPI Enable */
@@ -215,9 +253,19 @@ uint8_t sd_raw_init(bool use_crc, uint8_t speed)
            (1 << SPR1) | /* Clock Frequency: f_OSC / 128 */
            (1 << SPR0);
     SPSR = 0; // &= ~(1 << SPI2X); /* No doubled clock frequency */
+#endif
 
     /* initialization procedure */
     sd_raw_card_type = 0;
+#if !SD_RAW_SAVE_RAM
+    raw_read_address = NO_STREAM;
+    raw_read_streaming = 0;
+#endif
+#if SD_RAW_WRITE_SUPPORT
+    raw_busy = 0;
+    raw_stream_address = NO_STREAM;
+    raw_erase_address = raw_erase_end = 0;
+#endif
     if(!sd_raw_available())
     {
 	sd_errno = SDR_ERR_NOCARD;
@@ -359,7 +407,9 @@ uint8_t sd_raw_init(bool use_crc, uint8_t speed)
     unselect_card();
 
     /* switch to highest SPI frequency possible */
-#if SD_POOR_DESIGN
+#if defined(SIMULATOR)
+    /* the emulated card's timing sets the bus speed */
+#elif SD_POOR_DESIGN
     switch(speed) {
     /* f_OSC / 2 */
     case 0:
@@ -477,6 +527,9 @@ uint8_t sd_raw_locked()
  */
 void sd_raw_send_byte(uint8_t b)
 {
+#ifdef SIMULATOR
+    sdemu_exchange(b);
+#else
     uint8_t tries = 0;
 
     //PORTC |= 0x02;
@@ -486,6 +539,7 @@ void sd_raw_send_byte(uint8_t b)
 	_delay_us(1);
     //PORTC &= ~0x02;
     SPSR &= ~(1 << SPIF);
+#endif
 }
 
 /**
@@ -497,6 +551,9 @@ void sd_raw_send_byte(uint8_t b)
  */
 uint8_t sd_raw_rec_byte()
 {
+#ifdef SIMULATOR
+    return sdemu_exchange(0xff);
+#else
     uint8_t tries = 0;
     /* send dummy data for receiving some */
     //PORTC |= 0x01;
@@ -508,6 +565,7 @@ uint8_t sd_raw_rec_byte()
     SPSR &= ~(1 << SPIF);
 
     return SPDR;
+#endif
 }
 
 /**
@@ -523,12 +581,27 @@ uint8_t sd_raw_send_command(uint8_t command, uint32_t arg)
     uint8_t response;
     uint8_t *args = reinterpret_cast<uint8_t *>(&arg);
 
+#if !SD_RAW_SAVE_RAM
+    /* stop a multiple block read; this recurses once for CMD12 */
+    if(raw_read_address != NO_STREAM)
+        sd_raw_end_read();
+#endif
+#if SD_RAW_WRITE_SUPPORT
+    /* the card takes no command while writing
+     * several blocks or programming one
+     */
+    if(raw_stream_address != NO_STREAM)
+        sd_raw_end_stream();
+    if(raw_busy)
+        sd_raw_wait_ready();
+#endif
+
     /* wait some clock cycles */
     sd_raw_rec_byte();
 
 #if !SD_RAW_SAVE_RAM
     if ( sd_use_crc ) {
-	uint8_t crc[6] = { command | 0x40, args[3], args[2], args[1], args[0] };
+	uint8_t crc[6] = { (uint8_t)(command | 0x40), args[3], args[2], args[1], args[0] };
 	crc[5] = sd_crc7(crc, 5);
 	for (uint8_t i = 0; i < 6; i++)
 	    sd_raw_send_byte(crc[i]);
@@ -556,11 +629,16 @@ uint8_t sd_raw_send_command(uint8_t command, uint32_t arg)
     }
 #endif
 
-    /* receive response */
+    /* receive response; data of a multiple block read may
+     * still arrive until CMD12 takes effect
+     */
+    uint8_t stop = (command == CMD_STOP_TRANSMISSION);
+    if(stop)
+        sd_raw_rec_byte();
     for(uint8_t i = 0; i < 10; ++i)
     {
         response = sd_raw_rec_byte();
-        if(response != 0xff)
+        if(stop ? !(response & 0x80) : response != 0xff)
             break;
     }
 
@@ -602,7 +680,7 @@ uint8_t sd_raw_read(offset_t offset, uint8_t* buffer, uintptr_t length)
 #endif
         {
 #if SD_RAW_WRITE_BUFFERING
-            if(!sd_raw_sync())
+            if(!sd_raw_flush())
                 return 0;
 #endif
 
@@ -610,16 +688,33 @@ uint8_t sd_raw_read(offset_t offset, uint8_t* buffer, uintptr_t length)
             /* address card */
             select_card();
 
-            /* send single block request */
+#if !SD_RAW_SAVE_RAM
+            /* the block may be the next one of an open multiple block read */
+            if(block_address != raw_read_address)
+#endif
+            {
 #if SD_RAW_SDHC
-            if(sd_raw_send_command(CMD_READ_SINGLE_BLOCK, (sd_raw_card_type & (1 << SD_RAW_SPEC_SDHC) ? block_address / 512 : block_address)))
+                uint32_t card_address = (sd_raw_card_type & (1 << SD_RAW_SPEC_SDHC) ? block_address / 512 : block_address);
 #else
-            if(sd_raw_send_command(CMD_READ_SINGLE_BLOCK, block_address))
+                uint32_t card_address = block_address;
+#endif
+                uint8_t command = CMD_READ_SINGLE_BLOCK;
+#if !SD_RAW_SAVE_RAM
+                if(raw_read_streaming)
+                    command = CMD_READ_MULTIPLE_BLOCK;
+#endif
+
+                /* send block request */
+                if(sd_raw_send_command(command, card_address))
+                {
+                    unselect_card();
+                    sd_errno = SDR_ERR_BADRESPONSE;
+                    return 0;
+                }
+#if !SD_RAW_SAVE_RAM
+                if(raw_read_streaming)
+                    raw_read_address = block_address;
 #endif
-            {
-                unselect_card();
-		sd_errno = SDR_ERR_BADRESPONSE;
-                return 0;
             }
 
             /* wait for data block (start byte 0xfe) */
@@ -628,6 +723,10 @@ uint8_t sd_raw_read(offset_t offset, uint8_t* buffer, uintptr_t length)
 	    {
 		if(tries++ >= 0x7FFF)
 		{
+#if !SD_RAW_SAVE_RAM
+		    /* the card is likely gone; forget the read */
+		    raw_read_address = NO_STREAM;
+#endif
 		    unselect_card();
 		    sd_errno = SDR_ERR_COMMS;
 		    return 0;
@@ -649,31 +748,19 @@ uint8_t sd_raw_read(offset_t offset, uint8_t* buffer, uintptr_t length)
 	    sd_raw_rec_byte();
 #else
             /* read byte block */
-            uint8_t* cache = raw_block;
-            for(uint16_t i = 0; i < 512; ++i)
-                *cache++ = sd_raw_rec_byte();
-            raw_block_address = block_address;
-
-            /* read crc16 */
-	    if ( sd_use_crc ) {
-		uint16_t crc = sd_raw_rec_byte() << 8;
-		crc |= sd_raw_rec_byte();
-		if ( crc != sd_crc16(raw_block, (uint16_t)512) ) {
-		    unselect_card();
-		    if ( ++attempts < 5 ) {
-			sd_raw_rec_byte(); // pause a little
-			goto read_block;
-		    }
-		    sd_errno = SDR_ERR_CRC;
-		    return 0;
-		}
-	    }
-	    else
-	    {
-		/* ignore crc bytes */
-		sd_raw_rec_byte();
-		sd_raw_rec_byte();
-	    }
+            if(!sd_raw_rec_block(block_address))
+            {
+                /* fetch the block again with a new request */
+                if(raw_read_address != NO_STREAM)
+                    sd_raw_end_read();
+                unselect_card();
+                if ( ++attempts < 5 ) {
+                    sd_raw_rec_byte(); // pause a little
+                    goto read_block;
+                }
+                sd_errno = SDR_ERR_CRC;
+                return 0;
+            }
 
             memcpy(buffer, raw_block + block_offset, read_length);
             buffer += read_length;
@@ -701,6 +788,194 @@ uint8_t sd_raw_read(offset_t offset, uint8_t* buffer, uintptr_t length)
     return 1;
 }
 
+/**
+ * \ingroup sd_raw
+ * Reads raw data from the card, expecting more to be read right after it.
+ *
+ * Blocks are fetched with a multiple block read which stays open
+ * across calls as long as they continue where the last one ended.
+ * Any other access to the card stops it, as does sd_raw_stream_close().
+ *
+ * \param[in] offset The offset from which to read.
+ * \param[out] buffer The buffer into which to write the data.
+ * \param[in] length The number of bytes to read.
+ * \returns 0 on failure, 1 on success.
+ * \see sd_raw_read
+ */
+uint8_t sd_raw_stream_read(offset_t offset, uint8_t* buffer, uintptr_t length)
+{
+#if !SD_RAW_SAVE_RAM
+    raw_read_streaming = 1;
+    uint8_t ok = sd_raw_read(offset, buffer, length);
+    raw_read_streaming = 0;
+    return ok;
+#else
+    return sd_raw_read(offset, buffer, length);
+#endif
+}
+
+/**
+ * \ingroup sd_raw
+ * Starts the multiple block read of sd_raw_stream_read() at an offset
+ * without waiting for the data, so that the card fetches it while the
+ * caller goes on.  Nothing is sent if the block is already on its way.
+ *
+ * \param[in] offset The offset which the next sd_raw_stream_read() reads from.
+ * \returns 0 on failure, 1 on success.
+ * \see sd_raw_stream_read, sd_raw_stream_ready
+ */
+uint8_t sd_raw_stream_open(offset_t offset)
+{
+#if !SD_RAW_SAVE_RAM
+    offset_t block_address = offset - (offset & 0x01ff);
+
+    /* a cached block is read from the cache; the stream goes on after it */
+    if(block_address == raw_block_address)
+        block_address += 512;
+    if(block_address == raw_read_address)
+        return 1;
+
+#if SD_RAW_WRITE_BUFFERING
+    if(!sd_raw_flush())
+        return 0;
+#endif
+
+    select_card();
+#if SD_RAW_SDHC
+    uint32_t card_address = (sd_raw_card_type & (1 << SD_RAW_SPEC_SDHC) ? block_address / 512 : block_address);
+#else
+    uint32_t card_address = block_address;
+#endif
+    if(sd_raw_send_command(CMD_READ_MULTIPLE_BLOCK, card_address))
+    {
+        unselect_card();
+        sd_errno = SDR_ERR_BADRESPONSE;
+        return 0;
+    }
+    raw_read_address = block_address;
+    unselect_card();
+#endif
+    return 1;
+}
+
+/**
+ * \ingroup sd_raw
+ * Stops the multiple block read of sd_raw_stream_read(), if any.
+ */
+void sd_raw_stream_close()
+{
+#if !SD_RAW_SAVE_RAM
+    if(raw_read_address == NO_STREAM)
+        return;
+    select_card();
+    sd_raw_end_read();
+    unselect_card();
+#endif
+}
+
+/**
+ * \ingroup sd_raw
+ * Checks without waiting whether the next block of the multiple block
+ * read of sd_raw_stream_read() has arrived.  If it has, it is received
+ * into the block cache, so that reading it next costs no wait.
+ *
+ * \returns 0 while the card is still fetching the block, 1 otherwise.
+ */
+uint8_t sd_raw_stream_ready()
+{
+#if !SD_RAW_SAVE_RAM
+    if(raw_read_address == NO_STREAM)
+        return 1;
+#if SD_RAW_WRITE_BUFFERING
+    /* the cache holds a block yet to be written */
+    if(!raw_block_written)
+        return 1;
+#endif
+
+    select_card();
+    uint8_t b = sd_raw_rec_byte();
+    if(b == 0xff)
+    {
+        unselect_card();
+        return 0;
+    }
+
+    /* leave an error token or a bad block to sd_raw_read() to fetch again */
+    if(b != 0xfe || !sd_raw_rec_block(raw_read_address))
+        sd_raw_end_read();
+    unselect_card();
+
+    /* let card some time to finish */
+    sd_raw_rec_byte();
+#endif
+    return 1;
+}
+
+#if !SD_RAW_SAVE_RAM
+/**
+ * \ingroup sd_raw
+ * Receives a data block into the block cache, once its start byte has
+ * been seen.  The card must be selected.
+ *
+ * \param[in] block_address The offset of the block on the card.
+ * \returns 0 if the block's CRC is wrong, 1 otherwise.
+ */
+uint8_t sd_raw_rec_block(offset_t block_address)
+{
+    uint8_t* cache = raw_block;
+    for(uint16_t i = 0; i < 512; ++i)
+        *cache++ = sd_raw_rec_byte();
+    if(raw_read_address != NO_STREAM)
+        raw_read_address += 512;
+
+    /* read crc16 */
+    uint16_t crc = sd_raw_rec_byte() << 8;
+    crc |= sd_raw_rec_byte();
+    if(sd_use_crc && crc != sd_crc16(raw_block, (uint16_t)512))
+    {
+        raw_block_address = (offset_t) -1;
+        return 0;
+    }
+
+    raw_block_address = block_address;
+    return 1;
+}
+
+/**
+ * \ingroup sd_raw
+ * Ends a multiple block read.  The card must be selected.
+ */
+void sd_raw_end_read()
+{
+    raw_read_address = NO_STREAM;
+    sd_raw_send_command(CMD_STOP_TRANSMISSION, 0);
+    sd_raw_wait_ready();
+}
+#endif
+
+/**
+ * \ingroup sd_raw
+ * Waits while the card is busy.  The card must be selected.
+ *
+ * \returns 0 on timeout, 1 once the card is ready.
+ */
+uint8_t sd_raw_wait_ready()
+{
+    uint16_t tries = 0;
+    while(sd_raw_rec_byte() != 0xff)
+    {
+        if(tries++ >= 0x7FFF)
+        {
+            sd_errno = SDR_ERR_COMMS;
+            return 0;
+        }
+    }
+#if SD_RAW_WRITE_SUPPORT
+    raw_busy = 0;
+#endif
+    return 1;
+}
+
 /**
  * \ingroup sd_raw
  * Continuously reads units of \c interval bytes and calls a callback function.
@@ -874,8 +1149,8 @@ uint8_t sd_raw_write(offset_t offset, const uint8_t* buffer, uintptr_t length)
         if(block_address != raw_block_address)
         {
 #if SD_RAW_WRITE_BUFFERING
-            if(!sd_raw_sync())
-		// sd_raw_sync() calls us back...
+            if(!sd_raw_flush())
+		// sd_raw_flush() calls us back...
                 return 0;
 #endif
 
@@ -902,12 +1177,41 @@ uint8_t sd_raw_write(offset_t offset, const uint8_t* buffer, uintptr_t length)
         /* address card */
         select_card();
 
-        /* send single block request */
 #if SD_RAW_SDHC
-        if(sd_raw_send_command(CMD_WRITE_SINGLE_BLOCK, (sd_raw_card_type & (1 << SD_RAW_SPEC_SDHC) ? block_address / 512 : block_address)))
+        uint32_t card_address = (sd_raw_card_type & (1 << SD_RAW_SPEC_SDHC) ? block_address / 512 : block_address);
 #else
-        if(sd_raw_send_command(CMD_WRITE_SINGLE_BLOCK, block_address))
+        uint32_t card_address = block_address;
 #endif
+        uint8_t token = 0xfe;
+        if(block_address == raw_stream_address)
+        {
+            /* continue the multiple block write */
+            token = 0xfc;
+            if(!sd_raw_wait_ready())
+            {
+                unselect_card();
+                return 0;
+            }
+        }
+        else if(block_address >= raw_erase_address && block_address + 512 < raw_erase_end &&
+                (sd_raw_card_type & ((1 << SD_RAW_SPEC_1) | (1 << SD_RAW_SPEC_2))))
+        {
+            /* more blocks follow: let the card erase them all at once
+             * and write them without a command for each
+             */
+            sd_raw_send_command(CMD_APP, 0);
+            if(sd_raw_send_command(CMD_SET_WR_BLK_ERASE_COUNT, (uint32_t)((raw_erase_end - block_address) / 512)) ||
+               sd_raw_send_command(CMD_WRITE_MULTIPLE_BLOCK, card_address))
+            {
+                unselect_card();
+                sd_errno = SDR_ERR_BADRESPONSE;
+                return 0;
+            }
+            token = 0xfc;
+            raw_stream_address = block_address;
+        }
+        /* send single block request */
+        else if(sd_raw_send_command(CMD_WRITE_SINGLE_BLOCK, card_address))
         {
             unselect_card();
 	    sd_errno = SDR_ERR_BADRESPONSE;
@@ -915,7 +1219,7 @@ uint8_t sd_raw_write(offset_t offset, const uint8_t* buffer, uintptr_t length)
         }
 
         /* send start byte */
-        sd_raw_send_byte(0xfe);
+        sd_raw_send_byte(token);
 
         /* write byte block */
         uint8_t* cache = raw_block;
@@ -927,18 +1231,21 @@ uint8_t sd_raw_write(offset_t offset, const uint8_t* buffer, uintptr_t length)
 	sd_raw_send_byte(crc >> 8);
 	sd_raw_send_byte(crc & 0xff);
 
-        /* wait while card is busy */
-	uint16_t tries = 0;
-        while(sd_raw_rec_byte() != 0xff)
-	{
-	    if(tries++ >= 0x7FFF)
-	    {
-		unselect_card();
-		sd_errno = SDR_ERR_COMMS;
-		return 0;
-	    }
-	}
-        sd_raw_rec_byte();
+        /* the card accepts or rejects the block right away
+         * but programs it while we go on; it is waited for
+         * only when the card is needed again
+         */
+        if((sd_raw_rec_byte() & 0x1f) != DR_STATUS_ACCEPTED)
+        {
+            if(raw_stream_address != NO_STREAM)
+                sd_raw_end_stream();
+            unselect_card();
+            sd_errno = SDR_ERR_BADRESPONSE;
+            return 0;
+        }
+        raw_busy = 1;
+        if(raw_stream_address != NO_STREAM)
+            raw_stream_address += 512;
 
         /* deaddress card */
         unselect_card();
@@ -1008,9 +1315,29 @@ uint8_t sd_raw_write_interval(offset_t offset, uint8_t* buffer, uintptr_t length
 #endif
 
 #if DOXYGEN || SD_RAW_WRITE_SUPPORT
+#if SD_RAW_WRITE_BUFFERING
 /**
  * \ingroup sd_raw
- * Writes the write buffer's content to the card.
+ * Writes the write buffer's content to the card
+ * without waiting for the card to program it.
+ *
+ * \returns 0 on failure, 1 on success.
+ */
+uint8_t sd_raw_flush()
+{
+    if(raw_block_written)
+        return 1;
+    if(!sd_raw_write(raw_block_address, raw_block, sizeof(raw_block)))
+        return 0;
+    raw_block_written = 1;
+    return 1;
+}
+#endif
+
+/**
+ * \ingroup sd_raw
+ * Writes the write buffer's content to the card
+ * and waits until the card has programmed it.
  *
  * \note When write buffering is enabled, you should
  *       call this function before disconnecting the
@@ -1023,13 +1350,69 @@ uint8_t sd_raw_write_interval(offset_t offset, uint8_t* buffer, uintptr_t length
 uint8_t sd_raw_sync()
 {
 #if SD_RAW_WRITE_BUFFERING
-    if(raw_block_written)
-        return 1;
-    if(!sd_raw_write(raw_block_address, raw_block, sizeof(raw_block)))
+    if(!sd_raw_flush())
         return 0;
-    raw_block_written = 1;
 #endif
-    return 1;
+    sd_raw_stream_close();
+    raw_erase_address = raw_erase_end = 0;
+    if(!raw_busy && raw_stream_address == NO_STREAM)
+        return 1;
+
+    select_card();
+    if(raw_stream_address != NO_STREAM)
+        sd_raw_end_stream();
+    uint8_t ready = sd_raw_wait_ready();
+    unselect_card();
+    return ready;
+}
+
+/**
+ * \ingroup sd_raw
+ * Checks whether the card is still programming written data.
+ *
+ * \returns true while the card is busy, false once it is ready.
+ */
+uint8_t sd_raw_busy()
+{
+    if(raw_busy)
+    {
+        select_card();
+        if(sd_raw_rec_byte() == 0xff)
+            raw_busy = 0;
+        unselect_card();
+    }
+    return raw_busy;
+}
+
+/**
+ * \ingroup sd_raw
+ * Announces that the blocks from \c offset up to \c end are
+ * about to be written in order.
+ *
+ * The blocks may then be erased ahead and written as one
+ * multiple block write.  The hint lasts until the next
+ * sd_raw_sync() or sd_raw_erasable() call.
+ *
+ * \param[in] offset The block aligned offset of the first block.
+ * \param[in] end The offset just past the last block.
+ */
+void sd_raw_erasable(offset_t offset, offset_t end)
+{
+    raw_erase_address = offset;
+    raw_erase_end = end;
+}
+
+/**
+ * \ingroup sd_raw
+ * Ends a multiple block write.  The card must be selected.
+ */
+void sd_raw_end_stream()
+{
+    raw_stream_address = NO_STREAM;
+    sd_raw_wait_ready();
+    sd_raw_send_byte(0xfd);
+    sd_raw_rec_byte();
+    raw_busy = 1;
 }
 #endif
 
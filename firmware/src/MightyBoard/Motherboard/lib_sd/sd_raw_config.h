@@ -12,7 +12,11 @@
 
 #include <stdint.h>
 #include "Configuration.hh"
+#ifndef SIMULATOR
 #include "Pin.hh"
+#else
+#include "sdemu.hh"
+#endif
 
 #define SD_TIMEOUT 1000  //1ms
 
@@ -87,7 +91,16 @@ extern "C"
  */
 
 /* defines for customisation of sd/mmc port access */
-#if defined(__AVR_ATmega8__) || \
+#if defined(SIMULATOR)
+    /* the card is emulated on the host, see simulator/sdemu.cc */
+    #define configure_pin_mosi()
+    #define configure_pin_sck()
+    #define configure_pin_ss()
+    #define configure_pin_miso()
+
+    #define select_card() sdemu_select(true)
+    #define unselect_card() sdemu_select(false)
+#elif defined(__AVR_ATmega8__) || \
     defined(__AVR_ATmega48__) || \
     defined(__AVR_ATmega48P__) || \
     defined(__AVR_ATmega88__) || \
@@ -128,10 +141,15 @@ extern "C"
     #error "no sd/mmc pin mapping available!"
 #endif
 
+#if defined(SIMULATOR)
+#define configure_pin_available()
+#define get_pin_available() ( sdemu_present() ? 0x00 : 0xff )
+#else
 #define configure_pin_available() SD_DETECT_PIN.setDirection(false)
 #define get_pin_available() SD_DETECT_PIN.getValue()
+#endif
 
-#if !defined(SD_NO_WRITE_LOCK)
+#if !defined(SD_NO_WRITE_LOCK) && !defined(SIMULATOR)
 #define configure_pin_locked() SD_WRITE_PIN.setDirection(false)
 #define get_pin_locked() !SD_WRITE_PIN.getValue()
 #else
@@ -0,0 +1,206 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * Relay feedback tuning after K. J. Astrom and T. Hagglund, "Automatic
+ * tuning of simple regulators with specifications on phase and
+ * amplitude margins", Automatica 20(5), 1984.
+ */
+
+#include <math.h>
+#include "Autotune.hh"
+#include "PID.hh"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// scale of the PID output and limit of its error sum; must match PID.cc
+#define OUTPUT_SCALE 2
+#define ERR_ACC_MAX 256
+
+/// Margin by which the integral term can exceed the power that holds
+/// the target temperature
+#define HOLD_MARGIN 1.25
+
+/// The relay switches this many degrees past the target, so that sensor
+/// noise does not switch it back and forth
+#define HYSTERESIS 0.5
+
+/// Least time between relay switches, also to ride out noise (5 seconds)
+#define MIN_HALF_CYCLE 50000UL
+
+/// Give up if heating to the target or half a cycle takes longer (15 minutes)
+#define MAX_HALF_CYCLE 9000000UL
+
+/// Give up if the temperature runs this far over the target
+#define MAX_OVERSHOOT 20
+
+#define MIN_CYCLES 3
+#define MAX_CYCLES 20
+
+/// Relay output limits; the relay must be able to both heat and cool
+#define MIN_BIAS 20
+#define MAX_BIAS (255 - MIN_BIAS)
+
+/// Largest gains allowed, as advertised for the PID settings in EepromMap.hh
+#define MAX_P 100.0
+#define MAX_I 1.0
+#define MAX_D 100.0
+
+void Autotune::start(int16_t target_in, uint8_t cycles_in, uint8_t rule_in, uint8_t id_in) {
+	if ( cycles_in == 0 )
+		cycles_in = AUTOTUNE_DEFAULT_CYCLES;
+	else if ( cycles_in < MIN_CYCLES )
+		cycles_in = MIN_CYCLES;
+	else if ( cycles_in > MAX_CYCLES )
+		cycles_in = MAX_CYCLES;
+
+	target = target_in;
+	cycles = cycles_in;
+	rule = rule_in;
+	id = id_in;
+	cycle = 0;
+	bias = amplitude = 127;
+	heating = true;
+	heating_time = 0;
+	ku_sum = 0;
+	period_sum = 0;
+	samples = 0;
+	p = i = d = 0;
+	state = HEATING;
+}
+
+uint8_t Autotune::update(float temp, uint32_t now) {
+	uint32_t elapsed = now - switched;
+
+	if ( state == HEATING ) {
+		if ( samples++ == 0 )
+			switched = now;
+		else if ( elapsed > MAX_HALF_CYCLE ) {
+			state = FAILED;
+			return 0;
+		}
+		if ( temp < target )
+			return 255;
+
+		// Reached the target: start cycling with the relay off
+		state = CYCLING;
+		heating = false;
+		switched = now;
+		high = low = temp;
+		return bias - amplitude;
+	}
+
+	if ( state != CYCLING )
+		return 0;
+
+	samples++;
+	if ( temp > high ) high = temp;
+	if ( temp < low ) low = temp;
+
+	if ( (temp > target + MAX_OVERSHOOT) || (elapsed > MAX_HALF_CYCLE) ) {
+		state = FAILED;
+		return 0;
+	}
+
+	if ( elapsed >= MIN_HALF_CYCLE ) {
+		if ( heating ) {
+			if ( temp > target + HYSTERESIS ) {
+				heating = false;
+				heating_time = elapsed;
+				switched = now;
+			}
+		}
+		else if ( temp < target - HYSTERESIS ) {
+			// A cycle ends as the relay comes back on.  The cooling
+			// half after heating up is not part of one.
+			if ( heating_time ) {
+				uint32_t period = heating_time + elapsed;
+
+				if ( ++cycle > 1 ) {
+					// Ultimate gain from the describing function of
+					// a relay with hysteresis
+					float a = (high - low) * 0.5;
+					float a2 = a * a - HYSTERESIS * HYSTERESIS;
+					if ( a2 <= 0 ) {
+						state = FAILED;
+						return 0;
+					}
+					ku_sum += 4.0 * amplitude / (M_PI * sqrt(a2));
+					period_sum += period;
+				}
+				else
+					// The measured cycles start now
+					samples = 0;
+
+				if ( cycle >= cycles ) {
+					finish();
+					return 0;
+				}
+
+				// Move the bias toward equal heating and cooling times
+				int16_t b = bias + (int16_t)((int32_t)amplitude *
+					((int32_t)heating_time - (int32_t)elapsed) / (int32_t)period);
+				if ( b < MIN_BIAS ) b = MIN_BIAS;
+				else if ( b > MAX_BIAS ) b = MAX_BIAS;
+				bias = (uint8_t)b;
+				amplitude = ( bias < 128 ) ? bias : 255 - bias;
+			}
+			heating = true;
+			switched = now;
+			high = low = temp;
+		}
+	}
+
+	return heating ? bias + amplitude : bias - amplitude;
+}
+
+void Autotune::finish() {
+	uint8_t n = cycles - 1;
+	float ku = ku_sum / n;
+	float pu = (float)period_sum / n * 1.0e-4;            // seconds
+	float dt = (float)period_sum / samples * 1.0e-4;      // seconds per sample
+	float kc, ti, td;
+
+	if ( rule == ZIEGLER_NICHOLS ) {
+		kc = 0.6 * ku;
+		ti = 0.5 * pu;
+		td = 0.125 * pu;
+	}
+	else {
+		kc = ku / 2.2;
+		ti = 2.2 * pu;
+		td = pu / 6.3;
+	}
+
+	// PID::calculate() outputs OUTPUT_SCALE * (P e + I sum(e) + D delta(e))
+	// where sum(e) is the error summed over the samples so far and
+	// delta(e) is the change in error over DELTA_SAMPLES samples
+	p = kc / OUTPUT_SCALE;
+	i = p * dt / ti;
+	d = p * td / (DELTA_SAMPLES * dt);
+
+	// The error sum is clamped, so the integral term can only supply so
+	// much power.  It must be able to supply the power that holds the
+	// target, which is the relay's bias once trimmed, or the heater will
+	// settle short of the target.
+	float hold = HOLD_MARGIN * bias / (OUTPUT_SCALE * ERR_ACC_MAX);
+	if ( i < hold ) i = hold;
+
+	if ( p > MAX_P ) p = MAX_P;
+	if ( i > MAX_I ) i = MAX_I;
+	if ( d > MAX_D ) d = MAX_D;
+
+	state = DONE;
+}
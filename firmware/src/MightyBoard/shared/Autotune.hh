@@ -0,0 +1,106 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef AUTOTUNE_HH_
+#define AUTOTUNE_HH_
+
+#include <stdint.h>
+
+/// Full heating and cooling cycles run when the caller asks for zero
+#define AUTOTUNE_DEFAULT_CYCLES 5
+
+/// The Autotune module finds PID gains for a heater by relay feedback.
+/// The heater is switched between bias + d and bias - d PWM each time
+/// the temperature crosses the target, which makes the temperature
+/// oscillate about the target.  The amplitude and period of that
+/// oscillation are the heater's ultimate gain and period, from which
+/// the Tyreus-Luyben or Ziegler-Nichols rules give the gains.  The bias
+/// is trimmed each cycle so that the heating and cooling halves take
+/// equally long; the first cycle is run only to trim it.
+///
+/// The gains are scaled to the units of #PID and to the interval at
+/// which the temperature was sampled, so the caller should feed
+/// #update() from the same loop that will run the PID.
+/// \ingroup SoftwareLibraries
+class Autotune {
+public:
+    enum State {
+        IDLE = 0,                       ///< Never run, or cancelled
+        HEATING = 1,                    ///< Heating to the target at full power
+        CYCLING = 2,                    ///< Relay cycling about the target
+        DONE = 3,                       ///< Finished; the gains are valid
+        FAILED = 4                      ///< Gave up; the heater did not oscillate
+    };
+
+    enum Rule {
+        TYREUS_LUYBEN = 0,              ///< Less overshoot, slower integral
+        ZIEGLER_NICHOLS = 1             ///< Faster, at the cost of overshoot
+    };
+
+    float p;                            ///< Proportional gain found
+    float i;                            ///< Integral gain found
+    float d;                            ///< Derivative gain found
+
+    /// Start tuning, discarding any previous result.
+    /// \param[in] target Temperature to oscillate about, in degrees Celsius
+    /// \param[in] cycles Full cycles to run, including the first; 0 for the default
+    /// \param[in] rule #Rule used to turn the oscillation into gains
+    /// \param[in] id Caller's identifier for the heater, returned by #getId()
+    void start(int16_t target, uint8_t cycles, uint8_t rule, uint8_t id);
+
+    /// Stop tuning early.
+    /// \param[in] failed True to report #FAILED, false to report #IDLE
+    void stop(bool failed) { if ( isRunning() ) state = failed ? FAILED : IDLE; }
+
+    /// Process a temperature sample.
+    /// \param[in] temp Measured temperature, in degrees Celsius
+    /// \param[in] now Time of the sample, in hundreds of microseconds
+    /// \return PWM to drive the heater with until the next sample
+    uint8_t update(float temp, uint32_t now);
+
+    bool isRunning() const { return state == HEATING || state == CYCLING; }
+    uint8_t getState() const { return state; }
+    uint8_t getId() const { return id; }
+    int16_t getTarget() const { return target; }
+
+    /// \return Number of full cycles completed
+    uint8_t getCycle() const { return cycle; }
+
+    /// \return Number of full cycles that will be run
+    uint8_t getCycles() const { return cycles; }
+
+private:
+    uint8_t state;                      ///< #State
+    uint8_t rule;                       ///< #Rule
+    uint8_t id;                         ///< Caller's heater identifier
+    uint8_t cycles;                     ///< Full cycles to run
+    uint8_t cycle;                      ///< Full cycles completed
+    uint8_t bias;                       ///< Mean PWM of the relay
+    uint8_t amplitude;                  ///< Relay swings this far either side of bias
+    bool heating;                       ///< Relay is on (bias + amplitude)
+    int16_t target;                     ///< Temperature to oscillate about
+    float high;                         ///< Highest temperature this cycle
+    float low;                          ///< Lowest temperature this cycle
+    float ku_sum;                       ///< Sum of the ultimate gains measured
+    uint32_t period_sum;                ///< Sum of the periods measured
+    uint16_t samples;                   ///< Samples taken in the measured cycles
+    uint32_t switched;                  ///< Time the relay last switched
+    uint32_t heating_time;              ///< Length of this cycle's heating half
+
+    /// Turn the measured cycles into gains
+    void finish();
+};
+
+#endif /* AUTOTUNE_HH_ */
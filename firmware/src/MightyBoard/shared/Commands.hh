@@ -81,6 +81,15 @@
 #define HOST_CMD_GET_BUILD_STATS   24
 #define HOST_CMD_ADVANCED_VERSION  27
 
+// Tune a heater's PID gains by relay feedback and store them in
+// EEPROM, and report on the tuning
+#define HOST_CMD_HEATER_AUTOTUNE   30
+#define HOST_CMD_AUTOTUNE_STATUS   31
+
+// Play back a file on the SD card from one of its layers, as listed in
+// the file's layer index
+#define HOST_CMD_PLAYBACK_LAYER    32
+
 // These are our bufferable commands from the host
 
 #define HOST_CMD_FIND_AXES_MINIMUM 131
@@ -116,6 +125,16 @@
 #define HOST_CMD_SET_ACCELERATION_TOGGLE	156
 #define HOST_CMD_STREAM_VERSION		157
 #define HOST_CMD_PAUSE_AT_ZPOS		158
+// Store the current position as node (index % cols, index / cols) of
+// the auto-level mesh; cols == 0 erases the mesh
+#define HOST_CMD_STORE_MESH_POINT	159
+// Moves planned ahead by simulator/s3gplan; see Motherboard/PlannedBlock.hh
+#define HOST_CMD_PLANNED_HEADER		160
+#define HOST_CMD_QUEUE_POINT_PLANNED	161
+// CRC-32 (IEEE 802.3, sent little endian) of every byte of the file
+// before the command, checked by the SD pre-flight scan; see
+// Motherboard/Preflight.hh and simulator/s3gsum
+#define HOST_CMD_FILE_CHECKSUM		162
 
 #define HOST_CMD_DEBUG_ECHO        0x70
 
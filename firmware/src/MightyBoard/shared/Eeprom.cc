@@ -6,6 +6,9 @@
 #include "Version.hh"
 #include <avr/eeprom.h>
 #include <avr/wdt.h>
+#include <util/crc16.h>
+#include <stddef.h>
+#include <string.h>
 
 #ifdef EEPROM_MENU_ENABLE
 #include "SDCard.hh"
@@ -13,6 +16,8 @@
 
 namespace eeprom {
 
+static void clearCounterLog();
+
 /**
  * if the EEPROM is initalized and matches firmware version, exit
  * if the EEPROM is not initalized, write defaults, and set a new version
@@ -35,6 +40,8 @@ void init() {
 	    prom_version[1] < 6)
         	fullResetEEPROM();
 
+       clearCounterLog();
+
        //Update eeprom version # to match current firmware version
        prom_version[0] = firmware_version % 100;
        prom_version[1] = firmware_version / 100;
@@ -71,6 +78,8 @@ void erase() {
 bool saveToSDFile(const char *filename) {
 	uint8_t v;
 
+	flushSettings();
+
 	//Open the file for writing
 	if ( sdcard::startCapture((char *)filename) != sdcard::SD_SUCCESS )	return false;
 
@@ -94,6 +103,7 @@ bool saveToSDFile(const char *filename) {
 bool restoreFromSDFile(const char *filename) {
 	uint8_t v;
 
+	flushSettings();
 	if ( sdcard::startPlayback((char *)filename) != sdcard::SD_SUCCESS )	return false;
 
         for (uint16_t i = 0; i < EEPROM_SIZE; i ++ ) {
@@ -106,25 +116,385 @@ bool restoreFromSDFile(const char *filename) {
 	}
 
     	sdcard::finishPlayback();
+	loadSettings();
 
 	return true;
 }
 
 #endif
 
+Settings settings;
+
+/// Where each shadowed setting lives in the EEPROM and in settings
+struct SettingInfo {
+	uint16_t location;
+	uint8_t field;
+	uint8_t size;
+	uint32_t default_value;
+};
+
+#define EEPROM_SETTING_INFO(type, name, offset, dflt) \
+	{ offset, offsetof(Settings, name), sizeof(type), (uint32_t)(dflt) },
+
+static const SettingInfo settingInfo[SETTING_COUNT] PROGMEM = {
+	EEPROM_SETTINGS(EEPROM_SETTING_INFO)
+};
+
+/// Settings changed in RAM but not yet in the EEPROM, one bit per setting
+static uint16_t dirty = 0;
+
+static void readSettingInfo(uint8_t id, SettingInfo *info) {
+	memcpy_P(info, &settingInfo[id], sizeof(SettingInfo));
+}
+
+/// An erased value reads as its default, as with getEeprom8/16/32()
+static void storeSetting(const SettingInfo *info, uint8_t *value) {
+	uint8_t i;
+	for (i = 0; i < info->size && value[i] == 0xff; i++) ;
+	if ( i == info->size )
+		memcpy(value, &info->default_value, info->size);
+	memcpy((uint8_t *)&settings + info->field, value, info->size);
+}
+
+void loadSettings() {
+	SettingInfo info;
+	uint8_t value[sizeof(uint32_t)];
+
+	flushSettings();
+	for (uint8_t id = 0; id < SETTING_COUNT; id++) {
+		readSettingInfo(id, &info);
+		eeprom_read_block(value, (const void *)info.location, info.size);
+		storeSetting(&info, value);
+	}
+}
+
+void setSetting(uint8_t id, uint32_t value) {
+	SettingInfo info;
+
+	readSettingInfo(id, &info);
+	storeSetting(&info, (uint8_t *)&value);
+	dirty |= (uint16_t)1 << id;
+}
+
+/// Program the first byte of the lowest pending setting which differs
+/// from the EEPROM; false once that setting is entirely written back
+static bool writeSettingByte() {
+	SettingInfo info;
+	uint8_t id = 0;
+
+	while ( !(dirty & ((uint16_t)1 << id)) ) id++;
+	readSettingInfo(id, &info);
+
+	const uint8_t *value = (const uint8_t *)&settings + info.field;
+	for (uint8_t i = 0; i < info.size; i++) {
+		uint8_t *location = (uint8_t *)(info.location + i);
+		if ( eeprom_read_byte(location) != value[i] ) {
+			eeprom_write_byte(location, value[i]);
+			return true;
+		}
+	}
+	dirty &= ~((uint16_t)1 << id);
+	return false;
+}
+
+/// The latest counter record, written or still being written
+static counter_record_t counterRecord;
+/// The journal slot it goes in, and its next byte to write
+static uint8_t counterSlot = 0;
+static uint8_t counterByte = 0;
+static bool counterPending = false;
+/// Seconds of print time short of a minute not yet in TOTAL_BUILD_TIME
+static uint8_t counterCarry = 0;
+
+#if defined(SD_RESUME)
+/// The checkpoint which goes in each counter record
+static checkpoint_t checkpoint;
+#endif
+
+static uint8_t nextCounterSeq(uint8_t seq) {
+	return ( seq >= 0xfe ) ? 0 : seq + 1;
+}
+
+static uint16_t counterCrc(const void *data, uint8_t size) {
+	const uint8_t *p = (const uint8_t *)data;
+	uint16_t crc = 0xffff;
+	for (uint8_t i = 0; i < size; i++)
+		crc = _crc16_update(crc, p[i]);
+	return crc;
+}
+
+static uint16_t counterLocation(uint8_t slot) {
+	return eeprom_offsets::COUNTER_LOG + slot * sizeof(counter_record_t);
+}
+
+static bool readCounterRecord(uint8_t slot, counter_record_t *record) {
+	eeprom_read_block(record, (const void *)counterLocation(slot), sizeof(counter_record_t));
+	return record->seq != 0xff &&
+		record->crc == counterCrc(record, offsetof(counter_record_t, crc));
+}
+
+/// Program the next byte of the pending counter record which differs
+/// from the EEPROM, moving on to the next slot once the record is done
+static void writeCounterByte() {
+	const uint8_t *p = (const uint8_t *)&counterRecord;
+	uint16_t location = counterLocation(counterSlot);
+
+	while ( counterByte < sizeof(counter_record_t) ) {
+		uint8_t b = p[counterByte];
+		uint8_t *q = (uint8_t *)(location + counterByte++);
+		if ( eeprom_read_byte(q) != b ) {
+			eeprom_write_byte(q, b);
+			break;
+		}
+	}
+	if ( counterByte == sizeof(counter_record_t) ) {
+		counterPending = false;
+		counterSlot = (counterSlot + 1) % COUNTER_LOG_RECORDS;
+	}
+}
+
+static bool readCounterCommit(counter_commit_t *commit) {
+	eeprom_read_block(commit, (const void *)eeprom_offsets::COUNTER_COMMIT, sizeof(counter_commit_t));
+	return commit->seq != 0xff &&
+		commit->crc == counterCrc(commit, offsetof(counter_commit_t, crc));
+}
+
+/// Write the totals to commit to, rewriting only the bytes which change
+/// and the sequence number last, and wait for them
+static void writeCounterCommit(counter_commit_t *commit) {
+	const uint8_t *p = (const uint8_t *)commit;
+	uint8_t *q = (uint8_t *)eeprom_offsets::COUNTER_COMMIT;
+
+	commit->crc = counterCrc(commit, offsetof(counter_commit_t, crc));
+	for (uint8_t i = 0; i < sizeof(counter_commit_t); i++) {
+		if ( eeprom_read_byte(q + i) != p[i] )
+			eeprom_write_byte(q + i, p[i]);
+		wdt_reset();
+	}
+}
+
+/// Forget the totals once the lifetime counters hold them
+static void clearCounterCommit() {
+	eeprom_write_byte((uint8_t *)(eeprom_offsets::COUNTER_COMMIT + offsetof(counter_commit_t, seq)), 0xff);
+}
+
+/// Forget whatever the journal holds; its region may hold the leavings
+/// of other firmware
+static void clearCounterLog() {
+	for (uint8_t slot = 0; slot < COUNTER_LOG_RECORDS; slot++) {
+		eeprom_write_byte((uint8_t *)(counterLocation(slot) + offsetof(counter_record_t, seq)), 0xff);
+		wdt_reset();
+	}
+	clearCounterCommit();
+}
+
+/// Give the lifetime counters the totals committed to
+static void writeLifetimeCounters(const counter_commit_t *commit) {
+	for (uint8_t e = 0; e < 2; e++) {
+		uint16_t offset = eeprom_offsets::FILAMENT_LIFETIME + e * sizeof(int64_t);
+		if ( getEepromInt64(offset, 0) != commit->lifetime[e] )
+			setEepromInt64(offset, commit->lifetime[e]);
+	}
+	uint16_t hours;
+	uint8_t minutes;
+	getBuildTime(&hours, &minutes);
+	if ( hours != commit->hours || minutes != commit->minutes )
+		setBuildTime(commit->hours, commit->minutes);
+}
+
+void initCounterLog() {
+	counter_record_t next;
+	counter_commit_t commit;
+
+	flushSettings();
+
+	// The latest record is the one not followed by its successor
+	counterSlot = 0;
+	memset(&counterRecord, 0, sizeof(counterRecord));
+	counterRecord.seq = 0xfe;
+	for (uint8_t slot = 0; slot < COUNTER_LOG_RECORDS; slot++) {
+		if ( !readCounterRecord(slot, &next) )
+			continue;
+		uint8_t seq = nextCounterSeq(next.seq);
+		counterRecord = next;
+		counterSlot = (slot + 1) % COUNTER_LOG_RECORDS;
+		if ( !readCounterRecord(counterSlot, &next) || next.seq != seq )
+			break;
+	}
+#if defined(SD_RESUME)
+	checkpoint = counterRecord.checkpoint;
+#endif
+
+	// A power loss while the lifetime counters were being added to:
+	// if the journal got as far as the record the totals name, they're
+	// committed to and written, though the counters may already hold them
+	if ( readCounterCommit(&commit) ) {
+		if ( commit.seq == counterRecord.seq )
+			writeLifetimeCounters(&commit);
+		clearCounterCommit();
+	}
+
+	// A build which lost power never added what it used to them
+	counterCarry = 0;
+	if ( counterRecord.filament[0] || counterRecord.filament[1] || counterRecord.seconds >= 60 )
+		addCounters(counterRecord.filament[0], counterRecord.filament[1], counterRecord.seconds);
+	counterCarry = (uint8_t)counterRecord.seconds;
+}
+
+/// Queue a record unless it says the same as the latest
+static void queueCounterRecord(counter_record_t *record) {
+	if ( !memcmp(record, &counterRecord, offsetof(counter_record_t, crc)) )
+		return;
+
+	// A record still being written is replaced in its slot; its
+	// sequence number is written last so the torn one never counts
+	record->crc = counterCrc(record, offsetof(counter_record_t, crc));
+	record->seq = counterPending ? counterRecord.seq : nextCounterSeq(counterRecord.seq);
+	counterRecord = *record;
+	counterByte = 0;
+	counterPending = true;
+}
+
+void logCounters(int64_t filamentA, int64_t filamentB, uint32_t seconds) {
+	counter_record_t record;
+
+	memset(&record, 0, sizeof(record));
+	record.filament[0] = ( filamentA > 0x7fffffff ) ? 0x7fffffff : (int32_t)filamentA;
+	record.filament[1] = ( filamentB > 0x7fffffff ) ? 0x7fffffff : (int32_t)filamentB;
+	record.seconds = seconds + counterCarry;
+#if defined(SD_RESUME)
+	record.checkpoint = checkpoint;
+#endif
+	queueCounterRecord(&record);
+}
+
+void addCounters(int64_t filamentA, int64_t filamentB, uint32_t seconds) {
+	counter_record_t record = counterRecord;
+	counter_commit_t commit;
+	int64_t filament[2] = { filamentA, filamentB };
+
+	flushSettings();
+
+	// What the record has yet to add once this is added, and the totals
+	// the lifetime counters are committed to
+	for (uint8_t e = 0; e < 2; e++) {
+		int32_t f = ( filament[e] > 0x7fffffff ) ? 0x7fffffff : (int32_t)filament[e];
+		record.filament[e] = ( record.filament[e] > f ) ? record.filament[e] - f : 0;
+		commit.lifetime[e] = getEepromInt64(eeprom_offsets::FILAMENT_LIFETIME + e * sizeof(int64_t), 0) +
+			filament[e];
+	}
+	seconds += counterCarry;
+	uint32_t minutes = seconds / 60;
+	counterCarry = (uint8_t)(seconds % 60);
+	record.seconds = ( record.seconds > minutes * 60 ) ? record.seconds - minutes * 60 : counterCarry;
+
+	getBuildTime(&commit.hours, &commit.minutes);
+	minutes += commit.minutes;
+	commit.hours += (uint16_t)(minutes / 60);
+	commit.minutes = (uint8_t)(minutes % 60);
+
+	// The totals name the record, which is only written after them.  A
+	// record which says the same as the latest isn't written, but then
+	// the latest holds nothing of what is added.
+	queueCounterRecord(&record);
+	commit.seq = counterRecord.seq;
+	writeCounterCommit(&commit);
+	flushSettings();
+	writeLifetimeCounters(&commit);
+	clearCounterCommit();
+}
+
+#if defined(SD_RESUME)
+void setCheckpoint(const checkpoint_t *cp) {
+	if ( cp )
+		checkpoint = *cp;
+	else
+		memset(&checkpoint, 0, sizeof(checkpoint));
+}
+
+const checkpoint_t *getCheckpoint() {
+	return checkpoint.offset ? &checkpoint : 0;
+}
+
+void setCheckpointFile(const char *name) {
+	uint8_t *q = (uint8_t *)eeprom_offsets::CHECKPOINT_FILE;
+	for (uint8_t i = 0; i < CHECKPOINT_FILE_LEN; i++) {
+		if ( eeprom_read_byte(q + i) != (uint8_t)name[i] )
+			eeprom_write_byte(q + i, name[i]);
+		if ( !name[i] )
+			break;
+	}
+}
+
+void getCheckpointFile(char *name, uint8_t size) {
+	if ( size > CHECKPOINT_FILE_LEN )
+		size = CHECKPOINT_FILE_LEN;
+	eeprom_read_block(name, (const void *)eeprom_offsets::CHECKPOINT_FILE, size);
+	name[size - 1] = 0;
+}
+#endif
+
+void runEepromSlice() {
+	// Each byte takes the EEPROM about 3.4 ms to program, during which
+	// eeprom_write_byte() would wait; only start one once it is idle
+	if ( !eeprom_is_ready() )
+		return;
+	if ( dirty )
+		writeSettingByte();
+	else if ( counterPending )
+		writeCounterByte();
+}
+
+void flushSettings() {
+	while ( dirty ) {
+		writeSettingByte();
+		wdt_reset();
+	}
+	while ( counterPending ) {
+		writeCounterByte();
+		wdt_reset();
+	}
+}
+
+/// Point a read of a setting still waiting to be written back at RAM
+static const uint8_t *pendingSetting(const uint16_t location, const uint8_t size) {
+	SettingInfo info;
+
+	for (uint8_t id = 0; id < SETTING_COUNT; id++) {
+		if ( !(dirty & ((uint16_t)1 << id)) )
+			continue;
+		readSettingInfo(id, &info);
+		if ( info.location == location && info.size == size )
+			return (const uint8_t *)&settings + info.field;
+	}
+	return 0;
+}
+
 uint8_t getEeprom8(const uint16_t location, const uint8_t default_value) {
+	if ( dirty ) {
+		const uint8_t *value = pendingSetting(location, sizeof(uint8_t));
+		if ( value ) return *value;
+	}
         uint8_t data = eeprom_read_byte((uint8_t*)location);
         if (data == 0xff) data = default_value;
         return data;
 }
 
 uint16_t getEeprom16(const uint16_t location, const uint16_t default_value) {
+	if ( dirty ) {
+		const uint8_t *value = pendingSetting(location, sizeof(uint16_t));
+		if ( value ) return *(const uint16_t *)value;
+	}
         uint16_t data = eeprom_read_word((uint16_t*)location);
         if (data == 0xffff) data = default_value;
         return data;
 }
 
 uint32_t getEeprom32(const uint16_t location, const uint32_t default_value) {
+	if ( dirty ) {
+		const uint8_t *value = pendingSetting(location, sizeof(uint32_t));
+		if ( value ) return *(const uint32_t *)value;
+	}
         uint32_t data = eeprom_read_dword((uint32_t*)location);
         if (data == 0xffffffff) return default_value;
         return data;
@@ -29,6 +29,10 @@
 #include "Motherboard.hh"
 #endif
 
+#ifdef HEATER_FEED_FORWARD
+#include "StepperAccelPlanner.hh"
+#endif
+
 ExtruderBoard::ExtruderBoard(uint8_t slave_id_in, Pin HeaterPin_In, Pin FanPin_In,
 			     THERMOCOUPLE_TYPE thermocouple_channel, uint16_t eeprom_base) :
      extruder_thermocouple(thermocouple_channel, FOO_ARG(THERMOCOUPLE_SCK), FOO_ARG(THERMOCOUPLE_SO)),
@@ -67,6 +71,11 @@ void ExtruderBoard::reset() {
 void ExtruderBoard::runExtruderSlice() {
      if ( is_disabled )
 	  return;
+#ifdef HEATER_FEED_FORWARD
+     uint32_t ff = ((uint32_t)plan_extrusion_rate(slave_id, HEATER_FEED_FORWARD_HORIZON) *
+		    HEATER_FEED_FORWARD) / 1000;
+     extruder_heater.set_feed_forward((ff > 255) ? 255 : (uint8_t)ff);
+#endif
      extruder_heater.manage_temperature();
      coolingFan.manageCoolingFan();
 }
@@ -61,6 +61,11 @@ const uint32_t HEAT_PROGRESS_TIME = 90000000; // 90 seconds
 /// threshold above starting temperature we check for heating progres
 const int16_t HEAT_PROGRESS_THRESHOLD = 10;
 
+#ifdef HEATER_AUTOTUNE
+Autotune Heater::tuner;
+Heater *Heater::tuning = 0;
+#endif
+
 Heater::Heater(TemperatureSensor& sensor_in,
                HeatingElement& element_in,
                uint16_t eeprom_base_in, bool timingCheckOn, uint8_t calibration_offset) :
@@ -87,11 +92,17 @@ void Heater::reset() {
 }
 
 void Heater::abort() {
+#ifdef HEATER_AUTOTUNE
+	stop_autotune(false);
+#endif
 	fail_state = false;
 	fail_count = 0;
 	fail_mode = HEATER_FAIL_NONE;
 	value_fail_count = 0;
 	bypassing_PID = false;
+#ifdef HEATER_FEED_FORWARD
+	feed_forward = 0;
+#endif
 	heatingUpTimer = Timeout();
 	heatProgressTimer = Timeout();
 	progressChecked = false;
@@ -137,6 +148,10 @@ void Heater::disable(bool on) {
  */
 void Heater::set_target_temperature(int16_t target_temp)
 {
+#ifdef HEATER_AUTOTUNE
+	stop_autotune(false);
+#endif
+
        // clip our set temperature if we are over temp.
 	int16_t maxtemp = (calibration_eeprom_offset == 2) ? MAX_HBP_TEMP : MAX_VALID_TEMP;
 	if ( target_temp > maxtemp )
@@ -349,6 +364,27 @@ void Heater::manage_temperature() {
 		return;
 	}
 
+#ifdef HEATER_AUTOTUNE
+	if ( tuning == this ) {
+		Motherboard& board = Motherboard::getBoard();
+		uint8_t wrap;
+		set_output(tuner.update(fp_current_temp, board.getCurrentCentaMicros(&wrap)));
+		// a platform takes longer to tune than the inactivity timeout
+		board.resetUserInputTimeout();
+		if ( !tuner.isRunning() ) {
+			if ( tuner.getState() == Autotune::DONE ) {
+				eeprom::setPID(eeprom_base, tuner.p, tuner.i, tuner.d);
+				pid.setPGain(tuner.p);
+				pid.setIGain(tuner.i);
+				pid.setDGain(tuner.d);
+			}
+			tuning = 0;
+			set_target_temperature(0);
+		}
+		return;
+	}
+#endif
+
 	next_pid_timeout.start(UPDATE_INTERVAL_MICROS);
 
 	int delta = pid.getTarget() - current_temperature;
@@ -372,6 +408,11 @@ void Heater::manage_temperature() {
 			// but this works pretty well.
 #if HEATER_OFFSET_ADJUSTMENT
 			mv += HEATER_OFFSET_ADJUSTMENT;
+#endif
+#ifdef HEATER_FEED_FORWARD
+			// supply the power to melt the filament the queued moves
+			// are about to extrude rather than waiting for the sag
+			mv += feed_forward;
 #endif
 			// clamp value
 			if (mv < 0) mv = 0;
@@ -417,9 +458,38 @@ void Heater::set_output(uint8_t value)
 	element.setHeatingElement(value);
 }
 
+#ifdef HEATER_AUTOTUNE
+
+bool Heater::start_autotune(int16_t temp, uint8_t cycles, uint8_t rule)
+{
+	// only one heater is tuned at a time
+	if ( has_failed() || is_disabled || is_paused || temp <= 0 ||
+	     (tuning && tuning != this) )
+		return false;
+
+	// heat as for any other target so that the heat up checks apply
+	set_target_temperature(temp);
+	tuner.start(pid.getTarget(), cycles, rule, calibration_eeprom_offset);
+	tuning = this;
+	return true;
+}
+
+void Heater::stop_autotune(bool failed)
+{
+	if ( tuning == this ) {
+		tuning = 0;
+		tuner.stop(failed);
+	}
+}
+
+#endif
+
 // mark as failed and report to motherboard for user messaging
 void Heater::fail()
 {
+#ifdef HEATER_AUTOTUNE
+	stop_autotune(true);
+#endif
 	fail_state = true;
 	set_target_temperature(0);
 	set_output(0);
@@ -18,12 +18,16 @@
 #ifndef HEATER_H
 #define HEATER_H
 
+#include "Configuration.hh"
 #include "TemperatureSensor.hh"
 #include "HeatingElement.hh"
 #include "Pin.hh"
 #include "PID.hh"
 #include "Types.hh"
 #include "Timeout.hh"
+#ifdef HEATER_AUTOTUNE
+#include "Autotune.hh"
+#endif
 
 #define MAX_VALID_TEMP 280
 #define MAX_HBP_TEMP   130
@@ -65,6 +69,9 @@ class Heater
 
     PID pid;                            ///< PID controller instance
     bool bypassing_PID;                 ///< True if the heater is in full on
+#ifdef HEATER_FEED_FORWARD
+    uint8_t feed_forward;               ///< PWM added to the PID output for the coming extrusion
+#endif
 
     bool fail_state;                    ///< True if the heater has detected a hardware
                                         ///< failure and is shut down.
@@ -92,6 +99,15 @@ class Heater
     /// and sensor.
     const static micros_t UPDATE_INTERVAL_MICROS = 500L * 1000L;
 
+#ifdef HEATER_AUTOTUNE
+    static Autotune tuner;              ///< Relay feedback tuner, shared as only one
+                                        ///< heater is tuned at a time
+    static Heater *tuning;              ///< Heater being tuned, or 0
+
+    /// Stop tuning this heater, if it is being tuned.
+    void stop_autotune(bool failed);
+#endif
+
     /// Put the heater into a failure state, ensuring that the heating element is
     /// disabled.
     void fail();
@@ -137,6 +153,30 @@ class Heater
     /// \param value New setpoint temperature, in degrees Celcius.
     void set_output(uint8_t value);
 
+#ifdef HEATER_FEED_FORWARD
+    /// Set the PWM to add to the PID output for the extrusion about to
+    /// happen.  Used by extruder heaters while printing.
+    /// \param value PWM to add, 0 for none
+    void set_feed_forward(uint8_t value) { feed_forward = value; }
+#endif
+
+#ifdef HEATER_AUTOTUNE
+    /// Tune the PID gains by relay feedback about the given temperature.
+    /// When tuning finishes the gains are written to this heater's PID
+    /// settings in EEPROM and the heater is turned off.  Setting a target
+    /// temperature cancels tuning.
+    /// \param[in] temp Temperature to tune at, in degrees Celcius
+    /// \param[in] cycles Heating and cooling cycles to run, 0 for the default
+    /// \param[in] rule #Autotune::Rule to compute the gains with
+    /// \return false if the heater is disabled, failed or paused
+    bool start_autotune(int16_t temp, uint8_t cycles, uint8_t rule);
+
+    /// Get the state and result of the last tuning run of any heater.
+    /// The tuner's id is the heater's calibration offset: 0 or 1 for an
+    /// extruder, 2 for the platform.
+    static const Autotune& get_autotune() { return tuner; }
+#endif
+
     /// Reset the heater to a to board-on state
     void reset();
 
@@ -54,6 +54,9 @@
 // can't assume that its in that state when a sketch starts (and the
 // LiquidCrystal constructor is called).
 
+// DDRAM address of the first cell of each row
+static const uint8_t row_offsets[] PROGMEM = { 0x00, 0x40, 0x14, 0x54 };
+
 // Nothing to construct
 LiquidCrystalSerial::LiquidCrystalSerial() {}
 
@@ -104,8 +107,13 @@ void LiquidCrystalSerial::begin(uint8_t cols, uint8_t lines, uint8_t dotsize) {
   _displaycontrol = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
   display();
 
-  // clear it off
-  clear();
+  // clear it off; the display now matches a blank shadow framebuffer
+  command(LCD_CLEARDISPLAY);
+  _delay_us(2000);
+  memset(_shadow, ' ', sizeof(_shadow));
+  memset(_dirty, 0, sizeof(_dirty));
+  _flushCell = 0;
+  _xcursor = _ycursor = 0;
 
   // Initialize to default text direction (for romance languages)
   _displaymode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
@@ -191,6 +199,9 @@ void LiquidCrystalSerial::begin(uint8_t cols, uint8_t lines, uint8_t dotsize) {
   createChar(LCD_CUSTOM_CHAR_FOLDER, folder_in);
   createChar(LCD_CUSTOM_CHAR_RETURN, folder_out);
 
+  // createChar() left the display addressing CGRAM
+  _ddramAddr = 0xff;
+
 #if 0
     createChar(LCD_CUSTOM_CHAR_EXTRUDER_NORMAL, extruder_normal);
     createChar(LCD_CUSTOM_CHAR_EXTRUDER_HEATING, extruder_heating);
@@ -198,15 +209,21 @@ void LiquidCrystalSerial::begin(uint8_t cols, uint8_t lines, uint8_t dotsize) {
 }
 
 /********** high level commands, for the user! */
+
+// Clearing and homing only change the shadow framebuffer: flush() then
+// sends just the cells which change rather than waiting out the slow
+// LCD_CLEARDISPLAY and LCD_RETURNHOME commands.
 void LiquidCrystalSerial::clear() {
-  command(LCD_CLEARDISPLAY); // clear display, set cursor position to zero
-  _delay_us(2000);           // this command takes a long time!
+  for (uint8_t cell = 0; cell < LCD_SHADOW_SIZE; cell++) {
+    if (_shadow[cell] != ' ') {
+      _shadow[cell] = ' ';
+      _dirty[cell >> 3] |= (1 << (cell & 7));
+    }
+  }
+  setCursor(0, 0);
 }
 
-void LiquidCrystalSerial::home() {
-  command(LCD_RETURNHOME); // set cursor position to zero
-  _delay_us(2000);         // this command takes a long time!
-}
+void LiquidCrystalSerial::home() { setCursor(0, 0); }
 
 // A faster version of home()
 void LiquidCrystalSerial::homeCursor() { setCursor(0, 0); }
@@ -222,13 +239,11 @@ void LiquidCrystalSerial::clearHomeCursor() {
 }
 
 void LiquidCrystalSerial::setCursor(uint8_t col, uint8_t row) {
-  int row_offsets[] = { 0x00, 0x40, 0x14, 0x54 };
   if (row > _numlines) {
     row = _numlines - 1; // we count rows starting w/0
   }
 
   _xcursor = col; _ycursor = row;
-  command(LCD_SETDDRAMADDR | (col + row_offsets[row]));
 }
 
 // If col or row = -1, then the current position is retained
@@ -312,7 +327,7 @@ void LiquidCrystalSerial::createChar(uint8_t location, uint8_t charmap[]) {
     command(cmd);
     uint8_t *map = charmap;
     for (int i = 8; i; i--) {
-      write(*map++);
+      send(*map++, true);
     }
   }
 }
@@ -321,9 +336,66 @@ void LiquidCrystalSerial::createChar(uint8_t location, uint8_t charmap[]) {
 
 void LiquidCrystalSerial::command(uint8_t value) { send(value, false); }
 
-inline void LiquidCrystalSerial::write(uint8_t value) {
-  send(value, true);
+void LiquidCrystalSerial::write(uint8_t value) {
+  if (_xcursor < LCD_SCREEN_WIDTH && _ycursor < LCD_SCREEN_HEIGHT) {
+    uint8_t cell = _ycursor * LCD_SCREEN_WIDTH + _xcursor;
+    if (_shadow[cell] != value) {
+      _shadow[cell] = value;
+      _dirty[cell >> 3] |= (1 << (cell & 7));
+    }
+  }
   _xcursor++;
   if (_xcursor >= _numCols)
     setCursor(0, _ycursor + 1);
 }
+
+bool LiquidCrystalSerial::sendQueued(uint8_t value, bool dataMode) {
+  send(value, dataMode);
+  return true;
+}
+
+bool LiquidCrystalSerial::sendByte(uint8_t value, bool dataMode, bool wait) {
+  while (!sendQueued(value, dataMode)) {
+    if (!wait)
+      return false;
+  }
+  return true;
+}
+
+// Send dirty cells to the display, picking up where the last call left
+// off.  Sends at most LCD_FLUSH_BYTES bytes, each cell taking one byte
+// plus one more when the display's address must first be moved.  When
+// "all" is true, waits until every dirty cell has been sent.
+void LiquidCrystalSerial::flush(bool all) {
+  uint8_t budget = LCD_FLUSH_BYTES;
+
+  for (uint8_t n = LCD_SHADOW_SIZE; n; n--) {
+    uint8_t cell = _flushCell;
+    uint8_t mask = 1 << (cell & 7);
+
+    if (_dirty[cell >> 3] & mask) {
+      uint8_t row = cell / LCD_SCREEN_WIDTH;
+      uint8_t addr = pgm_read_byte(&row_offsets[row]) + (cell - row * LCD_SCREEN_WIDTH);
+
+      if (!all && budget < ((addr == _ddramAddr) ? 1 : 2))
+        return;
+
+      if (addr != _ddramAddr) {
+        if (!sendByte(LCD_SETDDRAMADDR | addr, false, all))
+          return;
+        _ddramAddr = addr;
+        budget--;
+      }
+
+      if (!sendByte(_shadow[cell], true, all))
+        return;
+      _dirty[cell >> 3] &= ~mask;
+      // The display advances its address after each character
+      _ddramAddr++;
+      budget--;
+    }
+
+    if (++_flushCell >= LCD_SHADOW_SIZE)
+      _flushCell = 0;
+  }
+}
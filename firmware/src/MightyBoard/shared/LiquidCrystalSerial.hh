@@ -35,8 +35,17 @@
 #include <stdint.h>
 #include <avr/pgmspace.h>
 #include "Pin.hh"
+#include "Configuration.hh"
 #include "VirtualDisplay.hh"
 
+// Size of the shadow framebuffer; one byte per character cell
+#define LCD_SHADOW_SIZE (LCD_SCREEN_WIDTH * LCD_SCREEN_HEIGHT)
+
+// Most bytes flush() sends to the display per call
+#ifndef LCD_FLUSH_BYTES
+#define LCD_FLUSH_BYTES 4
+#endif
+
 
 // commands
 #define LCD_CLEARDISPLAY 0x01
@@ -108,11 +117,18 @@ public:
   void setCursorExt(int8_t col, int8_t row);
 
   void write(uint8_t);
+
+  void flush(bool all = false);
   
 protected:
   
   void command(uint8_t);
 
+  /* Sends 8-bits to the HD44780 without waiting on the hardware when
+   * possible.  Returns false, having sent nothing, if the hardware is
+   * still busy with earlier bytes.  By default, just calls send(). */
+  virtual bool sendQueued(uint8_t value, bool dataMode);
+
   /* Sends 8-bits to the HD44780 in two 4-bit transmissions. */  
   virtual void send(uint8_t, bool) = 0;
   
@@ -142,6 +158,16 @@ protected:
   uint8_t _ycursor;
 
   uint8_t _numlines,_numCols;
+
+  /* Screens draw into the shadow framebuffer and flush() sends the
+   * cells marked dirty to the display. */
+  uint8_t _shadow[LCD_SHADOW_SIZE];
+  uint8_t _dirty[(LCD_SHADOW_SIZE + 7) / 8];
+  uint8_t _flushCell;   // Cell at which flush() resumes
+  uint8_t _ddramAddr;   // The display's DDRAM address; 0xff if unknown
+
+private:
+  bool sendByte(uint8_t value, bool dataMode, bool wait);
   
 };
 
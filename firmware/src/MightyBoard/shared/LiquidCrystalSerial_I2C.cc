@@ -75,8 +75,27 @@ void LiquidCrystalSerial_I2C::send(uint8_t value, bool dataMode) {
   write4bits((value & 0x0F), dataMode);
 }
 
+// Queue all four bus extender writes for the byte as a single TWI
+// write for the TWI interrupt to send
+bool LiquidCrystalSerial_I2C::sendQueued(uint8_t value, bool dataMode) {
+  uint8_t data[4];
+
+  data[1] = expanderBits((value >> 4), dataMode);
+  data[0] = data[1] | (1 << LCD_EN_PIN);
+  data[3] = expanderBits((value & 0x0F), dataMode);
+  data[2] = data[3] | (1 << LCD_EN_PIN);
+
+  return TWI_queue_write(LCD_I2C_DEVICE_ADDRESS << 1, data, 4);
+}
+
 // write4bits
 void LiquidCrystalSerial_I2C::write4bits(uint8_t value, bool dataMode) {
+  pulseEnable(expanderBits(value, dataMode));
+}
+
+// Map 4 bits of LCD data, the register select and the backlight
+// to the pins of the bus extender
+uint8_t LiquidCrystalSerial_I2C::expanderBits(uint8_t value, bool dataMode) {
   uint8_t bits = 0;
 
   // Map in the data bits
@@ -101,7 +120,7 @@ void LiquidCrystalSerial_I2C::write4bits(uint8_t value, bool dataMode) {
     bits |= (1 << LCD_BACKLIGHT_PIN);
 #endif
 
-  pulseEnable(bits);
+  return bits;
 }
 
 void LiquidCrystalSerial_I2C::pulseEnable(uint8_t data) {
@@ -62,9 +62,11 @@ public:
 
 private:
   void send(uint8_t, bool);
+  bool sendQueued(uint8_t value, bool dataMode);
   void writeSerial(uint8_t);
   void write4bits(uint8_t value, bool dataMode);
   void pulseEnable(uint8_t value);
+  uint8_t expanderBits(uint8_t value, bool dataMode);
 
   bool backlight_state;
 };
@@ -97,6 +97,10 @@ UtilitiesMenu                 utilityMenu;
 CoolingFanPwmScreen           coolingFanPwmScreen;
 #endif
 
+#if defined(HEATER_AUTOTUNE)
+HeaterAutotuneScreen          heaterAutotuneScreen;
+#endif
+
 #if defined(AUTO_LEVEL)
 MaxZDiffScreen                alevelZDiffScreen;
 #if defined(PSTOP_SUPPORT) && defined(PSTOP_ZMIN_LEVEL)
@@ -501,6 +505,7 @@ void NozzleCalibrationScreen::update(VirtualDisplay& lcd, bool forceRedraw) {
 			break;
 		}
 		lcd.writeFromPgmspace(msg);
+		lcd.flush(true);
 		_delay_us(500000);
 		Motherboard::interfaceBlinkOn();
 	}
@@ -599,11 +604,7 @@ void SelectAlignmentMenu::handleSelect(uint8_t index) {
 	//   it a second time, we would double update offsets[] and set the wrong value
 	//   the second time around.
 	int32_t offset = offsets[index] + stepperAxisMMToSteps((float)(counter[index] - 7) * 0.1f, index);
-	cli();
-	eeprom_write_block((uint8_t *)&offset,
-			   (uint8_t *)eeprom_offsets::TOOLHEAD_OFFSET_SETTINGS + index * sizeof(int32_t),
-			   sizeof(int32_t));
-	sei();
+	eeprom::setSetting(eeprom::SETTING_toolheadOffsetX + index, (uint32_t)offset);
 	lineUpdate = 1;
 }
 
@@ -760,6 +761,7 @@ void FilamentScreen::update(VirtualDisplay& lcd, bool forceRedraw) {
 			/// alert user to press M to stop extusion / reversal
 		case FILAMENT_STOP:
 			lcd.writeFromPgmspace(STOP_EXIT_MSG);
+			lcd.flush(true);
 			Motherboard::interfaceBlinkOn();
 			_delay_us(1000000);
 			break;
@@ -1870,19 +1872,19 @@ void PreheatSettingsMenu::handleSelect(uint8_t index) {
 		break;
 	case 1:
 		// store right tool setting
-		eeprom_write_word((uint16_t*)(eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_RIGHT_TEMP), counterRight);
+		eeprom::setSetting(eeprom::SETTING_preheatRightTemp, counterRight);
 		break;
 	case 2:
 		if ( !singleTool )
 			// store left tool setting
-			eeprom_write_word((uint16_t*)(eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_LEFT_TEMP), counterLeft);
+			eeprom::setSetting(eeprom::SETTING_preheatLeftTemp, counterLeft);
 		else if ( hasHBP )
-			eeprom_write_word((uint16_t*)(eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_PLATFORM_TEMP), counterPlatform);
+			eeprom::setSetting(eeprom::SETTING_preheatPlatformTemp, counterPlatform);
 		break;
 	case 3:
 		if ( !singleTool && hasHBP )
 			// store platform setting
-			eeprom_write_word((uint16_t*)(eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_PLATFORM_TEMP), counterPlatform);
+			eeprom::setSetting(eeprom::SETTING_preheatPlatformTemp, counterPlatform);
 		break;
 	}
 }
@@ -2060,10 +2062,10 @@ void ProfileSubMenu::handleSelect(uint8_t index) {
 		//Write out the home offsets
 		cli();
 		eeprom_write_block(homePosition, (void*)eeprom_offsets::AXIS_HOME_POSITIONS_STEPS, sizeof(uint32_t) * PROFILES_HOME_POSITIONS_STORED);
-		eeprom_write_word((uint16_t *)(eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_RIGHT_TEMP),    rightTemp);
-		eeprom_write_word((uint16_t *)(eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_LEFT_TEMP),     leftTemp);
-		eeprom_write_word((uint16_t *)(eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_PLATFORM_TEMP), hbpTemp);
 		sei();
+		eeprom::setSetting(eeprom::SETTING_preheatRightTemp,    rightTemp);
+		eeprom::setSetting(eeprom::SETTING_preheatLeftTemp,     leftTemp);
+		eeprom::setSetting(eeprom::SETTING_preheatPlatformTemp, hbpTemp);
 
 		interface::popScreen();
 		interface::popScreen();
@@ -2082,10 +2084,10 @@ void ProfileSubMenu::handleSelect(uint8_t index) {
 		//Get the home axis positions
 		cli();
 		eeprom_read_block((void *)homePosition,(void *)eeprom_offsets::AXIS_HOME_POSITIONS_STEPS, PROFILES_HOME_POSITIONS_STORED * sizeof(uint32_t));
-		rightTemp = eeprom_read_word((uint16_t *)(eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_RIGHT_TEMP));
-		leftTemp  = eeprom_read_word((uint16_t *)(eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_LEFT_TEMP));
-		hbpTemp   = eeprom_read_word((uint16_t *)(eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_PLATFORM_TEMP));
 		sei();
+		rightTemp = eeprom::settings.preheatRightTemp;
+		leftTemp  = eeprom::settings.preheatLeftTemp;
+		hbpTemp   = eeprom::settings.preheatPlatformTemp;
 
 		writeProfileToEeprom(profileIndex, NULL, homePosition, hbpTemp, rightTemp, leftTemp);
 
@@ -2380,6 +2382,7 @@ void HomeOffsetsModeScreen::reset() {
 	  offset = eeprom_offsets::TOOLHEAD_OFFSET_SETTINGS;
 	  msg = XYZTOOLHEAD_MSG;
      }
+     eeprom::flushSettings();
      cli();
      eeprom_read_block(homePosition, (void *)offset,
 		       PROFILES_HOME_POSITIONS_STORED * sizeof(uint32_t));
@@ -2451,12 +2454,17 @@ void HomeOffsetsModeScreen::notifyButtonPressed(ButtonArray::ButtonName button)
 		break;
 	case ButtonArray::CENTER:
 		if ( valueChanged ) {
-		     cli();
-		     eeprom_write_block(
-			  (void *)&homePosition[currentIndex],
-			  (void*)(offset + sizeof(uint32_t) * currentIndex),
-			  sizeof(uint32_t));
-		     sei();
+		     if ( offset == eeprom_offsets::TOOLHEAD_OFFSET_SETTINGS )
+			  eeprom::setSetting(eeprom::SETTING_toolheadOffsetX + currentIndex,
+					     homePosition[currentIndex]);
+		     else {
+			  cli();
+			  eeprom_write_block(
+			       (void *)&homePosition[currentIndex],
+			       (void*)(offset + sizeof(uint32_t) * currentIndex),
+			       sizeof(uint32_t));
+			  sei();
+		     }
 		}
 
 		if ( homeOffsetState == HOS_OFFSET_X )
@@ -2859,6 +2867,115 @@ void CoolingFanPwmScreen::notifyButtonPressed(ButtonArray::ButtonName button) {
 
 #endif
 
+#if defined(HEATER_AUTOTUNE)
+
+// Heaters are tuned at their preheat temperatures
+static int16_t autotuneTemp(uint8_t heater) {
+	if ( heater == 2 )
+		return eeprom::getEeprom16(eeprom_offsets::PREHEAT_SETTINGS + preheat_eeprom_offsets::PREHEAT_PLATFORM_TEMP, DEFAULT_PREHEAT_HBP);
+	return eeprom::getEeprom16(eeprom_offsets::PREHEAT_SETTINGS +
+				   (heater ? preheat_eeprom_offsets::PREHEAT_LEFT_TEMP : preheat_eeprom_offsets::PREHEAT_RIGHT_TEMP),
+				   DEFAULT_PREHEAT_TEMP);
+}
+
+void HeaterAutotuneScreen::reset() {
+	singleTool = eeprom::isSingleTool();
+	hasHBP = eeprom::hasHBP();
+
+	// show the heater being tuned, if any
+	const Autotune& tuner = Heater::get_autotune();
+	heater = tuner.isRunning() ? tuner.getId() : 0;
+}
+
+void HeaterAutotuneScreen::update(VirtualDisplay& lcd, bool forceRedraw) {
+	const Autotune& tuner = Heater::get_autotune();
+	uint8_t state = ( tuner.getId() == heater ) ? tuner.getState() : (uint8_t)Autotune::IDLE;
+
+	if ( forceRedraw || state != shownState ) {
+		const prog_uchar *msg;
+
+		shownState = state;
+		lcd.clearHomeCursor();
+		if ( heater == 2 ) msg = PLATFORM_MSG;
+		else if ( heater == 1 ) msg = LEFT_SPACES_MSG;
+		else msg = singleTool ? TOOL_MSG : RIGHT_SPACES_MSG;
+		lcd.writeFromPgmspace(msg);
+		lcd.moveWriteInt(16, 0, (state == Autotune::IDLE) ? autotuneTemp(heater) : tuner.getTarget(), 3);
+		lcd.write('C');
+
+		switch (state) {
+		default:
+			msg = AUTOTUNE_START_MSG;
+			break;
+		case Autotune::HEATING:
+			msg = HEATING_MSG;
+			break;
+		case Autotune::CYCLING:
+			msg = AUTOTUNE_CYCLE_MSG;
+			break;
+		case Autotune::DONE:
+			msg = AUTOTUNE_DONE_MSG;
+			break;
+		case Autotune::FAILED:
+			msg = AUTOTUNE_FAIL_MSG;
+			break;
+		}
+		lcd.moveWriteFromPgmspace(0, 1, msg);
+
+		if ( state == Autotune::DONE ) {
+			lcd.moveWriteFromPgmspace(0, 2, AUTOTUNE_GAINS_MSG);
+			lcd.writeFloat(tuner.p, 1, 6);
+			lcd.writeFloat(tuner.i, 3, 13);
+			lcd.writeFloat(tuner.d, 1, 20);
+		}
+
+		lcd.moveWriteFromPgmspace(0, 3, tuner.isRunning() ? FILAMENT_CANCEL_MSG : UPDNLM_MSG);
+	}
+
+	if ( state == Autotune::CYCLING ) {
+		uint8_t cycle = tuner.getCycle() + 1;
+		lcd.moveWriteInt(6, 1, (cycle > tuner.getCycles()) ? tuner.getCycles() : cycle, 2);
+		lcd.moveWriteInt(12, 1, tuner.getCycles(), 2);
+	}
+	if ( state == Autotune::HEATING || state == Autotune::CYCLING ) {
+		lcd.moveWriteInt(16, 1, Motherboard::getBoard().getHeater(heater).get_current_temperature(), 3);
+		lcd.write('C');
+	}
+}
+
+void HeaterAutotuneScreen::notifyButtonPressed(ButtonArray::ButtonName button) {
+	const Autotune& tuner = Heater::get_autotune();
+	int8_t step = 1;
+
+	switch (button) {
+	case ButtonArray::CENTER:
+		if ( !tuner.isRunning() )
+			Motherboard::getBoard().getHeater(heater).start_autotune(autotuneTemp(heater), 0, Autotune::TYREUS_LUYBEN);
+		return;
+	case ButtonArray::LEFT:
+		// cancel tuning, which turns the heater off
+		if ( tuner.isRunning() )
+			Motherboard::getBoard().getHeater(tuner.getId()).set_target_temperature(0);
+		interface::popScreen();
+		return;
+	case ButtonArray::UP:
+		step = 2;
+		// FALL THROUGH
+	case ButtonArray::DOWN:
+		if ( tuner.isRunning() )
+			return;
+		// step through the heaters this bot has
+		do {
+			heater = (heater + step) % 3;
+		} while ( (heater == 1 && singleTool) || (heater == 2 && !hasHBP) );
+		return;
+	default:
+		return;
+	}
+}
+
+#endif
+
 ActiveBuildMenu::ActiveBuildMenu() :
 	Menu(0, (uint8_t)0) {
 	reset();
@@ -3255,10 +3372,29 @@ void MainMenu::drawItem(uint8_t index, VirtualDisplay& lcd) {
 	case 3:
 		msg = UTILITIES_MSG;
 		break;
+#if defined(SD_RESUME)
+	case 4:
+		msg = RESUME_BUILD_MSG;
+		break;
+#endif
 	}
 	lcd.writeFromPgmspace(msg);
 }
 
+#if defined(SD_RESUME)
+void MainMenu::update(VirtualDisplay& lcd, bool forceRedraw) {
+	// Offer to resume a build from SD which lost power
+	uint8_t count = ( eeprom::getCheckpoint() &&
+			  host::getHostState() == host::HOST_STATE_READY ) ? 5 : 4;
+	if ( count != itemCount ) {
+		itemCount = count;
+		if ( itemIndex >= itemCount ) itemIndex = itemCount - 1;
+		forceRedraw = true;
+	}
+	Menu::update(lcd, forceRedraw);
+}
+#endif
+
 void MainMenu::handleSelect(uint8_t index) {
 	switch (index) {
 	case 1:
@@ -3273,6 +3409,13 @@ void MainMenu::handleSelect(uint8_t index) {
 		// home axes script
 		interface::pushScreen(&utilityMenu);
 		return;
+#if defined(SD_RESUME)
+	case 4:
+		// Resume the build from its checkpoint
+		if ( host::resumeBuildFromSD() != sdcard::SD_SUCCESS )
+			MenuBadness((sdcard::sdAvailable == sdcard::SD_ERR_CRC) ? CARDCRC_MSG : CARDOPENERR_MSG);
+		return;
+#endif
 	}
 }
 
@@ -3282,6 +3425,9 @@ UtilitiesMenu::UtilitiesMenu() :
 #if !defined(SINGLE_EXTRUDER)
 	     + 2
 #endif
+#if defined(HEATER_AUTOTUNE)
+	     + 1
+#endif
 #if defined(AUTO_LEVEL)
 	     + 1
 #if defined(PSTOP_SUPPORT) && defined(PSTOP_ZMIN_LEVEL)
@@ -3308,6 +3454,9 @@ void UtilitiesMenu::resetState() {
 #if defined(COOLING_FAN_PWM)
 	     1 +
 #endif
+#if defined(HEATER_AUTOTUNE)
+	     1 +
+#endif
 #if defined(EEPROM_MENU_ENABLE)
 	     1 +       
 #endif
@@ -3404,6 +3553,11 @@ void UtilitiesMenu::drawItem(uint8_t index, VirtualDisplay& lcd) {
 	lind++;
 #endif
 
+#if defined(HEATER_AUTOTUNE)
+	if ( index == lind ) msg = AUTOTUNE_MSG;
+	lind++;
+#endif
+
 	if ( index == lind ) msg = RESET_MSG;
 	lind++;
 
@@ -3555,6 +3709,13 @@ void UtilitiesMenu::handleSelect(uint8_t index) {
 	lind++;
 #endif
 
+#if defined(HEATER_AUTOTUNE)
+	if ( index == lind ) {
+	     interface::pushScreen(&heaterAutotuneScreen);
+	}
+	lind++;
+#endif
+
 	if ( index == lind ) {
 	     interface::pushScreen(&resetSettingsMenu);
 	}
@@ -3932,8 +4093,8 @@ void SettingsMenu::handleSelect(uint8_t index) {
 #ifdef DITTO_PRINT
 	if ( index == lind ) {
 	     if ( !singleExtruder ) {
-		  eeprom_write_byte((uint8_t*)eeprom_offsets::DITTO_PRINT_ENABLED,
-				    dittoPrintOn ? 1 : 0);
+		  eeprom::setSetting(eeprom::SETTING_dittoPrintEnabled,
+				     dittoPrintOn ? 1 : 0);
 		  flags = SETTINGS_COMMANDRST | SETTINGS_LINEUPDATE;
 	     }
 	}
@@ -3941,15 +4102,15 @@ void SettingsMenu::handleSelect(uint8_t index) {
 #endif
 
 	if ( index == lind ) {
-	     eeprom_write_byte((uint8_t *)eeprom_offsets::OVERRIDE_GCODE_TEMP,
-			       overrideGcodeTempOn ? 1 : 0);
+	     eeprom::setSetting(eeprom::SETTING_overrideGcodeTemp,
+				overrideGcodeTempOn ? 1 : 0);
 	     flags = SETTINGS_LINEUPDATE;
 	}
 	lind++;
 
 	if ( index == lind ) {
-	     eeprom_write_byte((uint8_t*)eeprom_offsets::HEAT_DURING_PAUSE,
-			       pauseHeatOn ? 1 : 0);
+	     eeprom::setSetting(eeprom::SETTING_heatDuringPause,
+				pauseHeatOn ? 1 : 0);
 	     flags = SETTINGS_LINEUPDATE;
 	}
 	lind++;
@@ -3979,7 +4140,7 @@ void SettingsMenu::handleSelect(uint8_t index) {
 	lind++;
 
 	if ( index == lind ) {
-	     eeprom_write_byte((uint8_t*)eeprom_offsets::HBP_PRESENT, hasHBP ? 1 : 0);
+	     eeprom::setSetting(eeprom::SETTING_hbpPresent, hasHBP ? 1 : 0);
 	     if ( !hasHBP )
 		  Motherboard::getBoard().getPlatformHeater().set_target_temperature(0);
 	     flags = SETTINGS_COMMANDRST | SETTINGS_LINEUPDATE;
@@ -3995,8 +4156,8 @@ void SettingsMenu::handleSelect(uint8_t index) {
 #endif
 
 	if ( index == lind ) {
-	     eeprom_write_byte((uint8_t*)eeprom_offsets::EXTRUDER_HOLD,
-			       extruderHoldOn ? 1 : 0);
+	     eeprom::setSetting(eeprom::SETTING_extruderHold,
+				extruderHoldOn ? 1 : 0);
 	     flags = SETTINGS_COMMANDRST | SETTINGS_LINEUPDATE;
 	}
 	lind++;
@@ -4050,23 +4211,14 @@ void SettingsMenu::handleSelect(uint8_t index) {
 	lineUpdate = flags & SETTINGS_LINEUPDATE ? 1 : 0;
 }
 
-//Returns true if the file is an s3g/x3g file
-//Keeping this in C instead of C++ saves 20 bytes
-
-bool isSXGFile(char *filename, uint8_t len) {
-	if ((len >= 4) &&
-	    (filename[len-4] == '.') &&
-	    ((filename[len-3] == 's') || (filename[len-3] == 'x') ||
-	     (filename[len-3] == 'S') || (filename[len-3] == 'X')) &&
-	    (filename[len-2] == '3') &&
-	    ((filename[len-1] == 'g') || (filename[len-1] == 'G'))) return true;
-	return false;
-}
-
 // Count the number of files on the SD card
 static uint8_t fileCount;
 
 uint8_t countFiles() {
+#if defined(SD_INDEX)
+	fileCount = sdcard::indexCount();
+	return fileCount;
+#else
 	fileCount = 0;
 
 	// First, reset the directory index
@@ -4087,15 +4239,25 @@ uint8_t countFiles() {
 		if ( isdir ) {
 			if ( fnbuf[0] != '.' || ( fnbuf[1] == '.' && fnbuf[2] == 0 ) ) fileCount++;
 		}
-		else if ( isSXGFile(fnbuf, flen) ) fileCount++;
+		else if ( sdcard::isJobFile(fnbuf, flen) ) fileCount++;
 	} while (true);
 
 	// Never reached
 	return fileCount;
+#endif
 }
 
 bool getFilename(uint8_t index, char buffer[], uint8_t buffer_size, uint8_t *buflen, bool *isdir) {
 
+#ifdef REVERSE_SD_FILES
+	// present files in reverse order in hopes this will show newer files first
+	// HOWEVER, with wrap around on the LCD menu, this isn't too useful
+	index = (fileCount - 1) - index;
+#endif
+
+#if defined(SD_INDEX)
+	return sdcard::indexEntry(index, buffer, buffer_size, buflen, isdir);
+#else
 	*buflen = 0;
 	*isdir = false;
 
@@ -4106,11 +4268,6 @@ bool getFilename(uint8_t index, char buffer[], uint8_t buffer_size, uint8_t *buf
 	uint8_t my_buflen = 0; // set to zero in case the for loop never runs
 	bool my_isdir;
 
-#ifdef REVERSE_SD_FILES
-	// present files in reverse order in hopes this will show newer files first
-	// HOWEVER, with wrap around on the LCD menu, this isn't too useful
-	index = (fileCount - 1) - index;
-#endif
 	for (uint8_t i = 0; i < index+1; i++) {
 		do {
 			sdcard::directoryNextEntry(buffer, buffer_size, &my_buflen, &my_isdir);
@@ -4121,7 +4278,7 @@ bool getFilename(uint8_t index, char buffer[], uint8_t buffer_size, uint8_t *buf
 				if ( buffer[0] != '.' || ( buffer[1] == '.' && buffer[2] == 0 ) )
 					break;
 			}
-			else if ( isSXGFile(buffer, my_buflen) )
+			else if ( sdcard::isJobFile(buffer, my_buflen) )
 				break;
 		} while (true);
 	}
@@ -4130,6 +4287,7 @@ bool getFilename(uint8_t index, char buffer[], uint8_t buffer_size, uint8_t *buf
 	*buflen = my_buflen;
 
 	return true;
+#endif
 }
 
 FinishedPrintMenu::FinishedPrintMenu() :
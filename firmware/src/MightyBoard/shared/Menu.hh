@@ -387,6 +387,26 @@ public:
 
 #endif
 
+#if defined(HEATER_AUTOTUNE)
+
+class HeaterAutotuneScreen: public Screen {
+
+private:
+	uint8_t heater;		///< heater to tune: 0 right, 1 left, 2 platform
+	uint8_t shownState;	///< Autotune::State last drawn
+
+public:
+	micros_t getUpdateRate() {return 500L * 1000L;}
+
+	void update(VirtualDisplay& lcd, bool forceRedraw);
+
+	void reset();
+
+	void notifyButtonPressed(ButtonArray::ButtonName button);
+};
+
+#endif
+
 class ActiveBuildMenu: public Menu {
 
 private:
@@ -887,6 +907,10 @@ public:
 
 	micros_t getUpdateRate() {return 200L * 1000L;}
 
+#if defined(SD_RESUME)
+	void update(VirtualDisplay& lcd, bool forceRedraw);
+#endif
+
 protected:
 	void drawItem(uint8_t index, VirtualDisplay& lcd);
 
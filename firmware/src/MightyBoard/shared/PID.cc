@@ -25,12 +25,28 @@
 #include <stdlib.h>
 #include "PID.hh"
 
-#define ERR_ACC_MAX 256
+#define ERR_ACC_MAX itok(256)
 #define ERR_ACC_MIN -ERR_ACC_MAX
 
 // scale the output term to account for our fixed-point bounds
 #define OUTPUT_SCALE 2
 
+// largest |p + i + d| whose scaled output still fits in an int
+#define OUTPUT_MAX itok(0x7fff / OUTPUT_SCALE)
+
+#if (DELTA_SAMPLES & (DELTA_SAMPLES - 1)) != 0
+#error DELTA_SAMPLES must be a power of two
+#endif
+
+// Saturating add; the terms are already saturated by mulkS()
+static _iAccum addkS(_iAccum a, _iAccum b) {
+	if ( b > 0 && a > AVRFIX_ACCUM_MAX - b )
+		return AVRFIX_ACCUM_MAX;
+	if ( b < 0 && a < AVRFIX_ACCUM_MIN - b )
+		return AVRFIX_ACCUM_MIN;
+	return a + b;
+}
+
 PID::PID() {
     reset();
 }
@@ -70,7 +86,7 @@ void PID::reset_state() {
 // the D term will immediately disappear.  By averaging the last N deltas, we
 // allow changes to be registered rather than get subsumed in the sampling noise.
 int PID::calculate(const float pv) {
-	float e = sp - pv;
+	_iAccum e = itok(sp) - ftok(pv);
 	error_acc += e;
 	// Clamp the error accumulator at accepted values.
 	// This will help control overcorrection for accumulated error during the run-up
@@ -80,23 +96,30 @@ int PID::calculate(const float pv) {
 		error_acc = ERR_ACC_MAX;
 	else if (error_acc < ERR_ACC_MIN)
 		error_acc = ERR_ACC_MIN;
-	float p_term = (float)e * p_gain;
-	float i_term = (float)error_acc * i_gain;
-	float delta = e - prev_error;
+	_iAccum p_term = mulkS(e, p_gain);
+	_iAccum i_term = mulkS(error_acc, i_gain);
+	_iAccum delta = e - prev_error;
 	// Add to delta history
 	delta_summation -= delta_history[delta_idx];
 	delta_history[delta_idx] = delta;
-	delta_summation += (float)delta;
-	delta_idx = (delta_idx+1) % DELTA_SAMPLES;
+	delta_summation += delta;
+	delta_idx = (delta_idx + 1) & (DELTA_SAMPLES - 1);
 	// Use the delta over the whole window
-	float d_term = delta_summation * d_gain;
+	_iAccum d_term = mulkS(delta_summation, d_gain);
 
 	prev_error = e;
 
+	_iAccum sum = addkS(addkS(p_term, i_term), d_term);
+	if (sum > OUTPUT_MAX)
+		sum = OUTPUT_MAX;
+	else if (sum < -OUTPUT_MAX)
+		sum = -OUTPUT_MAX;
+
 #if !defined(SUPPORT_GET_PID_STATE)
 	int last_output;
 #endif
-	last_output = ((int)(p_term + i_term + d_term))*OUTPUT_SCALE;
+	// Truncate towards zero as the (int) cast of the float version did
+	last_output = ((sum < 0) ? -ktoi(-sum) : ktoi(sum))*OUTPUT_SCALE;
 
 	return last_output;
 }
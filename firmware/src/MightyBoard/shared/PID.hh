@@ -25,25 +25,28 @@
 #define PID_HH_
 
 #include <stdint.h>
+#include "avrfix.h"
 
 /// Number of delta samples to
-#define DELTA_SAMPLES 4 // PID::reset_state() assumes 4.
+#define DELTA_SAMPLES 4 // PID::reset_state() assumes 4.  Must be a power of two.
 
 /// The PID controller module implements a simple PID controller.
+/// The loop runs in s15.16 fixed point (avrfix _iAccum) rather than float;
+/// gains are converted once when they are set.
 /// \ingroup SoftwareLibraries
 class PID {
 private:
-    float p_gain; ///< proportional gain
-    float i_gain; ///< integral gain
-    float d_gain; ///< derivative gain
+    _iAccum p_gain; ///< proportional gain
+    _iAccum i_gain; ///< integral gain
+    _iAccum d_gain; ///< derivative gain
 
     /// Data for approximating d (smoothing to handle discrete nature of sampling).
     /// See PID.cc for a description of why we do this.
-    float delta_history[DELTA_SAMPLES];
-    float delta_summation;      ///< ?
+    _iAccum delta_history[DELTA_SAMPLES];
+    _iAccum delta_summation;    ///< Sum of delta_history[]
     uint8_t delta_idx;          ///< Current index in the delta history buffer
-    float prev_error;             ///< Previous input for calculating next delta
-    float error_acc;              ///< Accumulated error, for calculating integral
+    _iAccum prev_error;           ///< Previous input for calculating next delta
+    _iAccum error_acc;            ///< Accumulated error, for calculating integral
 
     int sp;                     ///< Process set point
 
@@ -57,15 +60,15 @@ public:
 
     /// Set the P term of the PID controller
     /// \param[in] p_gain_in New proportional gain term
-    void setPGain(const float p_gain_in) { p_gain = p_gain_in; }
+    void setPGain(const float p_gain_in) { p_gain = ftok(p_gain_in); }
 
     /// Set the I term of the PID controller
     /// \param[in] i_gain_in New integration gain term
-    void setIGain(const float i_gain_in) { i_gain = i_gain_in; }
+    void setIGain(const float i_gain_in) { i_gain = ftok(i_gain_in); }
 
     /// Set the D term of the PID controller
     /// \param[in] d_gain_in New derivative gain term
-    void setDGain(const float d_gain_in) { d_gain = d_gain_in; }
+    void setDGain(const float d_gain_in) { d_gain = ftok(d_gain_in); }
 
     /// Set the setpoint of the PID controller
     /// \param[in] target New PID controller target
@@ -89,7 +92,7 @@ public:
 #if defined(SUPPORT_GET_PID_STATE)
     /// Get the current value of the error term
     /// \return Error term
-    int getErrorTerm() { return (int)error_acc; }
+    int getErrorTerm() { return ktoi(error_acc); }
 
     /// Get the last process output value
     /// \return Last process output value
@@ -97,7 +100,7 @@ public:
 
     /// Get the current value of the delta term
     /// \return Delta term
-    int getDeltaTerm() { return (int)delta_summation; }
+    int getDeltaTerm() { return ktoi(delta_summation); }
 #endif
 
 };
@@ -22,260 +22,185 @@
 #include <stdint.h>
 #include <avr/pgmspace.h>
 
-typedef struct {
-     int16_t adc;
-     int16_t value;
-} Entry;
-
-// TODO: Clean this up...
+// The tables hold temperatures in fixed point, with TEMP_FRAC_BITS fraction
+// bits, at readings spaced evenly from FIRST_ADC in steps of 1 << STEP_BITS.
+// A reading is converted with one indexed table read and an integer
+// interpolation; no search and no float divide.  The tables are made with
+// createTemperatureLookup.py --uniform, which keeps the breakpoint tables
+// they are resampled from.
 
-// Thermistor lookup table for RepRap Temperature Sensor Boards (http://make.rrrf.org/ts)
-// Made with createTemperatureLookup.py (http://svn.reprap.org/trunk/reprap/firmware/Arduino/utilities/createTemperatureLookup.py)
-// ./createTemperatureLookup.py --r0=100000 --t0=25 --r1=0 --r2=4700 --beta=4066 --max-adc=1023
-// r0: 100000
-// t0: 25
-// r1: 0
-// r2: 4700
-// beta: 4066
-// max adc: 1023
+#define TEMP_FRAC_BITS 4
 
 #if (BOARD_TYPE == BOARD_TYPE_MIGHTYBOARD_E)
 
-const static Entry table_hbp_thermistor[] PROGMEM = {
-     {   1, 841},
-     {  54, 255},
-     { 107, 209},
-     { 160, 184},
-     { 213, 166},
-     { 266, 153},
-     { 319, 142},
-     { 372, 132},
-     { 425, 124},
-     { 478, 116},
-     { 531, 108},
-     { 584, 101},
-     { 637,  93},
-     { 690,  86},
-     { 743,  78},
-     { 796,  70},
-     { 849,  61},
-     { 902,  50},
-     { 955,  34},
-     {1008,   3},
-     {1023,   0}
+// Made with ./createTemperatureLookup.py --uniform --table=hbp-e --name=hbp_thermistor --step-bits=3 --error-below=150
+// 129 entries, 8 ADC counts apart; worst error 0.44 C at ADC 955 (below 150 C)
+const static int16_t table_hbp_thermistor[] PROGMEM = {
+     13456, 12041, 10626,  9210,  7795,  6380,  4965,  4038,
+      3927,  3816,  3705,  3594,  3483,  3372,  3299,  3238,
+      3178,  3118,  3057,  2997,  2939,  2895,  2852,  2808,
+      2765,  2721,  2678,  2640,  2609,  2578,  2546,  2515,
+      2483,  2452,  2425,  2398,  2372,  2345,  2318,  2292,
+      2266,  2242,  2218,  2194,  2169,  2145,  2121,  2100,
+      2081,  2061,  2042,  2023,  2003,  1984,  1965,  1945,
+      1926,  1907,  1887,  1868,  1849,  1829,  1810,  1791,
+      1771,  1752,  1733,  1715,  1698,  1682,  1665,  1648,
+      1631,  1614,  1594,  1575,  1556,  1536,  1517,  1498,
+      1480,  1463,  1446,  1429,  1412,  1395,  1378,  1359,
+      1340,  1320,  1301,  1282,  1262,  1243,  1224,  1205,
+      1185,  1166,  1147,  1127,  1106,  1085,  1063,  1041,
+      1019,   998,   976,   949,   923,   896,   870,   843,
+       817,   786,   747,   708,   670,   631,   592,   554,
+       488,   413,   338,   263,   188,   114,    45,    19,
+        -6
 };
 
-#define HBP_THERMISTOR_NUM_TEMPS 21
+#define HBP_THERMISTOR_FIRST_ADC 1
+#define HBP_THERMISTOR_LAST_ADC 1023
+#define HBP_THERMISTOR_STEP_BITS 3
 
 #elif BOARD_TYPE == BOARD_TYPE_MIGHTYBOARD_G
 
-const static Entry table_hbp_thermistor[] PROGMEM = {
-     {   1, 916},
-     {  54, 265},
-     { 107, 216},
-     { 160, 189},
-     { 213, 171},
-     { 266, 157},
-     { 319, 135}, // Temps above 135 will be invalid
-     { 372, 127},
-     { 425, 119},
-     { 478, 112},
-     { 531, 104},
-     { 584,  98},
-     { 637,  91},
-     { 690,  84},
-     { 743,  77},
-     { 796,  68},
-     { 849,  58},
-     { 902,  48},
-     { 955,  34},
-     {1008,   2},
-     {1023,   0}
+// Temps above 135 are invalid
+// Made with ./createTemperatureLookup.py --uniform --table=hbp-g --name=hbp_thermistor --step-bits=3 --error-below=150
+// 129 entries, 8 ADC counts apart; worst error 0.56 C at ADC 955 (below 150 C)
+const static int16_t table_hbp_thermistor[] PROGMEM = {
+     14656, 13084, 11512,  9939,  8367,  6795,  5223,  4196,
+      4077,  3959,  3841,  3722,  3604,  3486,  3407,  3342,
+      3277,  3211,  3146,  3081,  3019,  2975,  2932,  2888,
+      2845,  2801,  2758,  2719,  2685,  2651,  2618,  2584,
+      2550,  2516,  2466,  2412,  2359,  2306,  2253,  2200,
+      2155,  2136,  2117,  2097,  2078,  2059,  2039,  2020,
+      2001,  1981,  1962,  1943,  1923,  1904,  1887,  1870,
+      1853,  1836,  1819,  1803,  1785,  1765,  1746,  1727,
+      1707,  1688,  1669,  1653,  1639,  1624,  1610,  1595,
+      1581,  1566,  1549,  1532,  1515,  1498,  1481,  1464,
+      1448,  1431,  1414,  1397,  1380,  1363,  1346,  1329,
+      1312,  1295,  1278,  1262,  1245,  1227,  1205,  1183,
+      1161,  1140,  1118,  1096,  1073,  1049,  1025,  1000,
+       976,   952,   928,   904,   880,   856,   831,   807,
+       783,   755,   722,   688,   654,   620,   586,   552,
+       486,   409,   331,   254,   177,   100,    30,    13,
+        -4
 };
 
-#define HBP_THERMISTOR_NUM_TEMPS 21
+#define HBP_THERMISTOR_FIRST_ADC 1
+#define HBP_THERMISTOR_LAST_ADC 1023
+#define HBP_THERMISTOR_STEP_BITS 3
 
 #else
 
 // Epcos 100K
-const static Entry table_ext_thermistor[] PROGMEM = {
-     {  23 * TEMP_OVERSAMPLE, 300 },
-     {  25 * TEMP_OVERSAMPLE, 295 },
-     {  27 * TEMP_OVERSAMPLE, 290 },
-     {  28 * TEMP_OVERSAMPLE, 285 },
-     {  31 * TEMP_OVERSAMPLE, 280 },
-     {  33 * TEMP_OVERSAMPLE, 275 },
-     {  35 * TEMP_OVERSAMPLE, 270 },
-     {  38 * TEMP_OVERSAMPLE, 265 },
-     {  41 * TEMP_OVERSAMPLE, 260 },
-     {  44 * TEMP_OVERSAMPLE, 255 },
-     {  48 * TEMP_OVERSAMPLE, 250 },
-     {  52 * TEMP_OVERSAMPLE, 245 },
-     {  56 * TEMP_OVERSAMPLE, 240 },
-     {  61 * TEMP_OVERSAMPLE, 235 },
-     {  66 * TEMP_OVERSAMPLE, 230 },
-     {  71 * TEMP_OVERSAMPLE, 225 },
-     {  78 * TEMP_OVERSAMPLE, 220 },
-     {  84 * TEMP_OVERSAMPLE, 215 },
-     {  92 * TEMP_OVERSAMPLE, 210 },
-     { 100 * TEMP_OVERSAMPLE, 205 },
-     { 109 * TEMP_OVERSAMPLE, 200 },
-     { 120 * TEMP_OVERSAMPLE, 195 },
-     { 131 * TEMP_OVERSAMPLE, 190 },
-     { 143 * TEMP_OVERSAMPLE, 185 },
-     { 156 * TEMP_OVERSAMPLE, 180 },
-     { 171 * TEMP_OVERSAMPLE, 175 },
-     { 187 * TEMP_OVERSAMPLE, 170 },
-     { 205 * TEMP_OVERSAMPLE, 165 },
-     { 224 * TEMP_OVERSAMPLE, 160 },
-     { 245 * TEMP_OVERSAMPLE, 155 },
-     { 268 * TEMP_OVERSAMPLE, 150 },
-     { 293 * TEMP_OVERSAMPLE, 145 },
-     { 320 * TEMP_OVERSAMPLE, 140 },
-     { 348 * TEMP_OVERSAMPLE, 135 },
-     { 379 * TEMP_OVERSAMPLE, 130 },
-     { 411 * TEMP_OVERSAMPLE, 125 },
-     { 445 * TEMP_OVERSAMPLE, 120 },
-     { 480 * TEMP_OVERSAMPLE, 115 },
-     { 516 * TEMP_OVERSAMPLE, 110 },
-     { 553 * TEMP_OVERSAMPLE, 105 },
-     { 591 * TEMP_OVERSAMPLE, 100 },
-     { 628 * TEMP_OVERSAMPLE,  95 },
-     { 665 * TEMP_OVERSAMPLE,  90 },
-     { 702 * TEMP_OVERSAMPLE,  85 },
-     { 737 * TEMP_OVERSAMPLE,  80 },
-     { 770 * TEMP_OVERSAMPLE,  75 },
-     { 801 * TEMP_OVERSAMPLE,  70 },
-     { 830 * TEMP_OVERSAMPLE,  65 },
-     { 857 * TEMP_OVERSAMPLE,  60 },
-     { 881 * TEMP_OVERSAMPLE,  55 },
-     { 903 * TEMP_OVERSAMPLE,  50 },
-     { 922 * TEMP_OVERSAMPLE,  45 },
-     { 939 * TEMP_OVERSAMPLE,  40 },
-     { 954 * TEMP_OVERSAMPLE,  35 },
-     { 966 * TEMP_OVERSAMPLE,  30 },
-     { 977 * TEMP_OVERSAMPLE,  25 },
-     { 985 * TEMP_OVERSAMPLE,  20 },
-     { 993 * TEMP_OVERSAMPLE,  15 },
-     { 999 * TEMP_OVERSAMPLE,  10 },
-     {1004 * TEMP_OVERSAMPLE,   5 },
-     {1008 * TEMP_OVERSAMPLE,   0 }
+// Made with ./createTemperatureLookup.py --uniform --table=epcos-100k --oversample=8 --name=ext_thermistor --step-bits=5 --error-below=260
+// 248 entries, 32 ADC counts apart; worst error 0.31 C at ADC 352 (below 260 C)
+const static int16_t table_ext_thermistor[] PROGMEM = {
+      4800,  4640,  4480,  4320,  4213,  4107,  4020,  3940,
+      3860,  3792,  3728,  3664,  3600,  3554,  3507,  3453,
+      3410,  3370,  3330,  3290,  3253,  3218,  3185,  3156,
+      3127,  3098,  3069,  3040,  3013,  2987,  2960,  2935,
+      2911,  2886,  2864,  2843,  2821,  2800,  2780,  2760,
+      2740,  2720,  2702,  2684,  2667,  2649,  2632,  2615,
+      2598,  2581,  2564,  2549,  2533,  2518,  2503,  2488,
+      2473,  2459,  2445,  2431,  2417,  2403,  2390,  2378,
+      2365,  2352,  2339,  2326,  2314,  2302,  2290,  2279,
+      2267,  2255,  2243,  2231,  2220,  2209,  2197,  2186,
+      2174,  2163,  2152,  2142,  2132,  2121,  2111,  2101,
+      2090,  2080,  2070,  2060,  2050,  2040,  2030,  2020,
+      2010,  2000,  1991,  1981,  1972,  1962,  1953,  1944,
+      1934,  1925,  1915,  1906,  1897,  1888,  1879,  1870,
+      1861,  1851,  1842,  1833,  1824,  1816,  1807,  1798,
+      1789,  1780,  1771,  1762,  1754,  1745,  1736,  1728,
+      1719,  1710,  1702,  1693,  1684,  1676,  1667,  1659,
+      1651,  1642,  1634,  1625,  1617,  1608,  1600,  1591,
+      1583,  1574,  1565,  1557,  1548,  1539,  1531,  1522,
+      1514,  1505,  1496,  1488,  1479,  1470,  1462,  1453,
+      1444,  1436,  1427,  1418,  1410,  1401,  1392,  1384,
+      1375,  1366,  1358,  1349,  1339,  1330,  1321,  1312,
+      1303,  1294,  1285,  1275,  1265,  1256,  1246,  1236,
+      1227,  1217,  1207,  1197,  1187,  1177,  1166,  1156,
+      1146,  1135,  1125,  1114,  1103,  1092,  1081,  1070,
+      1059,  1048,  1037,  1025,  1013,  1001,   990,   978,
+       966,   953,   940,   927,   913,   900,   887,   873,
+       858,   844,   829,   815,   800,   783,   766,   749,
+       733,   715,   696,   678,   659,   640,   619,   597,
+       576,   553,   527,   500,   473,   444,   415,   380,
+       340,   300,   260,   213,   160,    96,    20,   -60
 };
 
-#define EXT_THERMISTOR_NUM_TEMPS 61
+#define EXT_THERMISTOR_FIRST_ADC 184
+#define EXT_THERMISTOR_LAST_ADC 8064
+#define EXT_THERMISTOR_STEP_BITS 5
 
 // For the time being, assume Epcos 100K for the heater bed as well
 
 #define table_hbp_thermistor table_ext_thermistor
-#define HBP_THERMISTOR_NUM_TEMPS EXT_THERMISTOR_NUM_TEMPS
-
-#endif
+#define HBP_THERMISTOR_FIRST_ADC EXT_THERMISTOR_FIRST_ADC
+#define HBP_THERMISTOR_LAST_ADC EXT_THERMISTOR_LAST_ADC
+#define HBP_THERMISTOR_STEP_BITS EXT_THERMISTOR_STEP_BITS
 
-// Convert from scaled mV to Celsius (32767 adc-counts/256 mV)
-
-const static Entry table_thermocouple_k[] PROGMEM = {
-     {-304, -64},
-     {-232, -48},
-     {-157, -32},
-     {-79, -16},
-     {0, 0},
-     {82, 16},
-     {164, 32},
-     {248, 48},
-     {333, 64},
-     {418, 80},
-     {503, 96},
-     {588, 112},
-     {672, 128},
-     {755, 144},
-     {837, 160},
-     {919, 176},
-     {1001, 192},
-     {1083, 208},
-     {1165, 224},
-     {1248, 240},
-     {1331, 256},
-     {1415, 272},
-     {1499, 288},
-     {1584, 304},
-     {1754, 336},
-#if 0 // cut table off at 336C
-     {1840, 352},
-     {1926, 368},
-     {2012, 384},
-     {2099, 400},
-//#define THERMOCOUPLE_NUM_TEMPS 29
 #endif
 
+// Convert from scaled mV to Celsius (32767 adc-counts/256 mV), cut off at 336C
+
+// Made with ./createTemperatureLookup.py --uniform --table=thermocouple-k --name=thermocouple_k --step-bits=5
+// 66 entries, 32 ADC counts apart; worst error 0.11 C at ADC -1
+const static int16_t table_thermocouple_k[] PROGMEM = {
+     -1024,  -910,  -796,  -686,  -577,  -469,  -364,  -259,
+      -156,   -52,    50,   150,   250,   350,   450,   549,
+       646,   744,   840,   937,  1033,  1129,  1226,  1322,
+      1419,  1515,  1611,  1708,  1804,  1902,  1999,  2097,
+      2196,  2295,  2395,  2494,  2594,  2694,  2794,  2894,
+      2994,  3094,  3194,  3294,  3394,  3493,  3593,  3692,
+      3791,  3889,  3988,  4087,  4184,  4282,  4379,  4477,
+      4574,  4671,  4768,  4864,  4960,  5057,  5153,  5250,
+      5346,  5442
 };
 
-#define THERMOCOUPLE_K_NUM_TEMPS 25
+#define THERMOCOUPLE_K_FIRST_ADC -304
+#define THERMOCOUPLE_K_LAST_ADC 1754
+#define THERMOCOUPLE_K_STEP_BITS 5
 
-static uint8_t num_temps[] = {
-     THERMOCOUPLE_K_NUM_TEMPS - 1,
-     HBP_THERMISTOR_NUM_TEMPS - 1,
+typedef struct {
+     const int16_t *temps;  ///< PROGMEM table
+     int16_t first_adc;     ///< reading of temps[0]
+     int16_t last_adc;      ///< highest reading in range
+     uint8_t step_bits;     ///< log2 of the readings between entries
+} Table;
+
+static const Table tables[] = {
+     { table_thermocouple_k, THERMOCOUPLE_K_FIRST_ADC, THERMOCOUPLE_K_LAST_ADC, THERMOCOUPLE_K_STEP_BITS },
+     { table_hbp_thermistor, HBP_THERMISTOR_FIRST_ADC, HBP_THERMISTOR_LAST_ADC, HBP_THERMISTOR_STEP_BITS },
 #if BOARD_TYPE == BOARD_TYPE_AZTEEG_X3
-     EXT_THERMISTOR_NUM_TEMPS - 1
+     { table_ext_thermistor, EXT_THERMISTOR_FIRST_ADC, EXT_THERMISTOR_LAST_ADC, EXT_THERMISTOR_STEP_BITS }
 #endif
 };
 
 namespace TemperatureTable {
 
-/// get value from lookup tables stored in progmem
-///
-/// @param[in] entryIdx table entry offset to read
-/// @param[in] table_id  which table to read (valid values defined by therm_table struct)
-/// @return  table Entry, a pair of the format (adc_read, temperature)
-inline void getEntry(Entry *rv, uint8_t entryIdx, uint8_t table_id) {
-     if ( table_id == TABLE_THERMOCOUPLE_K )
-	  memcpy_PF(rv, (uint_farptr_t)&(table_thermocouple_k[entryIdx]), sizeof(Entry));
-#if BOARD_TYPE == BOARD_TYPE_AZTEEG_X3
-     else if ( table_id == TABLE_EXT_THERMISTOR )
-	  memcpy_PF(rv, (uint_farptr_t)&(table_ext_thermistor[entryIdx]), sizeof(Entry));
-#endif
-     else
-	  memcpy_PF(rv, (uint_farptr_t)&(table_hbp_thermistor[entryIdx]), sizeof(Entry));
-}
-
 /// Translate a temperature reading into degrees Celcius, using the provided lookup table.
 /// @param[in] reading Thermistor/Thermocouple voltage reading, in ADC counts
 /// @param[in] table_idx therm_tables index of the temperature lookup table
 /// @param[in] max_allowed_value default temperature if reading is outside of lookup table
 /// @return Temperature reading, in degrees Celcius
 float TempReadtoCelsius(int16_t reading, uint8_t table_idx, float max_allowed_value) {
-     uint8_t bottom = 0;
-     uint8_t numtemps = num_temps[table_idx];
-     uint8_t top = numtemps;
-     uint8_t mid = (bottom + top) >> 1;
-     Entry e;
-     while (mid > bottom) {
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Winline"
-	  getEntry(&e, mid, table_idx);
-	  if (reading < e.adc) {
-	       top = mid;
-	       mid = (bottom + top) >> 1;
-	  } else {
-	       bottom = mid;
-	       mid = (bottom + top) >> 1;
-	  }
-     }
-     Entry eb, et;
-     getEntry(&eb, bottom, table_idx);
-     getEntry(&et, top,    table_idx);
-#pragma GCC diagnostic pop
-     if (bottom == 0 && reading < eb.adc) {
-	  // out of scale; safety mode
-	  return max_allowed_value;
-     }
-     if (top == numtemps && reading > et.adc) {
+     const Table *table = &tables[table_idx];
+     if (reading < table->first_adc || reading > table->last_adc) {
 	  // out of scale; safety mode
 	  return max_allowed_value;
      }
 
+     uint16_t offset = (uint16_t)(reading - table->first_adc);
+     uint8_t step_bits = table->step_bits;
+     uint16_t idx = offset >> step_bits;
+     int16_t frac = offset & ((1 << step_bits) - 1);
+
+     // the tables always hold the entry after the one for last_adc
+     int16_t e[2];
+     memcpy_PF(e, (uint_farptr_t)&(table->temps[idx]), sizeof(e));
+
      // Interpolate
-     return (float)eb.value + (float)((reading - eb.adc) * (et.value - eb.value)) /
-	  (float)(et.adc - eb.adc);
+     int16_t temp = e[0] + (int16_t)(((int32_t)(e[1] - e[0]) * frac) >> step_bits);
+     return (float)temp * (1.0 / (1 << TEMP_FRAC_BITS));
 }
 
 }
@@ -23,8 +23,26 @@
 
 
 
+#include <util/atomic.h>
 #include "Thermocouple.hh"
+#include "Configuration.hh"
 
+#ifdef MAX31855
+#define THERMOCOUPLE_BITS 32
+#define THERMOCOUPLE_CONVERSION_TICKS 1000  // 100 ms conversion time
+#else
+#define THERMOCOUPLE_BITS 16
+#define THERMOCOUPLE_CONVERSION_TICKS 2200  // 220 ms conversion time
+#endif
+
+// Timer ticks (100 us) between background reads.  Two thermocouples take
+// turns, so each one is read about once per sample interval, and never
+// faster than its converter can finish a conversion: a read aborts the
+// conversion in progress.
+#define THERMOCOUPLE_INTERVAL_TICKS ((uint16_t)(SAMPLE_INTERVAL_MICROS_THERMOCOUPLE / 200L) - 100)
+#define THERMOCOUPLE_SAMPLE_TICKS \
+	( THERMOCOUPLE_INTERVAL_TICKS > THERMOCOUPLE_CONVERSION_TICKS ? \
+	  THERMOCOUPLE_INTERVAL_TICKS : THERMOCOUPLE_CONVERSION_TICKS )
 
 // We'll throw in nops to get the timing right (if necessary)
 inline void nop() {
@@ -35,51 +53,110 @@ inline void nop() {
         asm volatile("nop"::);
 }
 
+Thermocouple *Thermocouple::first = 0;
+
+// Background read state, owned by sampleTick()
+static Thermocouple *reading = 0;     // thermocouple being clocked, or 0 when between reads
+static Thermocouple *last_read = 0;   // where to continue the rotation
+static thermocouple_raw_t shift_in;
+static uint8_t shift_bits;
+static uint16_t sample_delay;
+
 
 Thermocouple::Thermocouple(const Pin& cs,const Pin& sck,const Pin& so) :
         cs_pin(cs),
         sck_pin(sck),
-        so_pin(so)
+        so_pin(so),
+        next(first),
+        ready(false),
+        sample_count(0),
+        used_count(0)
 {
+	first = this;
 }
 
 void Thermocouple::init() {
-	cs_pin.setDirection(true);
-	sck_pin.setDirection(true);
-	so_pin.setDirection(false);
-	cs_pin.setValue(true);   // Clock select is active low
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		// abandon a read of ours which is in progress
+		if ( reading == this )
+			reading = 0;
+		cs_pin.setDirection(true);
+		sck_pin.setDirection(true);
+		so_pin.setDirection(false);
+		cs_pin.setValue(true);   // Clock select is active low
+		used_count = sample_count;
+		ready = true;
+	}
 	current_temp = 0;
 }
 
-#ifndef MAX31855
+/*
+ * Background reader, called from the 10 kHz timer interrupt.  Each call
+ * clocks one bit from the thermocouple being read, so a read costs a few
+ * microseconds per tick instead of blocking the main loop.  Reads go on
+ * whether or not update() took the last one, into the slot of samples[]
+ * which doesn't hold the newest, so update() always finds a fresh read.
+ * Overwriting the slot update() may be reading takes a second read, a
+ * whole sample interval later.
+ */
+void Thermocouple::sampleTick() {
+	if ( !reading ) {
+		if ( sample_delay ) {
+			sample_delay--;
+			return;
+		}
+
+		// next thermocouple in the rotation which wants a read
+		Thermocouple *start = ( last_read && last_read->next ) ? last_read->next : first;
+		Thermocouple *tc = start;
+		while ( tc ) {
+			if ( tc->ready ) {
+				reading = last_read = tc;
+				break;
+			}
+			tc = tc->next ? tc->next : first;
+			if ( tc == start )
+				return;
+		}
+		if ( !reading )
+			return;
+
+		reading->sck_pin.setValue(false);
+		reading->cs_pin.setValue(false);
+		shift_in = 0;
+		shift_bits = THERMOCOUPLE_BITS;
+		return;
+	}
 
-Thermocouple::SensorState Thermocouple::update() {
-	cs_pin.setValue(false);
+	reading->sck_pin.setValue(false);
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Winline"
 	nop();
 #pragma GCC diagnostic pop
+	shift_in <<= 1;
+	if ( reading->so_pin.getValue() )
+		shift_in |= 1;
+	reading->sck_pin.setValue(true);
+
+	if ( --shift_bits == 0 ) {
+		reading->cs_pin.setValue(true);
+		uint8_t count = reading->sample_count;
+		reading->samples[count & 1] = shift_in;
+		reading->sample_count = count + 1;
+		reading = 0;
+		sample_delay = THERMOCOUPLE_SAMPLE_TICKS;
+	}
+}
 
-	uint16_t raw  = 0;
-	for (int8_t i = 15; i >= 0; i--)
-	{
-		sck_pin.setValue(false);
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Winline"
-		nop();
-#pragma GCC diagnostic ignored "-Winline"
-
-		if ( so_pin.getValue() )
-			raw |= (1 << i);
+#ifndef MAX31855
 
-		sck_pin.setValue(true);
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Winline"
-		nop();
-#pragma GCC diagnostic ignored "-Winline"
-	}
+Thermocouple::SensorState Thermocouple::update() {
+	uint8_t count = sample_count;
+	if ( count == used_count )
+		return SS_ADC_WAITING;
 
-	cs_pin.setValue(true);
+	uint16_t raw = samples[(uint8_t)(count - 1) & 1];
+	used_count = count;
 
 	if ( raw & 0x04 ) {
 		// Set the temperature to 1024 as an error condition
@@ -95,35 +172,12 @@ Thermocouple::SensorState Thermocouple::update() {
 #else
 
 Thermocouple::SensorState Thermocouple::update() {
+	uint8_t count = sample_count;
+	if ( count == used_count )
+		return SS_ADC_WAITING;
 
-	// TODO: Check timing against datasheet.
-#pragma GCC diagnostic push
-	sck_pin.setValue(false);
-#pragma GCC diagnostic ignored "-Winline"
-	nop();
-	cs_pin.setValue(false);
-#pragma GCC diagnostic ignored "-Winline"
-	nop();
-#pragma GCC diagnostic pop
-
-	uint32_t raw = 0;
-	for (uint8_t i = 0; i < 32; i++) {
-		sck_pin.setValue(false);
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Winline"
-		nop();
-#pragma GCC diagnostic pop
-		raw <<= 1;
-		if ( so_pin.getValue() ) 
-			raw |= 1;
-		sck_pin.setValue(true);
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Winline"
-		nop();
-#pragma GCC diagnostic pop
-	}
-
-	cs_pin.setValue(true);
+	uint32_t raw = samples[(uint8_t)(count - 1) & 1];
+	used_count = count;
 
 	// Evaluate the results
 
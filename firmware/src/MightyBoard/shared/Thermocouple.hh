@@ -21,14 +21,30 @@
 #include "TemperatureSensor.hh"
 #include "Pin.hh"
 
+#ifdef MAX31855
+typedef uint32_t thermocouple_raw_t;
+#else
+typedef uint16_t thermocouple_raw_t;
+#endif
+
 /// The thermocouple module provides a bitbanging driver that can read the
 /// temperature from (chip name) sensor, and also report on any error conditions.
+/// All thermocouples are read in turn by sampleTick(), one bit per call of the
+/// 10 kHz timer interrupt; update() only converts the last completed read.
 /// \ingroup SoftwareLibraries
 class Thermocouple : public TemperatureSensor {
 private:
         Pin cs_pin;  ///< Chip select pin (output)
         Pin sck_pin; ///< Clock pin (output)
         Pin so_pin;  ///< Data pin (input)
+
+        Thermocouple *next;                       ///< Next thermocouple read by sampleTick()
+        volatile bool ready;                      ///< Set once init() has configured the pins
+        volatile thermocouple_raw_t samples[2];   ///< Completed reads, written alternately by sampleTick()
+        volatile uint8_t sample_count;            ///< Reads completed; the newest is samples[(sample_count - 1) & 1]
+        volatile uint8_t used_count;              ///< sample_count when update() last took a read
+
+        static Thermocouple *first;               ///< Head of the list walked by sampleTick()
 public:
         /// Create a new thermocouple instance, and attach it to the given pins.
         /// \param [in] cs Chip Select (output).
@@ -39,5 +55,9 @@ public:
 	void init();
 
 	SensorState update();
+
+        /// Clock one bit of the background read.  Called from the 10 kHz
+        /// timer interrupt.
+        static void sampleTick();
 };
 #endif // THERMOCOUPLE_HH_
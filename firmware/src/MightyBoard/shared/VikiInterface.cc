@@ -164,8 +164,36 @@ void VikiInterface::send(uint8_t value, bool dataMode) {
   write4bits((value & 0x0F), dataMode);
 }
 
+// Queue the four port B writes for the byte for the TWI interrupt to
+// send.  Each is its own TWI write as the MCP23017 moves on to the next
+// register after each byte written.
+bool VikiInterface::sendQueued(uint8_t value, bool dataMode) {
+  // 4 writes of the device address, length, register and value
+  if (TWI_queue_space() < 16)
+    return false;
+
+  uint8_t data[2];
+  data[0] = MCP23017_GPIOB;
+  for (uint8_t i = 0; i < 2; i++) {
+    uint8_t bits = expanderBits(i ? (value & 0x0F) : (value >> 4), dataMode) |
+                   (expander_bits[1] & (1 << (B_HBP_LED_PIN)));
+    data[1] = bits | (1 << B_LCD_EN_PIN);
+    TWI_queue_write(VIKI_I2C_DEVICE_ADDRESS << 1, data, 2);
+    data[1] = bits;
+    TWI_queue_write(VIKI_I2C_DEVICE_ADDRESS << 1, data, 2);
+  }
+
+  return true;
+}
+
 // write4bits
 void VikiInterface::write4bits(uint8_t value, bool dataMode) {
+  pulseEnable(expanderBits(value, dataMode));
+}
+
+// Map 4 bits of LCD data and the register select to the pins of
+// the expander's port B
+uint8_t VikiInterface::expanderBits(uint8_t value, bool dataMode) {
   uint8_t bits = 0;
 
   // Map in the data bits
@@ -182,7 +210,7 @@ void VikiInterface::write4bits(uint8_t value, bool dataMode) {
   if (dataMode)
     bits |= (1 << B_LCD_RS_PIN);
 
-  pulseEnable(bits);
+  return bits;
 }
 
 void VikiInterface::pulseEnable(uint8_t data) {
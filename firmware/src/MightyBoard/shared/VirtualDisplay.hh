@@ -102,6 +102,11 @@ public:
   virtual void setCursorExt(int8_t col, int8_t row) = 0;
 
   virtual void write(uint8_t) = 0;
+
+  // Displays which buffer what is written send it to the hardware here.
+  // Called from the main loop, so should only send a little at a time
+  // unless "all" is true.
+  virtual void flush(bool all = false) {}
 };
 
 #endif // VIRTUAL_DISPLAY_HH
@@ -340,6 +340,23 @@ const PROGMEM prog_uchar MACHINE_ID_REP2X_MSG[] = "Rep2X";
 const PROGMEM prog_uchar COOLING_FAN_PWM_MSG[] = "Cooling Fan Power";
 #endif
 
+#if defined(HEATER_AUTOTUNE)
+const PROGMEM prog_uchar AUTOTUNE_MSG[]       = "Heizung PID-Tuning";
+const PROGMEM prog_uchar AUTOTUNE_START_MSG[] = "Mitte zum Starten";
+const PROGMEM prog_uchar AUTOTUNE_CYCLE_MSG[] = "Zyklus   von";
+const PROGMEM prog_uchar AUTOTUNE_DONE_MSG[]  = "PID gespeichert";
+const PROGMEM prog_uchar AUTOTUNE_FAIL_MSG[]  = "Tuning gescheitert";
+const PROGMEM prog_uchar AUTOTUNE_GAINS_MSG[] = "P      I      D";
+#endif
+
+#if defined(SD_RESUME)
+const PROGMEM prog_uchar RESUME_BUILD_MSG[]   = "Druck fortsetzen";
+#endif
+
+#if defined(SD_PREFLIGHT)
+const PROGMEM prog_uchar CARDFILE_MSG[]       = "Druckdatei ist      " "beschaedigt oder    " "unvollstaendig";
+#endif
+
 #if BOARD_TYPE == BOARD_TYPE_AZTEEG_X3
 const PROGMEM prog_uchar RIGHT_THERMISTOR_MSG[]    = "Right thermistr";
 const PROGMEM prog_uchar LEFT_THERMISTOR_MSG[]     = "Left thermistor";
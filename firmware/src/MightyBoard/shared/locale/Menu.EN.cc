@@ -303,6 +303,23 @@ const PROGMEM prog_uchar MACHINE_ID_REP2X_MSG[] = "Rep2X";
 const PROGMEM prog_uchar COOLING_FAN_PWM_MSG[] = "Cooling Fan Power";
 #endif
 
+#if defined(HEATER_AUTOTUNE)
+const PROGMEM prog_uchar AUTOTUNE_MSG[]       = "Tune Heater PID";
+const PROGMEM prog_uchar AUTOTUNE_START_MSG[] = "Center to tune";
+const PROGMEM prog_uchar AUTOTUNE_CYCLE_MSG[] = "Cycle    of";
+const PROGMEM prog_uchar AUTOTUNE_DONE_MSG[]  = "New PID saved";
+const PROGMEM prog_uchar AUTOTUNE_FAIL_MSG[]  = "Tuning failed";
+const PROGMEM prog_uchar AUTOTUNE_GAINS_MSG[] = "P      I      D";
+#endif
+
+#if defined(SD_RESUME)
+const PROGMEM prog_uchar RESUME_BUILD_MSG[]   = "Resume Print";
+#endif
+
+#if defined(SD_PREFLIGHT)
+const PROGMEM prog_uchar CARDFILE_MSG[]       = "The build file is   " "damaged or cut short";
+#endif
+
 #if BOARD_TYPE == BOARD_TYPE_AZTEEG_X3
 const PROGMEM prog_uchar RIGHT_THERMISTOR_MSG[]    = "Right thermistr";
 const PROGMEM prog_uchar LEFT_THERMISTOR_MSG[]     = "Left thermistor";
@@ -294,6 +294,23 @@ const PROGMEM prog_uchar MACHINE_ID_REP2X_MSG[] = "Rep2X";
 const PROGMEM prog_uchar COOLING_FAN_PWM_MSG[] = "Cooling Fan Power";
 #endif
 
+#if defined(HEATER_AUTOTUNE)
+const PROGMEM prog_uchar AUTOTUNE_MSG[]       = "Reglage PID chauffe";
+const PROGMEM prog_uchar AUTOTUNE_START_MSG[] = "Centre pour lancer";
+const PROGMEM prog_uchar AUTOTUNE_CYCLE_MSG[] = "Cycle    de";
+const PROGMEM prog_uchar AUTOTUNE_DONE_MSG[]  = "PID enregistre";
+const PROGMEM prog_uchar AUTOTUNE_FAIL_MSG[]  = "Echec du reglage";
+const PROGMEM prog_uchar AUTOTUNE_GAINS_MSG[] = "P      I      D";
+#endif
+
+#if defined(SD_RESUME)
+const PROGMEM prog_uchar RESUME_BUILD_MSG[]   = "Reprendre impression";
+#endif
+
+#if defined(SD_PREFLIGHT)
+const PROGMEM prog_uchar CARDFILE_MSG[]       = "Fichier a imprimer  " "endommage ou tronque";
+#endif
+
 #if BOARD_TYPE == BOARD_TYPE_AZTEEG_X3
 const PROGMEM prog_uchar RIGHT_THERMISTOR_MSG[]    = "Right thermistr";
 const PROGMEM prog_uchar LEFT_THERMISTOR_MSG[]     = "Left thermistor";
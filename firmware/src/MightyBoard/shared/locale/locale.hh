@@ -302,6 +302,23 @@ extern const unsigned char MACHINE_ID_REP2X_MSG[];
 extern const unsigned char COOLING_FAN_PWM_MSG[];
 #endif
 
+#if defined(HEATER_AUTOTUNE)
+extern const unsigned char AUTOTUNE_MSG[];
+extern const unsigned char AUTOTUNE_START_MSG[];
+extern const unsigned char AUTOTUNE_CYCLE_MSG[];
+extern const unsigned char AUTOTUNE_DONE_MSG[];
+extern const unsigned char AUTOTUNE_FAIL_MSG[];
+extern const unsigned char AUTOTUNE_GAINS_MSG[];
+#endif
+
+#if defined(SD_RESUME)
+extern const unsigned char RESUME_BUILD_MSG[];
+#endif
+
+#if defined(SD_PREFLIGHT)
+extern const unsigned char CARDFILE_MSG[];
+#endif
+
 #if BOARD_TYPE == BOARD_TYPE_AZTEEG_X3
 extern const unsigned char RIGHT_THERMISTOR_MSG[];
 extern const unsigned char LEFT_THERMISTOR_MSG[];
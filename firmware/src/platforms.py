@@ -75,9 +75,10 @@ platforms = {
         { 'mcu' : 'atmega2560',
           'programmer' : 'stk500v2',
           'board_directory' : 'mighty_one',
-          'defines' : [ 'BUILD_STATS', 'ALTERNATE_UART', 'AUTO_LEVEL',
+          'defines' : [ 'BUILD_STATS', 'ALTERNATE_UART', 'AUTO_LEVEL', 'AUTO_LEVEL_MESH',
                         'PSTOP_ZMIN_LEVEL', 'HAS_RGB_LED',
-                        'EEPROM_MENU_ENABLE' ]
+                        'EEPROM_MENU_ENABLE',
+                        'HEATER_AUTOTUNE', 'SD_INDEX', 'SD_RESUME', 'SD_LAYER_INDEX', 'SD_READ_AHEAD', 'SD_PLANNED', 'SD_PREFLIGHT' ]
         },
 
     'mighty_one-2560-corexy' :
@@ -85,9 +86,10 @@ platforms = {
           'programmer' : 'stk500v2',
           'board_directory' : 'mighty_one',
           'defines' : [ 'CORE_XY', 'BUILD_STATS', 'ALTERNATE_UART',
-                        'HEATERS_ON_STEROIDS', 'AUTO_LEVEL', 'HAS_RGB_LED',
+                        'HEATERS_ON_STEROIDS', 'AUTO_LEVEL', 'AUTO_LEVEL_MESH', 'HAS_RGB_LED',
                         'PSTOP_ZMIN_LEVEL', 'COOLING_FAN_PWM',
-                        'EEPROM_MENU_ENABLE' ]
+                        'EEPROM_MENU_ENABLE',
+                        'HEATER_AUTOTUNE', 'SD_INDEX', 'SD_RESUME', 'SD_LAYER_INDEX', 'SD_READ_AHEAD', 'SD_PLANNED', 'SD_PREFLIGHT' ]
         },
 
     'mighty_one-2560-max31855-corexy' :
@@ -95,9 +97,10 @@ platforms = {
           'programmer' : 'stk500v2',
           'board_directory' : 'mighty_one',
           'defines' : [ 'CORE_XY', 'BUILD_STATS', 'ALTERNATE_UART',
-                        'HAS_RGB_LED', 'HEATERS_ON_STEROIDS', 'AUTO_LEVEL',
+                        'HAS_RGB_LED', 'HEATERS_ON_STEROIDS', 'AUTO_LEVEL', 'AUTO_LEVEL_MESH',
                         'MAX31855', 'PSTOP_ZMIN_LEVEL', 'COOLING_FAN_PWM',
-                        'EEPROM_MENU_ENABLE' ]
+                        'EEPROM_MENU_ENABLE',
+                        'HEATER_AUTOTUNE', 'SD_INDEX', 'SD_RESUME', 'SD_LAYER_INDEX', 'SD_READ_AHEAD', 'SD_PLANNED', 'SD_PREFLIGHT' ]
         },
 
     'mighty_one-2560-max31855' :
@@ -105,8 +108,9 @@ platforms = {
           'programmer' : 'stk500v2',
           'board_directory' : 'mighty_one',
           'defines' : [ 'BUILD_STATS', 'ALTERNATE_UART', 'MAX31855',
-                        'AUTO_LEVEL', 'PSTOP_ZMIN_LEVEL', 'HAS_RGB_LED',
-                        'EEPROM_MENU_ENABLE' ]
+                        'AUTO_LEVEL', 'AUTO_LEVEL_MESH', 'PSTOP_ZMIN_LEVEL', 'HAS_RGB_LED',
+                        'EEPROM_MENU_ENABLE',
+                        'HEATER_AUTOTUNE', 'SD_INDEX', 'SD_RESUME', 'SD_LAYER_INDEX', 'SD_READ_AHEAD', 'SD_PLANNED', 'SD_PREFLIGHT' ]
         },
 
     'mighty_two' :
@@ -130,8 +134,9 @@ platforms = {
           'programmer' : 'stk500v2',
           'board_directory' : 'mighty_two',
           'defines' : [ 'SINGLE_EXTRUDER', 'BUILD_STATS', 'ALTERNATE_UART',
-                        'AUTO_LEVEL', 'PSTOP_ZMIN_LEVEL', 'HAS_RGB_LED',
-                        'EEPROM_MENU_ENABLE' ]
+                        'AUTO_LEVEL', 'AUTO_LEVEL_MESH', 'PSTOP_ZMIN_LEVEL', 'HAS_RGB_LED',
+                        'EEPROM_MENU_ENABLE',
+                        'HEATER_AUTOTUNE', 'SD_INDEX', 'SD_RESUME', 'SD_LAYER_INDEX', 'SD_READ_AHEAD', 'SD_PLANNED', 'SD_PREFLIGHT' ]
         },
 
     'mighty_twox' :
@@ -152,9 +157,10 @@ platforms = {
         { 'mcu' : 'atmega2560',
           'programmer' : 'stk500v2',
           'board_directory' : 'mighty_two',
-          'defines' : [ 'BUILD_STATS', 'ALTERNATE_UART', 'AUTO_LEVEL',
+          'defines' : [ 'BUILD_STATS', 'ALTERNATE_UART', 'AUTO_LEVEL', 'AUTO_LEVEL_MESH',
                         'PSTOP_ZMIN_LEVEL', 'HAS_RGB_LED',
-                        'EEPROM_MENU_ENABLE' ]
+                        'EEPROM_MENU_ENABLE',
+                        'HEATER_AUTOTUNE', 'SD_INDEX', 'SD_RESUME', 'SD_LAYER_INDEX', 'SD_READ_AHEAD', 'SD_PLANNED', 'SD_PREFLIGHT' ]
         },
 
     'ff_creator' :
@@ -174,9 +180,10 @@ platforms = {
           'programmer' : 'stk500v2',
           'board_directory' : 'mighty_one',
           'defines' : [ 'FF_CREATOR', 'BUILD_STATS', 'ALTERNATE_UART',
-                        'HEATERS_ON_STEROIDS', 'AUTO_LEVEL',
+                        'HEATERS_ON_STEROIDS', 'AUTO_LEVEL', 'AUTO_LEVEL_MESH',
                         'PSTOP_ZMIN_LEVEL', 'HAS_RGB_LED',
-                        'EEPROM_MENU_ENABLE' ]
+                        'EEPROM_MENU_ENABLE',
+                        'HEATER_AUTOTUNE', 'SD_INDEX', 'SD_RESUME', 'SD_LAYER_INDEX', 'SD_READ_AHEAD', 'SD_PLANNED', 'SD_PREFLIGHT' ]
         },
 
     'ff_creatorx-2560' :
@@ -184,9 +191,10 @@ platforms = {
           'programmer' : 'stk500v2',
           'board_directory' : 'mighty_one',
           'defines' : [ 'BUILD_STATS', 'ALTERNATE_UART', 'FF_CREATOR_X',
-                        'HEATERS_ON_STEROIDS', 'AUTO_LEVEL',
+                        'HEATERS_ON_STEROIDS', 'AUTO_LEVEL', 'AUTO_LEVEL_MESH',
                         'PSTOP_ZMIN_LEVEL', 'HAS_RGB_LED',
-                        'EEPROM_MENU_ENABLE' ]
+                        'EEPROM_MENU_ENABLE',
+                        'HEATER_AUTOTUNE', 'SD_INDEX', 'SD_RESUME', 'SD_LAYER_INDEX', 'SD_READ_AHEAD', 'SD_PLANNED', 'SD_PREFLIGHT' ]
         },
 
     'wanhao_dup4' :
@@ -219,8 +227,9 @@ platforms = {
           'board_directory' : 'mighty_one',
           'defines' : [ 'EEPROM_MENU_ENABLE', 'BUILD_STATS', 'SINGLE_EXTRUDER',
                         'ALTERNATE_UART', 'ZYYX_3D_PRINTER',
-                        'HEATERS_ON_STEROIDS', 'AUTO_LEVEL', 'AUTO_LEVEL_ZYYX',
-                        'PSTOP_ZMIN_LEVEL', 'ZYYX_LEVEL_SCRIPT' ]
+                        'HEATERS_ON_STEROIDS', 'AUTO_LEVEL', 'AUTO_LEVEL_MESH', 'AUTO_LEVEL_ZYYX',
+                        'PSTOP_ZMIN_LEVEL', 'ZYYX_LEVEL_SCRIPT',
+                        'HEATER_AUTOTUNE', 'SD_INDEX', 'SD_RESUME', 'SD_LAYER_INDEX', 'SD_READ_AHEAD', 'SD_PLANNED', 'SD_PREFLIGHT' ]
         },
 
     'zyyx-dual-2560' :
@@ -229,8 +238,9 @@ platforms = {
           'board_directory' : 'mighty_one',
           'defines' : [ 'EEPROM_MENU_ENABLE', 'BUILD_STATS',
                         'ALTERNATE_UART', 'ZYYX_3D_PRINTER',
-                        'HEATERS_ON_STEROIDS', 'AUTO_LEVEL', 'AUTO_LEVEL_ZYYX',
-                        'PSTOP_ZMIN_LEVEL', 'ZYYX_LEVEL_SCRIPT' ]
+                        'HEATERS_ON_STEROIDS', 'AUTO_LEVEL', 'AUTO_LEVEL_MESH', 'AUTO_LEVEL_ZYYX',
+                        'PSTOP_ZMIN_LEVEL', 'ZYYX_LEVEL_SCRIPT',
+                        'HEATER_AUTOTUNE', 'SD_INDEX', 'SD_RESUME', 'SD_LAYER_INDEX', 'SD_READ_AHEAD', 'SD_PLANNED', 'SD_PREFLIGHT' ]
         },
 
     'azteeg-x3' :
@@ -238,9 +248,10 @@ platforms = {
           'programmer' : 'stk500v2',
           'board_directory' : 'azteeg_x3',
           'defines' : [ 'BUILD_STATS', 'ALTERNATE_UART',
-                        'HEATERS_ON_STEROIDS', 'AUTO_LEVEL',
+                        'HEATERS_ON_STEROIDS', 'AUTO_LEVEL', 'AUTO_LEVEL_MESH',
                         'PSTOP_ZMIN_LEVEL',
-                        'EEPROM_MENU_ENABLE' ]
+                        'EEPROM_MENU_ENABLE',
+                        'HEATER_AUTOTUNE', 'SD_INDEX', 'SD_RESUME', 'SD_LAYER_INDEX', 'SD_READ_AHEAD', 'SD_PLANNED', 'SD_PREFLIGHT' ]
         },
 }
 